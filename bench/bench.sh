@@ -0,0 +1,129 @@
+#!/bin/sh
+#
+# dvdbackup benchmark suite: writes synthetic DVD-Video discs with
+# mkdvdvideo, as an image and as a VIDEO_TS tree, and times dvdbackup copying
+# and checking them with benchrun.
+# The results go to standard output as CSV, the output of dvdbackup to
+# BENCH_DIR/bench.log.
+#
+# Usage: bench.sh DVDBACKUP MKDVDVIDEO BENCHRUN
+#
+#   BENCH_SIZES     sizes of the images (default "100M 1G 4.7G 8.5G")
+#   BENCH_LAYOUT    mkdvdvideo options for the title sets, titles, chapters,
+#                   cells and VOB splits (default "-n 3 -t 2 -c 12 -l 2")
+#   BENCH_DIR       scratch directory, which needs about twice the largest
+#                   size (default bench.tmp)
+#   BENCH_INPUTS    which discs to read: "iso", "tree" or both (default
+#                   "iso tree")
+#   BENCH_SYSCALLS  "no" to leave out counting the system calls, which takes
+#                   an extra run under strace of every case
+#
+# A disc is read back right after it was written, so it is mostly served
+# from the page cache: the numbers are those of dvdbackup, not of a drive.
+# The faults of the gaps case are placed by disc sector, which a tree does
+# not have, so that case is only run on the image.
+
+if [ $# -ne 3 ]; then
+	echo "Usage: $0 DVDBACKUP MKDVDVIDEO BENCHRUN" >&2
+	exit 1
+fi
+
+dvdbackup=$1
+mkdvdvideo=$2
+benchrun=$3
+sizes=${BENCH_SIZES-"100M 1G 4.7G 8.5G"}
+layout=${BENCH_LAYOUT-"-n 3 -t 2 -c 12 -l 2"}
+dir=${BENCH_DIR-bench.tmp}
+inputs=${BENCH_INPUTS-"iso tree"}
+log=$dir/bench.log
+
+strace=
+if [ "$BENCH_SYSCALLS" != no ] && command -v strace >/dev/null 2>&1; then
+	strace=strace
+fi
+
+rm -rf "$dir" && mkdir -p "$dir" || exit 1
+: > "$log"
+
+
+fresh() {
+	rm -rf "$dir/out" && mkdir "$dir/out"
+}
+
+
+keep() {
+	:
+}
+
+
+# a mirror with a hole of hole_sectors in VTS_01_1.VOB for --gaps to fill
+hole_sectors=4096
+
+damaged() {
+	fresh
+	"$dvdbackup" -M -i "$disc" -o "$dir/out" -n BENCH --block-source=mock:"$dir/faults" >>"$log" 2>&1
+}
+
+
+# run CASE SETUP BYTES ARGUMENT...: runs dvdbackup with ARGUMENTS after SETUP,
+# counting BYTES or, if it is "tree", the bytes of the backup towards MB/s
+run() {
+	name=$1
+	setup=$2
+	if [ "$3" = tree ]; then
+		count="-b $dir/out/BENCH"
+	else
+		count="-B $3"
+	fi
+	shift 3
+
+	calls=
+	if [ -n "$strace" ]; then
+		$setup
+		$strace -f -c -o "$dir/strace.txt" "$dvdbackup" -i "$disc" -o "$dir/out" -n BENCH "$@" >>"$log" 2>&1
+		calls=$(awk '$NF == "total" { print $4 }' "$dir/strace.txt")
+	fi
+
+	$setup
+	echo "== $size $input $name" >>"$log"
+	"$benchrun" -l "$log" $count -c "$calls" "$size,$input,$name" \
+		"$dvdbackup" -i "$disc" -o "$dir/out" -n BENCH "$@"
+}
+
+
+echo "disc,input,case,bytes,seconds,mb_per_s,user_s,system_s,max_rss_kib,syscalls,exit"
+
+for size in $sizes; do
+	for input in $inputs; do
+		case $input in
+		iso)
+			disc=$dir/disc-$size.iso
+			made="-i $disc"
+			;;
+		tree)
+			disc=$dir/disc-$size
+			made="-o $disc"
+			;;
+		*)
+			echo "$0: unknown input $input" >&2
+			exit 1
+			;;
+		esac
+
+		if ! "$mkdvdvideo" $made -S "$size" $layout > "$dir/files"; then
+			echo "$0: cannot write the $size $input disc" >&2
+			exit 1
+		fi
+
+		run mirror fresh tree -M
+		run cmp keep tree -M --cmp
+		if [ $input = iso ]; then
+			awk '$1 == "VTS_01_1.VOB" { print "bad " ($2 + 1000) "-" ($2 + 999 + hole) }' hole=$hole_sectors "$dir/files" > "$dir/faults"
+			run gaps damaged $((hole_sectors * 2048)) -M --gaps
+		fi
+		run feature fresh tree -F
+		run title fresh tree -t 1 -s 2 -e 5
+
+		rm -rf "$disc" "$dir/out"
+	done
+done
@@ -0,0 +1,160 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchrun runs one benchmark command and prints a CSV row with its wall
+ * clock time, throughput, CPU time and peak resident set size as reported by
+ * wait4(). The command's own output goes to a log file so that it does not
+ * mix with the rows.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+static const char* program_name;
+static uint64_t tree_bytes;
+
+
+static int add_file_size(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+	(void)path;
+	(void)ftw;
+
+	if (type == FTW_F && S_ISREG(st->st_mode)) {
+		tree_bytes += (uint64_t)st->st_size;
+	}
+	return 0;
+}
+
+
+static double seconds_of(const struct timeval* tv) {
+	return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+
+static void print_help(void) {
+	printf("Usage: %s [OPTION]... LABEL COMMAND [ARGUMENT]...\n\n", program_name);
+	printf("\
+Runs COMMAND and prints the CSV row\n\
+LABEL,bytes,seconds,MB/s,user seconds,system seconds,peak RSS KiB,syscalls,exit status\n\
+where LABEL may itself hold several columns.\n\n\
+  -b PATH    count the bytes of the files at or below PATH once COMMAND is done\n\
+  -B BYTES   count BYTES bytes\n\
+  -c CALLS   fill in the syscalls column, counted in a separate run\n\
+  -l FILE    append the output of COMMAND to FILE (default /dev/null)\n");
+}
+
+
+int main(int argc, char* argv[]) {
+	const char* bytes_path = NULL;
+	const char* log_path = "/dev/null";
+	const char* syscalls = "";
+	struct timespec start, end;
+	struct rusage usage;
+	double seconds;
+	pid_t pid;
+	int status;
+	int option;
+
+	program_name = argv[0];
+
+	while ((option = getopt(argc, argv, "+b:B:c:l:h")) != -1) {
+		switch (option) {
+		case 'b':
+			bytes_path = optarg;
+			break;
+		case 'B':
+			tree_bytes = strtoull(optarg, NULL, 10);
+			break;
+		case 'c':
+			syscalls = optarg;
+			break;
+		case 'l':
+			log_path = optarg;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			fprintf(stderr, "Try '%s -h' for more information.\n", program_name);
+			return 1;
+		}
+	}
+	if (argc - optind < 2) {
+		fprintf(stderr, "%s: give a label and a command\n", program_name);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if (pid == -1) {
+		fprintf(stderr, "%s: cannot fork: %s\n", program_name, strerror(errno));
+		return 1;
+	}
+	if (pid == 0) {
+		int fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+
+		if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1 || dup2(fd, STDERR_FILENO) == -1) {
+			fprintf(stderr, "%s: cannot open %s: %s\n", program_name, log_path, strerror(errno));
+			_exit(127);
+		}
+		close(fd);
+		execvp(argv[optind + 1], &argv[optind + 1]);
+		fprintf(stderr, "%s: cannot run %s: %s\n", program_name, argv[optind + 1], strerror(errno));
+		_exit(127);
+	}
+
+	while (wait4(pid, &status, 0, &usage) == -1) {
+		if (errno != EINTR) {
+			fprintf(stderr, "%s: cannot wait for %s: %s\n", program_name, argv[optind + 1], strerror(errno));
+			return 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (bytes_path != NULL) {
+		tree_bytes = 0;
+		nftw(bytes_path, add_file_size, 16, FTW_PHYS);
+	}
+
+	printf("%s,%llu,%.3f,%.1f,%.3f,%.3f,%ld,%s,%d\n", argv[optind],
+			(unsigned long long)tree_bytes, seconds, seconds > 0 ? (double)tree_bytes / 1e6 / seconds : 0,
+			seconds_of(&usage.ru_utime), seconds_of(&usage.ru_stime), usage.ru_maxrss, syscalls,
+			WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * blankbench times the blank block kernels of blank.c on one chunk of
+ * BUFFER_SIZE blocks as dvdbackup reads it: the byte loop that buffer_is_blank()
+ * runs, the 64 bit word kernel and the SSE2 and AVX2 kernels where the CPU has
+ * them. It prints one CSV row per kernel and chunk.
+ */
+
+#include <config.h>
+#include "blank.h"
+
+/* C standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* C POSIX library */
+#include <unistd.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+
+
+/* Blocks per chunk, as BUFFER_SIZE in dvdbackup.c */
+#define CHUNK_BLOCKS 512
+
+typedef struct {
+	const char* name;
+	blank_kernel_t kernel; /* BLANK_KERNEL_AUTO for buffer_is_blank() */
+} kernel_t;
+
+static const kernel_t kernels[] = {
+	{ "bytes", BLANK_KERNEL_AUTO },
+	{ "words", BLANK_KERNEL_WORDS },
+	{ "sse2", BLANK_KERNEL_SSE2 },
+	{ "avx2", BLANK_KERNEL_AVX2 }
+};
+
+static const char* program_name;
+
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+
+/* Number of blank blocks of the chunk at data, the way kernel finds them */
+static size_t count_blank(const kernel_t* kernel, const unsigned char* data, unsigned char blank[]) {
+	size_t blanks = 0;
+	size_t i;
+
+	if (kernel->kernel != BLANK_KERNEL_AUTO) {
+		return blocks_blank(data, CHUNK_BLOCKS, blank);
+	}
+	for (i = 0; i < CHUNK_BLOCKS; ++i) {
+		blanks += (size_t)buffer_is_blank(data + i * DVD_VIDEO_LB_LEN, DVD_VIDEO_LB_LEN);
+	}
+	return blanks;
+}
+
+
+static void print_help(void) {
+	printf("Usage: %s [OPTION]...\n\n", program_name);
+	printf("\
+Times the blank block kernels and prints the CSV rows\n\
+kernel,chunk,blocks,seconds,gb_per_s\n\
+for a chunk of %d blocks that is all zero (blank), that has data in the\n\
+first byte of each block (data) or only in the last byte (tail).\n\n\
+  -n CHUNKS  chunks to check per kernel and chunk type (default 2000)\n", CHUNK_BLOCKS);
+}
+
+
+int main(int argc, char* argv[]) {
+	static const char* chunks[] = { "blank", "data", "tail" };
+	unsigned char* data;
+	unsigned char blank[CHUNK_BLOCKS];
+	long repeat = 2000;
+	size_t expected;
+	size_t k, c, i;
+	int option;
+
+	program_name = argv[0];
+
+	while ((option = getopt(argc, argv, "n:h")) != -1) {
+		switch (option) {
+		case 'n':
+			repeat = strtol(optarg, NULL, 10);
+			if (repeat < 1) {
+				fprintf(stderr, "%s: invalid number of chunks '%s'\n", program_name, optarg);
+				return 1;
+			}
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			fprintf(stderr, "Try '%s -h' for more information.\n", program_name);
+			return 1;
+		}
+	}
+
+	data = malloc(CHUNK_BLOCKS * DVD_VIDEO_LB_LEN);
+	if (data == NULL) {
+		fprintf(stderr, "%s: out of memory\n", program_name);
+		return 1;
+	}
+
+	printf("kernel,chunk,blocks,seconds,gb_per_s\n");
+
+	for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+		memset(data, 0, CHUNK_BLOCKS * DVD_VIDEO_LB_LEN);
+		for (i = 0; c > 0 && i < CHUNK_BLOCKS; ++i) {
+			data[i * DVD_VIDEO_LB_LEN + (c == 1 ? 0 : DVD_VIDEO_LB_LEN - 1)] = 0xff;
+		}
+		expected = c == 0 ? CHUNK_BLOCKS : 0;
+
+		for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+			const kernel_t* kernel = &kernels[k];
+			double start, seconds;
+			long r;
+
+			if (blank_use_kernel(kernel->kernel) != 0) {
+				fprintf(stderr, "%s: no %s kernel on this CPU\n", program_name, kernel->name);
+				continue;
+			}
+
+			start = now();
+			for (r = 0; r < repeat; ++r) {
+				if (count_blank(kernel, data, blank) != expected) {
+					fprintf(stderr, "%s: the %s kernel got the %s chunk wrong\n", program_name,
+							kernel->name, chunks[c]);
+					free(data);
+					return 1;
+				}
+			}
+			seconds = now() - start;
+
+			printf("%s,%s,%ld,%.3f,%.2f\n", kernel->name, chunks[c], repeat * CHUNK_BLOCKS, seconds,
+					seconds > 0 ? (double)repeat * CHUNK_BLOCKS * DVD_VIDEO_LB_LEN / 1e9 / seconds : 0);
+		}
+	}
+
+	blank_use_kernel(BLANK_KERNEL_AUTO);
+	free(data);
+	return 0;
+}
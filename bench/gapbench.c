@@ -0,0 +1,195 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * gapbench times the gap plans of gapplan.c with as many ranges as a badly
+ * scratched disc leaves: building a plan in ascending and in random order,
+ * punching holes into it as a gap fill does, and the lookups that pick the
+ * verification samples, next to the linear scan the lookups used to be. It
+ * prints one CSV row per operation.
+ */
+
+#include <config.h>
+#include "gapplan.h"
+
+/* C standard libraries */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* C POSIX library */
+#include <unistd.h>
+
+
+/* Every range is RANGE_BLOCKS blocks long and starts RANGE_STRIDE blocks after the one before */
+#define RANGE_BLOCKS 3
+#define RANGE_STRIDE 5
+
+static const char* program_name;
+static uint64_t random_state = 88172645463325252ull;
+
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+
+/* xorshift64, so that every C library benchmarks the same plans */
+static size_t random_below(size_t limit) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (size_t)(random_state % limit);
+}
+
+
+/* gap_plan_contains() as it was before the binary search */
+static int linear_contains(const gap_plan_t* plan, size_t block) {
+	size_t i;
+
+	for (i = 0; i < plan->count; ++i) {
+		const gap_range_t* range = &plan->ranges[i];
+
+		if (block < range->start_block) {
+			return 0;
+		}
+		if (block < range->start_block + range->block_count) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static void print_row(const char* operation, size_t ranges, size_t operations, double seconds) {
+	printf("%s,%zu,%zu,%.3f,%.1f\n", operation, ranges, operations, seconds,
+			operations > 0 ? seconds * 1e9 / (double)operations : 0);
+}
+
+
+static void print_help(void) {
+	printf("Usage: %s [OPTION]...\n\n", program_name);
+	printf("\
+Times gap plan operations and prints the CSV rows\n\
+operation,ranges,operations,seconds,ns_per_op\n\
+where ranges is the size of the plan the operations ran on.\n\n\
+  -r RANGES  ranges in the plan (default 100000)\n\
+  -l LOOKUPS lookups of the linear scan (default 2000)\n");
+}
+
+
+int main(int argc, char* argv[]) {
+	gap_plan_t ordered = { NULL, 0, 0 };
+	gap_plan_t shuffled = { NULL, 0, 0 };
+	size_t ranges = 100000;
+	size_t lookups = 2000;
+	size_t blocks, i;
+	volatile size_t sink = 0;
+	unsigned long value;
+	double start;
+	int option;
+
+	program_name = argv[0];
+
+	while ((option = getopt(argc, argv, "r:l:h")) != -1) {
+		switch (option) {
+		case 'r':
+		case 'l':
+			value = strtoul(optarg, NULL, 10);
+			if (value == 0) {
+				fprintf(stderr, "%s: invalid number '%s'\n", program_name, optarg);
+				return 1;
+			}
+			if (option == 'r') {
+				ranges = (size_t)value;
+			} else {
+				lookups = (size_t)value;
+			}
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			fprintf(stderr, "Try '%s -h' for more information.\n", program_name);
+			return 1;
+		}
+	}
+	blocks = ranges * RANGE_STRIDE;
+
+	printf("operation,ranges,operations,seconds,ns_per_op\n");
+
+	start = now();
+	for (i = 0; i < ranges; ++i) {
+		if (gap_plan_add(&ordered, i * RANGE_STRIDE + 1, RANGE_BLOCKS) != 0) {
+			goto out_of_memory;
+		}
+	}
+	print_row("add_ascending", ordered.count, ranges, now() - start);
+
+	start = now();
+	for (i = 0; i < ranges; ++i) {
+		if (gap_plan_add(&shuffled, random_below(ranges) * RANGE_STRIDE + 1, RANGE_BLOCKS) != 0) {
+			goto out_of_memory;
+		}
+	}
+	print_row("add_random", shuffled.count, ranges, now() - start);
+
+	/* split every other range in two, as refilled blocks in the middle do */
+	start = now();
+	for (i = 0; i < ranges; i += 2) {
+		if (gap_plan_subtract(&shuffled, i * RANGE_STRIDE + 2, 1) != 0) {
+			goto out_of_memory;
+		}
+	}
+	print_row("subtract_split", shuffled.count, (ranges + 1) / 2, now() - start);
+
+	start = now();
+	for (i = 0; i < blocks; ++i) {
+		sink += (size_t)gap_plan_contains(&ordered, i);
+	}
+	print_row("contains", ordered.count, blocks, now() - start);
+
+	start = now();
+	for (i = 0; i < lookups; ++i) {
+		sink += (size_t)linear_contains(&ordered, random_below(blocks));
+	}
+	print_row("contains_linear", ordered.count, lookups, now() - start);
+
+	start = now();
+	for (i = 0; i < blocks; ++i) {
+		sink += gap_plan_next_good(&ordered, i) + gap_plan_prev_good(&ordered, i);
+	}
+	print_row("next_prev_good", ordered.count, 2 * blocks, now() - start);
+
+	gap_plan_free(&ordered);
+	gap_plan_free(&shuffled);
+	return 0;
+
+out_of_memory:
+	fprintf(stderr, "%s: out of memory\n", program_name);
+	gap_plan_free(&ordered);
+	gap_plan_free(&shuffled);
+	return 1;
+}
@@ -0,0 +1,1126 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * mkdvdvideo writes a synthetic DVD-Video disc for the benchmarks: a
+ * VIDEO_TS tree, a UDF/ISO 9660 image of it, or both. The IFO files carry
+ * every table libdvdread requires (title search pointers, attributes,
+ * program chains, cell and VOBU address maps), so dvdbackup walks the disc
+ * the way it walks a pressed one. The VOBs are MPEG-2 program streams made of
+ * a navigation pack at the start of every VOBU followed by packs of padding
+ * filled with pseudo-random bytes, which keeps them from compressing or
+ * looking blank.
+ */
+
+#include <config.h>
+#include "image.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define SECTOR_SIZE 2048
+
+/* Capacity of a single sided dual layer DVD */
+#define DUAL_LAYER_SECTORS 4171712
+
+/* Split size of the title VOBs written by the usual authoring tools */
+#define DEFAULT_SPLIT_SECTORS 524272
+
+/* A VOBU covers about half a second at the bit rate below */
+#define VOBU_SECTORS 256
+#define BIT_RATE 8000000
+
+/* Sectors generated and written at a time */
+#define CHUNK_SECTORS 256
+
+/* Sizes fixed by the DVD-Video format */
+#define MAT_FP_PGC_OFFSET 0x400
+#define PGC_SIZE 236
+#define CELL_PLAYBACK_SIZE 24
+#define CELL_POSITION_SIZE 4
+#define SRP_SIZE 8
+#define TITLE_INFO_SIZE 12
+#define VTS_ATTRIBUTES_SIZE 542
+#define CELL_ADR_SIZE 12
+#define COMMAND_SIZE 8
+
+/* pgci_srp entry IDs */
+#define ENTRY_TITLE 0x80
+#define ENTRY_TITLE_MENU 0x82
+#define ENTRY_ROOT_MENU 0x83
+
+
+/* The cells of a menu or title VOBS, in the order they are stored */
+typedef struct {
+	int cells;
+	uint32_t* first;   /* relative to the start of the VOBS */
+	uint32_t* sectors;
+	uint16_t* vob_id;
+	uint8_t* cell_id;
+	uint32_t total;
+	uint64_t key;      /* seeds the padding bytes */
+} vobs_t;
+
+typedef struct {
+	unsigned char* data;
+	size_t length;
+} buffer_t;
+
+typedef struct {
+	vobs_t menu;
+	vobs_t title;
+	buffer_t ifo;
+	uint32_t lba;      /* of VTS_XX_0.IFO */
+} title_set_t;
+
+typedef struct {
+	char name[13];
+	uint32_t lba;
+	uint32_t sectors;
+	const buffer_t* ifo; /* contents of an IFO or BUP, NULL for a VOB */
+	const vobs_t* vobs;
+	uint32_t first;      /* first sector of a VOB inside vobs */
+} disc_file_t;
+
+/* A program chain over cells first_cell to first_cell + cells - 1 of vobs */
+typedef struct {
+	const vobs_t* vobs;
+	int first_cell;
+	int cells;
+	int programs;
+	const unsigned char* commands;
+	int pre_commands;
+	uint8_t entry_id;
+} pgc_spec_t;
+
+
+static const char* program_name;
+
+static int title_sets = 1;
+static int titles_per_set = 1;
+static int chapters = 8;
+static int cells_per_chapter = 1;
+static uint32_t menu_sectors = 512;
+static uint32_t split_sectors = DEFAULT_SPLIT_SECTORS;
+static uint64_t seed = 0;
+
+static vobs_t vmg_menu;
+static buffer_t vmg_ifo;
+static title_set_t* sets;
+static disc_file_t* files;
+static size_t file_count;
+
+
+static void* xrealloc(void* pointer, size_t size) {
+	pointer = realloc(pointer, size);
+	if (pointer == NULL) {
+		fprintf(stderr, "%s: out of memory\n", program_name);
+		exit(1);
+	}
+	return pointer;
+}
+
+
+static void put16(unsigned char* p, uint16_t value) {
+	p[0] = (unsigned char)(value >> 8);
+	p[1] = (unsigned char)value;
+}
+
+
+static void put32(unsigned char* p, uint32_t value) {
+	p[0] = (unsigned char)(value >> 24);
+	p[1] = (unsigned char)(value >> 16);
+	p[2] = (unsigned char)(value >> 8);
+	p[3] = (unsigned char)value;
+}
+
+
+static unsigned char bcd(unsigned int value) {
+	return (unsigned char)((value / 10 % 10) << 4 | value % 10);
+}
+
+
+/* dvd_time_t of 30 frames per second */
+static void put_time(unsigned char* p, uint64_t milliseconds) {
+	uint64_t seconds = milliseconds / 1000;
+
+	p[0] = bcd((unsigned int)(seconds / 3600 % 100));
+	p[1] = bcd((unsigned int)(seconds / 60 % 60));
+	p[2] = bcd((unsigned int)(seconds % 60));
+	p[3] = 0xc0 | bcd((unsigned int)(milliseconds % 1000 * 30 / 1000));
+}
+
+
+static uint64_t sectors_milliseconds(uint32_t sectors) {
+	return (uint64_t)sectors * SECTOR_SIZE * 8 * 1000 / BIT_RATE;
+}
+
+
+/* 90 kHz presentation time of sector */
+static uint32_t sector_ptm(uint32_t sector) {
+	return (uint32_t)((uint64_t)sector * SECTOR_SIZE * 8 * 90000 / BIT_RATE);
+}
+
+
+/* MPEG-2 video, NTSC, 16:9, 720x480 */
+static void put_video_attr(unsigned char* p) {
+	p[0] = 0x4c;
+	p[1] = 0x00;
+}
+
+
+/* AC-3, 48 kHz, 6 channels, English */
+static void put_audio_attr(unsigned char* p) {
+	p[0] = 0x04;
+	p[1] = 0x05;
+	p[2] = 'e';
+	p[3] = 'n';
+	p[5] = 0x01;
+}
+
+
+/* English subtitles */
+static void put_subp_attr(unsigned char* p) {
+	p[0] = 0x01;
+	p[2] = 'e';
+	p[3] = 'n';
+	p[5] = 0x01;
+}
+
+
+/* Starts a table of length bytes in the next sector of ifo and returns its offset. */
+static size_t ifo_table(buffer_t* ifo, size_t length) {
+	size_t offset = (ifo->length + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+
+	ifo->data = xrealloc(ifo->data, offset + length);
+	memset(ifo->data + ifo->length, 0, offset + length - ifo->length);
+	ifo->length = offset + length;
+	return offset;
+}
+
+
+static uint32_t ifo_sectors(const buffer_t* ifo) {
+	return (uint32_t)((ifo->length + SECTOR_SIZE - 1) / SECTOR_SIZE);
+}
+
+
+/* Pads ifo to whole sectors once all its tables are written. */
+static void ifo_finish(buffer_t* ifo) {
+	size_t length = (size_t)ifo_sectors(ifo) * SECTOR_SIZE;
+
+	ifo->data = xrealloc(ifo->data, length);
+	memset(ifo->data + ifo->length, 0, length - ifo->length);
+	ifo->length = length;
+}
+
+
+static void vobs_free(vobs_t* vobs) {
+	free(vobs->first);
+	free(vobs->sectors);
+	free(vobs->vob_id);
+	free(vobs->cell_id);
+	memset(vobs, 0, sizeof(*vobs));
+}
+
+
+/**
+ * Splits total sectors into vobs of vob_ids VOBs with cells_per_vob cells
+ * each, as evenly as possible. Returns -1 if a cell would be shorter than two
+ * sectors, the least a cell address table entry can describe.
+ */
+static int vobs_plan(vobs_t* vobs, uint32_t total, int vob_ids, int cells_per_vob, uint64_t key) {
+	int cells = vob_ids * cells_per_vob;
+	uint32_t first = 0;
+	int i;
+
+	vobs_free(vobs);
+	vobs->key = key;
+	if (total == 0) {
+		return 0;
+	}
+	if (total / (uint32_t)cells < 2) {
+		return -1;
+	}
+
+	vobs->cells = cells;
+	vobs->first = xrealloc(NULL, (size_t)cells * sizeof(uint32_t));
+	vobs->sectors = xrealloc(NULL, (size_t)cells * sizeof(uint32_t));
+	vobs->vob_id = xrealloc(NULL, (size_t)cells * sizeof(uint16_t));
+	vobs->cell_id = xrealloc(NULL, (size_t)cells * sizeof(uint8_t));
+	for (i = 0; i < cells; i++) {
+		vobs->first[i] = first;
+		vobs->sectors[i] = total / (uint32_t)cells + (i == cells - 1 ? total % (uint32_t)cells : 0);
+		vobs->vob_id[i] = (uint16_t)(i / cells_per_vob + 1);
+		vobs->cell_id[i] = (uint8_t)(i % cells_per_vob + 1);
+		first += vobs->sectors[i];
+	}
+	vobs->total = total;
+
+	return 0;
+}
+
+
+static uint32_t cell_vobus(const vobs_t* vobs, int cell) {
+	return (vobs->sectors[cell] + VOBU_SECTORS - 1) / VOBU_SECTORS;
+}
+
+
+static size_t pgc_length(const pgc_spec_t* pgc) {
+	size_t length = PGC_SIZE + (size_t)(pgc->programs + 1) / 2 * 2
+			+ (size_t)pgc->cells * (CELL_PLAYBACK_SIZE + CELL_POSITION_SIZE);
+
+	if (pgc->pre_commands > 0) {
+		length += 8 + (size_t)pgc->pre_commands * COMMAND_SIZE;
+	}
+	return length;
+}
+
+
+static void put_pgc(unsigned char* p, const pgc_spec_t* pgc) {
+	size_t offset = PGC_SIZE;
+	uint64_t milliseconds = 0;
+	int i;
+
+	p[2] = (unsigned char)pgc->programs;
+	p[3] = (unsigned char)pgc->cells;
+	if (pgc->cells > 0) {
+		/* audio stream 0 and subpicture stream 0 in every display mode */
+		put16(p + 12, 0x8000);
+		put32(p + 28, 0x80000000);
+	}
+
+	if (pgc->pre_commands > 0) {
+		size_t length = 8 + (size_t)pgc->pre_commands * COMMAND_SIZE;
+
+		put16(p + 228, (uint16_t)offset);
+		put16(p + offset, (uint16_t)pgc->pre_commands);
+		put16(p + offset + 6, (uint16_t)(length - 1));
+		memcpy(p + offset + 8, pgc->commands, (size_t)pgc->pre_commands * COMMAND_SIZE);
+		offset += length;
+	}
+	if (pgc->cells == 0) {
+		return;
+	}
+
+	put16(p + 230, (uint16_t)offset);
+	for (i = 0; i < pgc->programs; i++) {
+		p[offset + (size_t)i] = (unsigned char)(1 + i * (pgc->cells / pgc->programs));
+	}
+	offset += (size_t)(pgc->programs + 1) / 2 * 2;
+
+	put16(p + 232, (uint16_t)offset);
+	for (i = 0; i < pgc->cells; i++) {
+		const vobs_t* vobs = pgc->vobs;
+		int cell = pgc->first_cell + i;
+		unsigned char* playback = p + offset + (size_t)i * CELL_PLAYBACK_SIZE;
+		uint32_t last = vobs->first[cell] + vobs->sectors[cell] - 1;
+
+		put_time(playback + 4, sectors_milliseconds(vobs->sectors[cell]));
+		put32(playback + 8, vobs->first[cell]);
+		put32(playback + 16, vobs->first[cell] + (cell_vobus(vobs, cell) - 1) * VOBU_SECTORS);
+		put32(playback + 20, last);
+		milliseconds += sectors_milliseconds(vobs->sectors[cell]);
+	}
+	offset += (size_t)pgc->cells * CELL_PLAYBACK_SIZE;
+	put_time(p + 4, milliseconds);
+
+	put16(p + 234, (uint16_t)offset);
+	for (i = 0; i < pgc->cells; i++) {
+		unsigned char* position = p + offset + (size_t)i * CELL_POSITION_SIZE;
+
+		put16(position, pgc->vobs->vob_id[pgc->first_cell + i]);
+		position[3] = pgc->vobs->cell_id[pgc->first_cell + i];
+	}
+}
+
+
+static size_t pgcit_length(const pgc_spec_t pgcs[], int count) {
+	size_t length = 8 + (size_t)count * SRP_SIZE;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		length += pgc_length(&pgcs[i]);
+	}
+	return length;
+}
+
+
+static void put_pgcit(unsigned char* p, const pgc_spec_t pgcs[], int count) {
+	size_t offset = 8 + (size_t)count * SRP_SIZE;
+	int i;
+
+	put16(p, (uint16_t)count);
+	put32(p + 4, (uint32_t)pgcit_length(pgcs, count) - 1);
+	for (i = 0; i < count; i++) {
+		unsigned char* srp = p + 8 + (size_t)i * SRP_SIZE;
+
+		srp[0] = pgcs[i].entry_id;
+		put32(srp + 4, (uint32_t)offset);
+		put_pgc(p + offset, &pgcs[i]);
+		offset += pgc_length(&pgcs[i]);
+	}
+}
+
+
+/* Menu PGCI unit table of a single English language unit with one menu. */
+static uint32_t write_pgci_ut(buffer_t* ifo, const vobs_t* menu, uint8_t entry_id) {
+	pgc_spec_t pgc = { menu, 0, 1, 1, NULL, 0, entry_id };
+	size_t length = 16 + pgcit_length(&pgc, 1);
+	size_t offset = ifo_table(ifo, length);
+	unsigned char* p = ifo->data + offset;
+
+	put16(p, 1);
+	put32(p + 4, (uint32_t)length - 1);
+	p[8] = 'e';
+	p[9] = 'n';
+	p[11] = 0x80;
+	put32(p + 12, 16);
+	put_pgcit(p + 16, &pgc, 1);
+
+	return (uint32_t)(offset / SECTOR_SIZE);
+}
+
+
+static uint32_t write_c_adt(buffer_t* ifo, const vobs_t* vobs) {
+	size_t length = 8 + (size_t)vobs->cells * CELL_ADR_SIZE;
+	size_t offset = ifo_table(ifo, length);
+	unsigned char* p = ifo->data + offset;
+	int i;
+
+	put16(p, vobs->vob_id[vobs->cells - 1]);
+	put32(p + 4, (uint32_t)length - 1);
+	for (i = 0; i < vobs->cells; i++) {
+		unsigned char* entry = p + 8 + (size_t)i * CELL_ADR_SIZE;
+
+		put16(entry, vobs->vob_id[i]);
+		entry[2] = vobs->cell_id[i];
+		put32(entry + 4, vobs->first[i]);
+		put32(entry + 8, vobs->first[i] + vobs->sectors[i] - 1);
+	}
+
+	return (uint32_t)(offset / SECTOR_SIZE);
+}
+
+
+static uint32_t write_vobu_admap(buffer_t* ifo, const vobs_t* vobs) {
+	size_t vobus = 0;
+	size_t offset;
+	unsigned char* p;
+	int i;
+
+	for (i = 0; i < vobs->cells; i++) {
+		vobus += cell_vobus(vobs, i);
+	}
+	offset = ifo_table(ifo, 4 + vobus * 4);
+	p = ifo->data + offset;
+	put32(p, (uint32_t)(vobus * 4 + 3));
+	p += 4;
+	for (i = 0; i < vobs->cells; i++) {
+		uint32_t vobu;
+
+		for (vobu = 0; vobu < cell_vobus(vobs, i); vobu++) {
+			put32(p, vobs->first[i] + vobu * VOBU_SECTORS);
+			p += 4;
+		}
+	}
+
+	return (uint32_t)(offset / SECTOR_SIZE);
+}
+
+
+static void build_title_set(title_set_t* set) {
+	buffer_t* ifo = &set->ifo;
+	pgc_spec_t* pgcs = xrealloc(NULL, (size_t)titles_per_set * sizeof(pgc_spec_t));
+	uint32_t vobs_sectors;
+	unsigned char* mat;
+	size_t offset;
+	int i, j;
+
+	free(ifo->data);
+	ifo->data = NULL;
+	ifo->length = 0;
+	ifo_table(ifo, 984);
+
+	/* part of title search pointers: chapter j of title i is program j of PGC i */
+	offset = ifo_table(ifo, 8 + (size_t)titles_per_set * (4 + (size_t)chapters * 4));
+	put16(ifo->data + offset, (uint16_t)titles_per_set);
+	put32(ifo->data + offset + 4, (uint32_t)(8 + (size_t)titles_per_set * (4 + (size_t)chapters * 4) - 1));
+	for (i = 0; i < titles_per_set; i++) {
+		size_t ptts = 8 + (size_t)titles_per_set * 4 + (size_t)i * chapters * 4;
+
+		put32(ifo->data + offset + 8 + (size_t)i * 4, (uint32_t)ptts);
+		for (j = 0; j < chapters; j++) {
+			put16(ifo->data + offset + ptts + (size_t)j * 4, (uint16_t)(i + 1));
+			put16(ifo->data + offset + ptts + (size_t)j * 4 + 2, (uint16_t)(j + 1));
+		}
+	}
+	put32(ifo->data + 200, (uint32_t)(offset / SECTOR_SIZE));
+
+	for (i = 0; i < titles_per_set; i++) {
+		pgc_spec_t pgc = { &set->title, i * chapters * cells_per_chapter,
+				chapters * cells_per_chapter, chapters, NULL, 0, (uint8_t)(ENTRY_TITLE | (i + 1)) };
+
+		pgcs[i] = pgc;
+	}
+	offset = ifo_table(ifo, pgcit_length(pgcs, titles_per_set));
+	put_pgcit(ifo->data + offset, pgcs, titles_per_set);
+	put32(ifo->data + 204, (uint32_t)(offset / SECTOR_SIZE));
+	free(pgcs);
+
+	if (set->menu.total > 0) {
+		put32(ifo->data + 208, write_pgci_ut(ifo, &set->menu, ENTRY_ROOT_MENU));
+		put32(ifo->data + 216, write_c_adt(ifo, &set->menu));
+		put32(ifo->data + 220, write_vobu_admap(ifo, &set->menu));
+	}
+	put32(ifo->data + 224, write_c_adt(ifo, &set->title));
+	put32(ifo->data + 228, write_vobu_admap(ifo, &set->title));
+	ifo_finish(ifo);
+
+	mat = ifo->data;
+	memcpy(mat, "DVDVIDEO-VTS", 12);
+	vobs_sectors = set->menu.total + set->title.total;
+	put32(mat + 12, 2 * ifo_sectors(ifo) + vobs_sectors - 1);
+	put32(mat + 28, ifo_sectors(ifo) - 1);
+	mat[33] = 0x10;
+	put32(mat + 128, 983);
+	if (set->menu.total > 0) {
+		put32(mat + 192, ifo_sectors(ifo));
+		put_video_attr(mat + 256);
+		mat[259] = 1;
+		put_audio_attr(mat + 260);
+		mat[341] = 1;
+		put_subp_attr(mat + 342);
+	}
+	put32(mat + 196, ifo_sectors(ifo) + set->menu.total);
+	put_video_attr(mat + 512);
+	mat[515] = 1;
+	put_audio_attr(mat + 516);
+	mat[597] = 1;
+	put_subp_attr(mat + 598);
+}
+
+
+static void build_vmg(void) {
+	/* JumpTT 1 */
+	static const unsigned char first_play[COMMAND_SIZE] = { 0x30, 0x02, 0, 0, 0, 0x01, 0, 0 };
+	pgc_spec_t fp_pgc = { NULL, 0, 0, 0, first_play, 1, 0 };
+	buffer_t* ifo = &vmg_ifo;
+	int titles = title_sets * titles_per_set;
+	unsigned char* mat;
+	unsigned char* p;
+	size_t offset, length;
+	int i;
+
+	free(ifo->data);
+	ifo->data = NULL;
+	ifo->length = 0;
+	ifo_table(ifo, MAT_FP_PGC_OFFSET + pgc_length(&fp_pgc));
+	put_pgc(ifo->data + MAT_FP_PGC_OFFSET, &fp_pgc);
+
+	length = 8 + (size_t)titles * TITLE_INFO_SIZE;
+	offset = ifo_table(ifo, length);
+	p = ifo->data + offset;
+	put16(p, (uint16_t)titles);
+	put32(p + 4, (uint32_t)length - 1);
+	for (i = 0; i < titles; i++) {
+		unsigned char* title = p + 8 + (size_t)i * TITLE_INFO_SIZE;
+
+		title[1] = 1;
+		put16(title + 2, (uint16_t)chapters);
+		title[6] = (unsigned char)(i / titles_per_set + 1);
+		title[7] = (unsigned char)(i % titles_per_set + 1);
+		put32(title + 8, sets[i / titles_per_set].lba);
+	}
+	put32(ifo->data + 196, (uint32_t)(offset / SECTOR_SIZE));
+
+	if (vmg_menu.total > 0) {
+		put32(ifo->data + 200, write_pgci_ut(ifo, &vmg_menu, ENTRY_TITLE_MENU));
+	}
+
+	length = 8 + (size_t)title_sets * (4 + VTS_ATTRIBUTES_SIZE);
+	offset = ifo_table(ifo, length);
+	p = ifo->data + offset;
+	put16(p, (uint16_t)title_sets);
+	put32(p + 4, (uint32_t)length - 1);
+	for (i = 0; i < title_sets; i++) {
+		size_t entry = 8 + (size_t)title_sets * 4 + (size_t)i * VTS_ATTRIBUTES_SIZE;
+		unsigned char* attributes = p + entry;
+
+		put32(p + 8 + (size_t)i * 4, (uint32_t)entry);
+		put32(attributes, VTS_ATTRIBUTES_SIZE - 1);
+		/* the attributes are a copy of those in VTS_XX_0.IFO */
+		memcpy(attributes + 8, sets[i].ifo.data + 256, 254);
+		memcpy(attributes + 264, sets[i].ifo.data + 512, 278);
+	}
+	put32(ifo->data + 208, (uint32_t)(offset / SECTOR_SIZE));
+
+	if (vmg_menu.total > 0) {
+		put32(ifo->data + 216, write_c_adt(ifo, &vmg_menu));
+		put32(ifo->data + 220, write_vobu_admap(ifo, &vmg_menu));
+	}
+	ifo_finish(ifo);
+
+	mat = ifo->data;
+	memcpy(mat, "DVDVIDEO-VMG", 12);
+	put32(mat + 12, 2 * ifo_sectors(ifo) + vmg_menu.total - 1);
+	put32(mat + 28, ifo_sectors(ifo) - 1);
+	mat[33] = 0x10;
+	put16(mat + 38, 1);
+	put16(mat + 40, 1);
+	mat[42] = 1;
+	put16(mat + 62, (uint16_t)title_sets);
+	memcpy(mat + 64, "dvdbackup mkdvdvideo", 20);
+	put32(mat + 128, (uint32_t)(MAT_FP_PGC_OFFSET + pgc_length(&fp_pgc) - 1));
+	put32(mat + 132, MAT_FP_PGC_OFFSET);
+	if (vmg_menu.total > 0) {
+		put32(mat + 192, ifo_sectors(ifo));
+		put_video_attr(mat + 256);
+		mat[259] = 1;
+		put_audio_attr(mat + 260);
+		mat[341] = 1;
+		put_subp_attr(mat + 342);
+	}
+}
+
+
+/* Sectors of VIDEO_TS once the IFOs have been built */
+static uint64_t disc_sectors(void) {
+	uint64_t total = 2 * (uint64_t)ifo_sectors(&vmg_ifo) + vmg_menu.total;
+	int i;
+
+	for (i = 0; i < title_sets; i++) {
+		total += 2 * (uint64_t)ifo_sectors(&sets[i].ifo) + sets[i].menu.total + sets[i].title.total;
+	}
+	return total;
+}
+
+
+/**
+ * Shares title_sectors out among the title sets, the first getting the most
+ * as a main feature would, and builds the IFO files. Returns -1 if a cell
+ * would be too short.
+ */
+static int plan_disc(uint64_t title_sectors) {
+	uint64_t weights = (uint64_t)title_sets * (title_sets + 1) / 2;
+	uint64_t rest = title_sectors;
+	int i;
+
+	if (vobs_plan(&vmg_menu, menu_sectors, 1, 1, seed) != 0) {
+		return -1;
+	}
+	for (i = title_sets - 1; i >= 0; i--) {
+		uint64_t sectors = i == 0 ? rest : title_sectors * (uint64_t)(title_sets - i) / weights;
+		uint64_t key = seed ^ (uint64_t)(i + 1) << 32;
+
+		rest -= sectors;
+		if (sectors == 0 || vobs_plan(&sets[i].menu, menu_sectors, 1, 1, key) != 0
+				|| vobs_plan(&sets[i].title, (uint32_t)sectors, titles_per_set,
+					chapters * cells_per_chapter, key ^ (uint64_t)1 << 31) != 0) {
+			return -1;
+		}
+		build_title_set(&sets[i]);
+	}
+	build_vmg();
+
+	return 0;
+}
+
+
+static void add_file(const char* name, uint32_t* lba, uint32_t sectors,
+		const buffer_t* ifo, const vobs_t* vobs, uint32_t first) {
+	disc_file_t* file;
+
+	files = xrealloc(files, (file_count + 1) * sizeof(disc_file_t));
+	file = &files[file_count++];
+	snprintf(file->name, sizeof(file->name), "%s", name);
+	file->lba = *lba;
+	file->sectors = sectors;
+	file->ifo = ifo;
+	file->vobs = vobs;
+	file->first = first;
+	*lba += sectors;
+}
+
+
+/**
+ * Lists the files in the order they are stored on the disc from first_lba on
+ * and fills in the title set addresses of the VMG.
+ */
+static void place_files(uint32_t first_lba) {
+	uint32_t lba = first_lba;
+	char name[32];
+	int i;
+
+	file_count = 0;
+	add_file("VIDEO_TS.IFO", &lba, ifo_sectors(&vmg_ifo), &vmg_ifo, NULL, 0);
+	if (vmg_menu.total > 0) {
+		add_file("VIDEO_TS.VOB", &lba, vmg_menu.total, NULL, &vmg_menu, 0);
+	}
+	add_file("VIDEO_TS.BUP", &lba, ifo_sectors(&vmg_ifo), &vmg_ifo, NULL, 0);
+
+	for (i = 0; i < title_sets; i++) {
+		title_set_t* set = &sets[i];
+		uint32_t first;
+		int part = 1;
+
+		set->lba = lba;
+		snprintf(name, sizeof(name), "VTS_%02d_0.IFO", i + 1);
+		add_file(name, &lba, ifo_sectors(&set->ifo), &set->ifo, NULL, 0);
+		if (set->menu.total > 0) {
+			snprintf(name, sizeof(name), "VTS_%02d_0.VOB", i + 1);
+			add_file(name, &lba, set->menu.total, NULL, &set->menu, 0);
+		}
+		for (first = 0; first < set->title.total; first += split_sectors) {
+			uint32_t sectors = set->title.total - first;
+
+			snprintf(name, sizeof(name), "VTS_%02d_%d.VOB", i + 1, part++);
+			add_file(name, &lba, sectors < split_sectors ? sectors : split_sectors,
+					NULL, &set->title, first);
+		}
+		snprintf(name, sizeof(name), "VTS_%02d_0.BUP", i + 1);
+		add_file(name, &lba, ifo_sectors(&set->ifo), &set->ifo, NULL, 0);
+	}
+
+	build_vmg();
+}
+
+
+static void put_pack_header(unsigned char* p, uint64_t scr) {
+	p[2] = 0x01;
+	p[3] = 0xba;
+	p[4] = (unsigned char)(0x44 | ((scr >> 27) & 0x38) | ((scr >> 28) & 0x03));
+	p[5] = (unsigned char)(scr >> 20);
+	p[6] = (unsigned char)(0x04 | ((scr >> 12) & 0xf8) | ((scr >> 13) & 0x03));
+	p[7] = (unsigned char)(scr >> 5);
+	p[8] = (unsigned char)(0x04 | ((scr << 3) & 0xf8));
+	p[9] = 0x01;
+	/* program mux rate of 10.08 Mbit/s */
+	p[10] = 0x01;
+	p[11] = 0x89;
+	p[12] = 0xc3;
+	p[13] = 0xf8;
+}
+
+
+/* Navigation pack at sector of the VOBU ending at vobu_last */
+static void put_nav_pack(unsigned char* p, const vobs_t* vobs, int cell, uint32_t sector, uint32_t vobu_last) {
+	static const unsigned char system_header[24] = {
+		0x00, 0x00, 0x01, 0xbb, 0x00, 0x12, 0x80, 0xc4, 0xe1, 0x04, 0xe1, 0x7f,
+		0xb9, 0xe0, 0xe8, 0xb8, 0xc0, 0x20, 0xbd, 0xe0, 0x3a, 0xbf, 0xe0, 0x02
+	};
+	static const unsigned char pci_header[7] = { 0x00, 0x00, 0x01, 0xbf, 0x03, 0xd4, 0x00 };
+	static const unsigned char dsi_header[7] = { 0x00, 0x00, 0x01, 0xbf, 0x03, 0xfa, 0x01 };
+	uint64_t elapsed = sectors_milliseconds(sector - vobs->first[cell]);
+	unsigned char* pci = p + 38 + 7;
+	unsigned char* dsi = p + 1024 + 7;
+
+	memset(p, 0, SECTOR_SIZE);
+	put_pack_header(p, sector_ptm(sector));
+	memcpy(p + 14, system_header, sizeof(system_header));
+
+	memcpy(p + 38, pci_header, sizeof(pci_header));
+	put32(pci, sector);
+	put32(pci + 12, sector_ptm(sector));
+	put32(pci + 16, sector_ptm(vobu_last + 1));
+	put_time(pci + 24, elapsed);
+
+	memcpy(p + 1024, dsi_header, sizeof(dsi_header));
+	put32(dsi, sector_ptm(sector));
+	put32(dsi + 4, sector);
+	put32(dsi + 8, vobu_last - sector);
+	put16(dsi + 24, vobs->vob_id[cell]);
+	dsi[27] = vobs->cell_id[cell];
+	put_time(dsi + 28, elapsed);
+}
+
+
+/* Pack with a padding packet of pseudo-random bytes */
+static void put_padding_pack(unsigned char* p, const vobs_t* vobs, uint32_t sector) {
+	uint64_t state = vobs->key ^ (uint64_t)sector * 0x9e3779b97f4a7c15ULL;
+	size_t i;
+
+	memset(p, 0, 20);
+	put_pack_header(p, sector_ptm(sector));
+	p[16] = 0x01;
+	p[17] = 0xbe;
+	put16(p + 18, SECTOR_SIZE - 20);
+
+	/* splitmix64 */
+	for (i = 20; i < SECTOR_SIZE; i += 8) {
+		uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		z ^= z >> 31;
+		memcpy(p + i, &z, SECTOR_SIZE - i < 8 ? SECTOR_SIZE - i : 8);
+	}
+}
+
+
+static void fill_sector(unsigned char* p, const vobs_t* vobs, uint32_t sector) {
+	int low = 0, high = vobs->cells - 1;
+	uint32_t offset, vobu_last;
+
+	while (low < high) {
+		int middle = (low + high + 1) / 2;
+
+		if (vobs->first[middle] <= sector) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+
+	offset = sector - vobs->first[low];
+	if (offset % VOBU_SECTORS != 0) {
+		put_padding_pack(p, vobs, sector);
+		return;
+	}
+	vobu_last = sector + VOBU_SECTORS - 1;
+	if (vobu_last > vobs->first[low] + vobs->sectors[low] - 1) {
+		vobu_last = vobs->first[low] + vobs->sectors[low] - 1;
+	}
+	put_nav_pack(p, vobs, low, sector, vobu_last);
+}
+
+
+static int write_all(int fd, const unsigned char* buffer, size_t length) {
+	while (length > 0) {
+		ssize_t written = write(fd, buffer, length);
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buffer += written;
+		length -= (size_t)written;
+	}
+	return 0;
+}
+
+
+static int open_tree_file(const char* directory, const char* name) {
+	size_t length = strlen(directory) + strlen("/VIDEO_TS/") + strlen(name) + 1;
+	char* path = xrealloc(NULL, length);
+	int fd;
+
+	snprintf(path, length, "%s/VIDEO_TS/%s", directory, name);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		fprintf(stderr, "%s: cannot create %s: %s\n", program_name, path, strerror(errno));
+	}
+	free(path);
+	return fd;
+}
+
+
+static int make_tree(const char* directory) {
+	const char* subdirectories[] = { "", "/VIDEO_TS", "/AUDIO_TS" };
+	size_t length = strlen(directory) + strlen("/VIDEO_TS") + 1;
+	char* path = xrealloc(NULL, length);
+	size_t i;
+
+	for (i = 0; i < sizeof(subdirectories) / sizeof(subdirectories[0]); i++) {
+		snprintf(path, length, "%s%s", directory, subdirectories[i]);
+		if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+			fprintf(stderr, "%s: cannot create %s: %s\n", program_name, path, strerror(errno));
+			free(path);
+			return -1;
+		}
+	}
+	free(path);
+	return 0;
+}
+
+
+/**
+ * Writes every file to the VIDEO_TS tree under directory and to image,
+ * either of which may be NULL, generating the VOB sectors once for both.
+ */
+static int write_files(const char* directory, image_t* image) {
+	unsigned char* buffer = xrealloc(NULL, (size_t)CHUNK_SECTORS * SECTOR_SIZE);
+	size_t i;
+	int result = 0;
+
+	for (i = 0; i < file_count && result == 0; i++) {
+		const disc_file_t* file = &files[i];
+		int tree_fd = -1, image_fd = -1;
+		uint32_t done;
+
+		if (directory != NULL && (tree_fd = open_tree_file(directory, file->name)) == -1) {
+			result = -1;
+			break;
+		}
+		if (image != NULL && (image_fd = image_file_open(image, file->name, O_WRONLY)) == -1) {
+			fprintf(stderr, "%s: cannot open %s in the image: %s\n", program_name, file->name, strerror(errno));
+			result = -1;
+		}
+
+		for (done = 0; done < file->sectors && result == 0; ) {
+			const unsigned char* data;
+			uint32_t count = file->sectors - done;
+			uint32_t j;
+
+			if (count > CHUNK_SECTORS) {
+				count = CHUNK_SECTORS;
+			}
+			if (file->ifo != NULL) {
+				data = file->ifo->data + (size_t)done * SECTOR_SIZE;
+			} else {
+				for (j = 0; j < count; j++) {
+					fill_sector(buffer + (size_t)j * SECTOR_SIZE, file->vobs, file->first + done + j);
+				}
+				data = buffer;
+			}
+
+			if ((tree_fd != -1 && write_all(tree_fd, data, (size_t)count * SECTOR_SIZE) != 0)
+					|| (image_fd != -1 && write_all(image_fd, data, (size_t)count * SECTOR_SIZE) != 0)) {
+				fprintf(stderr, "%s: cannot write %s: %s\n", program_name, file->name, strerror(errno));
+				result = -1;
+			}
+			done += count;
+		}
+
+		if ((tree_fd != -1 && close(tree_fd) != 0) || (image_fd != -1 && image_file_close(image_fd) != 0)) {
+			fprintf(stderr, "%s: cannot close %s: %s\n", program_name, file->name, strerror(errno));
+			result = -1;
+		}
+	}
+
+	free(buffer);
+	return result;
+}
+
+
+static int write_image(const char* path, const char* volume_id) {
+	image_t* image = image_new(volume_id);
+	size_t i;
+	int result = -1;
+
+	if (image == NULL) {
+		fprintf(stderr, "%s: out of memory\n", program_name);
+		return -1;
+	}
+	for (i = 0; i < file_count; i++) {
+		if (image_add_file(image, files[i].name, (off_t)files[i].sectors * SECTOR_SIZE, files[i].lba) != 0) {
+			fprintf(stderr, "%s: cannot add %s to the image\n", program_name, files[i].name);
+			goto done;
+		}
+	}
+	if (image_layout(image) == -1 || !image_keeps_layout(image)) {
+		fprintf(stderr, "%s: cannot lay out the image\n", program_name);
+		goto done;
+	}
+	if (image_open(image, path, O_RDWR | O_CREAT | O_TRUNC) != 0) {
+		fprintf(stderr, "%s: cannot create %s: %s\n", program_name, path, strerror(errno));
+		goto done;
+	}
+	result = write_files(NULL, image);
+	if (image_close(image) != 0) {
+		fprintf(stderr, "%s: cannot close %s: %s\n", program_name, path, strerror(errno));
+		result = -1;
+	}
+
+done:
+	image_free(image);
+	return result;
+}
+
+
+/* Sizes are in bytes with an optional k, M or G suffix for powers of 1000, as DVD capacities are given. */
+static int parse_size(const char* text, uint64_t* sectors) {
+	char* end;
+	double value = strtod(text, &end);
+
+	switch (*end) {
+	case 'k': case 'K': value *= 1e3; end++; break;
+	case 'm': case 'M': value *= 1e6; end++; break;
+	case 'g': case 'G': value *= 1e9; end++; break;
+	}
+	if (end == text || *end != '\0' || value < 0 || value > (double)DUAL_LAYER_SECTORS * SECTOR_SIZE) {
+		return -1;
+	}
+	*sectors = (uint64_t)(value / SECTOR_SIZE);
+	return 0;
+}
+
+
+static int parse_count(const char* text, int max, int* count) {
+	char* end;
+	long value = strtol(text, &end, 10);
+
+	if (end == text || *end != '\0' || value < 1 || value > max) {
+		return -1;
+	}
+	*count = (int)value;
+	return 0;
+}
+
+
+static void print_help(void) {
+	printf("Usage: %s [OPTION]... (-o DIRECTORY | -i FILE)...\n\n", program_name);
+	printf("\
+Writes a synthetic DVD-Video disc for benchmarking dvdbackup.\n\n\
+  -o DIRECTORY   write the disc as DIRECTORY/VIDEO_TS\n\
+  -i FILE        write the disc as a UDF/ISO 9660 image\n\
+  -S SIZE        size of VIDEO_TS, up to a dual layer disc (default 100M)\n\
+  -n N           title sets (default 1); the first is the largest\n\
+  -t N           titles per title set (default 1)\n\
+  -c N           chapters per title (default 8)\n\
+  -l N           cells per chapter (default 1)\n\
+  -m SIZE        size of each menu VOB, 0 for no menus (default 1M)\n\
+  -v SIZE        split title VOBs at SIZE (default 1073709056)\n\
+  -V NAME        volume name of the image (default SYNTHETIC)\n\
+  -s SEED        seed of the VOB contents (default 0)\n\
+  -q             do not list the files\n\n\
+SIZE is in bytes, or in kB, MB or GB with a k, M or G suffix. The files are\n\
+listed with the sector they start at on the disc and their length in sectors.\n");
+}
+
+
+int main(int argc, char* argv[]) {
+	const char* directory = NULL;
+	const char* image_path = NULL;
+	const char* volume_id = "SYNTHETIC";
+	uint64_t requested = 100000000 / SECTOR_SIZE;
+	uint64_t sectors = 0;
+	uint64_t overhead;
+	int quiet = 0;
+	int option;
+	size_t i;
+
+	program_name = argv[0];
+
+	while ((option = getopt(argc, argv, "o:i:S:n:t:c:l:m:v:V:s:qh")) != -1) {
+		int valid = 1;
+
+		switch (option) {
+		case 'o':
+			directory = optarg;
+			break;
+		case 'i':
+			image_path = optarg;
+			break;
+		case 'S':
+			valid = parse_size(optarg, &requested) == 0 && requested > 0;
+			break;
+		case 'n':
+			valid = parse_count(optarg, 99, &title_sets) == 0;
+			break;
+		case 't':
+			valid = parse_count(optarg, 99, &titles_per_set) == 0;
+			break;
+		case 'c':
+			valid = parse_count(optarg, 99, &chapters) == 0;
+			break;
+		case 'l':
+			valid = parse_count(optarg, 255, &cells_per_chapter) == 0;
+			break;
+		case 'm':
+			valid = parse_size(optarg, &sectors) == 0 && sectors != 1;
+			menu_sectors = (uint32_t)sectors;
+			break;
+		case 'v':
+			valid = parse_size(optarg, &sectors) == 0 && sectors > 0 && sectors <= DEFAULT_SPLIT_SECTORS;
+			split_sectors = (uint32_t)sectors;
+			break;
+		case 'V':
+			volume_id = optarg;
+			valid = strlen(volume_id) <= 32;
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			fprintf(stderr, "Try '%s -h' for more information.\n", program_name);
+			return 1;
+		}
+		if (!valid) {
+			fprintf(stderr, "%s: invalid value '%s' for -%c\n", program_name, optarg, option);
+			return 1;
+		}
+	}
+
+	if (optind < argc || (directory == NULL && image_path == NULL)) {
+		fprintf(stderr, "%s: give a directory with -o or an image with -i\n", program_name);
+		return 1;
+	}
+	if (title_sets * titles_per_set > 99) {
+		fprintf(stderr, "%s: a disc has at most 99 titles\n", program_name);
+		return 1;
+	}
+	if (chapters * cells_per_chapter > 255) {
+		fprintf(stderr, "%s: a title has at most 255 cells\n", program_name);
+		return 1;
+	}
+
+	/* the IFOs and menus come out of the requested size, so plan twice */
+	sets = xrealloc(NULL, (size_t)title_sets * sizeof(title_set_t));
+	memset(sets, 0, (size_t)title_sets * sizeof(title_set_t));
+	if (plan_disc(requested) != 0) {
+		fprintf(stderr, "%s: the disc is too small for that many cells\n", program_name);
+		return 1;
+	}
+	overhead = disc_sectors() - requested;
+	if (overhead >= requested || plan_disc(requested - overhead) != 0) {
+		fprintf(stderr, "%s: the disc is too small for that many cells\n", program_name);
+		return 1;
+	}
+	for (i = 0; i < (size_t)title_sets; i++) {
+		if (sets[i].title.total > 9 * (uint64_t)split_sectors) {
+			fprintf(stderr, "%s: title set %d needs more than 9 title VOBs; raise -v\n", program_name, (int)i + 1);
+			return 1;
+		}
+	}
+	place_files(image_first_file_sector());
+
+	if (!quiet) {
+		for (i = 0; i < file_count; i++) {
+			printf("%-12s %10u %10u\n", files[i].name, files[i].lba, files[i].sectors);
+		}
+	}
+
+	if (directory != NULL && (make_tree(directory) != 0 || write_files(directory, NULL) != 0)) {
+		return 1;
+	}
+	if (image_path != NULL && write_image(image_path, volume_id) != 0) {
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "blank.h"
+
+/* C standard libraries */
+#include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+
+
+/*
+ * The kernels check a block a cache line or two at a time and stop at the
+ * first one that is not zero, which for blocks with data is almost always the
+ * first. Blank blocks have to be read to the end, which is where the width of
+ * the registers counts.
+ */
+
+static int block_is_blank_words(const unsigned char* block) {
+	size_t i;
+
+	for (i = 0; i < DVD_VIDEO_LB_LEN; i += 64) {
+		uint64_t word[8];
+
+		memcpy(word, block + i, sizeof(word));
+		if ((word[0] | word[1] | word[2] | word[3] | word[4] | word[5] | word[6] | word[7]) != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static int block_is_blank_sse2(const unsigned char* block) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i < DVD_VIDEO_LB_LEN; i += 64) {
+		const __m128i* p = (const __m128i*)(block + i);
+		__m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+				_mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xffff) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+__attribute__((target("avx2")))
+static int block_is_blank_avx2(const unsigned char* block) {
+	size_t i;
+
+	for (i = 0; i < DVD_VIDEO_LB_LEN; i += 128) {
+		const __m256i* p = (const __m256i*)(block + i);
+		__m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+				_mm256_or_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+
+		if (!_mm256_testz_si256(any, any)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+#endif
+
+
+/* kernel set by blank_use_kernel(), or NULL to pick one by the CPU */
+static int (*forced_kernel)(const unsigned char*) = NULL;
+
+
+int blank_use_kernel(blank_kernel_t kernel) {
+	switch (kernel) {
+	case BLANK_KERNEL_AUTO:
+		forced_kernel = NULL;
+		return 0;
+	case BLANK_KERNEL_WORDS:
+		forced_kernel = block_is_blank_words;
+		return 0;
+#ifdef HAVE_X86_SIMD
+	case BLANK_KERNEL_SSE2:
+		if (__builtin_cpu_supports("sse2")) {
+			forced_kernel = block_is_blank_sse2;
+			return 0;
+		}
+		return -1;
+	case BLANK_KERNEL_AVX2:
+		if (__builtin_cpu_supports("avx2")) {
+			forced_kernel = block_is_blank_avx2;
+			return 0;
+		}
+		return -1;
+#endif
+	default:
+		return -1;
+	}
+}
+
+
+int buffer_is_blank(const unsigned char* buffer, size_t length) {
+	size_t i;
+
+	for (i = 0; i < length; ++i) {
+		if (buffer[i] != 0x00) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+size_t blocks_blank(const unsigned char* buffer, size_t count, unsigned char blank[]) {
+	int (*block_is_blank)(const unsigned char*) = forced_kernel;
+	size_t blank_blocks = 0;
+	size_t i;
+
+	if (block_is_blank == NULL) {
+		block_is_blank = block_is_blank_words;
+#ifdef HAVE_X86_SIMD
+		if (__builtin_cpu_supports("avx2")) {
+			block_is_blank = block_is_blank_avx2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			block_is_blank = block_is_blank_sse2;
+		}
+#endif
+	}
+
+	for (i = 0; i < count; ++i) {
+		blank[i] = (unsigned char)block_is_blank(buffer + i * DVD_VIDEO_LB_LEN);
+		blank_blocks += blank[i];
+	}
+
+	return blank_blocks;
+}
@@ -0,0 +1,54 @@
+#ifndef BLANK_H_
+#define BLANK_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+/*
+ * Detection of all-zero DVD blocks, which is how unread or padded parts of a
+ * backup look. On x86 the widest of AVX2, SSE2 or plain 64 bit words that the
+ * CPU supports is picked at run time.
+ */
+
+/* 1 if the length bytes at buffer are all zero */
+int buffer_is_blank(const unsigned char* buffer, size_t length);
+
+/**
+ * Sets blank[i] to 1 if DVD block i of the count blocks at buffer is all zero
+ * and to 0 if not. Returns the number of blank blocks.
+ */
+size_t blocks_blank(const unsigned char* buffer, size_t count, unsigned char blank[]);
+
+typedef enum {
+	BLANK_KERNEL_AUTO,
+	BLANK_KERNEL_WORDS,
+	BLANK_KERNEL_SSE2,
+	BLANK_KERNEL_AVX2
+} blank_kernel_t;
+
+/**
+ * Makes blocks_blank() use kernel instead of the widest one the CPU supports,
+ * for benchmarks. Returns 0, or -1 if this build or CPU does not have it.
+ */
+int blank_use_kernel(blank_kernel_t kernel);
+
+#endif /* BLANK_H_ */
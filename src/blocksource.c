@@ -0,0 +1,407 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "blocksource.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <unistd.h>
+
+
+typedef enum {
+	FAULT_BAD,
+	FAULT_SLOW,
+	FAULT_FLAKY
+} fault_kind_t;
+
+typedef struct {
+	fault_kind_t kind;
+	uint32_t first;
+	uint32_t last;
+	unsigned int value; /* milliseconds or percent */
+} fault_t;
+
+struct block_faults_s {
+	fault_t* faults;
+	size_t count;
+};
+
+struct block_source_s {
+	int (*read)(block_source_t* source, int offset, int count, unsigned char* data);
+	void (*close)(block_source_t* source);
+	size_t blocks;
+
+	/* libdvdread */
+	dvd_file_t* file;
+
+	/* raw */
+	int fd;
+	off_t start;
+
+	/* mock */
+	block_source_t* inner;
+	const block_faults_t* faults;
+	uint32_t lba;
+	uint64_t random; /* xorshift state for the flaky sectors */
+
+	/* record and replay */
+	read_trace_t* trace;
+	disc_model_t* model;
+};
+
+
+static int dvdread_read(block_source_t* source, int offset, int count, unsigned char* data) {
+	return DVDReadBlocks(source->file, offset, (size_t)count, data);
+}
+
+
+block_source_t* block_source_dvdread(dvd_file_t* file) {
+	block_source_t* source = calloc(1, sizeof(*source));
+
+	if (source == NULL) {
+		return NULL;
+	}
+	source->read = dvdread_read;
+	source->file = file;
+	source->blocks = (size_t)DVDFileSize(file);
+	return source;
+}
+
+
+static int raw_read(block_source_t* source, int offset, int count, unsigned char* data) {
+	size_t length;
+	size_t done = 0;
+
+	if (offset < 0 || (size_t)offset >= source->blocks) {
+		return -1;
+	}
+	if ((size_t)count > source->blocks - (size_t)offset) {
+		count = (int)(source->blocks - (size_t)offset);
+	}
+	length = (size_t)count * DVD_VIDEO_LB_LEN;
+
+	while (done < length) {
+		ssize_t got = pread(source->fd, data + done, length - done,
+				source->start + (off_t)offset * DVD_VIDEO_LB_LEN + (off_t)done);
+
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			break;
+		}
+		done += (size_t)got;
+	}
+
+	return done >= DVD_VIDEO_LB_LEN ? (int)(done / DVD_VIDEO_LB_LEN) : -1;
+}
+
+
+static void raw_close(block_source_t* source) {
+	close(source->fd);
+}
+
+
+block_source_t* block_source_raw(const char* path, uint32_t lba, size_t blocks) {
+	block_source_t* source = calloc(1, sizeof(*source));
+
+	if (source == NULL) {
+		return NULL;
+	}
+	source->fd = open(path, O_RDONLY);
+	if (source->fd == -1) {
+		free(source);
+		return NULL;
+	}
+	source->read = raw_read;
+	source->close = raw_close;
+	source->start = (off_t)lba * DVD_VIDEO_LB_LEN;
+	source->blocks = blocks;
+	return source;
+}
+
+
+static int mock_fails(block_source_t* source, unsigned int percent) {
+	uint64_t x = source->random;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	source->random = x;
+	return x % 100 < percent;
+}
+
+
+static int mock_read(block_source_t* source, int offset, int count, unsigned char* data) {
+	uint32_t first = source->lba + (uint32_t)offset;
+	uint32_t end = first + (uint32_t)count;
+	uint32_t stop = end; /* first sector that fails */
+	unsigned long delay = 0;
+	size_t i;
+
+	for (i = 0; i < source->faults->count; ++i) {
+		const fault_t* fault = &source->faults->faults[i];
+		uint32_t from = fault->first > first ? fault->first : first;
+
+		if (fault->last < first || fault->first >= end) {
+			continue;
+		}
+		if (fault->kind == FAULT_BAD && from < stop) {
+			stop = from;
+		} else if (fault->kind == FAULT_FLAKY) {
+			uint32_t sector;
+
+			for (sector = from; sector <= fault->last && sector < stop; ++sector) {
+				if (mock_fails(source, fault->value)) {
+					stop = sector;
+				}
+			}
+		}
+	}
+
+	/* the drive spends the time up to and on the failing sector */
+	for (i = 0; i < source->faults->count; ++i) {
+		const fault_t* fault = &source->faults->faults[i];
+		uint32_t from = fault->first > first ? fault->first : first;
+		uint32_t to = stop < end ? stop + 1 : end;
+
+		if (fault->kind == FAULT_SLOW && from < to && fault->last >= from) {
+			to = fault->last + 1 < to ? fault->last + 1 : to;
+			delay += (unsigned long)(to - from) * fault->value;
+		}
+	}
+	if (delay > 0) {
+		struct timespec pause = { (time_t)(delay / 1000), (long)(delay % 1000) * 1000000L };
+
+		while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+		}
+	}
+
+	if (stop == first) {
+		return -1;
+	}
+	return block_source_read(source->inner, offset, (int)(stop - first), data);
+}
+
+
+/* Closes the source a mock or recording source reads through */
+static void inner_close(block_source_t* source) {
+	block_source_close(source->inner);
+}
+
+
+block_source_t* block_source_mock(block_source_t* inner, const block_faults_t* faults,
+		uint32_t lba) {
+	block_source_t* source;
+
+	if (inner == NULL) {
+		return NULL;
+	}
+	source = calloc(1, sizeof(*source));
+	if (source == NULL) {
+		block_source_close(inner);
+		return NULL;
+	}
+	source->read = mock_read;
+	source->close = inner_close;
+	source->blocks = inner->blocks;
+	source->inner = inner;
+	source->faults = faults;
+	source->lba = lba;
+	source->random = 0x9e3779b97f4a7c15ULL ^ lba;
+	return source;
+}
+
+
+static int record_read(block_source_t* source, int offset, int count, unsigned char* data) {
+	struct timespec started;
+	struct timespec ended;
+	int result;
+
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	result = block_source_read(source->inner, offset, count, data);
+	clock_gettime(CLOCK_MONOTONIC, &ended);
+	read_trace_add(source->trace, source->lba + (uint32_t)offset, count, result,
+			(double)(ended.tv_sec - started.tv_sec)
+			+ (double)(ended.tv_nsec - started.tv_nsec) / 1e9);
+	return result;
+}
+
+
+block_source_t* block_source_record(block_source_t* inner, read_trace_t* trace, uint32_t lba) {
+	block_source_t* source;
+
+	if (inner == NULL) {
+		return NULL;
+	}
+	source = calloc(1, sizeof(*source));
+	if (source == NULL) {
+		block_source_close(inner);
+		return NULL;
+	}
+	source->read = record_read;
+	source->close = inner_close;
+	source->blocks = inner->blocks;
+	source->inner = inner;
+	source->trace = trace;
+	source->lba = lba;
+	return source;
+}
+
+
+static int replay_read(block_source_t* source, int offset, int count, unsigned char* data) {
+	int result;
+
+	if (offset < 0 || (size_t)offset >= source->blocks) {
+		return -1;
+	}
+	result = disc_model_read(source->model, disc_model_first(source->model) + (uint32_t)offset,
+			count);
+	if (result > 0) {
+		memset(data, 0, (size_t)result * DVD_VIDEO_LB_LEN);
+	}
+	return result;
+}
+
+
+block_source_t* block_source_replay(disc_model_t* model) {
+	block_source_t* source = calloc(1, sizeof(*source));
+
+	if (source == NULL) {
+		return NULL;
+	}
+	source->read = replay_read;
+	source->blocks = disc_model_blocks(model);
+	source->model = model;
+	return source;
+}
+
+
+int block_source_read(block_source_t* source, int offset, int count, unsigned char* data) {
+	return source->read(source, offset, count, data);
+}
+
+
+size_t block_source_size(block_source_t* source) {
+	return source->blocks;
+}
+
+
+void block_source_close(block_source_t* source) {
+	if (source == NULL) {
+		return;
+	}
+	if (source->close != NULL) {
+		source->close(source);
+	}
+	free(source);
+}
+
+
+static int parse_fault(const char* line, fault_t* fault) {
+	char kind[8];
+	unsigned long first;
+	unsigned long last;
+	unsigned int value = 0;
+	int fields;
+
+	fields = sscanf(line, " %7s %lu-%lu %u", kind, &first, &last, &value);
+	if (fields < 3 || first > last || last >= UINT32_MAX) {
+		return -1;
+	}
+	fault->first = (uint32_t)first;
+	fault->last = (uint32_t)last;
+	fault->value = value;
+
+	if (strcmp(kind, "bad") == 0 && fields == 3) {
+		fault->kind = FAULT_BAD;
+	} else if (strcmp(kind, "slow") == 0 && fields == 4) {
+		fault->kind = FAULT_SLOW;
+	} else if (strcmp(kind, "flaky") == 0 && fields == 4 && value <= 100) {
+		fault->kind = FAULT_FLAKY;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+
+block_faults_t* block_faults_load(const char* path, int* error_line) {
+	block_faults_t* faults;
+	FILE* file;
+	char line[256];
+	int number = 0;
+
+	*error_line = 0;
+	file = fopen(path, "r");
+	if (file == NULL) {
+		return NULL;
+	}
+	faults = calloc(1, sizeof(*faults));
+	if (faults == NULL) {
+		fclose(file);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		const char* text = line + strspn(line, " \t");
+		fault_t* grown;
+
+		++number;
+		if (*text == '#' || *text == '\n' || *text == '\0') {
+			continue;
+		}
+		grown = realloc(faults->faults, (faults->count + 1) * sizeof(*grown));
+		if (grown == NULL) {
+			break;
+		}
+		faults->faults = grown;
+		if (parse_fault(text, &faults->faults[faults->count]) != 0) {
+			*error_line = number;
+			break;
+		}
+		faults->count++;
+	}
+
+	if (ferror(file) || !feof(file)) {
+		fclose(file);
+		block_faults_free(faults);
+		return NULL;
+	}
+	fclose(file);
+	return faults;
+}
+
+
+void block_faults_free(block_faults_t* faults) {
+	if (faults == NULL) {
+		return;
+	}
+	free(faults->faults);
+	free(faults);
+}
@@ -0,0 +1,91 @@
+#ifndef BLOCKSOURCE_H_
+#define BLOCKSOURCE_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trace.h"
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+
+/*
+ * Where the blocks of a DVD file are read from. All sources read like
+ * DVDReadBlocks(): count blocks from block offset of the file, returning
+ * the number of blocks read or -1.
+ */
+typedef struct block_source_s block_source_t;
+
+/* Faults a mock source injects, by disc sector */
+typedef struct block_faults_s block_faults_t;
+
+/* Reads file with libdvdread, which decrypts CSS. file stays the caller's. */
+block_source_t* block_source_dvdread(dvd_file_t* file);
+
+/**
+ * Reads a file of blocks blocks starting at sector lba straight from the disc
+ * or image at path, without libdvdread and without decrypting. Returns NULL
+ * with errno set if path cannot be opened.
+ */
+block_source_t* block_source_raw(const char* path, uint32_t lba, size_t blocks);
+
+/**
+ * Reads through inner, whose file starts at sector lba, with the faults
+ * injected. Like a drive a read stops at the first sector that fails. Takes
+ * over inner, also if out of memory.
+ */
+block_source_t* block_source_mock(block_source_t* inner, const block_faults_t* faults,
+		uint32_t lba);
+
+/**
+ * Reads through inner, whose file starts at sector lba, and adds every read
+ * to trace. Takes over inner, also if out of memory.
+ */
+block_source_t* block_source_record(block_source_t* inner, read_trace_t* trace, uint32_t lba);
+
+/* Reads the sectors of model as if they were one file, filling them with zeros */
+block_source_t* block_source_replay(disc_model_t* model);
+
+int block_source_read(block_source_t* source, int offset, int count, unsigned char* data);
+
+/* Number of blocks of the file */
+size_t block_source_size(block_source_t* source);
+
+void block_source_close(block_source_t* source);
+
+/**
+ * Loads a fault spec, one fault per line over a range of disc sectors:
+ *
+ *   bad FIRST-LAST        reads of these sectors fail
+ *   slow FIRST-LAST MS    reading each of these sectors takes MS milliseconds
+ *   flaky FIRST-LAST PCT  reads of each of these sectors fail PCT% of the time
+ *
+ * Blank lines and lines starting with # are skipped. Returns NULL with
+ * *error_line the line that could not be parsed, or 0 and errno set if the
+ * file could not be read.
+ */
+block_faults_t* block_faults_load(const char* path, int* error_line);
+
+void block_faults_free(block_faults_t* faults);
+
+#endif /* BLOCKSOURCE_H_ */
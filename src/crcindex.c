@@ -0,0 +1,334 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "crcindex.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78u
+
+/*
+ * The SSE4.2 instruction takes three cycles but can start one every cycle, so
+ * rounds of CRC_LANE_BYTES * 3 bytes are checksummed as three interleaved
+ * lanes. crc_shift moves the checksum of one lane past the next one.
+ */
+#define CRC_LANE_BYTES 1024
+
+/* slicing-by-8 tables, crc_table[0] being the plain byte table */
+static uint32_t crc_table[8][256];
+static uint32_t crc_shift[4][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+
+static void crc_table_init(void) {
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; ++i) {
+		crc = (uint32_t)i;
+		for (j = 0; j < 8; ++j) {
+			crc = crc & 1 ? crc >> 1 ^ CRC32C_POLY : crc >> 1;
+		}
+		crc_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; ++i) {
+		crc = crc_table[0][i];
+		for (j = 1; j < 8; ++j) {
+			crc = crc >> 8 ^ crc_table[0][crc & 0xff];
+			crc_table[j][i] = crc;
+		}
+	}
+
+	/* the checksum register is linear, so a shift is the XOR of its bits' */
+	for (i = 0; i < 32; ++i) {
+		crc = (uint32_t)1 << i;
+		for (j = 0; j < CRC_LANE_BYTES; ++j) {
+			crc = crc >> 8 ^ crc_table[0][crc & 0xff];
+		}
+		for (j = 0; j < 256; ++j) {
+			if (j & 1 << (i % 8)) {
+				crc_shift[i / 8][j] ^= crc;
+			}
+		}
+	}
+}
+
+
+static uint32_t crc_shift_lane(uint32_t crc) {
+	return crc_shift[0][crc & 0xff] ^ crc_shift[1][crc >> 8 & 0xff]
+		^ crc_shift[2][crc >> 16 & 0xff] ^ crc_shift[3][crc >> 24];
+}
+
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char* data, size_t length) {
+	pthread_once(&crc_table_once, crc_table_init);
+
+	while (length >= 8) {
+		uint32_t low = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8
+				| (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+
+		crc = crc_table[7][low & 0xff] ^ crc_table[6][low >> 8 & 0xff]
+			^ crc_table[5][low >> 16 & 0xff] ^ crc_table[4][low >> 24]
+			^ crc_table[3][data[4]] ^ crc_table[2][data[5]]
+			^ crc_table[1][data[6]] ^ crc_table[0][data[7]];
+		data += 8;
+		length -= 8;
+	}
+
+	while (length-- > 0) {
+		crc = crc >> 8 ^ crc_table[0][(crc ^ *data++) & 0xff];
+	}
+
+	return crc;
+}
+
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* data, size_t length) {
+	uint64_t crc64 = crc;
+
+	if (length >= CRC_LANE_BYTES * 3) {
+		pthread_once(&crc_table_once, crc_table_init);
+	}
+	while (length >= CRC_LANE_BYTES * 3) {
+		uint64_t crc1 = 0;
+		uint64_t crc2 = 0;
+		size_t i;
+
+		for (i = 0; i < CRC_LANE_BYTES; i += 8) {
+			uint64_t word0, word1, word2;
+
+			memcpy(&word0, data + i, sizeof(word0));
+			memcpy(&word1, data + CRC_LANE_BYTES + i, sizeof(word1));
+			memcpy(&word2, data + CRC_LANE_BYTES * 2 + i, sizeof(word2));
+			crc64 = _mm_crc32_u64(crc64, word0);
+			crc1 = _mm_crc32_u64(crc1, word1);
+			crc2 = _mm_crc32_u64(crc2, word2);
+		}
+
+		crc64 = crc_shift_lane(crc_shift_lane((uint32_t)crc64) ^ (uint32_t)crc1) ^ (uint32_t)crc2;
+		data += CRC_LANE_BYTES * 3;
+		length -= CRC_LANE_BYTES * 3;
+	}
+
+	while (length >= 8) {
+		uint64_t word;
+
+		memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+		data += 8;
+		length -= 8;
+	}
+
+	crc = (uint32_t)crc64;
+	while (length-- > 0) {
+		crc = _mm_crc32_u8(crc, *data++);
+	}
+
+	return crc;
+}
+#endif
+
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length) {
+	crc = ~crc;
+#ifdef HAVE_X86_SIMD
+	if (__builtin_cpu_supports("sse4.2")) {
+		return ~crc32c_sse42(crc, data, length);
+	}
+#endif
+	return ~crc32c_table(crc, data, length);
+}
+
+
+/*
+ * File layout: the magic, the block count as 32 bit little endian and four
+ * reserved bytes, followed by the checksums as 32 bit little endian.
+ */
+#define CRC_INDEX_MAGIC "DVDBCRCX"
+#define CRC_INDEX_HEADER 16
+
+struct crc_index_s {
+	int fd;
+	unsigned char* mapping;
+	size_t length;
+	unsigned char* checksums;
+	size_t extents;
+};
+
+
+static size_t crc_index_length(size_t blocks) {
+	return CRC_INDEX_HEADER
+		+ (blocks + CRC_INDEX_EXTENT_BLOCKS - 1) / CRC_INDEX_EXTENT_BLOCKS * 4;
+}
+
+
+static crc_index_t* crc_index_map(int fd, size_t blocks) {
+	crc_index_t* index;
+	void* mapping;
+	size_t length = crc_index_length(blocks);
+
+	index = malloc(sizeof(*index));
+	if (index == NULL) {
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		int saved_errno = errno;
+		free(index);
+		close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	index->fd = fd;
+	index->mapping = mapping;
+	index->length = length;
+	index->checksums = index->mapping + CRC_INDEX_HEADER;
+	index->extents = (length - CRC_INDEX_HEADER) / 4;
+	return index;
+}
+
+
+crc_index_t* crc_index_create(const char* path, size_t blocks) {
+	crc_index_t* index;
+	int fd;
+
+	if (blocks > UINT32_MAX) {
+		errno = EFBIG;
+		return NULL;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		return NULL;
+	}
+	if (ftruncate(fd, (off_t)crc_index_length(blocks)) != 0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	index = crc_index_map(fd, blocks);
+	if (index == NULL) {
+		return NULL;
+	}
+
+	memcpy(index->mapping, CRC_INDEX_MAGIC, 8);
+	index->mapping[8] = (unsigned char)(blocks & 0xff);
+	index->mapping[9] = (unsigned char)((blocks >> 8) & 0xff);
+	index->mapping[10] = (unsigned char)((blocks >> 16) & 0xff);
+	index->mapping[11] = (unsigned char)((blocks >> 24) & 0xff);
+	return index;
+}
+
+
+crc_index_t* crc_index_open(const char* path, size_t blocks) {
+	unsigned char header[CRC_INDEX_HEADER];
+	struct stat st;
+	size_t stored;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0 || pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	stored = (size_t)header[8] | (size_t)header[9] << 8
+		| (size_t)header[10] << 16 | (size_t)header[11] << 24;
+	if (memcmp(header, CRC_INDEX_MAGIC, 8) != 0 || stored != blocks
+			|| st.st_size != (off_t)crc_index_length(blocks)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return crc_index_map(fd, blocks);
+}
+
+
+size_t crc_index_extents(const crc_index_t* index) {
+	return index->extents;
+}
+
+
+void crc_index_set(crc_index_t* index, size_t extent, uint32_t crc) {
+	unsigned char* p;
+
+	if (extent >= index->extents) {
+		return;
+	}
+
+	p = index->checksums + extent * 4;
+	p[0] = (unsigned char)(crc & 0xff);
+	p[1] = (unsigned char)((crc >> 8) & 0xff);
+	p[2] = (unsigned char)((crc >> 16) & 0xff);
+	p[3] = (unsigned char)((crc >> 24) & 0xff);
+}
+
+
+uint32_t crc_index_get(const crc_index_t* index, size_t extent) {
+	const unsigned char* p = index->checksums + extent * 4;
+
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+int crc_index_close(crc_index_t* index) {
+	int result = 0;
+
+	if (munmap(index->mapping, index->length) != 0) {
+		result = -1;
+	}
+	if (close(index->fd) != 0) {
+		result = -1;
+	}
+	free(index);
+	return result;
+}
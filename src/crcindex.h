@@ -0,0 +1,64 @@
+#ifndef CRCINDEX_H_
+#define CRCINDEX_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Blocks covered by one checksum of an index, 32 KiB */
+#define CRC_INDEX_EXTENT_BLOCKS 16
+
+/**
+ * Continues the CRC32C (Castagnoli, as in iSCSI and ext4) crc of earlier data
+ * with length more bytes; start with 0. Uses the SSE4.2 instruction when the
+ * processor has it.
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+/*
+ * Checksum index of an output file: a memory mapped file with the CRC32C of
+ * every CRC_INDEX_EXTENT_BLOCKS blocks of the file, the last extent possibly
+ * shorter. Verifying the file against it needs no disc and tells exactly
+ * which extents changed.
+ */
+typedef struct crc_index_s crc_index_t;
+
+/* Creates or truncates the index at path for a file of blocks blocks. */
+crc_index_t* crc_index_create(const char* path, size_t blocks);
+
+/**
+ * Opens the existing index at path. Returns NULL with errno set to ENOENT if
+ * there is none, or to EINVAL if it is damaged or not for a file of blocks
+ * blocks.
+ */
+crc_index_t* crc_index_open(const char* path, size_t blocks);
+
+/* Number of extents, and so of checksums, in the index */
+size_t crc_index_extents(const crc_index_t* index);
+
+void crc_index_set(crc_index_t* index, size_t extent, uint32_t crc);
+
+uint32_t crc_index_get(const crc_index_t* index, size_t extent);
+
+int crc_index_close(crc_index_t* index);
+
+#endif /* CRCINDEX_H_ */
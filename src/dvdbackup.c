@@ -20,6 +20,17 @@
 
 #include <config.h>
 #include "dvdbackup.h"
+#include "blank.h"
+#include "blocksource.h"
+#include "crcindex.h"
+#include "gapplan.h"
+#include "hash.h"
+#include "image.h"
+#include "journal.h"
+#include "output.h"
+#include "sectormap.h"
+#include "tar.h"
+#include "trace.h"
 
 /* internationalisation */
 #include "gettext.h"
@@ -27,6 +38,7 @@
 
 /* C standard libraries */
 #include <ctype.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <errno.h>
 #include <stdint.h>
@@ -36,11 +48,16 @@
 
 /* C POSIX library */
 #include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
 #include <unistd.h>
 
 /* libdvdread */
 #include <dvdread/dvd_reader.h>
+#include <dvdread/dvd_udf.h>
 #include <dvdread/ifo_read.h>
 
 
@@ -58,23 +75,190 @@
  */
 #define MAX_VOB_SIZE 524288
 
+/**
+ * Number of BUFFER_SIZE chunks the reader thread may run ahead of the writer
+ * with --pipeline.
+ */
+#define PIPELINE_DEPTH 4
+
 /* Number of verification samples to collect when refreshing with --gaps. */
 #define GAP_SAMPLE_TARGET 32
 
+/**
+ * Bytes one drive of a rip of several drives may have queued for the writer
+ * thread: WRITER_QUEUE_SECONDS of the measured output rate, shared by the
+ * drives, but at least WRITER_QUEUE_MIN and at most WRITER_QUEUE_MAX.
+ */
+#define WRITER_QUEUE_SECONDS 0.5
+#define WRITER_QUEUE_MIN (2 * 1024 * 1024)
+#define WRITER_QUEUE_MAX (64 * 1024 * 1024)
+
 #define DVD_SEC_SIZ 2048
 
 /* Flag for verbose mode */
 int verbose = 0;
 int aspect;
 int progress = 0;
-char progressText[MAXNAME] = "n/a";
 int fill_gaps = 0;
 int no_overwrite = 0;
 gap_strategy_t gap_strategy = GAP_STRATEGY_FORWARD;
 unsigned int gap_random_seed = 0;
+int rescue_retries = 1;
+int rescue_time = 0;
 int gap_random_seed_set = 0;
 int compare_only = 0;
 int gap_map = 0;
+int pipeline = 0;
+int async_output = 0;
+int direct_io = 0;
+int sparse_output = 0;
+int preallocate = 0;
+int write_behind = 0;
+int physical_order = 0;
+char* image_file = NULL;
+int tar_output = 0;
+int bisect_max_depth = 9;
+int bisect_time_limit = 300;
+int resume = 0;
+int journal_interval = 0;
+int manifest = 0;
+int crc_index = 0;
+int repair = 0;
+int read_timeout = 0;
+const char* dvd_device = NULL;
+block_source_kind_t block_source = BLOCK_SOURCE_DVDREAD;
+char* fault_spec = NULL;
+char* record_trace = NULL;
+
+/* Faults of --block-source=mock */
+static block_faults_t* block_faults = NULL;
+
+/* Reads recorded with --record-trace, or NULL */
+static read_trace_t* read_trace = NULL;
+
+/* Disc a --replay-trace run simulates, whose clock is the time of the run */
+static disc_model_t* replay_model = NULL;
+
+/* Image written or compared instead of the VIDEO_TS directory with --iso */
+static image_t* output_image = NULL;
+static int output_image_created = 0;
+
+/* Archive written to the original standard output with --tar */
+static tar_t* output_tar = NULL;
+static int tar_fd = -1;
+
+/* Writer thread of a rip of several drives, which does all their output writes */
+static pthread_t writer_thread;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_work = PTHREAD_COND_INITIALIZER; /* a write was queued */
+static pthread_cond_t writer_done = PTHREAD_COND_INITIALIZER; /* a queued write finished */
+static int writer_running = 0;
+static int writer_stop = 0;
+static double writer_rate = 0.0; /* bytes per second the output takes */
+
+/* An output write queued for the writer thread */
+typedef struct write_item_s {
+	int fd;
+	off_t offset; /* -1 to write at the file offset */
+	unsigned char* data;
+	size_t length;
+	struct write_item_s* next;
+} write_item_t;
+
+/**
+ * Write-behind state of one output file: dirty bytes have been written within
+ * [start, end) but not yet handed to the kernel for writeback, and
+ * [prev_start, prev_end) is on its way to disk.
+ */
+typedef struct {
+	off_t start;
+	off_t end;
+	off_t dirty;
+	off_t prev_start;
+	off_t prev_end;
+} write_behind_t;
+
+typedef struct {
+	size_t start_block;
+	size_t block_count;
+} gap_map_entry_t;
+
+typedef struct {
+	gap_map_entry_t* entries;
+	size_t count;
+	size_t capacity;
+} gap_map_info_t;
+
+/**
+ * State of one rip. When several drives are ripped at once every drive has
+ * its own job and reader thread, which points job at it; a single rip uses
+ * default_job. The options themselves are set before the rip starts and
+ * shared by all jobs.
+ */
+typedef struct {
+	dvd_reader_t* dvd;
+	const char* device;
+	char* title_name;
+	char* targetdir;
+	read_error_strategy_t errorstrat;
+	int result;
+
+	char progress_text[MAXNAME];
+	int percent; /* of the file being copied or compared */
+	off_t bytes_written;
+	double seconds;
+	double write_wait; /* seconds spent waiting for the writer thread */
+	/* writes queued for the writer thread, oldest first */
+	write_item_t* write_head;
+	write_item_t* write_tail;
+	size_t write_queued; /* bytes queued or being written */
+	int write_error; /* errno of a queued write that failed, or 0 */
+
+	/* statistics of the bisecting error strategy */
+	size_t bisect_unreadable_blocks;
+	size_t bisect_recovered_blocks;
+	double bisect_seconds;
+	int bisect_limit_reported;
+
+	/* reads the --read-timeout watchdog gave up on */
+	int read_stalls;
+	size_t stalled_blocks;
+	/* reader that replaced dvd after a read stalled, or NULL */
+	dvd_reader_t* reader;
+	int reader_lost; /* a read stalled and the device could not be opened again */
+
+	gap_map_info_t gap_map_info;
+	size_t gap_map_total_blocks;
+	size_t gap_map_bad_blocks;
+	/* write-behind state of the file gap_fill_from_plan() is working on */
+	write_behind_t gap_write_behind;
+	/* sector state sidecar of the VOB being copied or compared, or NULL */
+	sector_map_t* sectors;
+	/* resume journal of the title VOBs being copied, or NULL */
+	journal_t* journal;
+	uint32_t journal_key;
+	off_t journal_unsynced; /* bytes written since the last entry */
+	/* --manifest hash of the file being copied, or NULL */
+	hasher_t* hasher;
+	size_t manifest_padded;
+	int manifest_pending; /* manifest_begin() was called, manifest_end() not yet */
+	/* --crc-index checksums of the VOB being copied or compared, or NULL */
+	crc_index_t* checksums;
+	size_t checksum_extent; /* the extent being checksummed */
+	size_t checksum_fill; /* bytes of it so far */
+	uint32_t checksum_crc;
+	unsigned char* checksum_stale; /* extents a --gaps run rewrote, or NULL */
+} job_t;
+
+static job_t default_job = { .progress_text = "n/a" };
+static __thread job_t* job = &default_job;
+
+/* The jobs of a rip of several drives, for the status line */
+static job_t* drive_jobs = NULL;
+static int drive_job_count = 0;
+static pthread_mutex_t status_lock = PTHREAD_MUTEX_INITIALIZER;
+static off_t drives_bytes_written = 0;
+static double drives_started = 0.0;
 
 /* Structs to keep title set information in */
 
@@ -109,6 +293,23 @@ typedef struct {
 	titles_t* titles;
 } titles_info_t;
 
+/* One file of a --physical-order mirror and where it is on the disc */
+typedef struct {
+	uint32_t lba;
+	int index; /* position in title set order, keeps the sort stable */
+	int title_set;
+	dvd_read_domain_t domain;
+	int vob; /* title VOB part, starting at 1 */
+	int offset; /* first block in the domain as open_dvd_file() opens it */
+	int blocks;
+} mirror_extent_t;
+
+/* A file of the VIDEO_TS directory, for --iso and --tar */
+typedef struct {
+	char name[32];
+	off_t size;
+} disc_file_t;
+
 
 static void bsort_max_to_min(int sector[], int title[], int size);
 
@@ -123,19 +324,6 @@ static int gap_process_segment(int fd, dvd_file_t* dvd_file, int dvd_offset,
 		size_t* filled_blocks_out);
 
 
-static int buffer_is_blank(const unsigned char* buffer, size_t length) {
-	size_t i;
-
-	for (i = 0; i < length; ++i) {
-		if (buffer[i] != 0x00) {
-			return 0;
-		}
-	}
-
-	return 1;
-}
-
-
 static void report_gap_stats(const char* path, size_t total_blocks, size_t blank_before, size_t blank_after) {
 	if (!fill_gaps) {
 		return;
@@ -157,7 +345,8 @@ static int finalize_vob_file(int streamout, const char* path, size_t size_blocks
 		size_t total_blocks, size_t blank_before, size_t blank_after) {
 	off_t target_size;
 
-	if (streamout == -1) {
+	/* files inside an --iso image already have their final size */
+	if (streamout == -1 || image_fd_length(streamout) >= 0) {
 		return 0;
 	}
 
@@ -185,7 +374,7 @@ static ssize_t read_existing_range(int fd, off_t offset, unsigned char* buffer,
 		return 0;
 	}
 
-	if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
+	if (lseek(fd, image_fd_base(fd) + offset, SEEK_SET) == (off_t)-1) {
 		return -1;
 	}
 
@@ -211,24 +400,61 @@ static ssize_t read_existing_range(int fd, off_t offset, unsigned char* buffer,
 }
 
 
-static int write_range(int fd, off_t offset, const unsigned char* data, size_t length) {
-	size_t total = 0;
+static double monotonic_seconds(void) {
+	struct timespec now;
 
-	if (length == 0) {
-		return 0;
+	if (replay_model != NULL) {
+		return disc_model_seconds(replay_model);
 	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
 
-	if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
-		return -1;
+
+/**
+ * Allocates a page aligned buffer for count DVD blocks, as O_DIRECT requires.
+ */
+static unsigned char* alloc_blocks(size_t count) {
+	void* buffer = NULL;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	if (page_size <= 0) {
+		page_size = 4096;
 	}
 
-	while (total < length) {
-		ssize_t written = write(fd, data + total, length - total);
+	if (posix_memalign(&buffer, (size_t)page_size, count * DVD_VIDEO_LB_LEN) != 0) {
+		return NULL;
+	}
+
+	return (unsigned char*)buffer;
+}
+
+
+/**
+ * Does the queued write item: at its offset with pwrite(), or else at the
+ * file offset like output_append(). Returns 0 or an errno.
+ */
+static int writer_write(const write_item_t* item) {
+	size_t total = 0;
+
+	while (total < item->length) {
+		ssize_t written = item->offset >= 0
+			? pwrite(item->fd, item->data + total, item->length - total, item->offset + (off_t)total)
+			: write(item->fd, item->data + total, item->length - total);
+
+#ifdef O_DIRECT
+		if (written == -1 && errno == EINVAL) {
+			int flags = fcntl(item->fd, F_GETFL);
+			if (flags != -1 && (flags & O_DIRECT) && fcntl(item->fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+				continue;
+			}
+		}
+#endif
 		if (written < 0) {
 			if (errno == EINTR) {
 				continue;
 			}
-			return -1;
+			return errno;
 		}
 		total += (size_t)written;
 	}
@@ -236,2915 +462,6953 @@ static int write_range(int fd, off_t offset, const unsigned char* data, size_t l
 	return 0;
 }
 
-typedef struct {
-	size_t start_block;
-	size_t block_count;
-} gap_range_t;
-
-typedef struct {
-	gap_range_t* ranges;
-	size_t count;
-	size_t capacity;
-} gap_plan_t;
 
-typedef struct {
-	size_t start_block;
-	size_t block_count;
-} gap_map_entry_t;
+/**
+ * The writer thread of a rip of several drives takes the queued writes of the
+ * drives in turn, one at a time, so the output device sees large sequential
+ * writes instead of interleaved ones, and measures the rate the output takes
+ * them at.
+ */
+static void* writer_main(void* arg) {
+	int next = 0;
+
+	(void)arg;
+	pthread_mutex_lock(&writer_lock);
+	for (;;) {
+		job_t* owner = NULL;
+		write_item_t* item;
+		double started, seconds;
+		int error;
+		int i;
+
+		for (i = 0; i < drive_job_count && owner == NULL; ++i) {
+			job_t* candidate = &drive_jobs[(next + i) % drive_job_count];
+
+			if (candidate->write_head != NULL) {
+				owner = candidate;
+				next = (next + i + 1) % drive_job_count;
+			}
+		}
+		if (owner == NULL) {
+			if (writer_stop) {
+				break;
+			}
+			pthread_cond_wait(&writer_work, &writer_lock);
+			continue;
+		}
 
-typedef struct {
-	gap_map_entry_t* entries;
-	size_t count;
-	size_t capacity;
-} gap_map_info_t;
+		item = owner->write_head;
+		owner->write_head = item->next;
+		if (owner->write_head == NULL) {
+			owner->write_tail = NULL;
+		}
+		/* a drive whose write failed only waits for the error */
+		error = owner->write_error;
+		pthread_mutex_unlock(&writer_lock);
 
-static gap_map_info_t gap_map_info = {0};
-static size_t gap_map_total_blocks = 0;
-static size_t gap_map_bad_blocks = 0;
+		started = monotonic_seconds();
+		if (error == 0) {
+			error = writer_write(item);
+		}
+		seconds = monotonic_seconds() - started;
 
+		pthread_mutex_lock(&writer_lock);
+		if (error != 0) {
+			owner->write_error = error;
+		} else {
+			owner->bytes_written += (off_t)item->length;
+			pthread_mutex_lock(&status_lock);
+			drives_bytes_written += (off_t)item->length;
+			pthread_mutex_unlock(&status_lock);
+			if (seconds > 0.0) {
+				double rate = (double)item->length / seconds;
+
+				writer_rate = writer_rate > 0.0 ? 0.9 * writer_rate + 0.1 * rate : rate;
+			}
+		}
+		owner->write_queued -= item->length;
+		pthread_cond_broadcast(&writer_done);
+		free(item->data);
+		free(item);
+	}
+	pthread_mutex_unlock(&writer_lock);
 
-static void gap_plan_free(gap_plan_t* plan) {
-	free(plan->ranges);
-	plan->ranges = NULL;
-	plan->count = 0;
-	plan->capacity = 0;
+	return NULL;
 }
 
 
-static int gap_plan_add(gap_plan_t* plan, size_t start, size_t count) {
-	gap_range_t* last;
-	size_t last_end;
-	gap_range_t* new_ranges;
-	size_t new_capacity;
+/* Bytes a drive may have queued before its next write waits */
+static size_t writer_queue_limit(void) {
+	double limit = writer_rate * WRITER_QUEUE_SECONDS / (drive_job_count > 0 ? drive_job_count : 1);
 
-	if (count == 0) {
-		return 0;
+	if (limit < WRITER_QUEUE_MIN) {
+		return WRITER_QUEUE_MIN;
 	}
+	return limit > WRITER_QUEUE_MAX ? WRITER_QUEUE_MAX : (size_t)limit;
+}
 
-	if (plan->count > 0) {
-		last = &plan->ranges[plan->count - 1];
-		last_end = last->start_block + last->block_count;
-		if (start <= last_end) {
-			size_t new_end = start + count;
-			if (new_end > last_end) {
-				last->block_count = new_end - last->start_block;
-			}
-			return 0;
-		}
-	}
 
-	if (plan->count == plan->capacity) {
-		new_capacity = plan->capacity == 0 ? 8 : plan->capacity * 2;
-		if (new_capacity < plan->count + 1) {
-			new_capacity = plan->count + 1;
-		}
-		new_ranges = realloc(plan->ranges, new_capacity * sizeof(*new_ranges));
-		if (new_ranges == NULL) {
-			return -1;
-		}
-		plan->ranges = new_ranges;
-		plan->capacity = new_capacity;
+/**
+ * Queues length bytes of data for the writer thread to write at offset of fd,
+ * or at its file offset if offset is -1. Waits, counted as write_wait, while
+ * the queue of the drive is full, so a drive only runs as far ahead as the
+ * output keeps up. Returns 0, or -1 with errno set if an earlier queued write
+ * of the drive failed or there is no memory.
+ */
+static int writer_queue(int fd, off_t offset, const unsigned char* data, size_t length) {
+	write_item_t* item = malloc(sizeof(*item));
+	unsigned char* copy = alloc_blocks((length + DVD_VIDEO_LB_LEN - 1) / DVD_VIDEO_LB_LEN);
+	double started;
+
+	if (item == NULL || copy == NULL) {
+		free(item);
+		free(copy);
+		errno = ENOMEM;
+		return -1;
 	}
-
-	plan->ranges[plan->count].start_block = start;
-	plan->ranges[plan->count].block_count = count;
-	plan->count++;
+	memcpy(copy, data, length);
+	item->fd = fd;
+	item->offset = offset;
+	item->data = copy;
+	item->length = length;
+	item->next = NULL;
+
+	pthread_mutex_lock(&writer_lock);
+	started = monotonic_seconds();
+	while (job->write_error == 0 && job->write_queued > 0
+			&& job->write_queued + length > writer_queue_limit()) {
+		pthread_cond_wait(&writer_done, &writer_lock);
+	}
+	job->write_wait += monotonic_seconds() - started;
+	if (job->write_error != 0) {
+		errno = job->write_error;
+		pthread_mutex_unlock(&writer_lock);
+		free(copy);
+		free(item);
+		return -1;
+	}
+	if (job->write_tail != NULL) {
+		job->write_tail->next = item;
+	} else {
+		job->write_head = item;
+	}
+	job->write_tail = item;
+	job->write_queued += length;
+	pthread_cond_signal(&writer_work);
+	pthread_mutex_unlock(&writer_lock);
 
 	return 0;
 }
 
 
-static int gap_plan_contains(const gap_plan_t* plan, size_t block) {
-	size_t i;
+/**
+ * Waits until the writer thread has written everything the drive queued. Must
+ * be called before an output file is read back, truncated, positioned or
+ * closed. Returns 0, or -1 with errno set if a queued write failed.
+ */
+static int writer_drain(void) {
+	double started;
+	int error;
 
-	for (i = 0; i < plan->count; ++i) {
-		const gap_range_t* range = &plan->ranges[i];
-		if (block < range->start_block) {
-			return 0;
-		}
-		if (block < range->start_block + range->block_count) {
-			return 1;
-		}
+	if (!writer_running) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&writer_lock);
+	started = monotonic_seconds();
+	while (job->write_queued > 0) {
+		pthread_cond_wait(&writer_done, &writer_lock);
 	}
+	job->write_wait += monotonic_seconds() - started;
+	error = job->write_error;
+	job->write_error = 0;
+	pthread_mutex_unlock(&writer_lock);
 
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
 	return 0;
 }
 
 
-void gap_map_reset(void) {
-	free(gap_map_info.entries);
-	gap_map_info.entries = NULL;
-	gap_map_info.count = 0;
-	gap_map_info.capacity = 0;
-	gap_map_total_blocks = 0;
-	gap_map_bad_blocks = 0;
+static int writer_start(void) {
+	writer_stop = 0;
+	writer_rate = 0.0;
+	if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+		return 1;
+	}
+	writer_running = 1;
+	return 0;
 }
 
 
-static int gap_map_add_entry(size_t start_block, size_t block_count) {
-	gap_map_entry_t* entry;
-
-	if (block_count == 0) {
-		return 0;
+static void writer_finish(void) {
+	if (!writer_running) {
+		return;
 	}
+	pthread_mutex_lock(&writer_lock);
+	writer_stop = 1;
+	pthread_cond_signal(&writer_work);
+	pthread_mutex_unlock(&writer_lock);
+	pthread_join(writer_thread, NULL);
+	writer_running = 0;
+}
 
-	if (gap_map_info.count == gap_map_info.capacity) {
-		size_t new_capacity = gap_map_info.capacity == 0 ? 32 : gap_map_info.capacity * 2;
-		gap_map_entry_t* new_entries = realloc(gap_map_info.entries, new_capacity * sizeof(*new_entries));
-		if (new_entries == NULL) {
-			return -1;
-		}
-		gap_map_info.entries = new_entries;
-		gap_map_info.capacity = new_capacity;
+
+/**
+ * Writes the path on the disc of a file of title set title_set: its IFO, its
+ * menu VOB or title VOB vob.
+ */
+static void disc_file_path(char* path, size_t size, int title_set, dvd_read_domain_t domain,
+		int vob) {
+	if (title_set == 0) {
+		snprintf(path, size, "/VIDEO_TS/VIDEO_TS.%s",
+				domain == DVD_READ_INFO_FILE ? "IFO" : "VOB");
+	} else if (domain == DVD_READ_INFO_FILE) {
+		snprintf(path, size, "/VIDEO_TS/VTS_%02i_0.IFO", title_set);
+	} else {
+		snprintf(path, size, "/VIDEO_TS/VTS_%02i_%i.VOB", title_set, vob);
 	}
+}
 
-	entry = &gap_map_info.entries[gap_map_info.count++];
-	entry->start_block = start_block;
-	entry->block_count = block_count;
-	gap_map_bad_blocks += block_count;
-	return 0;
+
+/**
+ * The blocks of the VOB files are read from a block source: libdvdread, the
+ * sectors of the device itself with --block-source=raw, or either with faults
+ * injected with --block-source=mock. Files whose blocks are read are opened
+ * with open_dvd_file(), which looks up where the file starts on the disc and
+ * opens its source, and read with read_blocks().
+ *
+ * With --read-timeout, reads are done by a worker thread of the reading
+ * thread, which gives up on a read that takes longer than the timeout. The
+ * worker is left to finish the hung read on its own, the read counts as
+ * failed, and the file is opened again on a new reader of the device so
+ * that later reads do not queue up behind the hung one.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	block_source_t* source;
+	dvd_file_t* file; /* read directly if source is NULL */
+	int offset;
+	int count;
+	int result;
+	int pending; /* a read was handed over and has not returned yet */
+	int abandoned; /* nobody waits for the read any more */
+	int stop;
+	unsigned char* buffer;
+	size_t buffer_blocks;
+} read_worker_t;
+
+/* A DVD file opened with open_dvd_file() */
+typedef struct open_file_s {
+	dvd_file_t* file; /* as opened by the caller */
+	dvd_reader_t* file_reader; /* reader file was opened on */
+	block_source_t* source; /* where its reads go */
+	dvd_file_t* reopened; /* file the source reads since a stall, or NULL */
+	dvd_reader_t* reader; /* reader of the file the source reads */
+	int title_set;
+	dvd_read_domain_t domain;
+	int source_hung; /* source is stuck in a read and must be left alone */
+	int no_file; /* file is only the key of a replayed source */
+	struct open_file_s* next;
+} open_file_t;
+
+/* A reader a read is stuck in; it is never used or closed again */
+typedef struct hung_reader_s {
+	dvd_reader_t* reader;
+	struct hung_reader_s* next;
+} hung_reader_t;
+
+static pthread_key_t read_worker_key;
+static pthread_once_t read_worker_once = PTHREAD_ONCE_INIT;
+static open_file_t* open_files = NULL;
+static hung_reader_t* hung_readers = NULL;
+static pthread_mutex_t open_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Whether reads can go straight to libdvdread */
+static int reads_direct(void) {
+	return read_timeout <= 0 && block_source == BLOCK_SOURCE_DVDREAD && read_trace == NULL;
 }
 
 
-static int gap_map_collect_from_plan(size_t base_block, size_t expected_blocks,
-		const gap_plan_t* plan, size_t existing_blocks) {
-	size_t i;
+static const char* read_device(void) {
+	return job->device != NULL ? job->device : dvd_device;
+}
 
-	for (i = 0; i < plan->count; ++i) {
-		if (gap_map_add_entry(base_block + plan->ranges[i].start_block,
-				plan->ranges[i].block_count) != 0) {
-			return -1;
-		}
+
+/* Whether a read is stuck in reader */
+static int reader_hung(dvd_reader_t* reader) {
+	hung_reader_t* hung;
+	int result = 0;
+
+	pthread_mutex_lock(&open_files_lock);
+	for (hung = hung_readers; hung != NULL && !result; hung = hung->next) {
+		result = hung->reader == reader;
 	}
+	pthread_mutex_unlock(&open_files_lock);
+	return result;
+}
 
-	if (existing_blocks < expected_blocks) {
-		size_t missing = expected_blocks - existing_blocks;
-		if (gap_map_add_entry(base_block + existing_blocks, missing) != 0) {
-			return -1;
-		}
+
+/**
+ * The reader the job opens its files on instead of dvd: dvd until a read
+ * stalls, a new reader of the device after that, as libdvdread must not be
+ * used while a read is stuck in it. NULL if the device could not be opened
+ * again.
+ */
+static dvd_reader_t* job_reader(dvd_reader_t* dvd) {
+	if (job->reader_lost) {
+		return NULL;
 	}
+	return job->reader != NULL ? job->reader : dvd;
+}
 
-	return 0;
+
+/* DVDOpenFile() on the reader of the job */
+static dvd_file_t* open_job_file(dvd_reader_t* dvd, int title_set, dvd_read_domain_t domain) {
+	dvd_reader_t* reader = job_reader(dvd);
+
+	return reader != NULL ? DVDOpenFile(reader, title_set, domain) : NULL;
 }
 
 
-static int gap_map_collect_missing(size_t base_block, size_t expected_blocks) {
-	return gap_map_add_entry(base_block, expected_blocks);
+/* ifoOpen() on the reader of the job */
+static ifo_handle_t* open_job_ifo(dvd_reader_t* dvd, int title_set) {
+	dvd_reader_t* reader = job_reader(dvd);
+
+	return reader != NULL ? ifoOpen(reader, title_set) : NULL;
 }
 
 
-void gap_map_render(void) {
-	const int rows = 20;
-	const int cols = 60;
-	char map[20][60];
-	size_t i;
-	const size_t inner_turn = 192;
-	const size_t outer_turn = 432;
-	double pct = 0.0;
+/**
+ * Leaves reader, which a read is stuck in, to that read for good and opens
+ * the device again for everything the job reads from now on, unless that
+ * already happened.
+ */
+static void abandon_reader(dvd_reader_t* reader) {
+	hung_reader_t* hung = malloc(sizeof(*hung));
+	const char* device = read_device();
 
-	if (gap_map_total_blocks == 0) {
-		printf(_("Gap map: no sectors examined.\n"));
-		return;
+	if (hung != NULL) {
+		hung->reader = reader;
+		pthread_mutex_lock(&open_files_lock);
+		hung->next = hung_readers;
+		hung_readers = hung;
+		pthread_mutex_unlock(&open_files_lock);
 	}
 
-	for (int r = 0; r < rows; ++r) {
-		for (int c = 0; c < cols; ++c) {
-			map[r][c] = '.';
-		}
+	if (job->reader_lost || (job->reader != NULL && job->reader != reader)) {
+		return;
 	}
-
-	for (i = 0; i < gap_map_info.count; ++i) {
-		size_t start = gap_map_info.entries[i].start_block;
-		size_t end = start + gap_map_info.entries[i].block_count;
-		size_t span = gap_map_info.entries[i].block_count;
-		size_t step = span / ((size_t)cols / 2 + 1);
-		if (step == 0) {
-			step = 1;
-		}
-		for (size_t block = start; block < end; block += step) {
-			size_t relative = block;
-			if (relative >= gap_map_total_blocks) {
-				relative = gap_map_total_blocks - 1;
-			}
-			size_t row_index = (relative * (size_t)rows) / gap_map_total_blocks;
-			if (row_index >= (size_t)rows) {
-				row_index = (size_t)rows - 1;
-			}
-			size_t turn_range;
-			if (rows > 1) {
-				size_t numerator = (outer_turn - inner_turn) * row_index;
-				size_t denom = (size_t)rows - 1;
-				size_t delta = denom ? numerator / denom : 0;
-				turn_range = inner_turn + delta;
-			} else {
-				turn_range = inner_turn;
-			}
-			if (turn_range == 0) {
-				turn_range = 1;
-			}
-			size_t pos_in_turn = relative % turn_range;
-			int col = (int)((pos_in_turn * (size_t)cols) / turn_range);
-			if (col >= cols) {
-				col = cols - 1;
-			}
-			int row = (int)row_index;
-			map[row][col] = '#';
-		}
+	job->reader = device != NULL ? DVDOpen(device) : NULL;
+	if (job->reader == NULL) {
+		fprintf(stderr, _("Cannot reopen %s after a read stalled\n"), device != NULL ? device : "");
+		job->reader_lost = 1;
 	}
+}
 
-	printf(_("Gap map (rows = inner to outer radius, columns = approximate angle):\n"));
-	for (int r = 0; r < rows; ++r) {
-		printf("|");
-		for (int c = 0; c < cols; ++c) {
-			putchar(map[r][c]);
-		}
-		printf("|\n");
+
+/**
+ * Closes dvd and the reader that replaced it after a read stalled, except
+ * for readers a read is still stuck in.
+ */
+void close_dvd_reader(dvd_reader_t* dvd) {
+	if (job->reader != NULL && !reader_hung(job->reader)) {
+		DVDClose(job->reader);
 	}
-	if (gap_map_total_blocks > 0) {
-		pct = ((double)gap_map_bad_blocks * 100.0) / (double)gap_map_total_blocks;
+	job->reader = NULL;
+	job->reader_lost = 0;
+	if (dvd != NULL && !reader_hung(dvd)) {
+		DVDClose(dvd);
 	}
-	printf(_("# marks sectors that appear blank or missing. Angle is estimated using an average turn length.\n"));
-	printf(_("Gap map summary: %zu of %zu sectors flagged (%.2f%%).\n"),
-		gap_map_bad_blocks, gap_map_total_blocks, pct);
 }
 
 
-void gap_map_free(void) {
-	free(gap_map_info.entries);
-	gap_map_info.entries = NULL;
-	gap_map_info.count = 0;
-	gap_map_info.capacity = 0;
-	gap_map_total_blocks = 0;
-	gap_map_bad_blocks = 0;
+/**
+ * Opens the block source of file, which was opened on dvd. Prints why and
+ * returns NULL if it cannot be opened.
+ */
+static block_source_t* open_block_source(dvd_reader_t* dvd, dvd_file_t* file, int title_set,
+		dvd_read_domain_t domain) {
+	block_source_t* source;
+	uint32_t lba = 0;
+	char path[64];
+
+	if (block_source != BLOCK_SOURCE_DVDREAD || read_trace != NULL) {
+		uint32_t filesize;
+
+		disc_file_path(path, sizeof(path), title_set, domain,
+				domain == DVD_READ_TITLE_VOBS ? 1 : 0);
+		lba = UDFFindFile(dvd, path, &filesize);
+		if (lba == 0) {
+			fprintf(stderr, _("Cannot find %s on the disc\n"), path);
+			return NULL;
+		}
+	}
+
+	if (block_source == BLOCK_SOURCE_RAW) {
+		source = block_source_raw(read_device(), lba, (size_t)DVDFileSize(file));
+		if (source == NULL) {
+			fprintf(stderr, _("Cannot read %s from %s\n"), path, read_device());
+			perror(PACKAGE);
+			return NULL;
+		}
+	} else {
+		source = block_source_dvdread(file);
+		if (block_source == BLOCK_SOURCE_MOCK) {
+			source = block_source_mock(source, block_faults, lba);
+		}
+	}
+	if (read_trace != NULL) {
+		source = block_source_record(source, read_trace, lba);
+	}
+	if (source == NULL) {
+		fprintf(stderr, _("Out of memory\n"));
+	}
+	return source;
 }
 
 
-static int gap_process_segment(int fd, dvd_file_t* dvd_file, int dvd_offset,
-		size_t segment_start, size_t block_count, const char* filename,
-		read_error_strategy_t errorstrat, unsigned char* buffer,
-		size_t* filled_blocks_out) {
-	size_t cursor = 0;
+static void read_worker_release(read_worker_t* worker) {
+	pthread_mutex_destroy(&worker->lock);
+	pthread_cond_destroy(&worker->cond);
+	free(worker->buffer);
+	free(worker);
+}
 
-	while (cursor < block_count) {
-		size_t chunk = block_count - cursor;
-		int blocks_read;
-		size_t usable_blocks = 0;
-		size_t skip_blocks = 0;
-		size_t read_block;
-		ssize_t written;
 
-		if (chunk > BUFFER_SIZE) {
-			chunk = BUFFER_SIZE;
-		}
+static void* read_worker_thread(void* arg) {
+	read_worker_t* worker = (read_worker_t*)arg;
 
-		read_block = segment_start + cursor;
-		blocks_read = DVDReadBlocks(dvd_file, dvd_offset + (int)read_block, (int)chunk, buffer);
-		if (blocks_read == (int)chunk) {
-			usable_blocks = chunk;
-		} else if (blocks_read > 0) {
-			usable_blocks = (size_t)blocks_read;
-			fprintf(stderr, _("Gap fill warning for %s: read %d of %zu blocks at %zu\n"),
-				filename, blocks_read, chunk, read_block);
-		} else {
-			fprintf(stderr, _("Gap fill error for %s: read failure at block %zu\n"),
-				filename, read_block);
+	pthread_mutex_lock(&worker->lock);
+	for (;;) {
+		while (!worker->pending && !worker->stop) {
+			pthread_cond_wait(&worker->cond, &worker->lock);
 		}
-
-		if (usable_blocks > 0) {
-			written = pwrite(fd, buffer, usable_blocks * DVD_VIDEO_LB_LEN,
-					(off_t)read_block * DVD_VIDEO_LB_LEN);
-			if (written != (ssize_t)(usable_blocks * DVD_VIDEO_LB_LEN)) {
-				fprintf(stderr, _("Error writing %s during gap fill\n"), filename);
-				perror(PACKAGE);
-				return 1;
-			}
-
-			if (filled_blocks_out) {
-				*filled_blocks_out += usable_blocks;
-			}
+		if (worker->stop) {
+			break;
+		}
+		pthread_mutex_unlock(&worker->lock);
+		int result = worker->source != NULL
+			? block_source_read(worker->source, worker->offset, worker->count, worker->buffer)
+			: DVDReadBlocks(worker->file, worker->offset, (size_t)worker->count, worker->buffer);
+		pthread_mutex_lock(&worker->lock);
+		worker->result = result;
+		worker->pending = 0;
+		if (worker->abandoned) {
+			break;
 		}
+		pthread_cond_broadcast(&worker->cond);
+	}
+	pthread_mutex_unlock(&worker->lock);
 
-		if (usable_blocks < chunk) {
-			size_t remaining = block_count - (cursor + usable_blocks);
+	read_worker_release(worker);
+	return NULL;
+}
 
-			if (remaining == 0) {
-				cursor = block_count;
-				continue;
-			}
 
-			if (errorstrat == STRATEGY_ABORT) {
-				return 1;
-			} else if (errorstrat == STRATEGY_SKIP_BLOCK) {
-				skip_blocks = 1;
-				fprintf(stderr, _("Gap fill: skipping single block for %s\n"), filename);
-			} else {
-				size_t unread = chunk - usable_blocks;
-				if (unread == 0) {
-					unread = 1;
-				}
-				skip_blocks = unread;
-				fprintf(stderr, _("Gap fill: skipping %zu blocks for %s\n"), skip_blocks, filename);
-			}
+/* Stops the worker of a thread that exits */
+static void read_worker_exit(void* arg) {
+	read_worker_t* worker = (read_worker_t*)arg;
 
-			if (skip_blocks > remaining) {
-				skip_blocks = remaining;
-			}
+	pthread_mutex_lock(&worker->lock);
+	worker->stop = 1;
+	pthread_cond_broadcast(&worker->cond);
+	pthread_mutex_unlock(&worker->lock);
+}
 
-			cursor += usable_blocks + skip_blocks;
-		} else {
-			cursor += chunk;
-		}
-	}
 
-	return 0;
+static void read_worker_key_create(void) {
+	pthread_key_create(&read_worker_key, read_worker_exit);
 }
 
 
-static int scan_existing_file_for_gaps(int fd, size_t expected_blocks, gap_plan_t* plan,
-		size_t* blank_blocks_out, size_t* full_blocks_out, off_t* existing_bytes_out) {
-	struct stat st;
-	off_t existing_bytes;
-	size_t full_blocks;
-	size_t scan_blocks;
-	unsigned char* buffer = NULL;
-	size_t processed = 0;
-	size_t blank_blocks = 0;
-	size_t pending_start = SIZE_MAX;
+static read_worker_t* read_worker_get(void) {
+	read_worker_t* worker;
+	pthread_t thread;
 
-	if (fstat(fd, &st) != 0) {
-		return -1;
+	pthread_once(&read_worker_once, read_worker_key_create);
+	worker = pthread_getspecific(read_worker_key);
+	if (worker != NULL) {
+		return worker;
 	}
 
-	existing_bytes = st.st_size;
-	if (existing_bytes_out) {
-		*existing_bytes_out = existing_bytes;
+	worker = calloc(1, sizeof(*worker));
+	if (worker == NULL) {
+		return NULL;
 	}
-
-	full_blocks = (size_t)(existing_bytes / DVD_VIDEO_LB_LEN);
-	scan_blocks = full_blocks;
-	if (scan_blocks > expected_blocks) {
-		scan_blocks = expected_blocks;
+	pthread_mutex_init(&worker->lock, NULL);
+	pthread_cond_init(&worker->cond, NULL);
+	if (pthread_create(&thread, NULL, read_worker_thread, worker) != 0) {
+		read_worker_release(worker);
+		return NULL;
 	}
+	pthread_detach(thread);
+	pthread_setspecific(read_worker_key, worker);
+	return worker;
+}
 
-	if (scan_blocks > 0) {
-		buffer = (unsigned char*)malloc((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
-		if (buffer == NULL) {
-			return -1;
-		}
-	}
 
-	while (processed < scan_blocks) {
-		size_t chunk_blocks = scan_blocks - processed;
-		ssize_t bytes;
-		size_t have_blocks;
-		size_t i;
+static dvd_file_t* open_dvd_file(dvd_reader_t* dvd, int title_set, dvd_read_domain_t domain) {
+	dvd_file_t* file = open_job_file(dvd, title_set, domain);
+	open_file_t* entry;
 
-		if (chunk_blocks > BUFFER_SIZE) {
-			chunk_blocks = BUFFER_SIZE;
-		}
+	if (file == NULL || reads_direct()) {
+		return file;
+	}
+	dvd = job_reader(dvd);
 
-		bytes = pread(fd, buffer, (size_t)chunk_blocks * DVD_VIDEO_LB_LEN,
-			(off_t)processed * DVD_VIDEO_LB_LEN);
-		if (bytes < 0) {
-			int saved_errno = errno;
-			free(buffer);
-			errno = saved_errno;
-			return -1;
+	entry = calloc(1, sizeof(*entry));
+	if (entry != NULL) {
+		entry->source = open_block_source(dvd, file, title_set, domain);
+	}
+	if (entry == NULL || entry->source == NULL) {
+		if (entry == NULL) {
+			fprintf(stderr, _("Out of memory\n"));
 		}
+		free(entry);
+		DVDCloseFile(file);
+		return NULL;
+	}
+	entry->file = file;
+	entry->file_reader = dvd;
+	entry->reader = dvd;
+	entry->title_set = title_set;
+	entry->domain = domain;
+
+	pthread_mutex_lock(&open_files_lock);
+	entry->next = open_files;
+	open_files = entry;
+	pthread_mutex_unlock(&open_files_lock);
+	return file;
+}
 
-		have_blocks = (size_t)bytes / DVD_VIDEO_LB_LEN;
-		if (have_blocks == 0) {
-			break;
-		}
-		if (have_blocks < chunk_blocks) {
-			chunk_blocks = have_blocks;
-		}
 
-		for (i = 0; i < chunk_blocks; ++i) {
-			size_t block_index = processed + i;
-			const unsigned char* block_ptr = buffer + i * DVD_VIDEO_LB_LEN;
+static void close_dvd_file(dvd_file_t* file) {
+	open_file_t** link;
+	open_file_t* entry = NULL;
 
-			if (buffer_is_blank(block_ptr, DVD_VIDEO_LB_LEN)) {
-				if (pending_start == SIZE_MAX) {
-					pending_start = block_index;
-				}
-			} else if (pending_start != SIZE_MAX) {
-				size_t run = block_index - pending_start;
-				if (gap_plan_add(plan, pending_start, run) != 0) {
-					free(buffer);
-					return -1;
-				}
-				blank_blocks += run;
-				pending_start = SIZE_MAX;
-			}
+	pthread_mutex_lock(&open_files_lock);
+	for (link = &open_files; *link != NULL; link = &(*link)->next) {
+		if ((*link)->file == file) {
+			entry = *link;
+			*link = entry->next;
+			break;
 		}
+	}
+	pthread_mutex_unlock(&open_files_lock);
 
-		processed += chunk_blocks;
+	if (entry == NULL) {
+		DVDCloseFile(file);
+		return;
 	}
 
-	if (pending_start != SIZE_MAX) {
-		size_t run = scan_blocks - pending_start;
-		if (gap_plan_add(plan, pending_start, run) != 0) {
-			free(buffer);
-			return -1;
+	/* handles of a reader a read is stuck in stay open; it is still being read */
+	if (!entry->source_hung && !reader_hung(entry->reader)) {
+		block_source_close(entry->source);
+		if (entry->reopened != NULL) {
+			DVDCloseFile(entry->reopened);
 		}
-		blank_blocks += run;
 	}
+	if (!entry->no_file && !reader_hung(entry->file_reader)) {
+		DVDCloseFile(entry->file);
+	}
+	free(entry);
+}
 
-	free(buffer);
 
-	if (blank_blocks_out) {
-		*blank_blocks_out = blank_blocks;
+/**
+ * Opens the file of entry again on the reader of the job once a read is
+ * stuck in the reader its source reads from. The old source is left to that
+ * read. Returns 0 if the source of entry can be read.
+ */
+static int reopen_dvd_file(open_file_t* entry) {
+	dvd_reader_t* reader = job_reader(NULL);
+	dvd_file_t* file = NULL;
+	block_source_t* source = NULL;
+
+	if (!entry->source_hung && !reader_hung(entry->reader)) {
+		return 0;
 	}
-	if (full_blocks_out) {
-		*full_blocks_out = full_blocks;
+	if (reader != NULL) {
+		file = DVDOpenFile(reader, entry->title_set, entry->domain);
+	}
+	if (file != NULL) {
+		source = open_block_source(reader, file, entry->title_set, entry->domain);
+	}
+	if (source == NULL) {
+		if (file != NULL) {
+			DVDCloseFile(file);
+		}
+		return 1;
 	}
 
+	pthread_mutex_lock(&open_files_lock);
+	entry->source = source;
+	entry->reopened = file;
+	entry->reader = reader;
+	entry->source_hung = 0;
+	pthread_mutex_unlock(&open_files_lock);
 	return 0;
 }
 
 
-static size_t gap_collect_samples(const gap_plan_t* plan, size_t available_blocks,
-		size_t desired, size_t samples[]) {
-	size_t target;
-	size_t count = 0;
-	size_t i;
+/**
+ * Reads count blocks from block offset of a file opened with open_dvd_file()
+ * from its block source, like DVDReadBlocks(). With --read-timeout a read
+ * that does not return in time fails like an unreadable one with -1.
+ */
+static int read_blocks(dvd_file_t* dvd_file, int offset, int count, unsigned char* data) {
+	open_file_t* entry;
+	read_worker_t* worker;
+	block_source_t* source = NULL;
+	struct timespec deadline;
+	int result;
 
-	if (available_blocks == 0 || desired == 0) {
-		return 0;
+	if (reads_direct()) {
+		return DVDReadBlocks(dvd_file, offset, (size_t)count, data);
 	}
 
-	target = desired;
-	if (available_blocks < desired) {
-		target = available_blocks;
+	pthread_mutex_lock(&open_files_lock);
+	for (entry = open_files; entry != NULL; entry = entry->next) {
+		if (entry->file == dvd_file) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&open_files_lock);
+	if (entry != NULL) {
+		/* a file of a reader a read is stuck in moves to the new reader first */
+		if (reopen_dvd_file(entry) != 0) {
+			return -1;
+		}
+		source = entry->source;
 	}
 
-	for (i = 0; i < target; ++i) {
-		size_t candidate = (size_t)(((uint64_t)(i + 1) * (uint64_t)available_blocks) / (target + 1));
-		size_t forward = candidate;
-		size_t backward;
+	worker = read_timeout > 0 ? read_worker_get() : NULL;
+	if (worker != NULL && worker->buffer_blocks < (size_t)count) {
+		unsigned char* buffer = realloc(worker->buffer, (size_t)count * DVD_VIDEO_LB_LEN);
 
-		if (candidate >= available_blocks) {
-			candidate = available_blocks - 1;
+		if (buffer != NULL) {
+			worker->buffer = buffer;
+			worker->buffer_blocks = (size_t)count;
+		} else {
+			worker = NULL;
 		}
+	}
+	if (worker == NULL) {
+		return source != NULL ? block_source_read(source, offset, count, data)
+			: DVDReadBlocks(dvd_file, offset, (size_t)count, data);
+	}
 
-		while (forward < available_blocks && gap_plan_contains(plan, forward)) {
-			forward++;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += read_timeout;
+
+	pthread_mutex_lock(&worker->lock);
+	worker->source = source;
+	worker->file = dvd_file;
+	worker->offset = offset;
+	worker->count = count;
+	worker->pending = 1;
+	pthread_cond_broadcast(&worker->cond);
+	while (worker->pending) {
+		if (pthread_cond_timedwait(&worker->cond, &worker->lock, &deadline) == ETIMEDOUT) {
+			break;
 		}
-		if (forward >= available_blocks) {
-			backward = candidate;
-			while (backward > 0 && gap_plan_contains(plan, backward)) {
-				backward--;
-			}
-			if (gap_plan_contains(plan, backward)) {
-				continue;
-			}
-			forward = backward;
+	}
+	if (!worker->pending) {
+		result = worker->result;
+		pthread_mutex_unlock(&worker->lock);
+		if (result > 0) {
+			memcpy(data, worker->buffer, (size_t)result * DVD_VIDEO_LB_LEN);
 		}
+		return result;
+	}
 
-		if (count > 0 && samples[count - 1] == forward) {
-			continue;
-		}
+	/* the worker frees itself once the read returns */
+	worker->abandoned = 1;
+	pthread_mutex_unlock(&worker->lock);
+	pthread_setspecific(read_worker_key, NULL);
 
-		samples[count++] = forward;
+	job->read_stalls++;
+	job->stalled_blocks += (size_t)count;
+	if (entry != NULL) {
+		pthread_mutex_lock(&open_files_lock);
+		entry->source_hung = 1;
+		pthread_mutex_unlock(&open_files_lock);
+		if (entry->reader != NULL) {
+			abandon_reader(entry->reader);
+		}
 	}
-
-	return count;
+	return -1;
 }
 
 
-static int gap_verify_samples(int fd, dvd_file_t* dvd_file, int dvd_offset,
-		const char* filename, const size_t samples[], size_t sample_count) {
-	unsigned char dvd_block[DVD_VIDEO_LB_LEN];
-	unsigned char file_block[DVD_VIDEO_LB_LEN];
-	size_t i;
-	ssize_t read_bytes;
+void read_stall_report(void) {
+	if (job->read_stalls == 0) {
+		return;
+	}
 
-	for (i = 0; i < sample_count; ++i) {
-		size_t block = samples[i];
+	if (progress) {
+		fprintf(stdout, "\n");
+	}
+	fprintf(stderr, _("%d reads stalled for more than %d seconds; %zu sectors were given up and the drive was reopened.\n"),
+			job->read_stalls, read_timeout, job->stalled_blocks);
+}
 
-		if (DVDReadBlocks(dvd_file, dvd_offset + (int)block, 1, dvd_block) != 1) {
-			fprintf(stderr, _("Error reading %s at block %zu during verification\n"), filename, block);
-			return 1;
-		}
 
-		read_bytes = pread(fd, file_block, DVD_VIDEO_LB_LEN, (off_t)block * DVD_VIDEO_LB_LEN);
-		if (read_bytes != DVD_VIDEO_LB_LEN) {
-			fprintf(stderr, _("Error reading existing data from %s during verification\n"), filename);
+int block_source_setup(void) {
+	int line;
+
+	if (record_trace != NULL) {
+		read_trace = read_trace_create(record_trace);
+		if (read_trace == NULL) {
+			fprintf(stderr, _("Cannot create the read trace %s\n"), record_trace);
 			perror(PACKAGE);
 			return 1;
 		}
+	}
+	if (block_source != BLOCK_SOURCE_MOCK) {
+		return 0;
+	}
 
-		if (memcmp(dvd_block, file_block, DVD_VIDEO_LB_LEN) != 0) {
-			fprintf(stderr, _("Verification sample mismatch for %s at sector %zu\n"), filename, block);
-			return 1;
+	block_faults = block_faults_load(fault_spec, &line);
+	if (block_faults == NULL) {
+		if (line > 0) {
+			fprintf(stderr, _("Cannot parse line %d of the fault spec %s\n"), line, fault_spec);
+		} else {
+			fprintf(stderr, _("Cannot read the fault spec %s\n"), fault_spec);
+			perror(PACKAGE);
 		}
+		return 1;
 	}
-
 	return 0;
 }
 
 
-static int gap_fill_from_plan(int fd, dvd_file_t* dvd_file, int dvd_offset,
-		const gap_plan_t* plan, const char* filename,
-		read_error_strategy_t errorstrat, size_t* filled_blocks_out) {
-	unsigned char* buffer;
-	size_t total_filled = 0;
-	size_t range_index;
+int block_source_finish(void) {
 	int result = 0;
 
-	if (plan->count == 0) {
-		if (filled_blocks_out) {
-			*filled_blocks_out = 0;
-		}
-		return 0;
+	if (read_trace_close(read_trace) != 0) {
+		fprintf(stderr, _("Error writing the read trace %s\n"), record_trace);
+		perror(PACKAGE);
+		result = 1;
 	}
+	read_trace = NULL;
+	block_faults_free(block_faults);
+	block_faults = NULL;
+	return result;
+}
 
-	buffer = (unsigned char*)malloc((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
-	if (buffer == NULL) {
-		if (filled_blocks_out) {
-			*filled_blocks_out = 0;
-		}
-		return 1;
+
+/**
+ * Progress of a rip of several drives: a single status line with how far
+ * every drive is through its current file and the combined output rate.
+ */
+static void drives_report_progress(int done, int total) {
+	double elapsed;
+	int i;
+
+	job->percent = total > 0 ? (int)((long long)done * 100 / total) : 100;
+
+	pthread_mutex_lock(&status_lock);
+	elapsed = monotonic_seconds() - drives_started;
+	fprintf(stdout, "\r");
+	for (i = 0; i < drive_job_count; ++i) {
+		fprintf(stdout, "%s: %s %d%%  ", drive_jobs[i].device,
+				drive_jobs[i].progress_text, drive_jobs[i].percent);
 	}
+	fprintf(stdout, _("output %.1f MiB/s"),
+			elapsed > 0.0 ? (double)drives_bytes_written / 1048576.0 / elapsed : 0.0);
+	fflush(stdout);
+	pthread_mutex_unlock(&status_lock);
+}
 
-	if (gap_strategy == GAP_STRATEGY_RANDOM) {
-		gap_fill_segment_t* segments = NULL;
-		size_t segment_count = 0;
-		size_t segment_capacity = 0;
 
-		for (range_index = 0; range_index < plan->count; ++range_index) {
-			size_t produced = 0;
-			size_t range_start = plan->ranges[range_index].start_block;
-			size_t range_blocks = plan->ranges[range_index].block_count;
+static int write_range(int fd, off_t offset, const unsigned char* data, size_t length) {
+	size_t total = 0;
 
-			while (produced < range_blocks) {
-				size_t chunk = range_blocks - produced;
-				if (chunk > BUFFER_SIZE) {
-					chunk = BUFFER_SIZE;
-				}
-				if (segment_count == segment_capacity) {
-					size_t new_capacity = segment_capacity == 0 ? 32 : segment_capacity * 2;
-					gap_fill_segment_t* new_segments = realloc(segments, new_capacity * sizeof(*new_segments));
-					if (new_segments == NULL) {
-						free(segments);
-						free(buffer);
-						if (filled_blocks_out) {
-							*filled_blocks_out = total_filled;
-						}
-						return 1;
-					}
-					segments = new_segments;
-					segment_capacity = new_capacity;
-				}
-				segments[segment_count].start_block = range_start + produced;
-				segments[segment_count].block_count = chunk;
-				segment_count++;
-				produced += chunk;
+	if (length == 0) {
+		return 0;
+	}
+
+	if (writer_running) {
+		return writer_queue(fd, offset, data, length);
+	}
+
+	if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
+		return -1;
+	}
+
+	while (total < length) {
+		ssize_t written = write(fd, data + total, length - total);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
 			}
+			return -1;
 		}
+		total += (size_t)written;
+	}
 
-		srand(gap_random_seed_set ? gap_random_seed : 0);
-		for (size_t i = segment_count; i > 1; --i) {
-			size_t j = (size_t)(rand() % (int)i);
-			gap_fill_segment_t temp = segments[i - 1];
-			segments[i - 1] = segments[j];
-			segments[j] = temp;
-		}
+	return 0;
+}
 
-		for (size_t i = 0; i < segment_count; ++i) {
-			if (gap_process_segment(fd, dvd_file, dvd_offset,
-					segments[i].start_block, segments[i].block_count,
-					filename, errorstrat, buffer, &total_filled) != 0) {
-				result = 1;
-				break;
-			}
+
+/**
+ * Writes length bytes at offset of the output file. With --async-io the data
+ * is queued on the io_uring (slot is the registered buffer it was read into or
+ * -1 to copy it), otherwise it is written synchronously.
+ */
+static int output_write(int fd, off_t offset, const unsigned char* data, size_t length, int slot) {
+	offset += image_fd_base(fd);
+
+	if (async_output) {
+		if (slot >= 0) {
+			return output_async_write(fd, slot, length, offset);
 		}
+		return output_async_write_copy(fd, data, length, offset);
+	}
 
-		free(segments);
-	} else {
-		for (range_index = 0; range_index < plan->count && result == 0; ++range_index) {
-			size_t range_start = plan->ranges[range_index].start_block;
-			size_t range_blocks = plan->ranges[range_index].block_count;
+	return write_range(fd, offset, data, length);
+}
 
-			switch (gap_strategy) {
-			case GAP_STRATEGY_FORWARD:
-				if (gap_process_segment(fd, dvd_file, dvd_offset,
-							range_start, range_blocks, filename,
-							errorstrat, buffer, &total_filled) != 0) {
-					result = 1;
-				}
-				break;
 
-			case GAP_STRATEGY_REVERSE: {
-				size_t processed = 0;
-				while (processed < range_blocks && result == 0) {
-					size_t chunk = range_blocks - processed;
-					if (chunk > BUFFER_SIZE) {
-						chunk = BUFFER_SIZE;
-					}
-					size_t segment_start = range_start + range_blocks - processed - chunk;
-					if (gap_process_segment(fd, dvd_file, dvd_offset,
-								segment_start, chunk, filename,
-								errorstrat, buffer, &total_filled) != 0) {
-						result = 1;
-						break;
-					}
-					processed += chunk;
-				}
-				break;
-			}
+/**
+ * Waits until all queued writes of --async-io or of the writer thread have
+ * reached the output files. Must be called before an output file is read back,
+ * truncated or closed.
+ */
+static int output_flush(const char* path) {
+	if ((async_output && output_async_drain() != 0) || writer_drain() != 0) {
+		fprintf(stderr, _("Error writing %s\n"), path);
+		perror(PACKAGE);
+		return 1;
+	}
 
-			case GAP_STRATEGY_OUTSIDE_IN: {
-				size_t front = 0;
-				size_t back = range_blocks;
-				int use_front = 1;
-				while (front < back && result == 0) {
-					size_t remaining = back - front;
-					size_t chunk = remaining;
-					if (chunk > BUFFER_SIZE) {
-						chunk = BUFFER_SIZE;
-					}
+	return 0;
+}
 
-					if (use_front) {
-						size_t segment_start = range_start + front;
-						if (gap_process_segment(fd, dvd_file, dvd_offset,
-									segment_start, chunk, filename,
-									errorstrat, buffer, &total_filled) != 0) {
-							result = 1;
-							break;
-						}
-						front += chunk;
-					} else {
-						size_t segment_start = range_start + (back - chunk);
-						if (gap_process_segment(fd, dvd_file, dvd_offset,
-									segment_start, chunk, filename,
-									errorstrat, buffer, &total_filled) != 0) {
-							result = 1;
-							break;
-						}
-						back -= chunk;
-					}
 
-					use_front = !use_front;
-				}
-				break;
-			}
+/**
+ * Base name of path, which is how files are known inside the --iso image.
+ */
+static const char* target_name(const char* path) {
+	const char* slash = strrchr(path, '/');
 
-			case GAP_STRATEGY_RANDOM:
-				/* handled above */
-				break;
-			}
+	return slash ? slash + 1 : path;
+}
+
+
+/**
+ * stat() of a backup file, looked up in the image with --iso. The files of a
+ * newly created image or of a --tar stream do not count as existing.
+ */
+static int target_stat(const char* path, struct stat* st) {
+	if (output_tar != NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (output_image != NULL) {
+		if (output_image_created) {
+			errno = ENOENT;
+			return -1;
 		}
+		return image_file_stat(output_image, target_name(path), st);
 	}
 
-	free(buffer);
-	if (filled_blocks_out) {
-		*filled_blocks_out = total_filled;
-	}
-	return result;
+	return stat(path, st);
 }
 
 
-static void gap_print_report(const char* path, size_t expected_blocks,
-		size_t blank_before, size_t truncated_before,
-		size_t blank_after, size_t truncated_after,
-		size_t filled_blocks) {
-	double blank_pct_before = 0.0;
-	double trunc_pct_before = 0.0;
-	double blank_pct_after = 0.0;
-	double trunc_pct_after = 0.0;
-
-	if (expected_blocks > 0) {
-		blank_pct_before = (double)blank_before * 100.0 / (double)expected_blocks;
-		trunc_pct_before = (double)truncated_before * 100.0 / (double)expected_blocks;
-		blank_pct_after = (double)blank_after * 100.0 / (double)expected_blocks;
-		trunc_pct_after = (double)truncated_after * 100.0 / (double)expected_blocks;
+/**
+ * Opens a backup file. With --iso the descriptor refers to the file inside the
+ * image and image_fd_base() has to be added to absolute offsets. With --tar it
+ * is the archive, after the header of the file was written.
+ */
+static int target_open(const char* path, int flags, mode_t mode) {
+	if (output_tar != NULL) {
+		return tar_file_open(output_tar, target_name(path));
+	}
+	if (output_image != NULL) {
+		return image_file_open(output_image, target_name(path), flags);
 	}
 
-	printf(_("Gaps report for %s: filled %zu sectors; before %zu zeroed (%.2f%%), %zu missing (%.2f%%); after %zu zeroed (%.2f%%), %zu missing (%.2f%%)\n"),
-		path, filled_blocks,
-		blank_before, blank_pct_before, truncated_before, trunc_pct_before,
-		blank_after, blank_pct_after, truncated_after, trunc_pct_after);
+	return open(path, flags, mode);
 }
 
 
-static int DVDCmpBlocks(dvd_file_t* dvd_file, int fd, int offset, int size,
-		const char* path, const char* label, read_error_strategy_t errorstrat) {
-	unsigned char dvd_buffer[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
-	unsigned char file_buffer[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
-	int remaining = size;
-	int total = size;
-	int to_read = BUFFER_SIZE;
-	int current_offset = offset;
-	size_t compared_blocks = 0;
+static int target_close(int fd) {
+	/* a queued write must not end up in the next file to get fd */
+	writer_drain();
+	if (output_tar != NULL) {
+		return tar_file_close(output_tar, fd);
+	}
+	if (output_image != NULL) {
+		return image_file_close(fd);
+	}
 
-	(void)errorstrat;
+	return close(fd);
+}
 
-	if (lseek(fd, (off_t)offset * DVD_VIDEO_LB_LEN, SEEK_SET) == (off_t)-1) {
-		perror(PACKAGE);
-		return 1;
+
+/**
+ * Path of the sidecar of the VOB at path with suffix appended to its name.
+ * Sidecars are kept in TITLE/.sectors, or in FILE.sectors next to an --iso
+ * image; a --tar stream has none. The length of the directory part is stored
+ * in directory_length. Returns NULL if there is no sidecar or no memory; the
+ * result has to be freed.
+ */
+static char* sidecar_path(const char* path, const char* suffix, size_t* directory_length) {
+	const char* name = target_name(path);
+	char* sidecar;
+	size_t length;
+
+	if (tar_output) {
+		return NULL;
 	}
 
-	while (remaining > 0) {
-		if (to_read > remaining) {
-			to_read = remaining;
+	if (output_image != NULL) {
+		*directory_length = strlen(image_file) + strlen(".sectors");
+		length = *directory_length + strlen(name) + strlen(suffix) + 2;
+		sidecar = malloc(length);
+		if (sidecar == NULL) {
+			return NULL;
+		}
+		snprintf(sidecar, length, "%s.sectors/%s%s", image_file, name, suffix);
+	} else {
+		/* TITLE/VIDEO_TS/NAME becomes TITLE/.sectors/NAME */
+		*directory_length = (size_t)(name - path);
+		if (*directory_length < strlen("VIDEO_TS/")
+				|| strncmp(name - strlen("VIDEO_TS/"), "VIDEO_TS/", strlen("VIDEO_TS/")) != 0) {
+			return NULL;
 		}
+		*directory_length -= strlen("VIDEO_TS/");
+		length = *directory_length + strlen(".sectors/") + strlen(name) + strlen(suffix) + 1;
+		sidecar = malloc(length);
+		if (sidecar == NULL) {
+			return NULL;
+		}
+		snprintf(sidecar, length, "%.*s.sectors/%s%s", (int)*directory_length, path, name, suffix);
+		*directory_length += strlen(".sectors");
+	}
 
-		int act_read = DVDReadBlocks(dvd_file, current_offset, to_read, dvd_buffer);
-		if (act_read != to_read) {
-			if (progress) {
-				fprintf(stdout, "\n");
-			}
-			if (act_read >= 0) {
-				fprintf(stderr, _("Error reading %s at block %d\n"), label, current_offset + act_read);
-			} else {
-				fprintf(stderr, _("Error reading %s at block %d, read error returned\n"), label, current_offset);
-			}
-			return 1;
+	return sidecar;
+}
+
+
+/**
+ * Opens the sector state sidecar of the VOB at path as job->sectors, a new
+ * one if create is set or else the existing one, if it is valid. Without a
+ * sidecar job->sectors is NULL. The sidecar of a file whose sectors are all
+ * good is kept as a header that says so, which --gaps plans from without
+ * reading the file.
+ */
+static void open_sector_map(const char* path, size_t blocks, int create) {
+	char* sidecar;
+	size_t directory_length;
+
+	job->sectors = NULL;
+	sidecar = sidecar_path(path, "", &directory_length);
+	if (sidecar == NULL) {
+		return;
+	}
+
+	if (create) {
+		sidecar[directory_length] = '\0';
+		if (mkdir(sidecar, 0777) != 0 && errno != EEXIST) {
+			fprintf(stderr, _("Failed creating directory %s for the sector states; gaps will be found by reading the files\n"), sidecar);
+			free(sidecar);
+			return;
+		}
+		sidecar[directory_length] = '/';
+		job->sectors = sector_map_create(sidecar, blocks);
+		if (job->sectors == NULL) {
+			fprintf(stderr, _("Failed creating sector state file %s\n"), sidecar);
+			perror(PACKAGE);
 		}
+	} else {
+		job->sectors = sector_map_open(sidecar, blocks);
+		if (job->sectors == NULL && errno != ENOENT) {
+			fprintf(stderr, _("Ignoring sector state file %s, which does not match the disc; reading the file instead\n"), sidecar);
+		}
+	}
+
+	free(sidecar);
+}
+
+
+static void close_sector_map(void) {
+	if (job->sectors != NULL) {
+		sector_map_close(job->sectors);
+		job->sectors = NULL;
+	}
+}
+
+
+/**
+ * Opens the --crc-index checksums of the VOB at path as job->checksums, the
+ * sidecar NAME.crc32c next to the sector states. A copy creates a new index if
+ * create is set; resuming continues the existing one from block done of the
+ * file open as fd. --gaps and --cmp open the existing one, if it is valid.
+ */
+static void open_checksums(int fd, const char* path, size_t blocks, int create, size_t done) {
+	char* sidecar;
+	size_t directory_length;
+
+	job->checksums = NULL;
+	job->checksum_extent = done / CRC_INDEX_EXTENT_BLOCKS;
+	job->checksum_fill = 0;
+	job->checksum_crc = 0;
+	job->checksum_stale = NULL;
+	if (!crc_index) {
+		return;
+	}
+	sidecar = sidecar_path(path, ".crc32c", &directory_length);
+	if (sidecar == NULL) {
+		return;
+	}
+
+	if (create) {
+		sidecar[directory_length] = '\0';
+		if (mkdir(sidecar, 0777) != 0 && errno != EEXIST) {
+			fprintf(stderr, _("Failed creating directory %s for the checksum index\n"), sidecar);
+			perror(PACKAGE);
+			free(sidecar);
+			return;
+		}
+		sidecar[directory_length] = '/';
+		job->checksums = crc_index_create(sidecar, blocks);
+		if (job->checksums == NULL) {
+			fprintf(stderr, _("Failed creating checksum index %s\n"), sidecar);
+			perror(PACKAGE);
+		}
+		free(sidecar);
+		return;
+	}
+
+	job->checksums = crc_index_open(sidecar, blocks);
+	if (job->checksums == NULL) {
+		if (errno != ENOENT) {
+			fprintf(stderr, _("Ignoring checksum index %s, which does not match the disc\n"), sidecar);
+		}
+		free(sidecar);
+		return;
+	}
+
+	if (fill_gaps || repair) {
+		job->checksum_stale = calloc(crc_index_extents(job->checksums), 1);
+		if (job->checksum_stale == NULL) {
+			crc_index_close(job->checksums);
+			job->checksums = NULL;
+		}
+	} else if (done % CRC_INDEX_EXTENT_BLOCKS != 0) {
+		/* the extent the copy stopped in continues from what is in the file */
+		unsigned char* buffer;
+		size_t bytes = done % CRC_INDEX_EXTENT_BLOCKS * DVD_VIDEO_LB_LEN;
+		off_t start = (off_t)job->checksum_extent * CRC_INDEX_EXTENT_BLOCKS * DVD_VIDEO_LB_LEN;
+
+		buffer = malloc(bytes);
+		if (buffer == NULL || read_existing_range(fd, start, buffer, bytes) != (ssize_t)bytes
+				|| lseek(fd, image_fd_base(fd) + (off_t)done * DVD_VIDEO_LB_LEN, SEEK_SET) == (off_t)-1) {
+			fprintf(stderr, _("Failed reading back %s; removing its checksum index %s\n"), path, sidecar);
+			crc_index_close(job->checksums);
+			job->checksums = NULL;
+			unlink(sidecar);
+		} else {
+			job->checksum_crc = crc32c(0, buffer, bytes);
+			job->checksum_fill = bytes;
+		}
+		free(buffer);
+	}
+
+	free(sidecar);
+}
+
+
+/**
+ * Adds the next length bytes of the file open_checksums() was called for, or
+ * zeros if data is NULL, to its checksum index.
+ */
+static void checksum_data(const unsigned char* data, size_t length) {
+	static const unsigned char zeros[CRC_INDEX_EXTENT_BLOCKS * DVD_VIDEO_LB_LEN];
+	const size_t extent_bytes = CRC_INDEX_EXTENT_BLOCKS * DVD_VIDEO_LB_LEN;
+
+	if (job->checksums == NULL) {
+		return;
+	}
+
+	while (length > 0) {
+		size_t part = extent_bytes - job->checksum_fill;
+
+		if (part > length) {
+			part = length;
+		}
+		job->checksum_crc = crc32c(job->checksum_crc, data != NULL ? data : zeros, part);
+		job->checksum_fill += part;
+		if (job->checksum_fill == extent_bytes) {
+			crc_index_set(job->checksums, job->checksum_extent++, job->checksum_crc);
+			job->checksum_crc = 0;
+			job->checksum_fill = 0;
+		}
+		if (data != NULL) {
+			data += part;
+		}
+		length -= part;
+	}
+}
+
+
+/* Notes that a --gaps run rewrote count blocks from block start. */
+static void checksum_invalidate(size_t start, size_t count) {
+	size_t extent;
+
+	if (job->checksum_stale == NULL || count == 0) {
+		return;
+	}
+
+	for (extent = start / CRC_INDEX_EXTENT_BLOCKS;
+			extent <= (start + count - 1) / CRC_INDEX_EXTENT_BLOCKS
+			&& extent < crc_index_extents(job->checksums); ++extent) {
+		job->checksum_stale[extent] = 1;
+	}
+}
+
+
+/**
+ * Stores the checksum of the last, short extent of a copy, or checksums the
+ * extents of the file at path, open as fd, that a --gaps run rewrote again,
+ * and closes the index.
+ */
+static void close_checksums(int fd, const char* path, size_t blocks) {
+	if (job->checksums == NULL) {
+		return;
+	}
+
+	if (job->checksum_fill > 0) {
+		crc_index_set(job->checksums, job->checksum_extent, job->checksum_crc);
+	}
+
+	if (job->checksum_stale != NULL && output_flush(path) == 0) {
+		unsigned char buffer[CRC_INDEX_EXTENT_BLOCKS * DVD_VIDEO_LB_LEN];
+		size_t extent;
+
+		for (extent = 0; extent < crc_index_extents(job->checksums); ++extent) {
+			size_t first = extent * CRC_INDEX_EXTENT_BLOCKS;
+			size_t count = blocks - first < CRC_INDEX_EXTENT_BLOCKS ? blocks - first : CRC_INDEX_EXTENT_BLOCKS;
+
+			if (!job->checksum_stale[extent]) {
+				continue;
+			}
+			/* a short read leaves zeros, which is what a later copy would pad */
+			if (read_existing_range(fd, (off_t)first * DVD_VIDEO_LB_LEN, buffer,
+					count * DVD_VIDEO_LB_LEN) < 0) {
+				perror(PACKAGE);
+				break;
+			}
+			crc_index_set(job->checksums, extent, crc32c(0, buffer, count * DVD_VIDEO_LB_LEN));
+		}
+	}
+	free(job->checksum_stale);
+	job->checksum_stale = NULL;
+
+	crc_index_close(job->checksums);
+	job->checksums = NULL;
+}
+
+
+/**
+ * Path of the file name that belongs to the title directory of the backup
+ * file at path, TITLE/VIDEO_TS/NAME, or of the file with image_suffix
+ * appended to the name of an --iso image. Returns NULL if there is no title
+ * directory or no memory; the result has to be freed.
+ */
+static char* title_file_path(const char* path, const char* name, const char* image_suffix) {
+	const char* base = target_name(path);
+	size_t directory_length;
+	size_t length;
+	char* result;
+
+	if (output_image != NULL) {
+		length = strlen(image_file) + strlen(image_suffix) + 1;
+		result = malloc(length);
+		if (result != NULL) {
+			snprintf(result, length, "%s%s", image_file, image_suffix);
+		}
+		return result;
+	}
+
+	directory_length = (size_t)(base - path);
+	if (directory_length < strlen("VIDEO_TS/")
+			|| strncmp(base - strlen("VIDEO_TS/"), "VIDEO_TS/", strlen("VIDEO_TS/")) != 0) {
+		return NULL;
+	}
+	directory_length -= strlen("VIDEO_TS/");
+	length = directory_length + strlen(name) + 1;
+	result = malloc(length);
+	if (result != NULL) {
+		snprintf(result, length, "%.*s%s", (int)directory_length, path, name);
+	}
+	return result;
+}
+
+
+/**
+ * Opens the resume journal for the copy identified by key as job->journal.
+ * The journal of the VOB at path is TITLE/.journal, or FILE.journal next to an
+ * --iso image. There is none without --journal or --resume, or with --tar or
+ * --gaps, so that job->journal stays NULL.
+ */
+static void open_journal(const char* path, uint32_t key) {
+	char* journal_path;
+
+	job->journal = NULL;
+	job->journal_key = key;
+	job->journal_unsynced = 0;
+	if (tar_output || fill_gaps || journal_interval == 0) {
+		return;
+	}
+
+	journal_path = title_file_path(path, ".journal", ".journal");
+	if (journal_path == NULL) {
+		return;
+	}
+
+	job->journal = journal_open(journal_path);
+	if (job->journal == NULL) {
+		fprintf(stderr, _("Failed opening resume journal %s; the copy cannot be resumed\n"), journal_path);
+		perror(PACKAGE);
+	}
+
+	free(journal_path);
+}
+
+
+static void close_journal(void) {
+	if (job->journal != NULL) {
+		journal_close(job->journal);
+		job->journal = NULL;
+	}
+}
+
+
+/**
+ * With --resume, looks up where the copy of job->journal_key got to. Returns 1
+ * and fills entry if it was interrupted or completed before.
+ */
+static int journal_resume_point(journal_entry_t* entry) {
+	if (!resume || job->journal == NULL) {
+		return 0;
+	}
+
+	return journal_lookup(job->journal, job->journal_key, entry) == 1;
+}
+
+
+/**
+ * Records in the resume journal that the copy continues at cell and disc
+ * sector with position bytes of the file at path complete, once written bytes
+ * add up to journal_interval MiB since the last entry or right away if force
+ * is set. The file is synced first, so that the journal never gets ahead of
+ * the data. If the journal cannot be written the copy goes on without it.
+ */
+static void journal_checkpoint(int fd, const char* path, int cell, int sector,
+		off_t position, off_t written, int force) {
+	journal_entry_t entry;
+
+	if (job->journal == NULL) {
+		return;
+	}
+
+	job->journal_unsynced += written;
+	if (!force && job->journal_unsynced < (off_t)journal_interval * 1024 * 1024) {
+		return;
+	}
+	job->journal_unsynced = 0;
+
+	snprintf(entry.file, sizeof(entry.file), "%s", target_name(path));
+	entry.cell = cell;
+	entry.sector = sector;
+	entry.blocks = (int)(position / DVD_VIDEO_LB_LEN);
+
+	if (output_flush(path) != 0
+#ifdef HAVE_FDATASYNC
+			|| fdatasync(fd) != 0
+#else
+			|| fsync(fd) != 0
+#endif
+			|| journal_append(job->journal, job->journal_key, &entry) != 0) {
+		fprintf(stderr, _("Failed writing the resume journal for %s; continuing without it\n"), path);
+		perror(PACKAGE);
+		close_journal();
+	}
+}
+
+
+/**
+ * Puts the XXH64 digest of the length bytes of the backup file at path, of
+ * which padded blocks were padded after read errors, into the --manifest in
+ * place of the entry the file had, or only removes that entry if entry is 0.
+ * The manifest is TITLE/MANIFEST, or FILE.manifest next to an --iso image;
+ * the entries of the files a rip does not write are kept. It is rewritten
+ * into a new file that replaces it, so it is never left half written.
+ */
+static void manifest_update(const char* title_name, const char* path, int entry, uint64_t digest,
+		uint64_t length, size_t padded) {
+	char* manifest_path;
+	char* new_path;
+	char suffix[MAXNAME];
+	char line[MAXNAME];
+	FILE* old;
+	FILE* file;
+	size_t suffix_length;
+	int error;
+
+	manifest_path = title_file_path(path, "MANIFEST", ".manifest");
+	if (manifest_path == NULL) {
+		return;
+	}
+	new_path = malloc(strlen(manifest_path) + sizeof(".new"));
+	if (new_path == NULL) {
+		fprintf(stderr, _("Out of memory updating manifest %s\n"), manifest_path);
+		free(manifest_path);
+		return;
+	}
+	sprintf(new_path, "%s.new", manifest_path);
+	snprintf(suffix, sizeof(suffix), " VIDEO_TS/%s\n", target_name(path));
+	suffix_length = strlen(suffix);
+
+	old = fopen(manifest_path, "r");
+	if (old == NULL && (errno != ENOENT || !entry)) {
+		if (errno != ENOENT) {
+			fprintf(stderr, _("Failed opening manifest %s\n"), manifest_path);
+			perror(PACKAGE);
+		}
+		free(new_path);
+		free(manifest_path);
+		return;
+	}
+	file = fopen(new_path, "w");
+	if (file == NULL) {
+		fprintf(stderr, _("Failed opening manifest %s\n"), new_path);
+		perror(PACKAGE);
+		if (old != NULL) {
+			fclose(old);
+		}
+		free(new_path);
+		free(manifest_path);
+		return;
+	}
+
+	if (old == NULL) {
+		fprintf(file, "# %s manifest of %s\n", PACKAGE_STRING, title_name);
+		fprintf(file, "# xxh64            bytes padded-blocks file\n");
+	} else {
+		/* every line but the old entry of the file, which the new one replaces */
+		while (fgets(line, sizeof(line), old) != NULL) {
+			size_t line_length = strlen(line);
+
+			if (line[0] != '#' && line_length >= suffix_length
+					&& strcmp(line + line_length - suffix_length, suffix) == 0) {
+				if (entry) {
+					fprintf(file, "%016" PRIx64 " %" PRIu64 " %zu VIDEO_TS/%s\n", digest, length,
+							padded, target_name(path));
+					entry = 0;
+				}
+				continue;
+			}
+			fputs(line, file);
+		}
+		error = ferror(old);
+		fclose(old);
+		if (error) {
+			fprintf(stderr, _("Error reading manifest %s\n"), manifest_path);
+			fclose(file);
+			unlink(new_path);
+			free(new_path);
+			free(manifest_path);
+			return;
+		}
+	}
+	if (entry) {
+		fprintf(file, "%016" PRIx64 " %" PRIu64 " %zu VIDEO_TS/%s\n", digest, length, padded, target_name(path));
+	}
+
+	if (fclose(file) != 0 || rename(new_path, manifest_path) != 0) {
+		fprintf(stderr, _("Error writing manifest %s\n"), manifest_path);
+		perror(PACKAGE);
+		unlink(new_path);
+	}
+
+	free(new_path);
+	free(manifest_path);
+}
+
+
+/**
+ * Starts hashing the backup file that is about to be written on a thread of
+ * its own, if there is a --manifest.
+ */
+static void manifest_begin(const char* path) {
+	job->hasher = NULL;
+	job->manifest_padded = 0;
+	if (!manifest) {
+		return;
+	}
+	job->manifest_pending = 1;
+
+	job->hasher = hasher_start((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
+	if (job->hasher == NULL) {
+		fprintf(stderr, _("Failed to start hashing %s; it is left out of the manifest\n"), path);
+		perror(PACKAGE);
+	}
+}
+
+
+/**
+ * Hashes the next length bytes of the file manifest_begin() was called for,
+ * or zeros if data is NULL. The data is copied, so the caller may reuse it.
+ */
+static void manifest_data(const unsigned char* data, size_t length) {
+	if (job->hasher != NULL) {
+		hasher_feed(job->hasher, data, length);
+	}
+}
+
+
+/**
+ * Finishes the hash of the file at path and puts it into the manifest, or
+ * removes the old entry of the file if its copy failed or was not hashed.
+ * Only the first call after manifest_begin() does anything.
+ */
+static void manifest_end(const char* title_name, const char* path, int result) {
+	uint64_t length = 0;
+	uint64_t digest = 0;
+
+	if (!job->manifest_pending) {
+		return;
+	}
+	job->manifest_pending = 0;
+
+	if (job->hasher != NULL) {
+		digest = hasher_finish(job->hasher, &length);
+		job->hasher = NULL;
+	} else {
+		result = 1;
+	}
+	manifest_update(title_name, path, result == 0, digest, length, job->manifest_padded);
+}
+
+
+/**
+ * Cuts a backup file that is resumed after blocks blocks back to them and
+ * positions fd there. Files inside an --iso image keep their size.
+ */
+static int resume_output(int fd, const char* path, int blocks) {
+	off_t length = (off_t)blocks * DVD_VIDEO_LB_LEN;
+
+	if ((image_fd_length(fd) < 0 && ftruncate(fd, length) != 0)
+			|| lseek(fd, image_fd_base(fd) + length, SEEK_SET) == (off_t)-1) {
+		fprintf(stderr, _("Error resuming %s\n"), path);
+		perror(PACKAGE);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Opens an output VOB. With --direct-io O_DIRECT is tried first and dropped
+ * again for file systems like tmpfs that refuse it.
+ */
+static int open_output(const char* path, int flags, mode_t mode) {
+#ifdef O_DIRECT
+	if (direct_io && !fill_gaps) {
+		int fd = target_open(path, flags | O_DIRECT, mode);
+		if (fd != -1 || errno != EINVAL) {
+			return fd;
+		}
+		if (verbose > 0) {
+			fprintf(stderr, _("%s does not support direct I/O; using the page cache.\n"), path);
+		}
+	}
+#endif
+
+	return target_open(path, flags, mode);
+}
+
+
+/**
+ * Like write(), but if the file was opened with O_DIRECT and the kernel
+ * rejects the request (e.g. an offset that is not aligned to the logical
+ * block size of the file system), O_DIRECT is dropped and the write retried.
+ */
+static ssize_t output_append(int fd, const unsigned char* data, size_t length) {
+	ssize_t written;
+
+	if (writer_running) {
+		return writer_queue(fd, -1, data, length) == 0 ? (ssize_t)length : -1;
+	}
+
+	written = write(fd, data, length);
+
+#ifdef O_DIRECT
+	if (written == -1 && errno == EINVAL) {
+		int flags = fcntl(fd, F_GETFL);
+		if (flags != -1 && (flags & O_DIRECT) && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+			written = write(fd, data, length);
+		}
+	}
+#endif
+
+	return written;
+}
+
+
+/**
+ * Leaves length bytes at the current output position unwritten, extending the
+ * file so they read back as zeros without allocating any disk space.
+ */
+static int output_skip(int fd, off_t position, size_t length) {
+	struct stat st;
+	off_t end;
+
+	/* without --async-io the file offset is the output position */
+	if (!async_output) {
+		if (writer_drain() != 0) {
+			return -1;
+		}
+		position = lseek(fd, 0, SEEK_CUR);
+		if (position == (off_t)-1) {
+			return -1;
+		}
+	} else {
+		position += image_fd_base(fd);
+	}
+
+	end = position + (off_t)length;
+	if (fstat(fd, &st) != 0) {
+		return -1;
+	}
+	if (st.st_size < end && ftruncate(fd, end) != 0) {
+		return -1;
+	}
+	if (!async_output && lseek(fd, end, SEEK_SET) == (off_t)-1) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Reserves length bytes of disk space for a newly created output file with
+ * --preallocate, so that large VOBs are not pieced together extent by extent.
+ * Only running out of space is an error; file systems that cannot preallocate
+ * are written as usual.
+ */
+static int preallocate_file(int fd, const char* path, off_t length) {
+	int error = 0;
+
+	/* an --iso image is preallocated as a whole */
+	if (!preallocate || length <= 0 || image_fd_length(fd) >= 0) {
+		return 0;
+	}
+
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	/* keep the size at 0 so that appending and ftruncate() work unchanged */
+	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, length) != 0) {
+		error = errno;
+	}
+#elif defined(HAVE_POSIX_FALLOCATE)
+	/* posix_fallocate() also sets the file size, which O_APPEND writers cannot use */
+	if (fcntl(fd, F_GETFL) & O_APPEND) {
+		return 0;
+	}
+	error = posix_fallocate(fd, 0, length);
+#else
+	(void)fd;
+#endif
+
+	if (error == ENOSPC) {
+		fprintf(stderr, _("Not enough free space to preallocate %s\n"), path);
+		errno = error;
+		perror(PACKAGE);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * check_free_space() for an --iso image, whose previous contents count as free.
+ */
+static int check_image_free_space(off_t needed) {
+	struct statvfs vfs;
+	struct stat st;
+	char* dir;
+	char* slash;
+	off_t available;
+
+	dir = strdup(image_file);
+	if (dir == NULL) {
+		perror(PACKAGE);
+		return 1;
+	}
+	slash = strrchr(dir, '/');
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else if (slash == dir) {
+		slash[1] = '\0';
+	} else {
+		*slash = '\0';
+	}
+
+	if (statvfs(dir, &vfs) != 0) {
+		free(dir);
+		return 0;
+	}
+	available = (off_t)vfs.f_bavail * (off_t)vfs.f_frsize;
+	if (stat(image_file, &st) == 0 && S_ISREG(st.st_mode)) {
+		available += (off_t)st.st_blocks * 512;
+	}
+
+	if (available < needed) {
+		fprintf(stderr, _("Not enough free space in %s: %jd MiB needed, %jd MiB available\n"),
+				dir, (intmax_t)(needed >> 20), (intmax_t)(available >> 20));
+		free(dir);
+		return 1;
+	}
+
+	free(dir);
+	return 0;
+}
+
+
+/* title sets for check_free_space() */
+#define ALL_TITLE_SETS -1
+#define NO_TITLE_SET -2
+
+/**
+ * Whether name is one of the IFO, BUP or VOB files of title_set, where 0
+ * stands for the VIDEO_TS.* files and ALL_TITLE_SETS for any of them.
+ */
+static int is_title_set_file(const char* name, int title_set) {
+	int set, vob, length = 0;
+	const char* extension;
+
+	if (strncmp(name, "VIDEO_TS.", 9) == 0) {
+		set = 0;
+		extension = name + 9;
+	} else if (sscanf(name, "VTS_%2d_%1d.%n", &set, &vob, &length) == 2 && length == 9 && set > 0) {
+		extension = name + 9;
+	} else {
+		return 0;
+	}
+	if (strcmp(extension, "IFO") != 0 && strcmp(extension, "BUP") != 0 && strcmp(extension, "VOB") != 0) {
+		return 0;
+	}
+
+	return title_set == ALL_TITLE_SETS || set == title_set;
+}
+
+
+/**
+ * With --preallocate, checks up front that the file system holding the
+ * backup has room for needed more bytes. Space taken by the files of
+ * title_set in VIDEO_TS (see is_title_set_file()), which the copy truncates,
+ * counts as free; NO_TITLE_SET credits none.
+ */
+static int check_free_space(const char* targetdir, const char* title_name, int title_set, off_t needed) {
+	struct statvfs vfs;
+	struct stat st;
+	char* path;
+	size_t path_length;
+	DIR* dir;
+	struct dirent* entry;
+	off_t available;
+
+	if (!preallocate || compare_only || fill_gaps || tar_output) {
+		return 0;
+	}
+	if (image_file != NULL) {
+		return check_image_free_space(needed);
+	}
+
+	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/<filename>" and terminating "\0"
+	path_length = strlen(targetdir) + strlen(title_name) + 12 + MAXNAME;
+	path = malloc(path_length);
+	if (path == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), path_length);
+		return 1;
+	}
+	snprintf(path, path_length, "%s/%s/VIDEO_TS", targetdir, title_name);
+
+	if (statvfs(path, &vfs) != 0) {
+		/* cannot tell; the copy will report ENOSPC itself */
+		free(path);
+		return 0;
+	}
+	available = (off_t)vfs.f_bavail * (off_t)vfs.f_frsize;
+
+	dir = title_set == NO_TITLE_SET ? NULL : opendir(path);
+	if (dir != NULL) {
+		while ((entry = readdir(dir)) != NULL) {
+			if (!is_title_set_file(entry->d_name, title_set)) {
+				continue;
+			}
+			snprintf(path, path_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, entry->d_name);
+			if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+				available += (off_t)st.st_blocks * 512;
+			}
+		}
+		closedir(dir);
+	}
+	free(path);
+
+	if (available < needed) {
+		fprintf(stderr, _("Not enough free space in %s/%s: %jd MiB needed, %jd MiB available\n"),
+				targetdir, title_name, (intmax_t)(needed >> 20), (intmax_t)(available >> 20));
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Number of bytes DVDMirrorTitleX() writes for title set title_set.
+ */
+static off_t title_set_bytes(const title_set_info_t* title_set_info, int title_set) {
+	const title_set_t* set = &title_set_info->title_set[title_set];
+	off_t bytes = 2 * set->size_ifo + set->size_menu;
+	int i;
+
+	for (i = 0; i < set->number_of_vob_files; i++) {
+		bytes += set->size_vob[i];
+	}
+
+	return bytes;
+}
+
+
+/**
+ * Waits until a range that write_behind_push() started is on disk and drops
+ * it from the page cache.
+ */
+static void write_behind_drop(int fd, off_t start, off_t end) {
+	if (end <= start) {
+		return;
+	}
+
+#ifdef HAVE_SYNC_FILE_RANGE
+	sync_file_range(fd, start, end - start,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+	fdatasync(fd);
+#endif
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd, start, end - start, POSIX_FADV_DONTNEED);
+#endif
+}
+
+
+/**
+ * Starts writeback of the current window, then waits for the previous one
+ * and evicts it, so at most two windows of a file are dirty at any time.
+ */
+static void write_behind_push(int fd, write_behind_t* wb) {
+	if (wb->dirty > 0) {
+#ifdef HAVE_SYNC_FILE_RANGE
+		sync_file_range(fd, wb->start, wb->end - wb->start, SYNC_FILE_RANGE_WRITE);
+#endif
+		write_behind_drop(fd, wb->prev_start, wb->prev_end);
+		wb->prev_start = wb->start;
+		wb->prev_end = wb->end;
+	}
+	wb->start = wb->end;
+	wb->dirty = 0;
+}
+
+
+/**
+ * Records that length bytes were written at offset. With --write-behind,
+ * every full window is pushed to disk instead of letting the kernel flush
+ * gigabytes of dirty pages in bursts that stall the DVD reads.
+ */
+static void write_behind_note(int fd, write_behind_t* wb, off_t offset, size_t length) {
+	if (write_behind == 0 || length == 0) {
+		return;
+	}
+	offset += image_fd_base(fd);
+
+	/* gap filling writes out of order; the window then spans all of them */
+	if (wb->dirty == 0) {
+		wb->start = offset;
+		wb->end = offset;
+	}
+	if (offset < wb->start) {
+		wb->start = offset;
+	}
+	if (offset + (off_t)length > wb->end) {
+		wb->end = offset + (off_t)length;
+	}
+	wb->dirty += (off_t)length;
+
+	if (wb->dirty >= (off_t)write_behind << 20) {
+		write_behind_push(fd, wb);
+	}
+}
+
+
+/**
+ * Flushes and evicts everything recorded for fd; called before it is closed.
+ */
+static void write_behind_finish(int fd, write_behind_t* wb) {
+	if (write_behind == 0) {
+		return;
+	}
+
+	write_behind_push(fd, wb);
+	write_behind_drop(fd, wb->prev_start, wb->prev_end);
+	memset(wb, 0, sizeof(*wb));
+}
+
+
+void async_output_setup(void) {
+	if (!async_output) {
+		return;
+	}
+
+	if (output_async_init((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN) != 0) {
+		fprintf(stderr, _("Asynchronous output (io_uring) is not available: %s; using synchronous writes.\n"),
+				strerror(errno));
+		async_output = 0;
+	}
+}
+
+
+/**
+ * Moves the --tar archive away from standard output, which then refers to
+ * standard error, so that progress and report lines cannot end up in it.
+ */
+int tar_output_setup(void) {
+	if (!tar_output) {
+		return 0;
+	}
+
+	if (isatty(STDOUT_FILENO)) {
+		fprintf(stderr, _("Refusing to write a tar archive to a terminal.\n"));
+		return 1;
+	}
+
+	tar_fd = dup(STDOUT_FILENO);
+	if (tar_fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+		perror(PACKAGE);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+void async_output_finish(void) {
+	unsigned long long writes;
+	unsigned int peak;
+	double average;
+
+	if (!async_output) {
+		return;
+	}
+
+	output_async_stats(&writes, &peak, &average);
+	if (verbose > 0) {
+		fprintf(stderr, _("Asynchronous output: %llu writes, queue depth peak %u, average %.1f of %d\n"),
+				writes, peak, average, OUTPUT_QUEUE_DEPTH);
+	}
+	output_async_shutdown();
+}
+
+
+void gap_map_reset(void) {
+	free(job->gap_map_info.entries);
+	job->gap_map_info.entries = NULL;
+	job->gap_map_info.count = 0;
+	job->gap_map_info.capacity = 0;
+	job->gap_map_total_blocks = 0;
+	job->gap_map_bad_blocks = 0;
+}
+
+
+static int gap_map_add_entry(size_t start_block, size_t block_count) {
+	gap_map_entry_t* entry;
+
+	if (block_count == 0) {
+		return 0;
+	}
+
+	if (job->gap_map_info.count == job->gap_map_info.capacity) {
+		size_t new_capacity = job->gap_map_info.capacity == 0 ? 32 : job->gap_map_info.capacity * 2;
+		gap_map_entry_t* new_entries = realloc(job->gap_map_info.entries, new_capacity * sizeof(*new_entries));
+		if (new_entries == NULL) {
+			return -1;
+		}
+		job->gap_map_info.entries = new_entries;
+		job->gap_map_info.capacity = new_capacity;
+	}
+
+	entry = &job->gap_map_info.entries[job->gap_map_info.count++];
+	entry->start_block = start_block;
+	entry->block_count = block_count;
+	job->gap_map_bad_blocks += block_count;
+	return 0;
+}
+
+
+static int gap_map_collect_from_plan(size_t base_block, size_t expected_blocks,
+		const gap_plan_t* plan, size_t existing_blocks) {
+	size_t i;
+
+	for (i = 0; i < plan->count; ++i) {
+		if (gap_map_add_entry(base_block + plan->ranges[i].start_block,
+				plan->ranges[i].block_count) != 0) {
+			return -1;
+		}
+	}
+
+	if (existing_blocks < expected_blocks) {
+		size_t missing = expected_blocks - existing_blocks;
+		if (gap_map_add_entry(base_block + existing_blocks, missing) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int gap_map_collect_missing(size_t base_block, size_t expected_blocks) {
+	return gap_map_add_entry(base_block, expected_blocks);
+}
+
+
+void gap_map_render(void) {
+	const int rows = 20;
+	const int cols = 60;
+	char map[20][60];
+	size_t i;
+	const size_t inner_turn = 192;
+	const size_t outer_turn = 432;
+	double pct = 0.0;
+
+	if (job->gap_map_total_blocks == 0) {
+		printf(_("Gap map: no sectors examined.\n"));
+		return;
+	}
+
+	for (int r = 0; r < rows; ++r) {
+		for (int c = 0; c < cols; ++c) {
+			map[r][c] = '.';
+		}
+	}
+
+	for (i = 0; i < job->gap_map_info.count; ++i) {
+		size_t start = job->gap_map_info.entries[i].start_block;
+		size_t end = start + job->gap_map_info.entries[i].block_count;
+		size_t span = job->gap_map_info.entries[i].block_count;
+		size_t step = span / ((size_t)cols / 2 + 1);
+		if (step == 0) {
+			step = 1;
+		}
+		for (size_t block = start; block < end; block += step) {
+			size_t relative = block;
+			if (relative >= job->gap_map_total_blocks) {
+				relative = job->gap_map_total_blocks - 1;
+			}
+			size_t row_index = (relative * (size_t)rows) / job->gap_map_total_blocks;
+			if (row_index >= (size_t)rows) {
+				row_index = (size_t)rows - 1;
+			}
+			size_t turn_range;
+			if (rows > 1) {
+				size_t numerator = (outer_turn - inner_turn) * row_index;
+				size_t denom = (size_t)rows - 1;
+				size_t delta = denom ? numerator / denom : 0;
+				turn_range = inner_turn + delta;
+			} else {
+				turn_range = inner_turn;
+			}
+			if (turn_range == 0) {
+				turn_range = 1;
+			}
+			size_t pos_in_turn = relative % turn_range;
+			int col = (int)((pos_in_turn * (size_t)cols) / turn_range);
+			if (col >= cols) {
+				col = cols - 1;
+			}
+			int row = (int)row_index;
+			map[row][col] = '#';
+		}
+	}
+
+	printf(_("Gap map (rows = inner to outer radius, columns = approximate angle):\n"));
+	for (int r = 0; r < rows; ++r) {
+		printf("|");
+		for (int c = 0; c < cols; ++c) {
+			putchar(map[r][c]);
+		}
+		printf("|\n");
+	}
+	if (job->gap_map_total_blocks > 0) {
+		pct = ((double)job->gap_map_bad_blocks * 100.0) / (double)job->gap_map_total_blocks;
+	}
+	printf(_("# marks sectors that appear blank or missing. Angle is estimated using an average turn length.\n"));
+	printf(_("Gap map summary: %zu of %zu sectors flagged (%.2f%%).\n"),
+		job->gap_map_bad_blocks, job->gap_map_total_blocks, pct);
+}
+
+
+void gap_map_free(void) {
+	free(job->gap_map_info.entries);
+	job->gap_map_info.entries = NULL;
+	job->gap_map_info.count = 0;
+	job->gap_map_info.capacity = 0;
+	job->gap_map_total_blocks = 0;
+	job->gap_map_bad_blocks = 0;
+}
+
+
+/**
+ * Writes count blocks a gap fill read into buffer, the --async-io slot slot
+ * or else -1, to block first of the file open as fd and marks them copied.
+ * Returns 0 on success.
+ */
+static int gap_write_blocks(int fd, const unsigned char* buffer, int slot, size_t first,
+		size_t count, const char* filename) {
+	off_t write_offset = image_fd_base(fd) + (off_t)first * DVD_VIDEO_LB_LEN;
+	ssize_t written;
+
+	if (async_output) {
+		written = output_async_write(fd, slot, count * DVD_VIDEO_LB_LEN, write_offset) == 0
+			? (ssize_t)(count * DVD_VIDEO_LB_LEN) : -1;
+	} else if (writer_running) {
+		written = writer_queue(fd, write_offset, buffer, count * DVD_VIDEO_LB_LEN) == 0
+			? (ssize_t)(count * DVD_VIDEO_LB_LEN) : -1;
+	} else {
+		written = pwrite(fd, buffer, count * DVD_VIDEO_LB_LEN, write_offset);
+	}
+	if (written != (ssize_t)(count * DVD_VIDEO_LB_LEN)) {
+		fprintf(stderr, _("Error writing %s during gap fill\n"), filename);
+		perror(PACKAGE);
+		return 1;
+	}
+	write_behind_note(fd, &job->gap_write_behind, (off_t)first * DVD_VIDEO_LB_LEN,
+			count * DVD_VIDEO_LB_LEN);
+	if (job->sectors != NULL) {
+		sector_map_set(job->sectors, first, count, SECTOR_GOOD);
+	}
+	checksum_invalidate(first, count);
+
+	return 0;
+}
+
+
+static int gap_process_segment(int fd, dvd_file_t* dvd_file, int dvd_offset,
+		size_t segment_start, size_t block_count, const char* filename,
+		read_error_strategy_t errorstrat, unsigned char* buffer,
+		size_t* filled_blocks_out) {
+	size_t cursor = 0;
+
+	while (cursor < block_count) {
+		size_t chunk = block_count - cursor;
+		int blocks_read;
+		size_t usable_blocks = 0;
+		size_t skip_blocks = 0;
+		size_t read_block;
+		unsigned char* target;
+		int slot;
+
+		if (chunk > BUFFER_SIZE) {
+			chunk = BUFFER_SIZE;
+		}
+
+		read_block = segment_start + cursor;
+		target = buffer;
+		slot = -1;
+		if (async_output) {
+			target = output_async_buffer(&slot);
+		}
+		blocks_read = read_blocks(dvd_file, dvd_offset + (int)read_block, (int)chunk, target);
+		if (blocks_read == (int)chunk) {
+			usable_blocks = chunk;
+		} else if (blocks_read > 0) {
+			usable_blocks = (size_t)blocks_read;
+			fprintf(stderr, _("Gap fill warning for %s: read %d of %zu blocks at %zu\n"),
+				filename, blocks_read, chunk, read_block);
+		} else {
+			fprintf(stderr, _("Gap fill error for %s: read failure at block %zu\n"),
+				filename, read_block);
+		}
+
+		if (usable_blocks == 0 && slot >= 0) {
+			output_async_release(slot);
+		}
+
+		if (usable_blocks > 0) {
+			if (gap_write_blocks(fd, target, slot, read_block, usable_blocks, filename) != 0) {
+				return 1;
+			}
+
+			if (filled_blocks_out) {
+				*filled_blocks_out += usable_blocks;
+			}
+		}
+
+		if (usable_blocks < chunk) {
+			size_t remaining = block_count - (cursor + usable_blocks);
+
+			if (remaining == 0) {
+				cursor = block_count;
+				continue;
+			}
+
+			if (errorstrat == STRATEGY_ABORT) {
+				return 1;
+			} else if (errorstrat == STRATEGY_SKIP_BLOCK) {
+				skip_blocks = 1;
+				fprintf(stderr, _("Gap fill: skipping single block for %s\n"), filename);
+			} else {
+				size_t unread = chunk - usable_blocks;
+				if (unread == 0) {
+					unread = 1;
+				}
+				skip_blocks = unread;
+				fprintf(stderr, _("Gap fill: skipping %zu blocks for %s\n"), skip_blocks, filename);
+			}
+
+			if (skip_blocks > remaining) {
+				skip_blocks = remaining;
+			}
+
+			cursor += usable_blocks + skip_blocks;
+		} else {
+			cursor += chunk;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Finds the first data extent at or after block from, in whole blocks clipped
+ * to limit. *data_start is limit if only holes follow. Returns -1 if the file
+ * system cannot report holes.
+ */
+static int next_data_extent(int fd, size_t from, size_t limit,
+		size_t* data_start, size_t* data_end) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	off_t base = image_fd_base(fd);
+	off_t data;
+	off_t hole;
+
+	data = lseek(fd, base + (off_t)from * DVD_VIDEO_LB_LEN, SEEK_DATA);
+	if (data == (off_t)-1) {
+		if (errno == ENXIO) {
+			*data_start = limit;
+			*data_end = limit;
+			return 0;
+		}
+		return -1;
+	}
+
+	hole = lseek(fd, data, SEEK_HOLE);
+	if (hole == (off_t)-1) {
+		return -1;
+	}
+	data -= base;
+	hole -= base;
+
+	/* a block that is only partly a hole still has to be read */
+	*data_start = (size_t)(data / DVD_VIDEO_LB_LEN);
+	*data_end = (size_t)((hole + DVD_VIDEO_LB_LEN - 1) / DVD_VIDEO_LB_LEN);
+	if (*data_start > limit) {
+		*data_start = limit;
+	}
+	if (*data_end > limit) {
+		*data_end = limit;
+	}
+
+	return 0;
+#else
+	(void)fd;
+	(void)from;
+	(void)limit;
+	(void)data_start;
+	(void)data_end;
+	return -1;
+#endif
+}
+
+
+static int scan_existing_file_for_gaps(int fd, size_t expected_blocks, gap_plan_t* plan,
+		size_t* blank_blocks_out, size_t* full_blocks_out, off_t* existing_bytes_out) {
+	struct stat st;
+	off_t existing_bytes;
+	size_t full_blocks;
+	size_t scan_blocks;
+	unsigned char* buffer = NULL;
+	size_t processed = 0;
+	size_t blank_blocks = 0;
+	size_t pending_start = SIZE_MAX;
+	size_t extent_end = 0;
+	int use_extents = 1;
+	off_t saved_offset;
+
+	if (fstat(fd, &st) != 0) {
+		return -1;
+	}
+
+	/* SEEK_DATA/SEEK_HOLE move the file offset, unlike pread() */
+	saved_offset = lseek(fd, 0, SEEK_CUR);
+
+	/* a file inside an --iso image always has its full size */
+	existing_bytes = image_fd_length(fd);
+	if (existing_bytes < 0) {
+		existing_bytes = st.st_size;
+	}
+	if (existing_bytes_out) {
+		*existing_bytes_out = existing_bytes;
+	}
+
+	full_blocks = (size_t)(existing_bytes / DVD_VIDEO_LB_LEN);
+	scan_blocks = full_blocks;
+	if (scan_blocks > expected_blocks) {
+		scan_blocks = expected_blocks;
+	}
+	if (full_blocks_out) {
+		*full_blocks_out = full_blocks;
+	}
+
+	/* the sidecar knows which blocks were never copied without reading any */
+	if (job->sectors != NULL) {
+		processed = sector_map_find(job->sectors, 0, 0);
+		while (processed < scan_blocks) {
+			size_t end = sector_map_find(job->sectors, processed, 1);
+			if (end > scan_blocks) {
+				end = scan_blocks;
+			}
+			if (gap_plan_add(plan, processed, end - processed) != 0) {
+				return -1;
+			}
+			blank_blocks += end - processed;
+			processed = sector_map_find(job->sectors, end, 0);
+		}
+		if (blank_blocks_out) {
+			*blank_blocks_out = blank_blocks;
+		}
+		return 0;
+	}
+
+	if (scan_blocks > 0) {
+		buffer = (unsigned char*)malloc((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
+		if (buffer == NULL) {
+			return -1;
+		}
+	}
+
+	while (processed < scan_blocks) {
+		size_t chunk_blocks;
+		ssize_t bytes;
+		size_t have_blocks;
+		unsigned char blank[BUFFER_SIZE];
+		size_t i;
+
+		/* Holes are blank by definition, so only the data extents need to be
+		 * read. File systems without SEEK_DATA support report the whole file
+		 * as data, older kernels fail with EINVAL and get a full scan. */
+		if (use_extents && processed >= extent_end) {
+			size_t data_start = processed;
+			if (next_data_extent(fd, processed, scan_blocks, &data_start, &extent_end) != 0) {
+				use_extents = 0;
+				extent_end = scan_blocks;
+			}
+			if (data_start > processed) {
+				if (pending_start == SIZE_MAX) {
+					pending_start = processed;
+				}
+				processed = data_start;
+				continue;
+			}
+		} else if (!use_extents) {
+			extent_end = scan_blocks;
+		}
+
+		chunk_blocks = extent_end - processed;
+		if (chunk_blocks > BUFFER_SIZE) {
+			chunk_blocks = BUFFER_SIZE;
+		}
+
+		bytes = pread(fd, buffer, (size_t)chunk_blocks * DVD_VIDEO_LB_LEN,
+			image_fd_base(fd) + (off_t)processed * DVD_VIDEO_LB_LEN);
+		if (bytes < 0) {
+			int saved_errno = errno;
+			free(buffer);
+			lseek(fd, saved_offset, SEEK_SET);
+			errno = saved_errno;
+			return -1;
+		}
+
+		have_blocks = (size_t)bytes / DVD_VIDEO_LB_LEN;
+		if (have_blocks == 0) {
+			break;
+		}
+		if (have_blocks < chunk_blocks) {
+			chunk_blocks = have_blocks;
+		}
+
+		blocks_blank(buffer, chunk_blocks, blank);
+		for (i = 0; i < chunk_blocks; ++i) {
+			size_t block_index = processed + i;
+
+			if (blank[i]) {
+				if (pending_start == SIZE_MAX) {
+					pending_start = block_index;
+				}
+			} else if (pending_start != SIZE_MAX) {
+				size_t run = block_index - pending_start;
+				if (gap_plan_add(plan, pending_start, run) != 0) {
+					free(buffer);
+					lseek(fd, saved_offset, SEEK_SET);
+					return -1;
+				}
+				blank_blocks += run;
+				pending_start = SIZE_MAX;
+			}
+		}
+
+		processed += chunk_blocks;
+	}
+
+	if (pending_start != SIZE_MAX) {
+		size_t run = scan_blocks - pending_start;
+		if (gap_plan_add(plan, pending_start, run) != 0) {
+			free(buffer);
+			lseek(fd, saved_offset, SEEK_SET);
+			return -1;
+		}
+		blank_blocks += run;
+	}
+
+	free(buffer);
+	lseek(fd, saved_offset, SEEK_SET);
+
+	if (blank_blocks_out) {
+		*blank_blocks_out = blank_blocks;
+	}
+
+	return 0;
+}
+
+
+static size_t gap_collect_samples(const gap_plan_t* plan, size_t available_blocks,
+		size_t desired, size_t samples[]) {
+	size_t target;
+	size_t count = 0;
+	size_t i;
+
+	if (available_blocks == 0 || desired == 0) {
+		return 0;
+	}
+
+	target = desired;
+	if (available_blocks < desired) {
+		target = available_blocks;
+	}
+
+	for (i = 0; i < target; ++i) {
+		size_t candidate = (size_t)(((uint64_t)(i + 1) * (uint64_t)available_blocks) / (target + 1));
+		size_t forward = candidate;
+		size_t backward;
+
+		if (candidate >= available_blocks) {
+			candidate = available_blocks - 1;
+		}
+
+		forward = gap_plan_next_good(plan, forward);
+		if (forward >= available_blocks) {
+			backward = gap_plan_prev_good(plan, candidate);
+			if (backward == (size_t)-1) {
+				continue;
+			}
+			forward = backward;
+		}
+
+		if (count > 0 && samples[count - 1] == forward) {
+			continue;
+		}
+
+		samples[count++] = forward;
+	}
+
+	return count;
+}
+
+
+static int gap_verify_samples(int fd, dvd_file_t* dvd_file, int dvd_offset,
+		const char* filename, const size_t samples[], size_t sample_count) {
+	unsigned char dvd_block[DVD_VIDEO_LB_LEN];
+	unsigned char file_block[DVD_VIDEO_LB_LEN];
+	size_t i;
+	ssize_t read_bytes;
+
+	for (i = 0; i < sample_count; ++i) {
+		size_t block = samples[i];
+
+		if (read_blocks(dvd_file, dvd_offset + (int)block, 1, dvd_block) != 1) {
+			fprintf(stderr, _("Error reading %s at block %zu during verification\n"), filename, block);
+			return 1;
+		}
+
+		read_bytes = pread(fd, file_block, DVD_VIDEO_LB_LEN,
+				image_fd_base(fd) + (off_t)block * DVD_VIDEO_LB_LEN);
+		if (read_bytes != DVD_VIDEO_LB_LEN) {
+			fprintf(stderr, _("Error reading existing data from %s during verification\n"), filename);
+			perror(PACKAGE);
+			return 1;
+		}
+
+		if (memcmp(dvd_block, file_block, DVD_VIDEO_LB_LEN) != 0) {
+			fprintf(stderr, _("Verification sample mismatch for %s at sector %zu\n"), filename, block);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Blocks the first rescue copy passes skip after a failed read, doubling per failure */
+#define RESCUE_SKIP_MIN 32
+#define RESCUE_SKIP_MAX (BUFFER_SIZE * 64)
+
+/*
+ * State of a --gap-strategy=rescue run over one file. pending holds the
+ * blocks still to read, untried those no read has covered yet and bad those
+ * a single block read failed on.
+ */
+typedef struct {
+	int fd;
+	dvd_file_t* dvd_file;
+	int dvd_offset;
+	const char* filename;
+	unsigned char* buffer;
+	gap_plan_t pending;
+	gap_plan_t untried;
+	gap_plan_t bad;
+	double deadline;
+	size_t filled;
+} gap_rescue_t;
+
+
+static int gap_rescue_expired(const gap_rescue_t* rescue) {
+	return rescue->deadline > 0 && monotonic_seconds() >= rescue->deadline;
+}
+
+
+/**
+ * Reads count blocks from first and writes the ones read. Returns the number
+ * of blocks read from the start of the range, or -1 on a write or memory
+ * error.
+ */
+static int gap_rescue_read(gap_rescue_t* rescue, size_t first, size_t count) {
+	unsigned char* target = rescue->buffer;
+	int slot = -1;
+	int blocks_read;
+
+	if (async_output) {
+		target = output_async_buffer(&slot);
+	}
+	blocks_read = read_blocks(rescue->dvd_file, rescue->dvd_offset + (int)first,
+			(int)count, target);
+	if (blocks_read <= 0) {
+		if (slot >= 0) {
+			output_async_release(slot);
+		}
+		return 0;
+	}
+	if ((size_t)blocks_read > count) {
+		blocks_read = (int)count;
+	}
+
+	if (gap_write_blocks(rescue->fd, target, slot, first, (size_t)blocks_read,
+				rescue->filename) != 0
+			|| gap_plan_subtract(&rescue->pending, first, (size_t)blocks_read) != 0) {
+		return -1;
+	}
+	rescue->filled += (size_t)blocks_read;
+
+	return blocks_read;
+}
+
+
+/**
+ * Reads the untried blocks in BUFFER_SIZE chunks. With skipping, every failed
+ * chunk skips a growing number of blocks to get past a damaged area quickly;
+ * those stay untried for the next pass. Returns 1 on error.
+ */
+static int gap_rescue_copy_pass(gap_rescue_t* rescue, int reverse, int skipping) {
+	gap_plan_t snapshot = {NULL, 0, 0};
+	int result = 0;
+
+	if (gap_plan_merge(&snapshot, &rescue->untried) != 0) {
+		return 1;
+	}
+
+	for (size_t i = 0; i < snapshot.count && result == 0; ++i) {
+		const gap_range_t* range = &snapshot.ranges[reverse ? snapshot.count - 1 - i : i];
+		size_t low = range->start_block;
+		size_t high = range->start_block + range->block_count;
+		size_t skip = RESCUE_SKIP_MIN;
+
+		while (low < high) {
+			size_t chunk = high - low;
+			size_t first;
+			int blocks_read;
+
+			if (gap_rescue_expired(rescue)) {
+				result = -1;
+				break;
+			}
+			if (chunk > BUFFER_SIZE) {
+				chunk = BUFFER_SIZE;
+			}
+			first = reverse ? high - chunk : low;
+
+			blocks_read = gap_rescue_read(rescue, first, chunk);
+			if (blocks_read < 0 || gap_plan_subtract(&rescue->untried, first, chunk) != 0) {
+				result = 1;
+				break;
+			}
+			if (reverse) {
+				high -= chunk;
+			} else {
+				low += chunk;
+			}
+
+			if ((size_t)blocks_read == chunk) {
+				skip = RESCUE_SKIP_MIN;
+			} else if (skipping) {
+				size_t skipped = skip < high - low ? skip : high - low;
+
+				if (reverse) {
+					high -= skipped;
+				} else {
+					low += skipped;
+				}
+				if (skip < RESCUE_SKIP_MAX) {
+					skip *= 2;
+				}
+			}
+		}
+	}
+
+	gap_plan_free(&snapshot);
+	/* running out of time is not an error */
+	return result > 0;
+}
+
+
+/**
+ * Reads the pending blocks one at a time. Blocks already known bad are left
+ * alone when scraping; when trimming only the edges of each range are read,
+ * up to the first failure from either side. Failures are added to the bad
+ * plan. Returns 1 on error.
+ */
+static int gap_rescue_block_pass(gap_rescue_t* rescue, int reverse, int trimming) {
+	gap_plan_t snapshot = {NULL, 0, 0};
+	int result = 0;
+
+	if (gap_plan_merge(&snapshot, &rescue->pending) != 0) {
+		return 1;
+	}
+
+	for (size_t i = 0; i < snapshot.count && result == 0; ++i) {
+		const gap_range_t* range = &snapshot.ranges[reverse ? snapshot.count - 1 - i : i];
+		size_t low = range->start_block;
+		size_t high = range->start_block + range->block_count;
+		int from_low = !reverse;
+
+		while (low < high) {
+			size_t block = from_low ? low : high - 1;
+			int blocks_read = 0;
+
+			if (gap_rescue_expired(rescue)) {
+				result = -1;
+				break;
+			}
+
+			if (trimming || !gap_plan_contains(&rescue->bad, block)) {
+				blocks_read = gap_rescue_read(rescue, block, 1);
+				if (blocks_read < 0
+						|| (blocks_read == 0 && gap_plan_add(&rescue->bad, block, 1) != 0)) {
+					result = 1;
+					break;
+				}
+			}
+			if (from_low) {
+				low++;
+			} else {
+				high--;
+			}
+
+			if (trimming && blocks_read == 0) {
+				if (!from_low) {
+					break;
+				}
+				/* trim the trailing edge next */
+				from_low = 0;
+			}
+		}
+	}
+
+	gap_plan_free(&snapshot);
+	return result > 0;
+}
+
+
+/**
+ * Fills the plan in the phases of a data rescue: copy passes that skip over
+ * damaged areas, trimming of the edges of what is left, scraping of the rest
+ * block by block, and --rescue-retries retry passes alternating direction.
+ * Every phase gives up after --rescue-time seconds.
+ */
+static int gap_rescue_plan(int fd, dvd_file_t* dvd_file, int dvd_offset,
+		const gap_plan_t* plan, const char* filename, unsigned char* buffer,
+		size_t* filled_blocks_out) {
+	gap_rescue_t rescue;
+	int result = 0;
+
+	memset(&rescue, 0, sizeof(rescue));
+	rescue.fd = fd;
+	rescue.dvd_file = dvd_file;
+	rescue.dvd_offset = dvd_offset;
+	rescue.filename = filename;
+	rescue.buffer = buffer;
+
+	if (gap_plan_merge(&rescue.pending, plan) != 0
+			|| gap_plan_merge(&rescue.untried, plan) != 0) {
+		result = 1;
+	}
+
+	for (int phase = 0; phase < 3 + rescue_retries && result == 0
+			&& rescue.pending.count > 0; ++phase) {
+		double started = monotonic_seconds();
+		size_t filled_before = rescue.filled;
+		const char* phase_name;
+
+		rescue.deadline = rescue_time > 0 ? started + rescue_time : 0;
+		switch (phase) {
+		case 0:
+			/* forward and reverse with skipping, then forward over what was skipped */
+			phase_name = _("copy");
+			result = gap_rescue_copy_pass(&rescue, 0, 1);
+			if (result == 0 && !gap_rescue_expired(&rescue)) {
+				result = gap_rescue_copy_pass(&rescue, 1, 1);
+			}
+			if (result == 0 && !gap_rescue_expired(&rescue)) {
+				result = gap_rescue_copy_pass(&rescue, 0, 0);
+			}
+			break;
+		case 1:
+			phase_name = _("trim");
+			result = gap_rescue_block_pass(&rescue, 0, 1);
+			break;
+		case 2:
+			phase_name = _("scrape");
+			result = gap_rescue_block_pass(&rescue, 0, 0);
+			break;
+		default:
+			/* the first retry goes backwards, the scrape having gone forwards */
+			phase_name = _("retry");
+			gap_plan_free(&rescue.bad);
+			result = gap_rescue_block_pass(&rescue, (phase - 3) % 2 == 0, 0);
+			break;
+		}
+
+		fprintf(stderr, _("Rescue of %s: %s phase read %zu blocks in %.1f s, %zu left\n"),
+				filename, phase_name, rescue.filled - filled_before,
+				monotonic_seconds() - started, gap_plan_blocks(&rescue.pending));
+	}
+
+	gap_plan_free(&rescue.pending);
+	gap_plan_free(&rescue.untried);
+	gap_plan_free(&rescue.bad);
+	*filled_blocks_out += rescue.filled;
+	return result;
+}
+
+
+static int gap_fill_from_plan(int fd, dvd_file_t* dvd_file, int dvd_offset,
+		const gap_plan_t* plan, const char* filename,
+		read_error_strategy_t errorstrat, size_t* filled_blocks_out) {
+	unsigned char* buffer;
+	size_t total_filled = 0;
+	size_t range_index;
+	int result = 0;
+
+	if (plan->count == 0) {
+		if (filled_blocks_out) {
+			*filled_blocks_out = 0;
+		}
+		return 0;
+	}
+
+	buffer = (unsigned char*)malloc((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
+	if (buffer == NULL) {
+		if (filled_blocks_out) {
+			*filled_blocks_out = 0;
+		}
+		return 1;
+	}
+
+	if (gap_strategy == GAP_STRATEGY_RESCUE) {
+		result = gap_rescue_plan(fd, dvd_file, dvd_offset, plan, filename, buffer,
+				&total_filled);
+	} else if (gap_strategy == GAP_STRATEGY_RANDOM) {
+		gap_fill_segment_t* segments = NULL;
+		size_t segment_count = 0;
+		size_t segment_capacity = 0;
+
+		for (range_index = 0; range_index < plan->count; ++range_index) {
+			size_t produced = 0;
+			size_t range_start = plan->ranges[range_index].start_block;
+			size_t range_blocks = plan->ranges[range_index].block_count;
+
+			while (produced < range_blocks) {
+				size_t chunk = range_blocks - produced;
+				if (chunk > BUFFER_SIZE) {
+					chunk = BUFFER_SIZE;
+				}
+				if (segment_count == segment_capacity) {
+					size_t new_capacity = segment_capacity == 0 ? 32 : segment_capacity * 2;
+					gap_fill_segment_t* new_segments = realloc(segments, new_capacity * sizeof(*new_segments));
+					if (new_segments == NULL) {
+						free(segments);
+						free(buffer);
+						if (filled_blocks_out) {
+							*filled_blocks_out = total_filled;
+						}
+						return 1;
+					}
+					segments = new_segments;
+					segment_capacity = new_capacity;
+				}
+				segments[segment_count].start_block = range_start + produced;
+				segments[segment_count].block_count = chunk;
+				segment_count++;
+				produced += chunk;
+			}
+		}
+
+		srand(gap_random_seed_set ? gap_random_seed : 0);
+		for (size_t i = segment_count; i > 1; --i) {
+			size_t j = (size_t)(rand() % (int)i);
+			gap_fill_segment_t temp = segments[i - 1];
+			segments[i - 1] = segments[j];
+			segments[j] = temp;
+		}
+
+		for (size_t i = 0; i < segment_count; ++i) {
+			if (gap_process_segment(fd, dvd_file, dvd_offset,
+					segments[i].start_block, segments[i].block_count,
+					filename, errorstrat, buffer, &total_filled) != 0) {
+				result = 1;
+				break;
+			}
+		}
+
+		free(segments);
+	} else {
+		for (range_index = 0; range_index < plan->count && result == 0; ++range_index) {
+			size_t range_start = plan->ranges[range_index].start_block;
+			size_t range_blocks = plan->ranges[range_index].block_count;
+
+			switch (gap_strategy) {
+			case GAP_STRATEGY_FORWARD:
+				if (gap_process_segment(fd, dvd_file, dvd_offset,
+							range_start, range_blocks, filename,
+							errorstrat, buffer, &total_filled) != 0) {
+					result = 1;
+				}
+				break;
+
+			case GAP_STRATEGY_REVERSE: {
+				size_t processed = 0;
+				while (processed < range_blocks && result == 0) {
+					size_t chunk = range_blocks - processed;
+					if (chunk > BUFFER_SIZE) {
+						chunk = BUFFER_SIZE;
+					}
+					size_t segment_start = range_start + range_blocks - processed - chunk;
+					if (gap_process_segment(fd, dvd_file, dvd_offset,
+								segment_start, chunk, filename,
+								errorstrat, buffer, &total_filled) != 0) {
+						result = 1;
+						break;
+					}
+					processed += chunk;
+				}
+				break;
+			}
+
+			case GAP_STRATEGY_OUTSIDE_IN: {
+				size_t front = 0;
+				size_t back = range_blocks;
+				int use_front = 1;
+				while (front < back && result == 0) {
+					size_t remaining = back - front;
+					size_t chunk = remaining;
+					if (chunk > BUFFER_SIZE) {
+						chunk = BUFFER_SIZE;
+					}
+
+					if (use_front) {
+						size_t segment_start = range_start + front;
+						if (gap_process_segment(fd, dvd_file, dvd_offset,
+									segment_start, chunk, filename,
+									errorstrat, buffer, &total_filled) != 0) {
+							result = 1;
+							break;
+						}
+						front += chunk;
+					} else {
+						size_t segment_start = range_start + (back - chunk);
+						if (gap_process_segment(fd, dvd_file, dvd_offset,
+									segment_start, chunk, filename,
+									errorstrat, buffer, &total_filled) != 0) {
+							result = 1;
+							break;
+						}
+						back -= chunk;
+					}
+
+					use_front = !use_front;
+				}
+				break;
+			}
+
+			case GAP_STRATEGY_RANDOM:
+			case GAP_STRATEGY_RESCUE:
+				/* handled above */
+				break;
+			}
+		}
+	}
+
+	write_behind_finish(fd, &job->gap_write_behind);
+	free(buffer);
+	if (filled_blocks_out) {
+		*filled_blocks_out = total_filled;
+	}
+	return result;
+}
+
+
+static void gap_print_report(const char* path, size_t expected_blocks,
+		size_t blank_before, size_t truncated_before,
+		size_t blank_after, size_t truncated_after,
+		size_t filled_blocks) {
+	double blank_pct_before = 0.0;
+	double trunc_pct_before = 0.0;
+	double blank_pct_after = 0.0;
+	double trunc_pct_after = 0.0;
+
+	if (expected_blocks > 0) {
+		blank_pct_before = (double)blank_before * 100.0 / (double)expected_blocks;
+		trunc_pct_before = (double)truncated_before * 100.0 / (double)expected_blocks;
+		blank_pct_after = (double)blank_after * 100.0 / (double)expected_blocks;
+		trunc_pct_after = (double)truncated_after * 100.0 / (double)expected_blocks;
+	}
+
+	printf(_("Gaps report for %s: filled %zu sectors; before %zu zeroed (%.2f%%), %zu missing (%.2f%%); after %zu zeroed (%.2f%%), %zu missing (%.2f%%)\n"),
+		path, filled_blocks,
+		blank_before, blank_pct_before, truncated_before, trunc_pct_before,
+		blank_after, blank_pct_after, truncated_after, trunc_pct_after);
+}
+
+
+/* The file side of DVDCmpBlocks(), read ahead by a thread of its own */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char* buffers;
+	ssize_t lengths[PIPELINE_DEPTH]; /* bytes read into each slot */
+	int errors[PIPELINE_DEPTH]; /* errno if a read failed */
+	size_t head;
+	size_t count;
+	int reader_done;
+	int cancel;
+
+	int fd;
+	int size;
+} cmp_prefetch_t;
+
+
+/**
+ * Reads the file for DVDCmpBlocks() in BUFFER_SIZE chunks into free ring
+ * slots until size blocks are read, the file ends early or the comparison is
+ * cancelled. A slot with less than a full chunk is the last one.
+ */
+static void* cmp_prefetch_reader(void* arg) {
+	cmp_prefetch_t* prefetch = (cmp_prefetch_t*)arg;
+	int remaining = prefetch->size;
+
+	while (remaining > 0) {
+		size_t slot;
+		size_t chunk_bytes = (size_t)(remaining < BUFFER_SIZE ? remaining : BUFFER_SIZE) * DVD_VIDEO_LB_LEN;
+		unsigned char* buffer;
+		size_t total_read = 0;
+		int error = 0;
+
+		pthread_mutex_lock(&prefetch->lock);
+		while (prefetch->count == PIPELINE_DEPTH && !prefetch->cancel) {
+			pthread_cond_wait(&prefetch->cond, &prefetch->lock);
+		}
+		if (prefetch->cancel) {
+			pthread_mutex_unlock(&prefetch->lock);
+			break;
+		}
+		slot = (prefetch->head + prefetch->count) % PIPELINE_DEPTH;
+		pthread_mutex_unlock(&prefetch->lock);
+
+		buffer = prefetch->buffers + slot * BUFFER_SIZE * DVD_VIDEO_LB_LEN;
+		while (total_read < chunk_bytes) {
+			ssize_t got = read(prefetch->fd, buffer + total_read, chunk_bytes - total_read);
+			if (got < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				error = errno;
+				break;
+			}
+			if (got == 0) {
+				break;
+			}
+			total_read += (size_t)got;
+		}
+
+		pthread_mutex_lock(&prefetch->lock);
+		prefetch->lengths[slot] = error != 0 ? -1 : (ssize_t)total_read;
+		prefetch->errors[slot] = error;
+		prefetch->count++;
+		pthread_cond_broadcast(&prefetch->cond);
+		pthread_mutex_unlock(&prefetch->lock);
+
+		if (total_read < chunk_bytes) {
+			break;
+		}
+		remaining -= BUFFER_SIZE;
+	}
+
+	pthread_mutex_lock(&prefetch->lock);
+	prefetch->reader_done = 1;
+	pthread_cond_broadcast(&prefetch->cond);
+	pthread_mutex_unlock(&prefetch->lock);
+
+	return NULL;
+}
+
+
+/**
+ * Compares size blocks of the disc from offset with the file open as fd,
+ * which is read ahead by a second thread while the disc is read, so the
+ * comparison takes about as long as reading the disc. Without mismatches it
+ * stops at the first difference. With it, for --repair, the pass goes on:
+ * differing blocks and the blocks past a short file are added to mismatches
+ * and a longer file is truncated, and only other errors fail the comparison.
+ */
+static int DVDCmpBlocks(dvd_file_t* dvd_file, int fd, int offset, int size,
+		const char* path, const char* label, read_error_strategy_t errorstrat,
+		gap_plan_t* mismatches) {
+	cmp_prefetch_t prefetch;
+	pthread_t reader;
+	unsigned char* dvd_buffer;
+	int remaining = size;
+	int total = size;
+	int to_read = BUFFER_SIZE;
+	int current_offset = offset;
+	size_t compared_blocks = 0;
+	int result = 0;
+
+	(void)errorstrat;
+
+	/* offset is where the file starts on the disc, the file itself at block 0 */
+	if (lseek(fd, image_fd_base(fd), SEEK_SET) == (off_t)-1) {
+		perror(PACKAGE);
+		return 1;
+	}
+
+	dvd_buffer = alloc_blocks(BUFFER_SIZE);
+	memset(&prefetch, 0, sizeof(prefetch));
+	prefetch.buffers = alloc_blocks((size_t)PIPELINE_DEPTH * BUFFER_SIZE);
+	if (dvd_buffer == NULL || prefetch.buffers == NULL) {
+		fprintf(stderr, _("Out of memory comparing %s\n"), path);
+		free(dvd_buffer);
+		free(prefetch.buffers);
+		return 1;
+	}
+	pthread_mutex_init(&prefetch.lock, NULL);
+	pthread_cond_init(&prefetch.cond, NULL);
+	prefetch.fd = fd;
+	prefetch.size = size;
+
+	if (pthread_create(&reader, NULL, cmp_prefetch_reader, &prefetch) != 0) {
+		fprintf(stderr, _("Failed to start reader thread for %s\n"), path);
+		result = 1;
+		goto prefetch_cleanup;
+	}
+
+	while (remaining > 0) {
+		unsigned char* file_buffer;
+		ssize_t file_bytes;
+		int file_ready;
+
+		if (to_read > remaining) {
+			to_read = remaining;
+		}
+
+		/* the reader thread fills the next slots meanwhile */
+		int act_read = read_blocks(dvd_file, current_offset, to_read, dvd_buffer);
+		if (act_read != to_read) {
+			if (progress) {
+				fprintf(stdout, "\n");
+			}
+			if (act_read >= 0) {
+				fprintf(stderr, _("Error reading %s at block %d\n"), label, current_offset + act_read);
+			} else {
+				fprintf(stderr, _("Error reading %s at block %d, read error returned\n"), label, current_offset);
+			}
+			result = 1;
+			break;
+		}
+
+		pthread_mutex_lock(&prefetch.lock);
+		while (prefetch.count == 0 && !prefetch.reader_done) {
+			pthread_cond_wait(&prefetch.cond, &prefetch.lock);
+		}
+		file_ready = prefetch.count > 0;
+		pthread_mutex_unlock(&prefetch.lock);
+		file_bytes = file_ready ? prefetch.lengths[prefetch.head] : 0;
+		if (file_bytes >= 0 && (size_t)file_bytes < (size_t)act_read * DVD_VIDEO_LB_LEN) {
+			if (progress) {
+				fprintf(stdout, "\n");
+			}
+			fprintf(stderr, _("File %s ended prematurely while comparing\n"), path);
+			if (mismatches == NULL || gap_plan_add(mismatches, compared_blocks, (size_t)remaining) != 0) {
+				result = 1;
+			}
+			break;
+		}
+
+		size_t chunk_bytes = (size_t)act_read * DVD_VIDEO_LB_LEN;
+		file_buffer = prefetch.buffers + prefetch.head * BUFFER_SIZE * DVD_VIDEO_LB_LEN;
+		if (file_bytes < 0) {
+			errno = prefetch.errors[prefetch.head];
+			perror(PACKAGE);
+			result = 1;
+			break;
+		}
+
+		if (memcmp(dvd_buffer, file_buffer, chunk_bytes) != 0) {
+			size_t block_index;
+			int reported = 0;
+			for (block_index = 0; block_index < (size_t)act_read; ++block_index) {
+				if (memcmp(dvd_buffer + block_index * DVD_VIDEO_LB_LEN,
+					file_buffer + block_index * DVD_VIDEO_LB_LEN,
+					DVD_VIDEO_LB_LEN) != 0) {
+					if (!reported) {
+						fprintf(stderr, _("Data mismatch for %s at sector %lld\n"),
+							path, (long long)(current_offset + (int)block_index));
+						reported = 1;
+					}
+					if (mismatches != NULL
+							&& gap_plan_add(mismatches, compared_blocks + block_index, 1) != 0) {
+						result = 1;
+						break;
+					}
+					/* flag every differing block for the next --gaps run */
+					if (job->sectors == NULL && mismatches == NULL) {
+						break;
+					}
+					if (job->sectors != NULL) {
+						sector_map_set(job->sectors, compared_blocks + block_index, 1, SECTOR_MISMATCHED);
+					}
+				}
+			}
+			if (mismatches == NULL || result != 0) {
+				result = 1;
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&prefetch.lock);
+		prefetch.head = (prefetch.head + 1) % PIPELINE_DEPTH;
+		prefetch.count--;
+		pthread_cond_broadcast(&prefetch.cond);
+		pthread_mutex_unlock(&prefetch.lock);
+
+		current_offset += act_read;
+		remaining -= act_read;
+		compared_blocks += (size_t)act_read;
+
+		if (progress) {
+			int done = (int)compared_blocks;
+			if (drive_job_count > 0) {
+				drives_report_progress(done, (int)total);
+			} else if (remaining < BUFFER_SIZE || (done % BUFFER_SIZE) == 0) {
+				float doneMiB = (float)done / 512.0f;
+				float totalMiB = (float)total / 512.0f;
+				fprintf(stdout, "\r");
+				fprintf(stdout, _("Comparing %s: %.0f%% done (%.0f/%.0f MiB)"),
+						job->progress_text, doneMiB / totalMiB * 100.0f, doneMiB, totalMiB);
+				fflush(stdout);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&prefetch.lock);
+	prefetch.cancel = 1;
+	pthread_cond_broadcast(&prefetch.cond);
+	pthread_mutex_unlock(&prefetch.lock);
+	pthread_join(reader, NULL);
+
+prefetch_cleanup:
+	pthread_cond_destroy(&prefetch.cond);
+	pthread_mutex_destroy(&prefetch.lock);
+	free(prefetch.buffers);
+	free(dvd_buffer);
+	if (result != 0) {
+		return 1;
+	}
+
+	unsigned char extra;
+	/* a file inside an --iso image is followed by the next one */
+	ssize_t extra_read = image_fd_length(fd) >= 0 ? 0 : read(fd, &extra, 1);
+	if (extra_read < 0) {
+		perror(PACKAGE);
+		return 1;
+	} else if (extra_read > 0) {
+		fprintf(stderr, _("File %s contains extra data beyond expected size\n"), path);
+		if (mismatches == NULL) {
+			return 1;
+		}
+		fprintf(stderr, _("Truncating %s to the size on the disc\n"), path);
+		if (ftruncate(fd, (off_t)size * DVD_VIDEO_LB_LEN) != 0) {
+			perror(PACKAGE);
+			return 1;
+		}
+	}
+
+	if (progress) {
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
+/**
+ * Compares the file at path, open as fd, against its --crc-index checksums
+ * instead of the disc. Unlike DVDCmpBlocks() it goes on after a mismatch, so
+ * every extent that differs is reported and flagged for the next --gaps run,
+ * which then rereads just those blocks. Sectors the sector states have as
+ * padded, never read or mismatched differ as well, although their zeros were
+ * checksummed. With mismatches, for --repair, the differing blocks and the
+ * blocks past a short file are added to it instead of failing the comparison,
+ * and a longer file is truncated.
+ */
+static int DVDCmpChecksums(int fd, int size, const char* path, gap_plan_t* mismatches) {
+	unsigned char buffer[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
+	size_t extents = crc_index_extents(job->checksums);
+	size_t chunk_extents = BUFFER_SIZE / CRC_INDEX_EXTENT_BLOCKS;
+	size_t mismatch_start = 0;
+	size_t mismatched = 0;
+	int in_mismatch = 0;
+	size_t extent;
+
+	for (extent = 0; extent <= extents; ++extent) {
+		size_t first = extent * CRC_INDEX_EXTENT_BLOCKS;
+		size_t count;
+		int differs = 0;
+
+		if (extent < extents) {
+			count = (size_t)size - first < CRC_INDEX_EXTENT_BLOCKS
+				? (size_t)size - first : CRC_INDEX_EXTENT_BLOCKS;
+
+			/* read a buffer full of extents at a time */
+			if (extent % chunk_extents == 0) {
+				size_t chunk_blocks = (size_t)size - first < BUFFER_SIZE
+					? (size_t)size - first : BUFFER_SIZE;
+				ssize_t got = read_existing_range(fd, (off_t)first * DVD_VIDEO_LB_LEN,
+						buffer, chunk_blocks * DVD_VIDEO_LB_LEN);
+
+				if (got < 0) {
+					perror(PACKAGE);
+					return 1;
+				}
+				if ((size_t)got < chunk_blocks * DVD_VIDEO_LB_LEN) {
+					if (progress) {
+						fprintf(stdout, "\n");
+					}
+					fprintf(stderr, _("File %s ended prematurely while comparing\n"), path);
+					if (mismatches == NULL || gap_plan_add(mismatches, first, (size_t)size - first) != 0) {
+						return 1;
+					}
+					return 0;
+				}
+			}
+
+			differs = crc32c(0, buffer + extent % chunk_extents * CRC_INDEX_EXTENT_BLOCKS * DVD_VIDEO_LB_LEN,
+					count * DVD_VIDEO_LB_LEN) != crc_index_get(job->checksums, extent);
+			if (differs) {
+				mismatched += count;
+				if (job->sectors != NULL) {
+					sector_map_set(job->sectors, first, count, SECTOR_MISMATCHED);
+				}
+				if (mismatches != NULL && gap_plan_add(mismatches, first, count) != 0) {
+					return 1;
+				}
+			} else if (job->sectors != NULL) {
+				/* padded sectors match the zeros they were checksummed as, but not the disc */
+				size_t block = sector_map_find(job->sectors, first, 0);
+
+				while (block < first + count) {
+					size_t end = sector_map_find(job->sectors, block, 1);
+
+					if (end > first + count) {
+						end = first + count;
+					}
+					differs = 1;
+					mismatched += end - block;
+					if (mismatches != NULL && gap_plan_add(mismatches, block, end - block) != 0) {
+						return 1;
+					}
+					block = sector_map_find(job->sectors, end, 0);
+				}
+			}
+		}
+
+		/* report a run of differing extents once it ends */
+		if (differs && !in_mismatch) {
+			mismatch_start = first;
+			in_mismatch = 1;
+		} else if (!differs && in_mismatch) {
+			if (progress) {
+				fprintf(stdout, "\n");
+			}
+			fprintf(stderr, _("Checksum mismatch for %s in blocks %zu-%zu\n"),
+					path, mismatch_start, (first < (size_t)size ? first : (size_t)size) - 1);
+			in_mismatch = 0;
+		}
+
+		if (progress && extent < extents && (extent % chunk_extents == chunk_extents - 1
+				|| extent == extents - 1)) {
+			int done = (int)(first + count);
+			if (drive_job_count > 0) {
+				drives_report_progress(done, size);
+			} else {
+				float doneMiB = (float)done / 512.0f;
+				float totalMiB = (float)size / 512.0f;
+				fprintf(stdout, "\r");
+				fprintf(stdout, _("Verifying %s: %.0f%% done (%.0f/%.0f MiB)"),
+						job->progress_text, doneMiB / totalMiB * 100.0f, doneMiB, totalMiB);
+				fflush(stdout);
+			}
+		}
+	}
+
+	if (progress) {
+		fprintf(stdout, "\n");
+	}
+
+	if (mismatches != NULL && image_fd_length(fd) < 0) {
+		struct stat fileinfo;
+
+		if (fstat(fd, &fileinfo) == 0 && fileinfo.st_size > (off_t)size * DVD_VIDEO_LB_LEN) {
+			fprintf(stderr, _("Truncating %s to the size on the disc\n"), path);
+			if (ftruncate(fd, (off_t)size * DVD_VIDEO_LB_LEN) != 0) {
+				perror(PACKAGE);
+				return 1;
+			}
+		}
+	}
+
+	if (mismatched > 0) {
+		fprintf(stderr, _("%zu of %d blocks of %s differ from the checksum index or were not read\n"),
+				mismatched, size, path);
+		return mismatches != NULL ? 0 : 1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Rewrites the blocks of plan in the file at path, open as fd, which --repair
+ * found to differ from the disc from offset on, with what the disc holds.
+ * Returns 0 if all of them could be read.
+ */
+static int DVDRepairBlocks(dvd_file_t* dvd_file, int fd, int offset, const gap_plan_t* plan,
+		const char* path, const char* label, read_error_strategy_t errorstrat) {
+	size_t planned = gap_plan_blocks(plan);
+	size_t filled = 0;
+	int result;
+
+	fprintf(stderr, _("Repairing %zu blocks of %s\n"), planned, path);
+	result = gap_fill_from_plan(fd, dvd_file, offset, plan, label, errorstrat, &filled);
+	if (output_flush(path) != 0) {
+		result = 1;
+	}
+
+	if (result != 0 || filled < planned) {
+		fprintf(stderr, _("Repaired only %zu of %zu blocks of %s\n"), filled, planned, path);
+		return 1;
+	}
+
+	fprintf(stderr, _("Repaired %zu blocks of %s\n"), filled, path);
+	return 0;
+}
+
+static int CheckSizeArray(const int size_array[], int reference, int target) {
+	if(size_array[target] && (size_array[reference]/size_array[target] == 1) &&
+			((size_array[reference] * 2 - size_array[target])/ size_array[target] == 1) &&
+			((size_array[reference]%size_array[target] * 3) < size_array[reference]) ) {
+		/* We have a dual DVD with two feature films - now let's see if they have the same amount of chapters*/
+		return(1);
+	} else {
+		return(0);
+	}
+}
+
+
+static int CheckAudioSubChannels(int audio_audio_array[], int title_set_audio_array[],
+		int subpicture_sub_array[], int title_set_sub_array[],
+		int channels_channel_array[],int title_set_channel_array[],
+		int reference, int candidate, int title_sets) {
+
+	int temp, i, found_audio, found_sub, found_channels;
+
+	found_audio=0;
+	temp = audio_audio_array[reference];
+	for (i=0 ; i < title_sets ; i++ ) {
+		if ( audio_audio_array[i] < temp ) {
+			break;
+		}
+		if ( candidate == title_set_audio_array[i] ) {
+			found_audio=1;
+			break;
+		}
+
+	}
+
+	found_sub=0;
+	temp = subpicture_sub_array[reference];
+	for (i=0 ; i < title_sets ; i++ ) {
+		if ( subpicture_sub_array[i] < temp ) {
+			break;
+		}
+		if ( candidate == title_set_sub_array[i] ) {
+			found_sub=1;
+			break;
+		}
+
+	}
+
+
+	found_channels=0;
+	temp = channels_channel_array[reference];
+	for (i=0 ; i < title_sets ; i++ ) {
+		if ( channels_channel_array[i] < temp ) {
+			break;
+		}
+		if ( candidate == title_set_channel_array[i] ) {
+			found_channels=1;
+			break;
+		}
+
+	}
+
+
+	return(found_audio + found_sub + found_channels);
+}
+
+
+/**
+ * Opens the sector states of a VOB that -t copies for blocks blocks. With
+ * --gaps the blocks past the end of the file, open as fd, count as never
+ * read, whatever the states say.
+ */
+static void open_cells_sector_map(int fd, const char* path, off_t blocks, int create) {
+	struct stat st;
+	size_t existing;
+
+	open_sector_map(path, (size_t)blocks, create);
+	if (fill_gaps && job->sectors != NULL && fstat(fd, &st) == 0) {
+		existing = (size_t)(st.st_size / DVD_VIDEO_LB_LEN);
+		if (existing < (size_t)blocks) {
+			sector_map_set(job->sectors, existing, (size_t)blocks - existing, SECTOR_NEVER_READ);
+		}
+	}
+}
+
+
+/**
+ * Fills the gaps of a chunk of count blocks that -t copies from disc sector
+ * sector to block first of the VOB open as fd, as its sector states have
+ * them: only the blocks that are not good are read and written. Returns
+ * count, or -1 after an error.
+ */
+static int write_cells_fill_gaps(dvd_file_t* dvd_file, int fd, int sector, int first, int count,
+		unsigned char* buffer) {
+	size_t end = (size_t)first + (size_t)count;
+	size_t start = sector_map_find(job->sectors, (size_t)first, 0);
+	size_t stop;
+	int have_read;
+
+	while (start < end) {
+		stop = sector_map_find(job->sectors, start, 1);
+		if (stop > end) {
+			stop = end;
+		}
+		have_read = read_blocks(dvd_file, sector + (int)(start - (size_t)first), (int)(stop - start), buffer);
+		if (have_read != (int)(stop - start)) {
+			fprintf(stderr, _("Error reading TITLE VOB: %d != %d\n"), have_read, (int)(stop - start));
+			return -1;
+		}
+		if (output_write(fd, (off_t)start * DVD_VIDEO_LB_LEN, buffer, (stop - start) * DVD_VIDEO_LB_LEN, -1) != 0) {
+			fprintf(stderr, _("Error writing TITLE VOB\n"));
+			perror(PACKAGE);
+			return -1;
+		}
+		sector_map_set(job->sectors, start, stop - start, SECTOR_GOOD);
+		start = sector_map_find(job->sectors, stop, 0);
+	}
+
+	return count;
+}
+
+
+static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
+		int cell_end_sector[], int length, int titles,
+		title_set_info_t * title_set_info, titles_info_t * titles_info,
+		char * targetdir,char * title_name) {
+
+	/* Loop variables */
+	int i;
+
+	/* Vob control */
+	int vob = 1;
+
+	/* Temp filename,dirname */
+	char *targetname = NULL;
+	size_t targetname_length;
+
+	/* Write buffers */
+	unsigned char *buffer = NULL;
+	unsigned char *existing_buffer = NULL;
+	unsigned char *read_buffer;
+	int slot = -1;
+
+	/* File Handler */
+	int streamout = -1;
+
+	int size;
+	int left;
+	int to_read;
+	int have_read;
+	int soffset = 0;
+
+	/* DVD handler */
+	dvd_file_t* dvd_file = NULL;
+
+	int title_set;
+	int result = 1;
+	int open_flags;
+	size_t vob_total_blocks = 0;
+	size_t vob_blank_before = 0;
+	size_t vob_blank_after = 0;
+	off_t cells_left = 0;
+	off_t vob_blocks;
+	int from_states;
+	write_behind_t wb = {0};
+
+	/* Where an interrupted copy continues with --resume */
+	int first_cell = 0;
+	int first_sector = -1;
+	journal_entry_t entry;
+	uint32_t key;
+	struct stat fileinfo;
+
+#ifndef DEBUG
+	(void)title_set_info;
+#endif
+
+#ifdef DEBUG
+	int number_of_vob_files;
+	fprintf(stderr,"DVDWriteCells: length is %d\n", length);
+#endif
+
+	title_set = titles_info->titles[titles - 1].title_set;
+#ifdef DEBUG
+	number_of_vob_files = title_set_info->title_set[title_set].number_of_vob_files;
+	fprintf(stderr,"DVDWriteCells: title set is %d\n", title_set);
+	fprintf(stderr,"DVDWriteCells: vob files are %d\n", number_of_vob_files);
+#endif
+
+	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/VTS_XX_X.VOB" and terminating "\0"
+	targetname_length = strlen(targetdir) + strlen(title_name) + 24;
+	targetname = malloc(targetname_length);
+	if (targetname == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
+		goto cleanup;
+	}
+
+	/* the journal knows the copy by the cells it is made of */
+	key = journal_key(JOURNAL_KEY_INIT, &title_set, sizeof(title_set));
+	key = journal_key(key, &length, sizeof(length));
+	key = journal_key(key, cell_start_sector, (size_t)length * sizeof(int));
+	key = journal_key(key, cell_end_sector, (size_t)length * sizeof(int));
+	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
+	open_journal(targetname, key);
+
+	size = 0;
+	if (journal_resume_point(&entry) && sscanf(entry.file, "VTS_%*2d_%d.VOB", &vob) == 1
+			&& vob >= 1 && vob <= 9 && entry.cell >= 0 && entry.cell <= length
+			&& entry.blocks >= 0 && entry.blocks <= MAX_VOB_SIZE) {
+		if (entry.cell == length) {
+			fprintf(stderr, _("The chapters of title %d were copied before; skipping.\n"), titles);
+			result = 0;
+			goto cleanup;
+		}
+		snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
+		if (stat(targetname, &fileinfo) == 0 && (off_t)entry.blocks * DVD_VIDEO_LB_LEN <= fileinfo.st_size
+				&& entry.sector >= cell_start_sector[entry.cell] && entry.sector <= cell_end_sector[entry.cell]) {
+			first_cell = entry.cell;
+			first_sector = entry.sector;
+			size = entry.blocks;
+			/* the last entry was written just before the next VOB was started */
+			if (size >= MAX_VOB_SIZE) {
+				vob++;
+				size = 0;
+			}
+			fprintf(stderr, _("The copy of title %d was interrupted; resuming in %s at block %d.\n"),
+					titles, targetname, entry.blocks);
+		} else {
+			vob = 1;
+		}
+	} else {
+		vob = 1;
+	}
+
+	/* Remove all old files silently if they exists, except the ones resumed */
+	if (!fill_gaps) {
+		for (i = first_sector >= 0 ? vob : 0; i < 10; i++) {
+			snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, i + 1);
+#ifdef DEBUG
+			fprintf(stderr,"DVDWriteCells: file is %s\n", targetname);
+#endif
+			unlink(targetname);
+		}
+	}
+
+#ifdef DEBUG
+	for (i = 0; i < number_of_vob_files; i++) {
+		fprintf(stderr,"vob %i size: %lld\n", i + 1, title_set_info->title_set[title_set].size_vob[i]);
+	}
+#endif
+
+	/* Create VTS_XX_X.VOB */
+	if (title_set == 0) {
+		fprintf(stderr,_("Do not try to copy chapters from the VMG domain; there are none.\n"));
+		goto cleanup;
+	} else {
+		snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
+	}
+
+#ifdef DEBUG
+	fprintf(stderr,"DVDWriteCells: 1\n");
+#endif
+
+	buffer = alloc_blocks(BUFFER_SIZE);
+	if (buffer == NULL) {
+		fprintf(stderr, _("Out of memory copying %s\n"), targetname);
+		goto cleanup;
+	}
+	read_buffer = buffer;
+
+#ifdef DEBUG
+	fprintf(stderr,"DVDWriteCells: 2\n");
+#endif
+
+	if (fill_gaps) {
+		existing_buffer = (unsigned char *)malloc(BUFFER_SIZE * DVD_VIDEO_LB_LEN * sizeof(unsigned char));
+		if (existing_buffer == NULL) {
+			fprintf(stderr, _("Out of memory copying %s\n"), targetname);
+			goto cleanup;
+		}
+	}
+
+	for (i = first_cell; i < length; i++) {
+		cells_left += cell_end_sector[i] - (i == first_cell && first_sector >= 0 ? first_sector : cell_start_sector[i]);
+	}
+	/* the VOBs this copy replaces were removed above */
+	if (check_free_space(targetdir, title_name, NO_TITLE_SET, cells_left * DVD_VIDEO_LB_LEN) != 0) {
+		goto cleanup;
+	}
+
+	/* queued writes may complete in any order, so they cannot rely on O_APPEND */
+	open_flags = fill_gaps ? (O_RDWR | O_CREAT) : (O_WRONLY | O_CREAT | (async_output ? 0 : O_APPEND));
+	streamout = open_output(targetname, open_flags, 0666);
+	if (streamout == -1) {
+		fprintf(stderr, _("Error creating %s\n"), targetname);
+		perror(PACKAGE);
+		goto cleanup;
+	}
+	if (first_sector >= 0 && resume_output(streamout, targetname, size) != 0) {
+		goto cleanup;
+	}
+	vob_blocks = cells_left + size < MAX_VOB_SIZE ? cells_left + size : MAX_VOB_SIZE;
+	if (!fill_gaps && preallocate_file(streamout, targetname, vob_blocks * DVD_VIDEO_LB_LEN) != 0) {
+		goto cleanup;
+	}
+	open_cells_sector_map(streamout, targetname, vob_blocks, !fill_gaps && first_sector < 0);
+
+#ifdef DEBUG
+	fprintf(stderr,"DVDWriteCells: 3\n");
+#endif
+
+	dvd_file = open_dvd_file(dvd, title_set, DVD_READ_TITLE_VOBS);
+	if (dvd_file == 0) {
+		fprintf(stderr, _("Failed opening TITLE VOB\n"));
+		goto cleanup;
+	}
+
+	/* supersede what the journal says about an earlier copy */
+	if (first_sector < 0) {
+		journal_checkpoint(streamout, targetname, 0, cell_start_sector[0], 0, 0, 1);
+	}
+	manifest_begin(targetname);
+
+	for (i = first_cell; i < length; i++) {
+		left = cell_end_sector[i] - cell_start_sector[i];
+		soffset = cell_start_sector[i];
+		if (i == first_cell && first_sector >= 0) {
+			left = cell_end_sector[i] - first_sector;
+			soffset = first_sector;
+		}
+
+		while (left > 0) {
+			to_read = left;
+			if (to_read + size > MAX_VOB_SIZE) {
+				to_read = MAX_VOB_SIZE - size;
+			}
+			if (to_read > BUFFER_SIZE) {
+				to_read = BUFFER_SIZE;
+			}
+
+			if (async_output && !fill_gaps) {
+				read_buffer = output_async_buffer(&slot);
+			}
+
+			/* with --gaps the sector states tell what is missing */
+			from_states = fill_gaps && job->sectors != NULL;
+			if (from_states) {
+				have_read = write_cells_fill_gaps(dvd_file, streamout, soffset, size, to_read, read_buffer);
+				if (have_read < 0) {
+					goto cleanup;
+				}
+			} else {
+				have_read = read_blocks(dvd_file, soffset, to_read, read_buffer);
+			}
+			if (have_read <= 0 && slot >= 0) {
+				output_async_release(slot);
+				slot = -1;
+			}
+			if (have_read < 0) {
+				fprintf(stderr, _("Error reading TITLE VOB: %d != %d\n"), have_read, to_read);
+				result = 1;
+				goto cleanup;
+			}
+			if (have_read == 0) {
+				fprintf(stderr, _("Error reading TITLE VOB: no data read\n"));
+				result = 1;
+				goto cleanup;
+			}
+			if (have_read < to_read) {
+				fprintf(stderr, _("DVDReadBlocks read %d blocks of %d blocks\n"), have_read, to_read);
+			}
+			if (!from_states) {
+				manifest_data(read_buffer, (size_t)have_read * DVD_VIDEO_LB_LEN);
+			}
+
+		if (from_states) {
+			/* write_cells_fill_gaps() wrote the missing blocks already */
+		} else if (fill_gaps) {
+			size_t chunk_blocks = (size_t)have_read;
+			size_t chunk_bytes = chunk_blocks * DVD_VIDEO_LB_LEN;
+			off_t chunk_offset = (off_t)size * DVD_VIDEO_LB_LEN;
+			ssize_t existing_bytes = read_existing_range(streamout, chunk_offset, existing_buffer, chunk_bytes);
+			if (existing_bytes < 0) {
+					fprintf(stderr, _("Error reading existing data from %s\n"), targetname);
+					perror(PACKAGE);
+					result = 1;
+					goto cleanup;
+				}
+
+				size_t block_size = DVD_VIDEO_LB_LEN;
+				size_t existing_blocks = (size_t)existing_bytes / block_size;
+				size_t partial_bytes = (size_t)existing_bytes % block_size;
+				size_t pending_start = SIZE_MAX;
+				unsigned char dvd_blank[BUFFER_SIZE];
+				unsigned char existing_blank[BUFFER_SIZE];
+
+				blocks_blank(buffer, chunk_blocks, dvd_blank);
+				blocks_blank(existing_buffer, existing_blocks, existing_blank);
+
+				for (size_t block_idx = 0; block_idx < chunk_blocks; ++block_idx) {
+					unsigned char* existing_block = existing_buffer + block_idx * block_size;
+					const unsigned char* dvd_block = buffer + block_idx * block_size;
+					int block_has_full = (block_idx < existing_blocks);
+					int block_has_partial = (!block_has_full && (block_idx == existing_blocks) && (partial_bytes > 0));
+					int block_blank;
+					int after_blank = dvd_blank[block_idx];
+
+					if (block_has_full) {
+						block_blank = existing_blank[block_idx];
+						if (!block_blank) {
+							if (memcmp(existing_block, dvd_block, block_size) != 0) {
+								fprintf(stderr, _("Existing data in %s does not match the DVD at offset %lld\n"), targetname, (long long)(chunk_offset + (off_t)block_idx * block_size));
+								result = 1;
+								goto cleanup;
+							}
+						}
+					} else if (block_has_partial) {
+						block_blank = buffer_is_blank(existing_block, partial_bytes);
+						if (!block_blank) {
+							if (memcmp(existing_block, dvd_block, partial_bytes) != 0) {
+								fprintf(stderr, _("Existing data in %s does not match the DVD at offset %lld\n"), targetname, (long long)(chunk_offset + (off_t)block_idx * block_size));
+								result = 1;
+								goto cleanup;
+							}
+						}
+					} else {
+						block_blank = 1;
+					}
+
+					vob_total_blocks++;
+					if (block_blank) {
+						vob_blank_before++;
+					}
+					if (after_blank) {
+						vob_blank_after++;
+					}
+
+					if (block_blank) {
+						if (pending_start == SIZE_MAX) {
+							pending_start = block_idx;
+						}
+					} else if (pending_start != SIZE_MAX) {
+						size_t pending_blocks = block_idx - pending_start;
+						off_t write_offset = chunk_offset + (off_t)pending_start * block_size;
+						size_t bytes_to_write = pending_blocks * block_size;
+						if (output_write(streamout, write_offset, buffer + pending_start * block_size, bytes_to_write, -1) != 0) {
+							fprintf(stderr, _("Error writing TITLE VOB\n"));
+							perror(PACKAGE);
+							result = 1;
+							goto cleanup;
+						}
+						pending_start = SIZE_MAX;
+					}
+				}
+
+				if (pending_start != SIZE_MAX) {
+					size_t pending_blocks = chunk_blocks - pending_start;
+					off_t write_offset = chunk_offset + (off_t)pending_start * block_size;
+					size_t bytes_to_write = pending_blocks * block_size;
+					if (output_write(streamout, write_offset, buffer + pending_start * block_size, bytes_to_write, -1) != 0) {
+						fprintf(stderr, _("Error writing TITLE VOB\n"));
+						perror(PACKAGE);
+						result = 1;
+						goto cleanup;
+					}
+				}
+			} else if (async_output) {
+				int queued = output_async_write(streamout, slot, (size_t)have_read * DVD_VIDEO_LB_LEN,
+						(off_t)size * DVD_VIDEO_LB_LEN);
+				slot = -1;
+				if (queued != 0) {
+					fprintf(stderr, _("Error writing TITLE VOB\n"));
+					perror(PACKAGE);
+					result = 1;
+					goto cleanup;
+				}
+			} else {
+				if (output_append(streamout, buffer, have_read * DVD_VIDEO_LB_LEN) != have_read * DVD_VIDEO_LB_LEN) {
+					fprintf(stderr, _("Error writing TITLE VOB\n"));
+					perror(PACKAGE);
+					result = 1;
+					goto cleanup;
+				}
+			}
+			write_behind_note(streamout, &wb, (off_t)size * DVD_VIDEO_LB_LEN,
+					(size_t)have_read * DVD_VIDEO_LB_LEN);
+			if (job->sectors != NULL && !fill_gaps) {
+				sector_map_set(job->sectors, (size_t)size, (size_t)have_read, SECTOR_GOOD);
+			}
+
+#ifdef DEBUG
+			fprintf(stderr,"Current soffset changed from %i to ",soffset);
+#endif
+			soffset = soffset + have_read;
+#ifdef DEBUG
+			fprintf(stderr,"%i\n",soffset);
+#endif
+			left -= have_read;
+			size += have_read;
+			cells_left -= have_read;
+			journal_checkpoint(streamout, targetname, i, soffset, (off_t)size * DVD_VIDEO_LB_LEN,
+					(off_t)have_read * DVD_VIDEO_LB_LEN, 0);
+
+			if ((size >= MAX_VOB_SIZE) && (left > 0)) {
+#ifdef DEBUG
+				fprintf(stderr,"size: %i, MAX_VOB_SIZE: %i\n ",size, MAX_VOB_SIZE);
+#endif
+				if (output_flush(targetname) != 0 ||
+						finalize_vob_file(streamout, targetname, (size_t)size,
+						vob_total_blocks, vob_blank_before, vob_blank_after) != 0) {
+					result = 1;
+					goto cleanup;
+				}
+				write_behind_finish(streamout, &wb);
+				manifest_end(title_name, targetname, 0);
+				close_sector_map();
+				close(streamout);
+				streamout = -1;
+				vob = vob + 1;
+				size = 0;
+				vob_total_blocks = 0;
+				vob_blank_before = 0;
+				vob_blank_after = 0;
+				snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
+				streamout = open_output(targetname, open_flags, 0666);
+				if (streamout == -1) {
+					fprintf(stderr, _("Error creating %s\n"), targetname);
+					perror(PACKAGE);
+					result = 1;
+					goto cleanup;
+				}
+				vob_blocks = cells_left < MAX_VOB_SIZE ? cells_left : MAX_VOB_SIZE;
+				if (!fill_gaps && preallocate_file(streamout, targetname, vob_blocks * DVD_VIDEO_LB_LEN) != 0) {
+					result = 1;
+					goto cleanup;
+				}
+				open_cells_sector_map(streamout, targetname, vob_blocks, !fill_gaps);
+				manifest_begin(targetname);
+			}
+		}
+	}
+
+	if (output_flush(targetname) != 0 ||
+			finalize_vob_file(streamout, targetname, (size_t)size,
+			vob_total_blocks, vob_blank_before, vob_blank_after) != 0) {
+		result = 1;
+		goto cleanup;
+	}
+	write_behind_finish(streamout, &wb);
+	journal_checkpoint(streamout, targetname, length, soffset, (off_t)size * DVD_VIDEO_LB_LEN, 0, 1);
+	manifest_end(title_name, targetname, 0);
+
+	result = 0;
+
+cleanup:
+	if (dvd_file) {
+		close_dvd_file(dvd_file);
+	}
+	if (streamout != -1) {
+		if (output_flush(targetname) != 0) {
+			result = 1;
+		}
+		close(streamout);
+	}
+	manifest_end(title_name, targetname, 1);
+	close_sector_map();
+	close_journal();
+	free(existing_buffer);
+	free(buffer);
+	free(targetname);
+
+	return result;
+}
+
+
+
+static void FreeSortArrays( int chapter_chapter_array[], int title_set_chapter_array[],
+		int angle_angle_array[], int title_set_angle_array[],
+		int subpicture_sub_array[], int title_set_sub_array[],
+		int audio_audio_array[], int title_set_audio_array[],
+		int size_size_array[], int title_set_size_array[],
+		int channels_channel_array[], int title_set_channel_array[]) {
+
+
+	free(chapter_chapter_array);
+	free(title_set_chapter_array);
+
+	free(angle_angle_array);
+	free(title_set_angle_array);
+
+	free(subpicture_sub_array);
+	free(title_set_sub_array);
+
+	free(audio_audio_array);
+	free(title_set_audio_array);
+
+	free(size_size_array);
+	free(title_set_size_array);
+
+	free(channels_channel_array);
+	free(title_set_channel_array);
+}
+
+
+static titles_info_t * DVDGetInfo(dvd_reader_t * _dvd) {
+
+	/* title interation */
+	int counter, i, f;
+
+	/* Our guess */
+	int candidate;
+	int multi = 0;
+	int dual = 0;
+
+
+	int titles;
+	int title_sets;
+
+	/* Arrays for chapter, angle, subpicture, audio, size, aspect, channels - file_set relationship */
+
+	/* Size == number_of_titles */
+	int * chapter_chapter_array;
+	int * title_set_chapter_array;
+
+	int * angle_angle_array;
+	int * title_set_angle_array;
+
+	/* Size == number_of_title_sets */
+
+	int * subpicture_sub_array;
+	int * title_set_sub_array;
+
+	int * audio_audio_array;
+	int * title_set_audio_array;
+
+	int * size_size_array;
+	int * title_set_size_array;
+
+	int * channels_channel_array;
+	int * title_set_channel_array;
+
+	/* Temp helpers */
+	int channels;
+	int found;
+	int chapters_1;
+	int chapters_2;
+	int found_chapter;
+	int number_of_multi;
+
+
+	/* DVD handlers */
+	ifo_handle_t* vmg_ifo = NULL;
+	dvd_file_t* vts_title_file = NULL;
+
+	titles_info_t* titles_info = NULL;
+
+	/* Open main info file */
+	vmg_ifo = open_job_ifo(_dvd, 0);
+	if(!vmg_ifo) {
+		fprintf( stderr, _("Cannot open VMG info.\n"));
+		return (0);
+	}
+
+	titles = vmg_ifo->tt_srpt->nr_of_srpts;
+	title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+
+	if ((vmg_ifo->tt_srpt == 0) || (vmg_ifo->vts_atrt == 0)) {
+		ifoClose(vmg_ifo);
+		return(0);
+	}
+
+
+	if((titles_info = (titles_info_t *)malloc(sizeof(titles_info_t))) == NULL) {
+		fprintf(stderr, _("Out of memory creating titles info structure\n"));
+		return NULL;
+	}
+
+	titles_info->titles = (titles_t *)malloc((titles)* sizeof(titles_t));
+	titles_info->number_of_titles = titles;
+
+
+	chapter_chapter_array = malloc(titles * sizeof(int));
+	title_set_chapter_array = malloc(titles * sizeof(int));
+
+	/*currently not used in the guessing */
+	angle_angle_array = malloc(titles * sizeof(int));
+	title_set_angle_array = malloc(titles * sizeof(int));
+
+
+	subpicture_sub_array = malloc(title_sets * sizeof(int));
+	title_set_sub_array = malloc(title_sets * sizeof(int));
+
+	audio_audio_array = malloc(title_sets * sizeof(int));
+	title_set_audio_array = malloc(title_sets * sizeof(int));
+
+	size_size_array = malloc(title_sets * sizeof(int));
+	title_set_size_array = malloc(title_sets * sizeof(int));
+
+	channels_channel_array = malloc(title_sets * sizeof(int));
+	title_set_channel_array = malloc(title_sets * sizeof(int));
+
+	/* Check mallocs */
+	if(!titles_info->titles || !chapter_chapter_array || !title_set_chapter_array ||
+			!angle_angle_array || !title_set_angle_array || !subpicture_sub_array ||
+			!title_set_sub_array || !audio_audio_array || !title_set_audio_array ||
+			!size_size_array || !title_set_size_array || !channels_channel_array ||
+			!title_set_channel_array) {
+		fprintf(stderr, _("Out of memory creating arrays for titles info\n"));
+		free(titles_info);
+		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
+						angle_angle_array, title_set_angle_array,
+						subpicture_sub_array, title_set_sub_array,
+						audio_audio_array, title_set_audio_array,
+						size_size_array, title_set_size_array,
+						channels_channel_array, title_set_channel_array);
+		return NULL;
+	}
+
+	/* Interate over the titles nr_of_srpts */
+	for(counter = 0; counter < titles; counter++) {
+		/* For titles_info */
+		titles_info->titles[counter].title = counter + 1;
+		titles_info->titles[counter].title_set = vmg_ifo->tt_srpt->title[counter].title_set_nr;
+		titles_info->titles[counter].vts_title = vmg_ifo->tt_srpt->title[counter].vts_ttn;
+		titles_info->titles[counter].chapters = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
+		titles_info->titles[counter].angles = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
+
+		/* For main title*/
+		chapter_chapter_array[counter] = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
+		title_set_chapter_array[counter] = vmg_ifo->tt_srpt->title[counter].title_set_nr;
+		angle_angle_array[counter] = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
+		title_set_angle_array[counter] = vmg_ifo->tt_srpt->title[counter].title_set_nr;
+	}
+
+	/* Interate over vmg_nr_of_title_sets */
+
+	for(counter = 0; counter < title_sets; counter++) {
+
+		/* Picture*/
+		subpicture_sub_array[counter] = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
+		title_set_sub_array[counter] = counter + 1;
+
+
+		/* Audio */
+		audio_audio_array[counter] = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
+		title_set_audio_array[counter] = counter + 1;
+
+		channels=0;
+		for(i = 0; i < audio_audio_array[counter]; i++) {
+			if ( channels < vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1) {
+				channels = vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1;
+			}
+
+		}
+		channels_channel_array[counter] = channels;
+		title_set_channel_array[counter] = counter + 1;
+
+		/* For titles_info */
+		for (f=0; f < titles_info->number_of_titles ; f++ ) {
+			if ( titles_info->titles[f].title_set == counter + 1 ) {
+				titles_info->titles[f].aspect_ratio = vmg_ifo->vts_atrt->vts[counter].vtstt_vobs_video_attr.display_aspect_ratio;
+				titles_info->titles[f].sub_pictures = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
+				titles_info->titles[f].audio_tracks = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
+				titles_info->titles[f].audio_channels = channels;
+			}
+		}
+
+	}
+
+
+
+
+	for (counter=0; counter < title_sets; counter++ ) {
+
+		vts_title_file = open_job_file(_dvd, counter + 1, DVD_READ_TITLE_VOBS);
+
+		if(vts_title_file != 0) {
+			size_size_array[counter] = DVDFileSize(vts_title_file);
+			DVDCloseFile(vts_title_file);
+		} else {
+			size_size_array[counter] = 0;
+		}
+
+		title_set_size_array[counter] = counter + 1;
+
+
+	}
+
+
+	/* Sort all arrays max to min */
+
+	bsort_max_to_min(chapter_chapter_array, title_set_chapter_array, titles);
+	bsort_max_to_min(angle_angle_array, title_set_angle_array, titles);
+	bsort_max_to_min(subpicture_sub_array, title_set_sub_array, title_sets);
+	bsort_max_to_min(audio_audio_array, title_set_audio_array, title_sets);
+	bsort_max_to_min(size_size_array, title_set_size_array, title_sets);
+	bsort_max_to_min(channels_channel_array, title_set_channel_array, title_sets);
+
+
+	/* Check if the second biggest one actually can be a feature title */
+	/* Here we will take do biggest/second and if that is bigger than one it's not a feauture title */
+	/* Now this is simply not enough since we have to check that the diff between the two of them is small enough
+	 to consider the second one a feature title we are doing two checks (biggest + biggest - second) /second == 1
+	 and biggest%second * 3 < biggest */
 
-		size_t chunk_bytes = (size_t)act_read * DVD_VIDEO_LB_LEN;
-		size_t total_read = 0;
-		while (total_read < chunk_bytes) {
-			ssize_t got = read(fd, file_buffer + total_read, chunk_bytes - total_read);
-			if (got < 0) {
-				if (errno == EINTR) {
-					continue;
+	if ( title_sets > 1 && CheckSizeArray(size_size_array, 0, 1) == 1 ) {
+		/* We have a dual DVD with two feature films - now let's see if they have the same amount of chapters*/
+
+		chapters_1 = 0;
+		for (i=0 ; i < titles ; i++ ) {
+			if (titles_info->titles[i].title_set == title_set_size_array[0] ) {
+				if ( chapters_1 < titles_info->titles[i].chapters){
+					chapters_1 = titles_info->titles[i].chapters;
 				}
-				perror(PACKAGE);
-				return 1;
-			}
-			if (got == 0) {
-				fprintf(stderr, _("File %s ended prematurely while comparing\n"), path);
-				return 1;
 			}
-			total_read += (size_t)got;
 		}
 
-		if (memcmp(dvd_buffer, file_buffer, chunk_bytes) != 0) {
-			size_t block_index;
-			for (block_index = 0; block_index < (size_t)act_read; ++block_index) {
-				if (memcmp(dvd_buffer + block_index * DVD_VIDEO_LB_LEN,
-					file_buffer + block_index * DVD_VIDEO_LB_LEN,
-					DVD_VIDEO_LB_LEN) != 0) {
-					fprintf(stderr, _("Data mismatch for %s at sector %lld\n"),
-						path, (long long)(current_offset + (int)block_index));
-					break;
+		chapters_2 = 0;
+		for (i=0 ; i < titles ; i++ ) {
+			if (titles_info->titles[i].title_set == title_set_size_array[1] ) {
+				if ( chapters_2 < titles_info->titles[i].chapters){
+					chapters_2 = titles_info->titles[i].chapters;
 				}
 			}
-			return 1;
 		}
 
-		current_offset += act_read;
-		remaining -= act_read;
-		compared_blocks += (size_t)act_read;
-
-		if (progress) {
-			int done = (int)compared_blocks;
-			if (remaining < BUFFER_SIZE || (done % BUFFER_SIZE) == 0) {
-				float doneMiB = (float)done / 512.0f;
-				float totalMiB = (float)total / 512.0f;
-				fprintf(stdout, "\r");
-				fprintf(stdout, _("Comparing %s: %.0f%% done (%.0f/%.0f MiB)"),
-						progressText, doneMiB / totalMiB * 100.0f, doneMiB, totalMiB);
-				fflush(stdout);
+		if(vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio ==
+			vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio) {
+			/* In this case it's most likely so that we have a dual film but with different context
+			They are with in the same size range and have the same aspect ratio
+			I would guess that such a case is e.g. a DVD containing several episodes of a TV serie*/
+			candidate = title_set_size_array[0];
+			multi = 1;
+		} else if ( chapters_1 == chapters_2 && vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio !=
+			vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio){
+			/* In this case we have (guess only) the same context - they have the same number of chapters but different aspect ratio and are in the same size range*/
+			if ( vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio == aspect) {
+				candidate = title_set_size_array[0];
+			} else if ( vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio == aspect) {
+				candidate = title_set_size_array[1];
+			} else {
+				/* Okay we didn't have the prefered aspect ratio - just make the biggest one a candidate */
+				/* please send report if this happens*/
+				fprintf(stderr, _("You have encountered a very special DVD; please send a bug report along with all IFO files from this title\n"));
+				candidate = title_set_size_array[0];
 			}
+			dual = 1;
+		} else {
+			/* Can this case ever happen? */
+			candidate = title_set_size_array[0];
 		}
+	} else {
+		candidate = title_set_size_array[0];
 	}
 
-	unsigned char extra;
-	ssize_t extra_read = read(fd, &extra, 1);
-	if (extra_read < 0) {
-		perror(PACKAGE);
-		return 1;
-	} else if (extra_read > 0) {
-		fprintf(stderr, _("File %s contains extra data beyond expected size\n"), path);
-		return 1;
-	}
 
-	if (progress) {
-		fprintf(stdout, "\n");
-	}
+	/* Lets start checking audio,sub pictures and channels my guess is namly that a special suburb will put titles with a lot of
+	 chapters just to make our backup hard */
 
-	return 0;
-}
 
+	found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
+			subpicture_sub_array, title_set_sub_array,
+			channels_channel_array, title_set_channel_array,
+			0 , candidate, title_sets);
 
-static int CheckSizeArray(const int size_array[], int reference, int target) {
-	if(size_array[target] && (size_array[reference]/size_array[target] == 1) &&
-			((size_array[reference] * 2 - size_array[target])/ size_array[target] == 1) &&
-			((size_array[reference]%size_array[target] * 3) < size_array[reference]) ) {
-		/* We have a dual DVD with two feature films - now let's see if they have the same amount of chapters*/
-		return(1);
-	} else {
-		return(0);
+
+	/* Now let's see if we can find our candidate among the top most chapters */
+	found_chapter=6;
+	for (i=0 ; (i < titles) && (i < 4) ; i++ ) {
+		if ( candidate == title_set_chapter_array[i] ) {
+			found_chapter=i+1;
+			break;
+		}
 	}
-}
 
+	/* Close the VMG ifo file we got all the info we need */
+	ifoClose(vmg_ifo);
 
-static int CheckAudioSubChannels(int audio_audio_array[], int title_set_audio_array[],
-		int subpicture_sub_array[], int title_set_sub_array[],
-		int channels_channel_array[],int title_set_channel_array[],
-		int reference, int candidate, int title_sets) {
 
-	int temp, i, found_audio, found_sub, found_channels;
+	if (((found == 3) && (found_chapter == 1) && (dual == 0) && (multi == 0)) || ((found == 3) && (found_chapter < 3 ) && (dual == 1))) {
 
-	found_audio=0;
-	temp = audio_audio_array[reference];
-	for (i=0 ; i < title_sets ; i++ ) {
-		if ( audio_audio_array[i] < temp ) {
-			break;
-		}
-		if ( candidate == title_set_audio_array[i] ) {
-			found_audio=1;
-			break;
-		}
+		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
+				angle_angle_array, title_set_angle_array,
+				subpicture_sub_array, title_set_sub_array,
+				audio_audio_array, title_set_audio_array,
+				size_size_array, title_set_size_array,
+				channels_channel_array, title_set_channel_array);
+		titles_info->main_title_set = candidate;
+		return(titles_info);
 
 	}
 
-	found_sub=0;
-	temp = subpicture_sub_array[reference];
-	for (i=0 ; i < title_sets ; i++ ) {
-		if ( subpicture_sub_array[i] < temp ) {
-			break;
+	if (multi == 1) {
+		for (i=0 ; i < title_sets ; ++i) {
+			if (CheckSizeArray(size_size_array, 0, i + 1) == 0) {
+				break;
+			}
 		}
-		if ( candidate == title_set_sub_array[i] ) {
-			found_sub=1;
-			break;
+		number_of_multi = i;
+		for (i = 0; i < number_of_multi; i++ ) {
+			if (title_set_chapter_array[0] == i + 1) {
+				candidate = title_set_chapter_array[0];
+			}
 		}
 
+		found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
+				subpicture_sub_array, title_set_sub_array,
+				channels_channel_array, title_set_channel_array,
+				0 , candidate, title_sets);
+
+		if (found == 3) {
+			FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
+					angle_angle_array, title_set_angle_array,
+					subpicture_sub_array, title_set_sub_array,
+					audio_audio_array, title_set_audio_array,
+					size_size_array, title_set_size_array,
+					channels_channel_array, title_set_channel_array);
+			titles_info->main_title_set = candidate;
+			return(titles_info);
+		}
 	}
 
+	/* We have now come to that state that we more or less have given up :( giving you a good guess of the main feature film*/
+	/*No matter what we will more or less only return the biggest VOB*/
+	/* Lets see if we can find our biggest one - then we return that one */
+	candidate = title_set_size_array[0];
 
-	found_channels=0;
-	temp = channels_channel_array[reference];
-	for (i=0 ; i < title_sets ; i++ ) {
-		if ( channels_channel_array[i] < temp ) {
-			break;
-		}
-		if ( candidate == title_set_channel_array[i] ) {
-			found_channels=1;
+	found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
+			subpicture_sub_array, title_set_sub_array,
+			channels_channel_array, title_set_channel_array,
+			0 , candidate, title_sets);
+
+	/* Now let's see if we can find our candidate among the top most chapters */
+
+	found_chapter=5;
+	for (i=0 ; (i < titles) && (i < 4) ; i++ ) {
+		if ( candidate == title_set_chapter_array[i] ) {
+			found_chapter=i+1;
 			break;
 		}
 
 	}
 
+	/* Here we take chapters in to consideration*/
+	if (found == 3) {
+		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
+				angle_angle_array, title_set_angle_array,
+				subpicture_sub_array, title_set_sub_array,
+				audio_audio_array, title_set_audio_array,
+				size_size_array, title_set_size_array,
+				channels_channel_array, title_set_channel_array);
+		titles_info->main_title_set = candidate;
+		return(titles_info);
+	}
+
+	/* Here we do but we lower the treshold for audio, sub and channels */
+
+	if ((found > 1 ) && (found_chapter <= 4)) {
+		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
+				angle_angle_array, title_set_angle_array,
+				subpicture_sub_array, title_set_sub_array,
+				audio_audio_array, title_set_audio_array,
+				size_size_array, title_set_size_array,
+				channels_channel_array, title_set_channel_array);
+		titles_info->main_title_set = candidate;
+		return(titles_info);
+
+		/* return it */
+	} else {
+		/* Here we give up and just return the biggest one :(*/
+		/* Just return the biggest badest one*/
+		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
+				angle_angle_array, title_set_angle_array,
+				subpicture_sub_array, title_set_sub_array,
+				audio_audio_array, title_set_audio_array,
+				size_size_array, title_set_size_array,
+				channels_channel_array, title_set_channel_array);
+		titles_info->main_title_set = candidate;
+		return(titles_info);
+	}
+
 
-	return(found_audio + found_sub + found_channels);
-}
+	/* Some radom thoughts about DVD guessing */
+	/* We will now gather as much data about the DVD-Video as we can and
+	then make a educated guess which one is the main feature film of it*/
+
+
+	/* Make a tripple array with chapters, angles and title sets
+	 - sort out dual title sets with a low number of chapters. Tradtionaly
+	 the title set with most chapters is the main film. Number of angles is
+	 keept as a reference point of low value*/
+
+	/* Make a dual array with number of audio streams, sub picture streams
+	 and title sets. Tradtionaly the main film has many audio streams
+	 since it's supposed be synchronised e.g. a English film synchronised/dubbed
+	 in German. We are also keeping track of sub titles since it's also indication
+	 of the main film*/
 
+	/* Which title set is the biggest one - dual array with title sets and size
+	 The biggest one is usally the main film*/
 
+	/* Which title set is belonging to title 1 and how many chapters has it. Once
+	 again tradtionaly title one is belonging to the main film*/
 
+	/* Yes a lot of rant - but it helps me think - some sketch on paper or in the mind
+	 I sketch in the comments - beside it will help you understand the code*/
 
-static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
-		int cell_end_sector[], int length, int titles,
-		title_set_info_t * title_set_info, titles_info_t * titles_info,
-		char * targetdir,char * title_name) {
+	/* Okay let's see if the biggest one has most chapters, it also has more subtitles
+	 and audio tracks than the second one and it's title one.
+	 Done it must be the main film
 
-	/* Loop variables */
-	int i;
+	 Hmm the biggest one doesn't have the most chapters?
 
-	/* Vob control */
-	int vob = 1;
+	 See if the second one has the same amount of chapters and is the biggest one
+	 If so we probably have a 4:3 and 16:9 versions of film on the same disk
 
-	/* Temp filename,dirname */
-	char *targetname = NULL;
-	size_t targetname_length;
+	 Now we fetch the 16:9 by default unless the forced to do 4:3
+	 First check which one is which.
+	 If the 16:9 is the biggest one and has the same or more subtitle, audio streams
+	 then we are happy unless we are in force 4:3 mode :(
+	 The same goes in reverse if we are in force 4:3 mode
 
-	/* Write buffers */
-	unsigned char *buffer = NULL;
-	unsigned char *existing_buffer = NULL;
 
-	/* File Handler */
-	int streamout = -1;
+	 Hmm, in force 4:3 mode - now we check how much smaller than the biggest one it is
+	 (or the reverse if we are in 16:9 mode)
 
-	int size;
-	int left;
-	int to_read;
-	int have_read;
-	int soffset;
+	 Generally a reverse division should render in 1 and with a small modulo - like wise
+	 a normal modulo should give us a high modulo
 
-	/* DVD handler */
-	dvd_file_t* dvd_file = NULL;
+	 If we get more than one it's of cource a fake however if we get just one we still need to check
+	 if we subtract the smaller one from the bigger one we should end up with a small number - hence we
+	 need to multiply it more than 4 times to get it bigger than the biggest one. Now we know that the
+	 two biggest once are really big and possibly carry the same film in differnet formats.
 
-	int title_set;
-	int result = 1;
-	int open_flags;
-	size_t vob_total_blocks = 0;
-	size_t vob_blank_before = 0;
-	size_t vob_blank_after = 0;
+	 We will now return the prefered one either 16:9 or 4:3 but we will first check that the one
+	 we return at lest has two or more audio tracks. We don't want it if the other one has a lot
+	 more sound (we may end up with a film that only has 2ch Dolby Digital so we want to check for
+	 6ch DTS or Dolby Digital. If the prefered one doesn't have those features but the other once has
+	 we will return the other one.
+	 */
 
-#ifndef DEBUG
-	(void)title_set_info;
-#endif
+}
 
-#ifdef DEBUG
-	int number_of_vob_files;
-	fprintf(stderr,"DVDWriteCells: length is %d\n", length);
-#endif
 
-	title_set = titles_info->titles[titles - 1].title_set;
-#ifdef DEBUG
-	number_of_vob_files = title_set_info->title_set[title_set].number_of_vob_files;
-	fprintf(stderr,"DVDWriteCells: title set is %d\n", title_set);
-	fprintf(stderr,"DVDWriteCells: vob files are %d\n", number_of_vob_files);
-#endif
+static int DVDCopyBlocksFillGaps(dvd_file_t* dvd_file, int destination, int offset,
+		int size, const char* path, const char* label, read_error_strategy_t errorstrat) {
+	gap_plan_t plan = {0};
+	size_t blank_blocks = 0;
+	size_t existing_blocks = 0;
+	off_t existing_bytes = 0;
+	size_t truncated_blocks = 0;
+	size_t sample_slots[GAP_SAMPLE_TARGET];
+	size_t sample_count;
+	int result = 0;
 
-	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/VTS_XX_X.VOB" and terminating "\0"
-	targetname_length = strlen(targetdir) + strlen(title_name) + 24;
-	targetname = malloc(targetname_length);
-	if (targetname == NULL) {
-		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
-		goto cleanup;
+	if (scan_existing_file_for_gaps(destination, (size_t)size, &plan,
+			&blank_blocks, &existing_blocks, &existing_bytes) != 0) {
+		perror(PACKAGE);
+		gap_plan_free(&plan);
+		return 1;
 	}
 
-	/* Remove all old files silently if they exists */
-	if (!fill_gaps) {
-		for (i = 0; i < 10; i++) {
-			snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, i + 1);
-#ifdef DEBUG
-			fprintf(stderr,"DVDWriteCells: file is %s\n", targetname);
-#endif
-			unlink(targetname);
+	if ((size_t)size < existing_blocks) {
+		existing_blocks = (size_t)size;
+	}
+
+	if ((size_t)size > existing_blocks) {
+		size_t missing = (size_t)size - existing_blocks;
+		if (gap_plan_add(&plan, existing_blocks, missing) != 0) {
+			gap_plan_free(&plan);
+			return 1;
 		}
+		truncated_blocks = missing;
 	}
 
-#ifdef DEBUG
-	for (i = 0; i < number_of_vob_files; i++) {
-		fprintf(stderr,"vob %i size: %lld\n", i + 1, title_set_info->title_set[title_set].size_vob[i]);
+	/* a complete file is left alone without reading the disc */
+	if (plan.count == 0) {
+		gap_print_report(path, (size_t)size, 0, 0, 0, 0, 0);
+		return 0;
 	}
-#endif
 
-	/* Create VTS_XX_X.VOB */
-	if (title_set == 0) {
-		fprintf(stderr,_("Do not try to copy chapters from the VMG domain; there are none.\n"));
-		goto cleanup;
-	} else {
-		snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
+	sample_count = gap_collect_samples(&plan, (size_t)size, GAP_SAMPLE_TARGET, sample_slots);
+	if (sample_count > 0) {
+		if (gap_verify_samples(destination, dvd_file, offset,
+				label ? label : path, sample_slots, sample_count) != 0) {
+			gap_plan_free(&plan);
+			return 1;
+		}
 	}
 
-#ifdef DEBUG
-	fprintf(stderr,"DVDWriteCells: 1\n");
-#endif
+	size_t blank_after = blank_blocks;
+	size_t truncated_after = truncated_blocks;
+	size_t filled_blocks = 0;
+	int fill_status = gap_fill_from_plan(destination, dvd_file, offset, &plan,
+			label ? label : path, errorstrat, &filled_blocks);
 
-	buffer = (unsigned char *)malloc(BUFFER_SIZE * DVD_VIDEO_LB_LEN * sizeof(unsigned char));
-	if (buffer == NULL) {
-		fprintf(stderr, _("Out of memory copying %s\n"), targetname);
-		goto cleanup;
+	gap_plan_free(&plan);
+
+	if (output_flush(path) != 0) {
+		fill_status = 1;
 	}
 
-#ifdef DEBUG
-	fprintf(stderr,"DVDWriteCells: 2\n");
-#endif
+	if (fill_status == 0) {
+		gap_plan_t verify_plan = (gap_plan_t){0};
+		size_t verify_blank = 0;
+		size_t verify_existing_blocks = 0;
+		off_t verify_bytes = 0;
 
-	if (fill_gaps) {
-		existing_buffer = (unsigned char *)malloc(BUFFER_SIZE * DVD_VIDEO_LB_LEN * sizeof(unsigned char));
-		if (existing_buffer == NULL) {
-			fprintf(stderr, _("Out of memory copying %s\n"), targetname);
-			goto cleanup;
+		if (scan_existing_file_for_gaps(destination, (size_t)size, &verify_plan,
+				&verify_blank, &verify_existing_blocks, &verify_bytes) == 0) {
+			blank_after = verify_blank;
+			if ((size_t)size > verify_existing_blocks) {
+				truncated_after = (size_t)size - verify_existing_blocks;
+			} else {
+				truncated_after = 0;
+			}
 		}
+		gap_plan_free(&verify_plan);
 	}
 
-	open_flags = fill_gaps ? (O_RDWR | O_CREAT) : (O_WRONLY | O_CREAT | O_APPEND);
-	streamout = open(targetname, open_flags, 0666);
-	if (streamout == -1) {
-		fprintf(stderr, _("Error creating %s\n"), targetname);
-		perror(PACKAGE);
-		goto cleanup;
+	gap_print_report(path, (size_t)size,
+			blank_blocks, truncated_blocks,
+			blank_after, truncated_after,
+			filled_blocks);
+
+	if (fill_status != 0) {
+		result = 1;
 	}
 
-#ifdef DEBUG
-	fprintf(stderr,"DVDWriteCells: 3\n");
-#endif
+	return result;
+}
 
-	dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS);
-	if (dvd_file == 0) {
-		fprintf(stderr, _("Failed opening TITLE VOB\n"));
-		goto cleanup;
-	}
 
-	size = 0;
+/**
+ * One read request of the copy loop. The reader fills in act_read and
+ * decides how many blocks to pad (-1 means abort) so that the writer does
+ * not need to know about the error strategy.
+ */
+typedef struct {
+	int offset;
+	int to_read;
+	int act_read;
+	int blanks;
+	int recovered; /* blocks bisection got back after a failed read, or -1 */
+	unsigned char padded[BUFFER_SIZE / 8]; /* blocks bisection zero filled */
+	unsigned char* data;
+} copy_chunk_t;
 
-	for (i = 0; i < length; i++) {
-		left = cell_end_sector[i] - cell_start_sector[i];
-		soffset = cell_start_sector[i];
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	copy_chunk_t chunks[PIPELINE_DEPTH];
+	size_t head;
+	size_t count;
+	int reader_done;
+	int cancel;
 
-		while (left > 0) {
-			to_read = left;
-			if (to_read + size > MAX_VOB_SIZE) {
-				to_read = MAX_VOB_SIZE - size;
-			}
-			if (to_read > BUFFER_SIZE) {
-				to_read = BUFFER_SIZE;
-			}
+	dvd_file_t* dvd_file;
+	int offset;
+	int size;
+	read_error_strategy_t errorstrat;
+	job_t* job; /* of the writer, which the reader reports to */
+} copy_pipeline_t;
 
-			have_read = DVDReadBlocks(dvd_file, soffset, to_read, buffer);
-			if (have_read < 0) {
-				fprintf(stderr, _("Error reading TITLE VOB: %d != %d\n"), have_read, to_read);
-				result = 1;
-				goto cleanup;
-			}
-			if (have_read == 0) {
-				fprintf(stderr, _("Error reading TITLE VOB: no data read\n"));
-				result = 1;
-				goto cleanup;
-			}
-			if (have_read < to_read) {
-				fprintf(stderr, _("DVDReadBlocks read %d blocks of %d blocks\n"), have_read, to_read);
-			}
 
-		if (fill_gaps) {
-			size_t chunk_blocks = (size_t)have_read;
-			size_t chunk_bytes = chunk_blocks * DVD_VIDEO_LB_LEN;
-			off_t chunk_offset = (off_t)size * DVD_VIDEO_LB_LEN;
-			ssize_t existing_bytes = read_existing_range(streamout, chunk_offset, existing_buffer, chunk_bytes);
-			if (existing_bytes < 0) {
-					fprintf(stderr, _("Error reading existing data from %s\n"), targetname);
-					perror(PACKAGE);
-					result = 1;
-					goto cleanup;
-				}
+static int bisect_time_exhausted(void) {
+	return bisect_time_limit > 0 && job->bisect_seconds >= (double)bisect_time_limit;
+}
 
-				size_t block_size = DVD_VIDEO_LB_LEN;
-				size_t existing_blocks = (size_t)existing_bytes / block_size;
-				size_t partial_bytes = (size_t)existing_bytes % block_size;
-				size_t pending_start = SIZE_MAX;
 
-				for (size_t block_idx = 0; block_idx < chunk_blocks; ++block_idx) {
-					unsigned char* existing_block = existing_buffer + block_idx * block_size;
-					const unsigned char* dvd_block = buffer + block_idx * block_size;
-					int block_has_full = (block_idx < existing_blocks);
-					int block_has_partial = (!block_has_full && (block_idx == existing_blocks) && (partial_bytes > 0));
-					int block_blank;
-					int after_blank = buffer_is_blank(dvd_block, block_size);
+static int bisect_read(dvd_file_t* dvd_file, copy_chunk_t* chunk, int first, int count,
+		int depth);
 
-					if (block_has_full) {
-						block_blank = buffer_is_blank(existing_block, block_size);
-						if (!block_blank) {
-							if (memcmp(existing_block, dvd_block, block_size) != 0) {
-								fprintf(stderr, _("Existing data in %s does not match the DVD at offset %lld\n"), targetname, (long long)(chunk_offset + (off_t)block_idx * block_size));
-								result = 1;
-								goto cleanup;
-							}
-						}
-					} else if (block_has_partial) {
-						block_blank = buffer_is_blank(existing_block, partial_bytes);
-						if (!block_blank) {
-							if (memcmp(existing_block, dvd_block, partial_bytes) != 0) {
-								fprintf(stderr, _("Existing data in %s does not match the DVD at offset %lld\n"), targetname, (long long)(chunk_offset + (off_t)block_idx * block_size));
-								result = 1;
-								goto cleanup;
-							}
-						}
-					} else {
-						block_blank = 1;
-					}
 
-					vob_total_blocks++;
-					if (block_blank) {
-						vob_blank_before++;
-					}
-					if (after_blank) {
-						vob_blank_after++;
-					}
+/**
+ * Splits count blocks of chunk starting at its block first, which were just
+ * found unreadable, in halves and reads each of them with bisect_read(), so
+ * that the failed read is never reissued as a whole. Ranges below
+ * bisect_max_depth halvings, or left after the bisection time budget of the
+ * disc is used up, are zero filled and flagged in chunk->padded. Returns the
+ * number of blocks read.
+ */
+static int bisect_split(dvd_file_t* dvd_file, copy_chunk_t* chunk, int first, int count,
+		int depth) {
+	int half;
+	int i;
+
+	if (count > 1 && depth < bisect_max_depth && !bisect_time_exhausted()) {
+		half = count / 2;
+		return bisect_read(dvd_file, chunk, first, half, depth + 1)
+			+ bisect_read(dvd_file, chunk, first + half, count - half, depth + 1);
+	}
+
+	memset(chunk->data + (size_t)first * DVD_VIDEO_LB_LEN, 0, (size_t)count * DVD_VIDEO_LB_LEN);
+	for (i = first; i < first + count; ++i) {
+		chunk->padded[i / 8] |= (unsigned char)(1 << (i % 8));
+	}
+	return 0;
+}
+
+
+/**
+ * Reads count blocks of chunk starting at its block first and bisects the
+ * part that fails with bisect_split(). Returns the number of blocks read.
+ */
+static int bisect_read(dvd_file_t* dvd_file, copy_chunk_t* chunk, int first, int count,
+		int depth) {
+	int got = 0;
+
+	if (!bisect_time_exhausted()) {
+		got = read_blocks(dvd_file, chunk->offset + first, count,
+				chunk->data + (size_t)first * DVD_VIDEO_LB_LEN);
+		if (got < 0) {
+			got = 0;
+		}
+		if (got >= count) {
+			return count;
+		}
+	}
 
-					if (block_blank) {
-						if (pending_start == SIZE_MAX) {
-							pending_start = block_idx;
-						}
-					} else if (pending_start != SIZE_MAX) {
-						size_t pending_blocks = block_idx - pending_start;
-						off_t write_offset = chunk_offset + (off_t)pending_start * block_size;
-						size_t bytes_to_write = pending_blocks * block_size;
-						if (write_range(streamout, write_offset, buffer + pending_start * block_size, bytes_to_write) != 0) {
-							fprintf(stderr, _("Error writing TITLE VOB\n"));
-							perror(PACKAGE);
-							result = 1;
-							goto cleanup;
-						}
-						pending_start = SIZE_MAX;
-					}
-				}
+	return got + bisect_split(dvd_file, chunk, first + got, count - got, depth);
+}
 
-				if (pending_start != SIZE_MAX) {
-					size_t pending_blocks = chunk_blocks - pending_start;
-					off_t write_offset = chunk_offset + (off_t)pending_start * block_size;
-					size_t bytes_to_write = pending_blocks * block_size;
-					if (write_range(streamout, write_offset, buffer + pending_start * block_size, bytes_to_write) != 0) {
-						fprintf(stderr, _("Error writing TITLE VOB\n"));
-						perror(PACKAGE);
-						result = 1;
-						goto cleanup;
-					}
-				}
-			} else {
-				if (write(streamout, buffer, have_read * DVD_VIDEO_LB_LEN) != have_read * DVD_VIDEO_LB_LEN) {
-					fprintf(stderr, _("Error writing TITLE VOB\n"));
-					perror(PACKAGE);
-					result = 1;
-					goto cleanup;
-				}
-			}
 
+static void copy_chunk_read(dvd_file_t* dvd_file, copy_chunk_t* chunk,
+		read_error_strategy_t errorstrat) {
+	int good;
 
-#ifdef DEBUG
-			fprintf(stderr,"Current soffset changed from %i to ",soffset);
-#endif
-			soffset = soffset + have_read;
-#ifdef DEBUG
-			fprintf(stderr,"%i\n",soffset);
-#endif
-			left -= have_read;
-			size += have_read;
+	chunk->act_read = read_blocks(dvd_file, chunk->offset, chunk->to_read, chunk->data);
+	chunk->blanks = 0;
+	chunk->recovered = -1;
 
-			if ((size >= MAX_VOB_SIZE) && (left > 0)) {
-#ifdef DEBUG
-				fprintf(stderr,"size: %i, MAX_VOB_SIZE: %i\n ",size, MAX_VOB_SIZE);
-#endif
-				if (finalize_vob_file(streamout, targetname, (size_t)size,
-						vob_total_blocks, vob_blank_before, vob_blank_after) != 0) {
-					result = 1;
-					goto cleanup;
-				}
-				close(streamout);
-				streamout = -1;
-				vob = vob + 1;
-				size = 0;
-				vob_total_blocks = 0;
-				vob_blank_before = 0;
-				vob_blank_after = 0;
-				snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
-				streamout = open(targetname, open_flags, 0666);
-				if (streamout == -1) {
-					fprintf(stderr, _("Error creating %s\n"), targetname);
-					perror(PACKAGE);
-					result = 1;
-					goto cleanup;
-				}
-			}
+	if (chunk->act_read == chunk->to_read) {
+		return;
+	}
+
+	good = chunk->act_read < 0 ? 0 : chunk->act_read;
+
+	switch (errorstrat) {
+	case STRATEGY_ABORT:
+		chunk->blanks = -1;
+		break;
+
+	case STRATEGY_SKIP_BLOCK:
+		chunk->blanks = 1;
+		break;
+
+	case STRATEGY_SKIP_MULTIBLOCK:
+		chunk->blanks = chunk->to_read - good;
+		break;
+
+	case STRATEGY_BISECT:
+		if (bisect_time_exhausted()) {
+			chunk->blanks = chunk->to_read - good;
+		} else {
+			double started = monotonic_seconds();
+			int unreadable = chunk->to_read - good;
+
+			memset(chunk->padded, 0, sizeof(chunk->padded));
+			chunk->recovered = bisect_split(dvd_file, chunk, good, unreadable, 0);
+			job->bisect_seconds += monotonic_seconds() - started;
+			job->bisect_unreadable_blocks += (size_t)unreadable;
+			job->bisect_recovered_blocks += (size_t)chunk->recovered;
 		}
+		break;
 	}
+}
 
-	if (finalize_vob_file(streamout, targetname, (size_t)size,
-			vob_total_blocks, vob_blank_before, vob_blank_after) != 0) {
-		result = 1;
-		goto cleanup;
+
+void bisect_report(void) {
+	if (job->bisect_unreadable_blocks == 0) {
+		return;
 	}
 
-	result = 0;
+	if (progress) {
+		fprintf(stdout, "\n");
+	}
 
-cleanup:
-	if (dvd_file) {
-		DVDCloseFile(dvd_file);
+	if (bisect_time_exhausted() && !job->bisect_limit_reported) {
+		job->bisect_limit_reported = 1;
+		fprintf(stderr, _("The bisection time limit of %d seconds was reached; later read errors were padded like with -r m.\n"),
+				bisect_time_limit);
 	}
-	if (streamout != -1) {
-		close(streamout);
+
+	fprintf(stderr, _("Bisection recovered %zu of %zu sectors that skipping multiple blocks would have padded (%zu padded, %.1f seconds spent).\n"),
+			job->bisect_recovered_blocks, job->bisect_unreadable_blocks,
+			job->bisect_unreadable_blocks - job->bisect_recovered_blocks, job->bisect_seconds);
+}
+
+
+/**
+ * Number of blocks a chunk accounts for, read or padded.
+ */
+static int copy_chunk_blocks(const copy_chunk_t* chunk) {
+	if (chunk->recovered >= 0) {
+		return chunk->to_read;
 	}
-	free(existing_buffer);
-	free(buffer);
-	free(targetname);
 
-	return result;
+	return (chunk->act_read > 0 ? chunk->act_read : 0) + chunk->blanks;
 }
 
 
+/**
+ * Records which blocks of a chunk written at block first of the output file
+ * were read and which were padded in the sector state sidecar.
+ */
+static void copy_chunk_mark(size_t first, const copy_chunk_t* chunk) {
+	int read_blocks = chunk->act_read > 0 ? chunk->act_read : 0;
+	int i;
 
-static void FreeSortArrays( int chapter_chapter_array[], int title_set_chapter_array[],
-		int angle_angle_array[], int title_set_angle_array[],
-		int subpicture_sub_array[], int title_set_sub_array[],
-		int audio_audio_array[], int title_set_audio_array[],
-		int size_size_array[], int title_set_size_array[],
-		int channels_channel_array[], int title_set_channel_array[]) {
+	if (job->sectors == NULL) {
+		return;
+	}
 
+	if (chunk->recovered >= 0) {
+		for (i = 0; i < chunk->to_read; ++i) {
+			sector_map_set(job->sectors, first + (size_t)i, 1,
+					chunk->padded[i / 8] & (1 << (i % 8)) ? SECTOR_PADDED : SECTOR_GOOD);
+		}
+		return;
+	}
 
-	free(chapter_chapter_array);
-	free(title_set_chapter_array);
+	sector_map_set(job->sectors, first, (size_t)read_blocks, SECTOR_GOOD);
+	if (chunk->blanks > 0) {
+		sector_map_set(job->sectors, first + (size_t)read_blocks, (size_t)chunk->blanks, SECTOR_PADDED);
+	}
+}
 
-	free(angle_angle_array);
-	free(title_set_angle_array);
 
-	free(subpicture_sub_array);
-	free(title_set_sub_array);
+/**
+ * Hands the blocks of a chunk, including the zero padding, to the --manifest
+ * hash and the --crc-index checksums of the file.
+ */
+static void copy_chunk_hash(const copy_chunk_t* chunk) {
+	int i;
 
-	free(audio_audio_array);
-	free(title_set_audio_array);
+	if (job->hasher == NULL && job->checksums == NULL) {
+		return;
+	}
 
-	free(size_size_array);
-	free(title_set_size_array);
+	if (chunk->recovered >= 0) {
+		manifest_data(chunk->data, (size_t)chunk->to_read * DVD_VIDEO_LB_LEN);
+		checksum_data(chunk->data, (size_t)chunk->to_read * DVD_VIDEO_LB_LEN);
+		for (i = 0; i < chunk->to_read; ++i) {
+			if (chunk->padded[i / 8] & (1 << (i % 8))) {
+				job->manifest_padded++;
+			}
+		}
+		return;
+	}
 
-	free(channels_channel_array);
-	free(title_set_channel_array);
+	if (chunk->act_read > 0) {
+		manifest_data(chunk->data, (size_t)chunk->act_read * DVD_VIDEO_LB_LEN);
+		checksum_data(chunk->data, (size_t)chunk->act_read * DVD_VIDEO_LB_LEN);
+	}
+	if (chunk->blanks > 0) {
+		manifest_data(NULL, (size_t)chunk->blanks * DVD_VIDEO_LB_LEN);
+		checksum_data(NULL, (size_t)chunk->blanks * DVD_VIDEO_LB_LEN);
+		job->manifest_padded += (size_t)chunk->blanks;
+	}
 }
 
 
-static titles_info_t * DVDGetInfo(dvd_reader_t * _dvd) {
+/**
+ * Reports and writes one chunk produced by copy_chunk_read() at *position,
+ * including the zero padding for unreadable blocks, and advances *position.
+ * slot is the --async-io buffer the chunk was read into or -1. Returns 0 on
+ * success.
+ */
+static int copy_chunk_write(int destination, off_t* position, const copy_chunk_t* chunk,
+		int slot, const char* label, const unsigned char* buffer_zero) {
+	int act_read = chunk->act_read;
+	off_t start = *position;
 
-	/* title interation */
-	int counter, i, f;
+	/* before an --async-io write takes the buffer */
+	copy_chunk_hash(chunk);
 
-	/* Our guess */
-	int candidate;
-	int multi = 0;
-	int dual = 0;
+	if (act_read != chunk->to_read) {
+		if (progress) {
+			fprintf(stdout, "\n");
+		}
+		if (act_read >= 0) {
+			fprintf(stderr, _("Error reading %s at block %d\n"), label, chunk->offset + act_read);
+		} else {
+			fprintf(stderr, _("Error reading %s at block %d, read error returned\n"), label, chunk->offset);
+		}
+	}
 
+	/* bisection already zero filled what it could not read */
+	if (chunk->recovered >= 0) {
+		act_read = chunk->to_read;
+	}
 
-	int titles;
-	int title_sets;
+	if (act_read > 0) {
+		/* Writing blocks */
+		if (async_output) {
+			if (output_write(destination, *position, chunk->data, act_read * DVD_VIDEO_LB_LEN, slot) != 0) {
+				if (progress) {
+					fprintf(stdout, "\n");
+				}
+				fprintf(stderr, _("Error writing %s.\n"), label);
+				return 1;
+			}
+		} else if (output_append(destination, chunk->data, act_read * DVD_VIDEO_LB_LEN) != act_read * DVD_VIDEO_LB_LEN) {
+			if (progress) {
+				fprintf(stdout, "\n");
+			}
+			fprintf(stderr, _("Error writing %s.\n"), label);
+			return 1;
+		}
+		*position += (off_t)act_read * DVD_VIDEO_LB_LEN;
+	} else if (slot >= 0) {
+		output_async_release(slot);
+	}
 
-	/* Arrays for chapter, angle, subpicture, audio, size, aspect, channels - file_set relationship */
+	if (chunk->recovered >= 0) {
+		if (progress) {
+			fprintf(stdout, "\n");
+		}
+		fprintf(stderr, _("bisection recovered %d of %d blocks, padding %d\n"),
+				chunk->recovered, chunk->to_read - (chunk->act_read > 0 ? chunk->act_read : 0),
+				chunk->to_read - (chunk->act_read > 0 ? chunk->act_read : 0) - chunk->recovered);
+	} else if (act_read != chunk->to_read) {
+		if (progress) {
+			fprintf(stdout, "\n");
+		}
 
-	/* Size == number_of_titles */
-	int * chapter_chapter_array;
-	int * title_set_chapter_array;
+		if (chunk->blanks < 0) {
+			fprintf(stderr, _("aborting\n"));
+			return 1;
+		} else if (chunk->blanks == 1) {
+			fprintf(stderr, _("padding single block\n"));
+		} else {
+			fprintf(stderr, _("padding %d blocks\n"), chunk->blanks);
+		}
 
-	int * angle_angle_array;
-	int * title_set_angle_array;
+		if (sparse_output) {
+			if (output_skip(destination, *position, (size_t)chunk->blanks * DVD_VIDEO_LB_LEN) != 0) {
+				fprintf(stderr, _("Error writing %s (padding)\n"), label);
+				perror(PACKAGE);
+				return 1;
+			}
+		} else if (async_output) {
+			if (output_write(destination, *position, buffer_zero, chunk->blanks * DVD_VIDEO_LB_LEN, -1) != 0) {
+				fprintf(stderr, _("Error writing %s (padding)\n"), label);
+				return 1;
+			}
+		} else if (output_append(destination, buffer_zero, chunk->blanks * DVD_VIDEO_LB_LEN) != chunk->blanks * DVD_VIDEO_LB_LEN) {
+			fprintf(stderr, _("Error writing %s (padding)\n"), label);
+			return 1;
+		}
+		*position += (off_t)chunk->blanks * DVD_VIDEO_LB_LEN;
+	}
 
-	/* Size == number_of_title_sets */
+	copy_chunk_mark((size_t)(start / DVD_VIDEO_LB_LEN), chunk);
+	return 0;
+}
 
-	int * subpicture_sub_array;
-	int * title_set_sub_array;
 
-	int * audio_audio_array;
-	int * title_set_audio_array;
+static void copy_report_progress(int total, int remaining) {
+	int done = total - remaining; // blocks done
 
-	int * size_size_array;
-	int * title_set_size_array;
+	if (drive_job_count > 0) {
+		drives_report_progress(done, total);
+	} else if (remaining < BUFFER_SIZE || (done % BUFFER_SIZE) == 0) { // don't print too often
+		float doneMiB = (float)(done) / 512.0f; // [MiB] done
+		float totalMiB = (float)(total) / 512.0f; // total size in [MiB]
+		fprintf(stdout, "\r");
+		fprintf(stdout, _("Copying %s: %.0f%% done (%.0f/%.0f MiB)"),
+				job->progress_text, doneMiB / totalMiB * 100.0f, doneMiB, totalMiB);
+		fflush(stdout);
+	}
+}
 
-	int * channels_channel_array;
-	int * title_set_channel_array;
 
-	/* Temp helpers */
-	int channels;
-	int found;
-	int chapters_1;
-	int chapters_2;
-	int found_chapter;
-	int number_of_multi;
+/**
+ * Reader side of the copy pipeline: reads chunks from the DVD into free ring
+ * slots until the range is done, an abort is requested by the error strategy
+ * or the writer cancels.
+ */
+static void* copy_pipeline_reader(void* arg) {
+	copy_pipeline_t* pipe = (copy_pipeline_t*)arg;
+	int offset = pipe->offset;
+	int remaining = pipe->size;
 
+	job = pipe->job;
+	while (remaining > 0) {
+		copy_chunk_t* chunk;
+		int advance;
 
-	/* DVD handlers */
-	ifo_handle_t* vmg_ifo = NULL;
-	dvd_file_t* vts_title_file = NULL;
+		pthread_mutex_lock(&pipe->lock);
+		while (pipe->count == PIPELINE_DEPTH && !pipe->cancel) {
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		}
+		if (pipe->cancel) {
+			pthread_mutex_unlock(&pipe->lock);
+			break;
+		}
+		chunk = &pipe->chunks[(pipe->head + pipe->count) % PIPELINE_DEPTH];
+		pthread_mutex_unlock(&pipe->lock);
 
-	titles_info_t* titles_info = NULL;
+		chunk->offset = offset;
+		chunk->to_read = remaining < BUFFER_SIZE ? remaining : BUFFER_SIZE;
+		copy_chunk_read(pipe->dvd_file, chunk, pipe->errorstrat);
 
-	/* Open main info file */
-	vmg_ifo = ifoOpen( _dvd, 0 );
-	if(!vmg_ifo) {
-		fprintf( stderr, _("Cannot open VMG info.\n"));
-		return (0);
+		pthread_mutex_lock(&pipe->lock);
+		pipe->count++;
+		pthread_cond_broadcast(&pipe->cond);
+		pthread_mutex_unlock(&pipe->lock);
+
+		if (chunk->blanks < 0) {
+			break;
+		}
+
+		/* pretend we read what we padded */
+		advance = copy_chunk_blocks(chunk);
+		offset += advance;
+		remaining -= advance;
 	}
 
-	titles = vmg_ifo->tt_srpt->nr_of_srpts;
-	title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+	pthread_mutex_lock(&pipe->lock);
+	pipe->reader_done = 1;
+	pthread_cond_broadcast(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
 
-	if ((vmg_ifo->tt_srpt == 0) || (vmg_ifo->vts_atrt == 0)) {
-		ifoClose(vmg_ifo);
-		return(0);
+	return NULL;
+}
+
+
+/**
+ * Same as the sequential loop in DVDCopyBlocks(), but the DVD is read by a
+ * separate thread while this thread writes the previous chunks, so the drive
+ * keeps streaming while the output disk is busy.
+ */
+static int DVDCopyBlocksPipelined(dvd_file_t* dvd_file, int destination, int offset,
+		int size, const char* label, read_error_strategy_t errorstrat) {
+	copy_pipeline_t pipe;
+	pthread_t reader;
+	unsigned char* buffers;
+	unsigned char* buffer_zero;
+	int remaining = size;
+	int result = 0;
+	off_t position = 0;
+	off_t written_from;
+	write_behind_t wb = {0};
+	size_t i;
+
+	/* a resumed copy starts in the middle of the file */
+	if (!tar_output) {
+		position = lseek(destination, 0, SEEK_CUR) - image_fd_base(destination);
+	}
+
+	buffers = alloc_blocks((size_t)PIPELINE_DEPTH * BUFFER_SIZE);
+	buffer_zero = alloc_blocks(BUFFER_SIZE);
+	if (buffers == NULL || buffer_zero == NULL) {
+		fprintf(stderr, _("Out of memory copying %s\n"), label);
+		free(buffers);
+		free(buffer_zero);
+		return 1;
 	}
 
+	memset(&pipe, 0, sizeof(pipe));
+	memset(buffer_zero, 0, (size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
+	pthread_mutex_init(&pipe.lock, NULL);
+	pthread_cond_init(&pipe.cond, NULL);
+	for (i = 0; i < PIPELINE_DEPTH; ++i) {
+		pipe.chunks[i].data = buffers + i * BUFFER_SIZE * DVD_VIDEO_LB_LEN;
+	}
+	pipe.dvd_file = dvd_file;
+	pipe.offset = offset;
+	pipe.size = size;
+	pipe.errorstrat = errorstrat;
+	pipe.job = job;
 
-	if((titles_info = (titles_info_t *)malloc(sizeof(titles_info_t))) == NULL) {
-		fprintf(stderr, _("Out of memory creating titles info structure\n"));
-		return NULL;
+	if (pthread_create(&reader, NULL, copy_pipeline_reader, &pipe) != 0) {
+		fprintf(stderr, _("Failed to start reader thread for %s\n"), label);
+		result = 1;
+		goto pipeline_cleanup;
 	}
 
-	titles_info->titles = (titles_t *)malloc((titles)* sizeof(titles_t));
-	titles_info->number_of_titles = titles;
+	for (;;) {
+		copy_chunk_t* chunk;
 
+		pthread_mutex_lock(&pipe.lock);
+		while (pipe.count == 0 && !pipe.reader_done) {
+			pthread_cond_wait(&pipe.cond, &pipe.lock);
+		}
+		if (pipe.count == 0) {
+			pthread_mutex_unlock(&pipe.lock);
+			break;
+		}
+		chunk = &pipe.chunks[pipe.head];
+		pthread_mutex_unlock(&pipe.lock);
 
-	chapter_chapter_array = malloc(titles * sizeof(int));
-	title_set_chapter_array = malloc(titles * sizeof(int));
+		written_from = position;
+		if (copy_chunk_write(destination, &position, chunk, -1, label, buffer_zero) != 0) {
+			result = 1;
+		} else {
+			write_behind_note(destination, &wb, written_from, (size_t)(position - written_from));
+			remaining -= copy_chunk_blocks(chunk);
+			journal_checkpoint(destination, label, 0, offset + size - remaining,
+					position, position - written_from, 0);
+			if (progress) {
+				copy_report_progress(size, remaining);
+			}
+		}
 
-	/*currently not used in the guessing */
-	angle_angle_array = malloc(titles * sizeof(int));
-	title_set_angle_array = malloc(titles * sizeof(int));
+		pthread_mutex_lock(&pipe.lock);
+		pipe.head = (pipe.head + 1) % PIPELINE_DEPTH;
+		pipe.count--;
+		if (result != 0) {
+			pipe.cancel = 1;
+		}
+		pthread_cond_broadcast(&pipe.cond);
+		pthread_mutex_unlock(&pipe.lock);
 
+		if (result != 0) {
+			break;
+		}
+	}
 
-	subpicture_sub_array = malloc(title_sets * sizeof(int));
-	title_set_sub_array = malloc(title_sets * sizeof(int));
+	pthread_join(reader, NULL);
 
-	audio_audio_array = malloc(title_sets * sizeof(int));
-	title_set_audio_array = malloc(title_sets * sizeof(int));
+	if (output_flush(label) != 0) {
+		result = 1;
+	}
+	write_behind_finish(destination, &wb);
 
-	size_size_array = malloc(title_sets * sizeof(int));
-	title_set_size_array = malloc(title_sets * sizeof(int));
+	if (result == 0 && progress) {
+		fprintf(stdout, "\n");
+	}
 
-	channels_channel_array = malloc(title_sets * sizeof(int));
-	title_set_channel_array = malloc(title_sets * sizeof(int));
+pipeline_cleanup:
+	pthread_cond_destroy(&pipe.cond);
+	pthread_mutex_destroy(&pipe.lock);
+	free(buffer_zero);
+	free(buffers);
+	return result;
+}
 
-	/* Check mallocs */
-	if(!titles_info->titles || !chapter_chapter_array || !title_set_chapter_array ||
-			!angle_angle_array || !title_set_angle_array || !subpicture_sub_array ||
-			!title_set_sub_array || !audio_audio_array || !title_set_audio_array ||
-			!size_size_array || !title_set_size_array || !channels_channel_array ||
-			!title_set_channel_array) {
-		fprintf(stderr, _("Out of memory creating arrays for titles info\n"));
-		free(titles_info);
-		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-						angle_angle_array, title_set_angle_array,
-						subpicture_sub_array, title_set_sub_array,
-						audio_audio_array, title_set_audio_array,
-						size_size_array, title_set_size_array,
-						channels_channel_array, title_set_channel_array);
-		return NULL;
-	}
 
-	/* Interate over the titles nr_of_srpts */
-	for(counter = 0; counter < titles; counter++) {
-		/* For titles_info */
-		titles_info->titles[counter].title = counter + 1;
-		titles_info->titles[counter].title_set = vmg_ifo->tt_srpt->title[counter].title_set_nr;
-		titles_info->titles[counter].vts_title = vmg_ifo->tt_srpt->title[counter].vts_ttn;
-		titles_info->titles[counter].chapters = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
-		titles_info->titles[counter].angles = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
+static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int size,
+		const char* path, const char* label, read_error_strategy_t errorstrat) {
+	int result = 0;
 
-		/* For main title*/
-		chapter_chapter_array[counter] = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
-		title_set_chapter_array[counter] = vmg_ifo->tt_srpt->title[counter].title_set_nr;
-		angle_angle_array[counter] = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
-		title_set_angle_array[counter] = vmg_ifo->tt_srpt->title[counter].title_set_nr;
+	if (fill_gaps) {
+		return DVDCopyBlocksFillGaps(dvd_file, destination, offset, size, path, label, errorstrat);
 	}
 
-	/* Interate over vmg_nr_of_title_sets */
+	if (pipeline) {
+		return DVDCopyBlocksPipelined(dvd_file, destination, offset, size, label, errorstrat);
+	}
 
-	for(counter = 0; counter < title_sets; counter++) {
+	/* all sizes are in DVD logical blocks */
+	int remaining = size;
+	int total = size; // total size in blocks
+	copy_chunk_t chunk;
+	off_t position = 0;
+	off_t written_from;
+	write_behind_t wb = {0};
+	int slot = -1;
+
+	/* Write buffers, page aligned for --direct-io */
+	unsigned char* buffer = alloc_blocks(BUFFER_SIZE);
+	unsigned char* buffer_zero = alloc_blocks(BUFFER_SIZE);
+
+	if (buffer == NULL || buffer_zero == NULL) {
+		fprintf(stderr, _("Out of memory copying %s\n"), label);
+		free(buffer);
+		free(buffer_zero);
+		return 1;
+	}
+	memset(buffer_zero, 0, (size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
 
-		/* Picture*/
-		subpicture_sub_array[counter] = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
-		title_set_sub_array[counter] = counter + 1;
+	chunk.data = buffer;
+	chunk.to_read = BUFFER_SIZE;
 
+	/* a resumed copy starts in the middle of the file */
+	if (!tar_output) {
+		position = lseek(destination, 0, SEEK_CUR) - image_fd_base(destination);
+	}
 
-		/* Audio */
-		audio_audio_array[counter] = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
-		title_set_audio_array[counter] = counter + 1;
+	while( remaining > 0 ) {
 
-		channels=0;
-		for(i = 0; i < audio_audio_array[counter]; i++) {
-			if ( channels < vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1) {
-				channels = vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1;
-			}
+		if (chunk.to_read > remaining) {
+			chunk.to_read = remaining;
+		}
 
+		/* Read straight into a registered buffer of the output queue */
+		if (async_output) {
+			chunk.data = output_async_buffer(&slot);
 		}
-		channels_channel_array[counter] = channels;
-		title_set_channel_array[counter] = counter + 1;
 
-		/* For titles_info */
-		for (f=0; f < titles_info->number_of_titles ; f++ ) {
-			if ( titles_info->titles[f].title_set == counter + 1 ) {
-				titles_info->titles[f].aspect_ratio = vmg_ifo->vts_atrt->vts[counter].vtstt_vobs_video_attr.display_aspect_ratio;
-				titles_info->titles[f].sub_pictures = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
-				titles_info->titles[f].audio_tracks = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
-				titles_info->titles[f].audio_channels = channels;
-			}
+		/* Reading blocks */
+		chunk.offset = offset;
+		copy_chunk_read(dvd_file, &chunk, errorstrat);
+
+		/* Writing blocks */
+		written_from = position;
+		if (copy_chunk_write(destination, &position, &chunk, slot, label, buffer_zero) != 0) {
+			output_flush(label);
+			result = 1;
+			break;
+		}
+		write_behind_note(destination, &wb, written_from, (size_t)(position - written_from));
+
+		/* pretend we read what we padded */
+		offset += copy_chunk_blocks(&chunk);
+		remaining -= copy_chunk_blocks(&chunk);
+		journal_checkpoint(destination, path, 0, offset, position, position - written_from, 0);
+
+		if(progress) {
+			copy_report_progress(total, remaining);
 		}
 
 	}
 
+	if (result == 0 && output_flush(label) != 0) {
+		result = 1;
+	}
+	write_behind_finish(destination, &wb);
 
+	if(result == 0 && progress) {
+		fprintf(stdout, "\n");
+	}
 
+	free(buffer_zero);
+	free(buffer);
+	return result;
+}
 
-	for (counter=0; counter < title_sets; counter++ ) {
 
-		vts_title_file = DVDOpenFile(_dvd, counter + 1, DVD_READ_TITLE_VOBS);
 
-		if(vts_title_file != 0) {
-			size_size_array[counter] = DVDFileSize(vts_title_file);
-			DVDCloseFile(vts_title_file);
-		} else {
-			size_size_array[counter] = 0;
-		}
+static int DVDCopyTitleVobX(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, int vob, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
 
-		title_set_size_array[counter] = counter + 1;
+	/* Loop variable */
+	int i;
 
+	/* Temp filename,dirname */
+	// filename is either "VIDEO_TS.VOB" or "VTS_XX_X.VOB" and terminating "\0"
+	char filename[13] = "VIDEO_TS.VOB";
+	char *targetname;
+	size_t targetname_length;
+	struct stat fileinfo;
 
-	}
+	/* File Handler */
+	int streamout;
 
+	int size;
 
-	/* Sort all arrays max to min */
+	int offset = 0;
+	int tsize;
 
-	bsort_max_to_min(chapter_chapter_array, title_set_chapter_array, titles);
-	bsort_max_to_min(angle_angle_array, title_set_angle_array, titles);
-	bsort_max_to_min(subpicture_sub_array, title_set_sub_array, title_sets);
-	bsort_max_to_min(audio_audio_array, title_set_audio_array, title_sets);
-	bsort_max_to_min(size_size_array, title_set_size_array, title_sets);
-	bsort_max_to_min(channels_channel_array, title_set_channel_array, title_sets);
+	/* Blocks kept from an interrupted copy with --resume */
+	int done = 0;
+	journal_entry_t entry;
+	uint32_t key;
 
+	/* DVD handler */
+	dvd_file_t* dvd_file=NULL;
 
-	/* Check if the second biggest one actually can be a feature title */
-	/* Here we will take do biggest/second and if that is bigger than one it's not a feauture title */
-	/* Now this is simply not enough since we have to check that the diff between the two of them is small enough
-	 to consider the second one a feature title we are doing two checks (biggest + biggest - second) /second == 1
-	 and biggest%second * 3 < biggest */
+	/* Return value */
+	int result;
 
-	if ( title_sets > 1 && CheckSizeArray(size_size_array, 0, 1) == 1 ) {
-		/* We have a dual DVD with two feature films - now let's see if they have the same amount of chapters*/
 
-		chapters_1 = 0;
-		for (i=0 ; i < titles ; i++ ) {
-			if (titles_info->titles[i].title_set == title_set_size_array[0] ) {
-				if ( chapters_1 < titles_info->titles[i].chapters){
-					chapters_1 = titles_info->titles[i].chapters;
-				}
-			}
+	/* create filename VIDEO_TS.VOB or VTS_XX_X.VOB */
+	if(title_set > 0) {
+		sprintf(filename, "VTS_%02i_%1i.VOB", title_set, vob);
+	}
+
+	if (title_set_info->number_of_title_sets + 1 < title_set) {
+		fprintf(stderr,_("Failed num title test\n"));
+		return(1);
+	}
+
+	if (title_set_info->title_set[title_set].number_of_vob_files < vob ) {
+		fprintf(stderr,_("Failed vob test\n"));
+		return(1);
+	}
+
+	if (title_set_info->title_set[title_set].size_vob[0] == 0 ) {
+		fprintf(stderr,_("Failed vob 1 size test\n"));
+		return(0);
+	} else if (title_set_info->title_set[title_set].size_vob[vob - 1] == 0 ) {
+		fprintf(stderr,_("Failed vob %d test\n"), vob);
+		return(0);
+	} else {
+		size = title_set_info->title_set[title_set].size_vob[vob - 1]/DVD_VIDEO_LB_LEN;
+		if (title_set_info->title_set[title_set].size_vob[vob - 1]%DVD_VIDEO_LB_LEN != 0) {
+			fprintf(stderr, _("The Title VOB number %d of title set %d does not have a valid DVD size\n"), vob, title_set);
+			return(1);
 		}
+	}
+#ifdef DEBUG
+	fprintf(stderr,"After we check the vob it self %d\n", vob);
+#endif
 
-		chapters_2 = 0;
-		for (i=0 ; i < titles ; i++ ) {
-			if (titles_info->titles[i].title_set == title_set_size_array[1] ) {
-				if ( chapters_2 < titles_info->titles[i].chapters){
-					chapters_2 = titles_info->titles[i].chapters;
-				}
-			}
+	/* Create VTS_XX_X.VOB */
+	if (title_set == 0) {
+		fprintf(stderr,_("Do not try to copy a Title VOB from the VMG domain; there are none.\n"));
+		return(1);
+	} else {
+		// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/<filename>" and terminating "\0"
+		targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
+		targetname = malloc(targetname_length);
+		if (targetname == NULL) {
+			fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
+			return 1;
 		}
+		snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
+	}
 
-		if(vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio ==
-			vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio) {
-			/* In this case it's most likely so that we have a dual film but with different context
-			They are with in the same size range and have the same aspect ratio
-			I would guess that such a case is e.g. a DVD containing several episodes of a TV serie*/
-			candidate = title_set_size_array[0];
-			multi = 1;
-		} else if ( chapters_1 == chapters_2 && vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio !=
-			vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio){
-			/* In this case we have (guess only) the same context - they have the same number of chapters but different aspect ratio and are in the same size range*/
-			if ( vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio == aspect) {
-				candidate = title_set_size_array[0];
-			} else if ( vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio == aspect) {
-				candidate = title_set_size_array[1];
-			} else {
-				/* Okay we didn't have the prefered aspect ratio - just make the biggest one a candidate */
-				/* please send report if this happens*/
-				fprintf(stderr, _("You have encountered a very special DVD; please send a bug report along with all IFO files from this title\n"));
-				candidate = title_set_size_array[0];
+
+
+	/* Now figure out the offset we will start at also check that the previus files are of valid DVD size */
+	for ( i = 0; i < vob - 1; i++ ) {
+		tsize = title_set_info->title_set[title_set].size_vob[i];
+		if (tsize%DVD_VIDEO_LB_LEN != 0) {
+			fprintf(stderr, _("The Title VOB number %d of title set %d does not have a valid DVD size\n"), i + 1, title_set);
+			free(targetname);
+			return(1);
+		} else {
+			offset = offset + tsize/DVD_VIDEO_LB_LEN;
+		}
+	}
+#ifdef DEBUG
+	fprintf(stderr,"The offset for vob %d is %d\n", vob, offset);
+#endif
+
+	/* the journal knows the file by where it is on the disc */
+	key = journal_key(JOURNAL_KEY_INIT, filename, strlen(filename));
+	key = journal_key(key, &offset, sizeof(offset));
+	key = journal_key(key, &size, sizeof(size));
+	open_journal(targetname, key);
+
+	if (target_stat(targetname, &fileinfo) == 0) {
+		if (! S_ISREG(fileinfo.st_mode)) {
+			/* TRANSLATORS: The sentence starts with "The title file %s is not valid[...]" */
+			fprintf(stderr,_("The %s %s is not valid, it may be a directory.\n"), _("title file"), targetname);
+			close_journal();
+			free(targetname);
+			return(1);
+		}
+		if (fill_gaps) {
+			fprintf(stderr, _("The %s %s exists; checking for gaps.\n"), _("title file"), targetname);
+			streamout = target_open(targetname, O_RDWR, 0666);
+		} else if (journal_resume_point(&entry) && strcmp(entry.file, filename) == 0
+				&& entry.blocks >= 0 && entry.blocks <= size
+				&& (off_t)entry.blocks * DVD_VIDEO_LB_LEN <= fileinfo.st_size) {
+			if (entry.blocks == size) {
+				fprintf(stderr, _("The %s %s was completed before; skipping.\n"), _("title file"), targetname);
+				close_journal();
+				free(targetname);
+				return(0);
+			}
+			fprintf(stderr, _("The %s %s was interrupted; resuming at block %d.\n"), _("title file"), targetname, entry.blocks);
+			done = entry.blocks;
+			/* --crc-index reads back the extent the copy stopped in */
+			streamout = open_output(targetname, crc_index ? O_RDWR : O_WRONLY, 0666);
+			if (streamout != -1 && resume_output(streamout, targetname, done) != 0) {
+				target_close(streamout);
+				close_journal();
+				free(targetname);
+				return(1);
 			}
-			dual = 1;
 		} else {
-			/* Can this case ever happen? */
-			candidate = title_set_size_array[0];
+			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("title file"), targetname);
+			streamout = open_output(targetname, O_WRONLY | O_TRUNC, 0666);
+		}
+		if (streamout == -1) {
+			fprintf(stderr, _("Error opening %s\n"), targetname);
+			perror(PACKAGE);
+			close_journal();
+			free(targetname);
+			return(1);
 		}
 	} else {
-		candidate = title_set_size_array[0];
+		int create_flags = fill_gaps ? (O_RDWR | O_CREAT) : (O_WRONLY | O_CREAT);
+		if ((streamout = open_output(targetname, create_flags, 0666)) == -1) {
+			fprintf(stderr, _("Error creating %s\n"), targetname);
+			perror(PACKAGE);
+			close_journal();
+			free(targetname);
+			return(1);
+		}
 	}
 
+	if (!fill_gaps && preallocate_file(streamout, targetname, (off_t)size * DVD_VIDEO_LB_LEN) != 0) {
+		target_close(streamout);
+		close_journal();
+		free(targetname);
+		return(1);
+	}
 
-	/* Lets start checking audio,sub pictures and channels my guess is namly that a special suburb will put titles with a lot of
-	 chapters just to make our backup hard */
-
+	if ((dvd_file = open_dvd_file(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
+		fprintf(stderr, _("Failed opening TITLE VOB\n"));
+		target_close(streamout);
+		close_journal();
+		free(targetname);
+		return(1);
+	}
 
-	found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
-			subpicture_sub_array, title_set_sub_array,
-			channels_channel_array, title_set_channel_array,
-			0 , candidate, title_sets);
+	/* supersede what the journal says about an earlier copy of the file */
+	if (done == 0) {
+		journal_checkpoint(streamout, targetname, 0, offset, 0, 0, 1);
+	}
 
+	open_sector_map(targetname, (size_t)size, !fill_gaps && done == 0);
+	open_checksums(streamout, targetname, (size_t)size, !fill_gaps && done == 0, (size_t)done);
+	manifest_begin(targetname);
+	result = DVDCopyBlocks(dvd_file, streamout, offset + done, size - done, targetname, filename, errorstrat);
+	manifest_end(title_name, targetname, result);
+	close_checksums(streamout, targetname, (size_t)size);
+	close_sector_map();
 
-	/* Now let's see if we can find our candidate among the top most chapters */
-	found_chapter=6;
-	for (i=0 ; (i < titles) && (i < 4) ; i++ ) {
-		if ( candidate == title_set_chapter_array[i] ) {
-			found_chapter=i+1;
-			break;
-		}
+	if (result == 0) {
+		journal_checkpoint(streamout, targetname, 0, offset + size, (off_t)size * DVD_VIDEO_LB_LEN, 0, 1);
 	}
+	close_journal();
 
-	/* Close the VMG ifo file we got all the info we need */
-	ifoClose(vmg_ifo);
+	close_dvd_file(dvd_file);
+	target_close(streamout);
+	free(targetname);
+	return result;
+}
 
 
-	if (((found == 3) && (found_chapter == 1) && (dual == 0) && (multi == 0)) || ((found == 3) && (found_chapter < 3 ) && (dual == 1))) {
+static int DVDCmpTitleVobX(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, int vob, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
+	char filename[13] = "VIDEO_TS.VOB";
+	char *targetname;
+	size_t targetname_length;
+	struct stat fileinfo;
+	dvd_file_t* dvd_file = NULL;
+	int fd = -1;
+	int size;
+	int offset = 0;
+	int tsize;
 
-		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-				angle_angle_array, title_set_angle_array,
-				subpicture_sub_array, title_set_sub_array,
-				audio_audio_array, title_set_audio_array,
-				size_size_array, title_set_size_array,
-				channels_channel_array, title_set_channel_array);
-		titles_info->main_title_set = candidate;
-		return(titles_info);
+	(void)errorstrat;
 
+	if(title_set > 0) {
+		sprintf(filename, "VTS_%02i_%1i.VOB", title_set, vob);
 	}
 
-	if (multi == 1) {
-		for (i=0 ; i < title_sets ; ++i) {
-			if (CheckSizeArray(size_size_array, 0, i + 1) == 0) {
-				break;
-			}
-		}
-		number_of_multi = i;
-		for (i = 0; i < number_of_multi; i++ ) {
-			if (title_set_chapter_array[0] == i + 1) {
-				candidate = title_set_chapter_array[0];
-			}
-		}
+	if (title_set_info->number_of_title_sets + 1 < title_set) {
+		return 1;
+	}
 
-		found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
-				subpicture_sub_array, title_set_sub_array,
-				channels_channel_array, title_set_channel_array,
-				0 , candidate, title_sets);
+	if (title_set_info->title_set[title_set].number_of_vob_files < vob ) {
+		return 1;
+	}
 
-		if (found == 3) {
-			FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-					angle_angle_array, title_set_angle_array,
-					subpicture_sub_array, title_set_sub_array,
-					audio_audio_array, title_set_audio_array,
-					size_size_array, title_set_size_array,
-					channels_channel_array, title_set_channel_array);
-			titles_info->main_title_set = candidate;
-			return(titles_info);
+	if (title_set_info->title_set[title_set].size_vob[0] == 0 ) {
+		return 1;
+	} else if (title_set_info->title_set[title_set].size_vob[vob - 1] == 0 ) {
+		return 1;
+	} else {
+		size = title_set_info->title_set[title_set].size_vob[vob - 1]/DVD_VIDEO_LB_LEN;
+		if (title_set_info->title_set[title_set].size_vob[vob - 1]%DVD_VIDEO_LB_LEN != 0) {
+			return 1;
 		}
 	}
 
-	/* We have now come to that state that we more or less have given up :( giving you a good guess of the main feature film*/
-	/*No matter what we will more or less only return the biggest VOB*/
-	/* Lets see if we can find our biggest one - then we return that one */
-	candidate = title_set_size_array[0];
-
-	found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
-			subpicture_sub_array, title_set_sub_array,
-			channels_channel_array, title_set_channel_array,
-			0 , candidate, title_sets);
-
-	/* Now let's see if we can find our candidate among the top most chapters */
-
-	found_chapter=5;
-	for (i=0 ; (i < titles) && (i < 4) ; i++ ) {
-		if ( candidate == title_set_chapter_array[i] ) {
-			found_chapter=i+1;
-			break;
+	for (int i = 0; i < vob - 1; i++) {
+		tsize = title_set_info->title_set[title_set].size_vob[i];
+		if (tsize % DVD_VIDEO_LB_LEN != 0) {
+			return 1;
 		}
-
+		offset += tsize / DVD_VIDEO_LB_LEN;
 	}
 
-	/* Here we take chapters in to consideration*/
-	if (found == 3) {
-		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-				angle_angle_array, title_set_angle_array,
-				subpicture_sub_array, title_set_sub_array,
-				audio_audio_array, title_set_audio_array,
-				size_size_array, title_set_size_array,
-				channels_channel_array, title_set_channel_array);
-		titles_info->main_title_set = candidate;
-		return(titles_info);
+	if ((dvd_file = open_dvd_file(dvd, title_set, DVD_READ_TITLE_VOBS)) == 0) {
+		return 1;
 	}
 
-	/* Here we do but we lower the treshold for audio, sub and channels */
-
-	if ((found > 1 ) && (found_chapter <= 4)) {
-		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-				angle_angle_array, title_set_angle_array,
-				subpicture_sub_array, title_set_sub_array,
-				audio_audio_array, title_set_audio_array,
-				size_size_array, title_set_size_array,
-				channels_channel_array, title_set_channel_array);
-		titles_info->main_title_set = candidate;
-		return(titles_info);
-
-		/* return it */
-	} else {
-		/* Here we give up and just return the biggest one :(*/
-		/* Just return the biggest badest one*/
-		FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-				angle_angle_array, title_set_angle_array,
-				subpicture_sub_array, title_set_sub_array,
-				audio_audio_array, title_set_audio_array,
-				size_size_array, title_set_size_array,
-				channels_channel_array, title_set_channel_array);
-		titles_info->main_title_set = candidate;
-		return(titles_info);
+	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
+	targetname = malloc(targetname_length);
+	if (targetname == NULL) {
+		close_dvd_file(dvd_file);
+		return 1;
 	}
+	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
 
+	/* --repair copies a missing file in full */
+	if (repair && target_stat(targetname, &fileinfo) != 0) {
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return DVDCopyTitleVobX(dvd, title_set_info, title_set, vob, targetdir, title_name, errorstrat);
+	}
 
-	/* Some radom thoughts about DVD guessing */
-	/* We will now gather as much data about the DVD-Video as we can and
-	then make a educated guess which one is the main feature film of it*/
-
-
-	/* Make a tripple array with chapters, angles and title sets
-	 - sort out dual title sets with a low number of chapters. Tradtionaly
-	 the title set with most chapters is the main film. Number of angles is
-	 keept as a reference point of low value*/
-
-	/* Make a dual array with number of audio streams, sub picture streams
-	 and title sets. Tradtionaly the main film has many audio streams
-	 since it's supposed be synchronised e.g. a English film synchronised/dubbed
-	 in German. We are also keeping track of sub titles since it's also indication
-	 of the main film*/
-
-	/* Which title set is the biggest one - dual array with title sets and size
-	 The biggest one is usally the main film*/
+	if (target_stat(targetname, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
+		if (gap_map) {
+			size_t base = job->gap_map_total_blocks;
+			gap_map_collect_missing(base, (size_t)size);
+			job->gap_map_total_blocks += size;
+		}
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
 
-	/* Which title set is belonging to title 1 and how many chapters has it. Once
-	 again tradtionaly title one is belonging to the main film*/
+	off_t expected_bytes = (off_t)size * DVD_VIDEO_LB_LEN;
+	if (fileinfo.st_size != expected_bytes && !repair) {
+		if (gap_map) {
+			size_t base = job->gap_map_total_blocks;
+			gap_map_collect_missing(base, (size_t)size);
+			job->gap_map_total_blocks += size;
+		}
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
 
-	/* Yes a lot of rant - but it helps me think - some sketch on paper or in the mind
-	 I sketch in the comments - beside it will help you understand the code*/
+	fd = target_open(targetname, repair ? O_RDWR : O_RDONLY, 0);
+	if (fd == -1) {
+		perror(PACKAGE);
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
 
-	/* Okay let's see if the biggest one has most chapters, it also has more subtitles
-	 and audio tracks than the second one and it's title one.
-	 Done it must be the main film
+	open_sector_map(targetname, (size_t)size, 0);
 
-	 Hmm the biggest one doesn't have the most chapters?
+	if (progress) {
+		snprintf(job->progress_text, MAXNAME, _("Title, part %i"), vob);
+	}
 
-	 See if the second one has the same amount of chapters and is the biggest one
-	 If so we probably have a 4:3 and 16:9 versions of film on the same disk
+	if (gap_map) {
+		size_t base = job->gap_map_total_blocks;
+		gap_plan_t plan = {0};
+		size_t blank_blocks = 0;
+		size_t full_blocks = 0;
+		off_t existing_bytes = 0;
+		if (scan_existing_file_for_gaps(fd, (size_t)size, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
+			gap_map_collect_from_plan(base, (size_t)size, &plan, full_blocks);
+		} else {
+			gap_map_collect_missing(base, (size_t)size);
+		}
+		gap_plan_free(&plan);
+		job->gap_map_total_blocks += size;
+		if (lseek(fd, image_fd_base(fd), SEEK_SET) == (off_t)-1) {
+			perror(PACKAGE);
+			close_sector_map();
+			target_close(fd);
+			free(targetname);
+			close_dvd_file(dvd_file);
+			return 1;
+		}
+	}
 
-	 Now we fetch the 16:9 by default unless the forced to do 4:3
-	 First check which one is which.
-	 If the 16:9 is the biggest one and has the same or more subtitle, audio streams
-	 then we are happy unless we are in force 4:3 mode :(
-	 The same goes in reverse if we are in force 4:3 mode
+	int cmp;
+	gap_plan_t mismatches = {0};
+	open_checksums(fd, targetname, (size_t)size, 0, 0);
+	if (job->checksums != NULL) {
+		cmp = DVDCmpChecksums(fd, size, targetname, repair ? &mismatches : NULL);
+	} else {
+		if (crc_index) {
+			fprintf(stderr, _("No checksum index for %s; comparing against the disc\n"), targetname);
+		}
+		cmp = DVDCmpBlocks(dvd_file, fd, offset, size, targetname, filename, errorstrat,
+				repair ? &mismatches : NULL);
+	}
+	if (mismatches.count > 0 && DVDRepairBlocks(dvd_file, fd, offset, &mismatches,
+			targetname, filename, errorstrat) != 0) {
+		cmp = 1;
+	}
+	gap_plan_free(&mismatches);
+	close_checksums(fd, targetname, (size_t)size);
 
+	close_sector_map();
+	target_close(fd);
+	free(targetname);
+	close_dvd_file(dvd_file);
+	return cmp;
+}
 
-	 Hmm, in force 4:3 mode - now we check how much smaller than the biggest one it is
-	 (or the reverse if we are in 16:9 mode)
 
-	 Generally a reverse division should render in 1 and with a small modulo - like wise
-	 a normal modulo should give us a high modulo
+static int DVDCopyMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
 
-	 If we get more than one it's of cource a fake however if we get just one we still need to check
-	 if we subtract the smaller one from the bigger one we should end up with a small number - hence we
-	 need to multiply it more than 4 times to get it bigger than the biggest one. Now we know that the
-	 two biggest once are really big and possibly carry the same film in differnet formats.
+	/* Temp filename,dirname */
+	// filename is either "VIDEO_TS.VOB" or "VTS_XX_0.VOB" and terminating "\0"
+	char filename[13] = "VIDEO_TS.VOB";
+	char *targetname;
+	size_t targetname_length;
+	struct stat fileinfo;
 
-	 We will now return the prefered one either 16:9 or 4:3 but we will first check that the one
-	 we return at lest has two or more audio tracks. We don't want it if the other one has a lot
-	 more sound (we may end up with a film that only has 2ch Dolby Digital so we want to check for
-	 6ch DTS or Dolby Digital. If the prefered one doesn't have those features but the other once has
-	 we will return the other one.
-	 */
+	/* File Handler */
+	int streamout;
 
-}
+	int size;
 
+	/* return value */
+	int result;
 
-static int DVDCopyBlocksFillGaps(dvd_file_t* dvd_file, int destination, int offset,
-		int size, const char* path, const char* label, read_error_strategy_t errorstrat) {
-	gap_plan_t plan = {0};
-	size_t blank_blocks = 0;
-	size_t existing_blocks = 0;
-	off_t existing_bytes = 0;
-	size_t truncated_blocks = 0;
-	size_t sample_slots[GAP_SAMPLE_TARGET];
-	size_t sample_count;
-	int result = 0;
+	/* DVD handler */
+	dvd_file_t* dvd_file = NULL;
 
-	if (scan_existing_file_for_gaps(destination, (size_t)size, &plan,
-			&blank_blocks, &existing_blocks, &existing_bytes) != 0) {
-		perror(PACKAGE);
-		gap_plan_free(&plan);
-		return 1;
+	/* create filename VIDEO_TS.VOB or VTS_XX_0.VOB */
+	if(title_set > 0) {
+		sprintf(filename, "VTS_%02i_0.VOB", title_set);
 	}
 
-	if ((size_t)size < existing_blocks) {
-		existing_blocks = (size_t)size;
+	if (title_set_info->number_of_title_sets + 1 < title_set) {
+		return(1);
 	}
 
-	if ((size_t)size > existing_blocks) {
-		size_t missing = (size_t)size - existing_blocks;
-		if (gap_plan_add(&plan, existing_blocks, missing) != 0) {
-			gap_plan_free(&plan);
-			return 1;
+	if (title_set_info->title_set[title_set].size_menu == 0 ) {
+		return(0);
+	} else {
+		size = title_set_info->title_set[title_set].size_menu/DVD_VIDEO_LB_LEN;
+		if (title_set_info->title_set[title_set].size_menu%DVD_VIDEO_LB_LEN != 0) {
+			fprintf(stderr, _("Warning: The Menu VOB of title set %d (%s) does not have a valid DVD size.\n"), title_set, filename);
 		}
-		truncated_blocks = missing;
 	}
 
-	sample_count = gap_collect_samples(&plan, (size_t)size, GAP_SAMPLE_TARGET, sample_slots);
-	if (sample_count > 0) {
-		if (gap_verify_samples(destination, dvd_file, offset,
-				label ? label : path, sample_slots, sample_count) != 0) {
-			gap_plan_free(&plan);
-			return 1;
-		}
+	if ((dvd_file = open_dvd_file(dvd, title_set, DVD_READ_MENU_VOBS))== 0) {
+		fprintf(stderr, _("Failed opening %s\n"), filename);
+		return(1);
 	}
 
-	size_t blank_after = blank_blocks;
-	size_t truncated_after = truncated_blocks;
-	size_t filled_blocks = 0;
-	int fill_status = gap_fill_from_plan(destination, dvd_file, offset, &plan,
-			label ? label : path, errorstrat, &filled_blocks);
-
-	gap_plan_free(&plan);
-
-	if (fill_status == 0) {
-		gap_plan_t verify_plan = (gap_plan_t){0};
-		size_t verify_blank = 0;
-		size_t verify_existing_blocks = 0;
-		off_t verify_bytes = 0;
+	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/<filename>" and terminating "\0"
+	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
+	targetname = malloc(targetname_length);
+	if (targetname == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
+		return 1;
+	}
+	/* Create VIDEO_TS.VOB or VTS_XX_0.VOB */
+	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
 
-		if (scan_existing_file_for_gaps(destination, (size_t)size, &verify_plan,
-				&verify_blank, &verify_existing_blocks, &verify_bytes) == 0) {
-			blank_after = verify_blank;
-			if ((size_t)size > verify_existing_blocks) {
-				truncated_after = (size_t)size - verify_existing_blocks;
-			} else {
-				truncated_after = 0;
-			}
+	if (target_stat(targetname, &fileinfo) == 0) {
+		if (! S_ISREG(fileinfo.st_mode)) {
+			/* TRANSLATORS: The sentence starts with "The menu file %s is not valid[...]" */
+			fprintf(stderr,_("The %s %s is not valid, it may be a directory.\n"), _("menu file"), targetname);
+			close_dvd_file(dvd_file);
+			free(targetname);
+			return(1);
+		}
+		if (fill_gaps) {
+			fprintf(stderr, _("The %s %s exists; checking for gaps.\n"), _("menu file"), targetname);
+			streamout = target_open(targetname, O_RDWR, 0666);
+		} else {
+			/* TRANSLATORS: The sentence starts with "The menu file %s exists[...]" */
+			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("menu file"), targetname);
+			streamout = open_output(targetname, O_WRONLY | O_TRUNC, 0666);
+		}
+		if (streamout == -1) {
+			fprintf(stderr, _("Error opening %s\n"), targetname);
+			perror(PACKAGE);
+			close_dvd_file(dvd_file);
+			free(targetname);
+			return(1);
+		}
+	} else {
+		int create_flags = fill_gaps ? (O_RDWR | O_CREAT) : (O_WRONLY | O_CREAT);
+		if ((streamout = open_output(targetname, create_flags, 0666)) == -1) {
+			fprintf(stderr, _("Error creating %s\n"), targetname);
+			perror(PACKAGE);
+			close_dvd_file(dvd_file);
+			free(targetname);
+			return(1);
 		}
-		gap_plan_free(&verify_plan);
 	}
 
-	gap_print_report(path, (size_t)size,
-			blank_blocks, truncated_blocks,
-			blank_after, truncated_after,
-			filled_blocks);
+	if (!fill_gaps && preallocate_file(streamout, targetname, (off_t)size * DVD_VIDEO_LB_LEN) != 0) {
+		close_dvd_file(dvd_file);
+		target_close(streamout);
+		free(targetname);
+		return(1);
+	}
 
-	if (fill_status != 0) {
-		result = 1;
+	if(progress) {
+		strncpy(job->progress_text, _("menu"), MAXNAME);
 	}
 
+	open_sector_map(targetname, (size_t)size, !fill_gaps);
+	open_checksums(streamout, targetname, (size_t)size, !fill_gaps, 0);
+	manifest_begin(targetname);
+	result = DVDCopyBlocks(dvd_file, streamout, 0, size, targetname, filename, errorstrat);
+	manifest_end(title_name, targetname, result);
+	close_checksums(streamout, targetname, (size_t)size);
+	close_sector_map();
+
+	close_dvd_file(dvd_file);
+	target_close(streamout);
+	free(targetname);
 	return result;
+
 }
 
 
-static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int size,
-		const char* path, const char* label, read_error_strategy_t errorstrat) {
-	int i;
+static int DVDCmpMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
+	char filename[13] = "VIDEO_TS.VOB";
+	char *targetname;
+	size_t targetname_length;
+	struct stat fileinfo;
+	dvd_file_t* dvd_file = NULL;
+	int fd = -1;
+	int size;
 
-	if (fill_gaps) {
-		return DVDCopyBlocksFillGaps(dvd_file, destination, offset, size, path, label, errorstrat);
+	(void)errorstrat;
+
+	if(title_set > 0) {
+		sprintf(filename, "VTS_%02i_0.VOB", title_set);
 	}
 
-	/* all sizes are in DVD logical blocks */
-	int remaining = size;
-	int total = size; // total size in blocks
-	float totalMiB = (float)(total) / 512.0f; // total size in [MiB]
-	int to_read = BUFFER_SIZE;
-	int act_read; /* number of buffers actually read */
+	if (title_set_info->number_of_title_sets + 1 < title_set) {
+		return 1;
+	}
 
-	/* Write buffer */
-	unsigned char buffer[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
-	unsigned char buffer_zero[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
+	if (title_set_info->title_set[title_set].size_menu == 0) {
+		return 0;
+	}
 
-	for(i = 0; i < BUFFER_SIZE * DVD_VIDEO_LB_LEN; i++) {
-		buffer_zero[i] = '\0';
+	if (title_set_info->title_set[title_set].size_menu % DVD_VIDEO_LB_LEN != 0) {
+		fprintf(stderr, _("Warning: The Menu VOB of title set %d (%s) does not have a valid DVD size.\n"), title_set, filename);
+		return 1;
 	}
 
-	while( remaining > 0 ) {
+	if ((dvd_file = open_dvd_file(dvd, title_set, DVD_READ_MENU_VOBS)) == 0) {
+		fprintf(stderr, _("Failed opening %s\n"), filename);
+		return 1;
+	}
 
-		if (to_read > remaining) {
-			to_read = remaining;
-		}
+	size = title_set_info->title_set[title_set].size_menu / DVD_VIDEO_LB_LEN;
+	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
+	targetname = malloc(targetname_length);
+	if (targetname == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
+	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
 
-		/* Reading blocks */
-		act_read = DVDReadBlocks(dvd_file, offset, to_read, buffer);
+	/* --repair copies a missing file in full */
+	if (repair && target_stat(targetname, &fileinfo) != 0) {
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return DVDCopyMenu(dvd, title_set_info, title_set, targetdir, title_name, errorstrat);
+	}
 
-		if(act_read != to_read) {
-			if(progress) {
-				fprintf(stdout, "\n");
-			}
-			if(act_read >= 0) {
-				fprintf(stderr, _("Error reading %s at block %d\n"), label, offset+act_read);
-			} else {
-				fprintf(stderr, _("Error reading %s at block %d, read error returned\n"), label, offset);
-			}
+	if (target_stat(targetname, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
+		fprintf(stderr, _("Cannot compare %s; file is missing or invalid.\n"), targetname);
+		if (gap_map) {
+			size_t base = job->gap_map_total_blocks;
+			gap_map_collect_missing(base, (size_t)size);
+			job->gap_map_total_blocks += size;
 		}
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
 
-		if(act_read > 0) {
-			/* Writing blocks */
-			if(write(destination, buffer, act_read * DVD_VIDEO_LB_LEN) != act_read * DVD_VIDEO_LB_LEN) {
-				if(progress) {
-					fprintf(stdout, "\n");
-				}
-				fprintf(stderr, _("Error writing %s.\n"), label);
-				return(1);
-			}
-
-			offset += act_read;
-			remaining -= act_read;
+	off_t expected_bytes = (off_t)size * DVD_VIDEO_LB_LEN;
+	if (fileinfo.st_size != expected_bytes && !repair) {
+		fprintf(stderr, _("Size mismatch for %s: expected %lld bytes, found %lld bytes.\n"),
+			targetname, (long long)expected_bytes, (long long)fileinfo.st_size);
+		if (gap_map) {
+			size_t base = job->gap_map_total_blocks;
+			gap_map_collect_missing(base, (size_t)size);
+			job->gap_map_total_blocks += size;
 		}
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
 
-		if(act_read != to_read) {
-			int numBlanks = 0;
+	fd = target_open(targetname, repair ? O_RDWR : O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, _("Error opening %s\n"), targetname);
+		perror(PACKAGE);
+		free(targetname);
+		close_dvd_file(dvd_file);
+		return 1;
+	}
 
-			if(progress) {
-				fprintf(stdout, "\n");
-			}
+	open_sector_map(targetname, (size_t)size, 0);
 
-			if (act_read < 0) {
-				act_read = 0;
-			}
+	if (progress) {
+		strncpy(job->progress_text, _("menu"), MAXNAME);
+	}
 
-			switch (errorstrat) {
-			case STRATEGY_ABORT:
-				fprintf(stderr, _("aborting\n"));
-				return 1;
+	if (gap_map) {
+		size_t base = job->gap_map_total_blocks;
+		gap_plan_t plan = {0};
+		size_t blank_blocks = 0;
+		size_t full_blocks = 0;
+		off_t existing_bytes = 0;
+		if (scan_existing_file_for_gaps(fd, (size_t)size, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
+			gap_map_collect_from_plan(base, (size_t)size, &plan, full_blocks);
+		} else {
+			gap_map_collect_missing(base, (size_t)size);
+		}
+		gap_plan_free(&plan);
+		job->gap_map_total_blocks += size;
+		if (lseek(fd, image_fd_base(fd), SEEK_SET) == (off_t)-1) {
+			perror(PACKAGE);
+			close_sector_map();
+			target_close(fd);
+			free(targetname);
+			close_dvd_file(dvd_file);
+			return 1;
+		}
+	}
 
-			case STRATEGY_SKIP_BLOCK:
-				numBlanks = 1;
-				fprintf(stderr, _("padding single block\n"));
-				break;
+	int cmp;
+	gap_plan_t mismatches = {0};
+	open_checksums(fd, targetname, (size_t)size, 0, 0);
+	if (job->checksums != NULL) {
+		cmp = DVDCmpChecksums(fd, size, targetname, repair ? &mismatches : NULL);
+	} else {
+		if (crc_index) {
+			fprintf(stderr, _("No checksum index for %s; comparing against the disc\n"), targetname);
+		}
+		cmp = DVDCmpBlocks(dvd_file, fd, 0, size, targetname, filename, errorstrat,
+				repair ? &mismatches : NULL);
+	}
+	if (mismatches.count > 0 && DVDRepairBlocks(dvd_file, fd, 0, &mismatches,
+			targetname, filename, errorstrat) != 0) {
+		cmp = 1;
+	}
+	gap_plan_free(&mismatches);
+	close_checksums(fd, targetname, (size_t)size);
 
-			case STRATEGY_SKIP_MULTIBLOCK:
-				numBlanks = to_read - act_read;
-				fprintf(stderr, _("padding %d blocks\n"), numBlanks);
-				break;
-			}
+	close_sector_map();
+	target_close(fd);
+	free(targetname);
+	close_dvd_file(dvd_file);
+	return cmp;
+}
 
-			if (write(destination, buffer_zero, numBlanks * DVD_VIDEO_LB_LEN) != numBlanks * DVD_VIDEO_LB_LEN) {
-				fprintf(stderr, _("Error writing %s (padding)\n"), label);
-				return 1;
-			}
 
-			/* pretend we read what we padded */
-			offset += numBlanks;
-			remaining -= numBlanks;
-		}
+/**
+ * Writes the IFO data read from the disc to the IFO or BUP file fd.
+ */
+static int write_ifo_copy(int fd, const char* path, const unsigned char* buffer, size_t size) {
+	ssize_t written;
 
-		if(progress) {
-			int done = total - remaining; // blocks done
-			if(remaining < BUFFER_SIZE || (done % BUFFER_SIZE) == 0) { // don't print too often
-				float doneMiB = (float)(done) / 512.0f; // [MiB] done
-				fprintf(stdout, "\r");
-				fprintf(stdout, _("Copying %s: %.0f%% done (%.0f/%.0f MiB)"),
-						progressText, doneMiB / totalMiB * 100.0f, doneMiB, totalMiB);
-				fflush(stdout);
-			}
+	if (async_output) {
+		if (output_write(fd, 0, buffer, size, -1) != 0) {
+			fprintf(stderr, _("Error writing %s\n"), path);
+			return 1;
 		}
-
+		return output_flush(path);
 	}
 
-	if(progress) {
-		fprintf(stdout, "\n");
+	written = output_append(fd, buffer, size);
+	if (written != (ssize_t)size) {
+		fprintf(stderr, _("Error writing %s\n"), path);
+		return 1;
 	}
 
 	return 0;
 }
 
 
-
-static int DVDCopyTitleVobX(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, int vob, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
-
-	/* Loop variable */
-	int i;
-
-	/* Temp filename,dirname */
-	// filename is either "VIDEO_TS.VOB" or "VTS_XX_X.VOB" and terminating "\0"
-	char filename[13] = "VIDEO_TS.VOB";
-	char *targetname;
-	size_t targetname_length;
+static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, int title_set, char* targetdir, char* title_name) {
+	char *targetname_ifo = NULL;
+	char *targetname_bup = NULL;
+	size_t string_length;
 	struct stat fileinfo;
+	unsigned char* buffer = NULL;
+	dvd_file_t* ifo_file = NULL;
+	int streamout_ifo = -1;
+	int streamout_bup = -1;
+	int result = 1;
+	size_t size = 0;
 
-	/* File Handler */
-	int streamout;
-
-	int size;
-
-	int offset = 0;
-	int tsize;
-
-	/* DVD handler */
-	dvd_file_t* dvd_file=NULL;
-
-	/* Return value */
-	int result;
-
-
-	/* create filename VIDEO_TS.VOB or VTS_XX_X.VOB */
-	if(title_set > 0) {
-		sprintf(filename, "VTS_%02i_%1i.VOB", title_set, vob);
+	if (title_set_info->number_of_title_sets + 1 < title_set) {
+		return 1;
 	}
 
-	if (title_set_info->number_of_title_sets + 1 < title_set) {
-		fprintf(stderr,_("Failed num title test\n"));
-		return(1);
+	if (title_set_info->title_set[title_set].size_ifo == 0) {
+		return 0;
 	}
 
-	if (title_set_info->title_set[title_set].number_of_vob_files < vob ) {
-		fprintf(stderr,_("Failed vob test\n"));
-		return(1);
+	if (title_set_info->title_set[title_set].size_ifo % DVD_VIDEO_LB_LEN != 0) {
+		fprintf(stderr, _("The IFO of title set %d does not have a valid DVD size\n"), title_set);
+		return 1;
 	}
 
-	if (title_set_info->title_set[title_set].size_vob[0] == 0 ) {
-		fprintf(stderr,_("Failed vob 1 size test\n"));
-		return(0);
-	} else if (title_set_info->title_set[title_set].size_vob[vob - 1] == 0 ) {
-		fprintf(stderr,_("Failed vob %d test\n"), vob);
-		return(0);
-	} else {
-		size = title_set_info->title_set[title_set].size_vob[vob - 1]/DVD_VIDEO_LB_LEN;
-		if (title_set_info->title_set[title_set].size_vob[vob - 1]%DVD_VIDEO_LB_LEN != 0) {
-			fprintf(stderr, _("The Title VOB number %d of title set %d does not have a valid DVD size\n"), vob, title_set);
-			return(1);
-		}
+	/* Reserve space for "<targetdir>/<title_name>/VIDEO_TS/VTS_XX_0.IFO" */
+	string_length = strlen(targetdir) + strlen(title_name) + 24;
+	targetname_ifo = malloc(string_length);
+	targetname_bup = malloc(string_length);
+	if (targetname_ifo == NULL || targetname_bup == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), string_length);
+		goto copy_ifo_cleanup;
 	}
-#ifdef DEBUG
-	fprintf(stderr,"After we check the vob it self %d\n", vob);
-#endif
 
-	/* Create VTS_XX_X.VOB */
 	if (title_set == 0) {
-		fprintf(stderr,_("Do not try to copy a Title VOB from the VMG domain; there are none.\n"));
-		return(1);
+		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.IFO", targetdir, title_name);
+		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.BUP", targetdir, title_name);
 	} else {
-		// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/<filename>" and terminating "\0"
-		targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
-		targetname = malloc(targetname_length);
-		if (targetname == NULL) {
-			fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
-			return 1;
-		}
-		snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
+		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.IFO", targetdir, title_name, title_set);
+		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.BUP", targetdir, title_name, title_set);
 	}
 
-
-
-	/* Now figure out the offset we will start at also check that the previus files are of valid DVD size */
-	for ( i = 0; i < vob - 1; i++ ) {
-		tsize = title_set_info->title_set[title_set].size_vob[i];
-		if (tsize%DVD_VIDEO_LB_LEN != 0) {
-			fprintf(stderr, _("The Title VOB number %d of title set %d does not have a valid DVD size\n"), i + 1, title_set);
-			free(targetname);
-			return(1);
+	if (target_stat(targetname_ifo, &fileinfo) == 0) {
+		if (fill_gaps) {
+			fprintf(stderr, _("The %s %s exists; refreshing it for --gaps.\n"), _("IFO file"), targetname_ifo);
 		} else {
-			offset = offset + tsize/DVD_VIDEO_LB_LEN;
+			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("IFO file"), targetname_ifo);
+		}
+		if (!S_ISREG(fileinfo.st_mode)) {
+			fprintf(stderr, _("The %s %s is not valid, it may be a directory.\n"), _("IFO file"), targetname_ifo);
+			goto copy_ifo_cleanup;
 		}
 	}
-#ifdef DEBUG
-	fprintf(stderr,"The offset for vob %d is %d\n", vob, offset);
-#endif
 
-
-	if (stat(targetname, &fileinfo) == 0) {
-		if (! S_ISREG(fileinfo.st_mode)) {
-			/* TRANSLATORS: The sentence starts with "The title file %s is not valid[...]" */
-			fprintf(stderr,_("The %s %s is not valid, it may be a directory.\n"), _("title file"), targetname);
-			free(targetname);
-			return(1);
-		}
+	if (target_stat(targetname_bup, &fileinfo) == 0) {
 		if (fill_gaps) {
-			fprintf(stderr, _("The %s %s exists; checking for gaps.\n"), _("title file"), targetname);
-			streamout = open(targetname, O_RDWR, 0666);
+			fprintf(stderr, _("The %s %s exists; refreshing it for --gaps.\n"), _("BUP file"), targetname_bup);
 		} else {
-			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("title file"), targetname);
-			streamout = open(targetname, O_WRONLY | O_TRUNC, 0666);
-		}
-		if (streamout == -1) {
-			fprintf(stderr, _("Error opening %s\n"), targetname);
-			perror(PACKAGE);
-			free(targetname);
-			return(1);
+			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("BUP file"), targetname_bup);
 		}
-	} else {
-		int create_flags = fill_gaps ? (O_RDWR | O_CREAT) : (O_WRONLY | O_CREAT);
-		if ((streamout = open(targetname, create_flags, 0666)) == -1) {
-			fprintf(stderr, _("Error creating %s\n"), targetname);
-			perror(PACKAGE);
-			free(targetname);
-			return(1);
+		if (!S_ISREG(fileinfo.st_mode)) {
+			fprintf(stderr, _("The %s %s is not valid, it may be a directory.\n"), _("BUP file"), targetname_bup);
+			goto copy_ifo_cleanup;
 		}
 	}
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
-		fprintf(stderr, _("Failed opening TITLE VOB\n"));
-		close(streamout);
-		free(targetname);
-		return(1);
+	ifo_file = open_job_file(dvd, title_set, DVD_READ_INFO_FILE);
+	if (ifo_file == NULL) {
+		fprintf(stderr, _("Failed opening IFO for title set %d\n"), title_set);
+		goto copy_ifo_cleanup;
 	}
 
-	result = DVDCopyBlocks(dvd_file, streamout, offset, size, targetname, filename, errorstrat);
+	size = (size_t)DVDFileSize(ifo_file) * DVD_VIDEO_LB_LEN;
+	buffer = malloc(size);
+	if (buffer == NULL) {
+		perror(PACKAGE);
+		goto copy_ifo_cleanup;
+	}
 
-	DVDCloseFile(dvd_file);
-	close(streamout);
-	free(targetname);
+	DVDFileSeek(ifo_file, 0);
+	if (DVDReadBytes(ifo_file, buffer, size) != (ssize_t)size) {
+		fprintf(stderr, _("Error reading IFO for title set %d\n"), title_set);
+		goto copy_ifo_cleanup;
+	}
+
+	/* the IFO is complete before the BUP is created, as --tar requires */
+	streamout_ifo = target_open(targetname_ifo, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (streamout_ifo == -1) {
+		fprintf(stderr, _("Error creating %s\n"), targetname_ifo);
+		perror(PACKAGE);
+		goto copy_ifo_cleanup;
+	}
+	if (write_ifo_copy(streamout_ifo, targetname_ifo, buffer, size) != 0) {
+		goto copy_ifo_cleanup;
+	}
+	target_close(streamout_ifo);
+	streamout_ifo = -1;
+
+	streamout_bup = target_open(targetname_bup, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (streamout_bup == -1) {
+		fprintf(stderr, _("Error creating %s\n"), targetname_bup);
+		perror(PACKAGE);
+		goto copy_ifo_cleanup;
+	}
+	if (write_ifo_copy(streamout_bup, targetname_bup, buffer, size) != 0) {
+		goto copy_ifo_cleanup;
+	}
+
+	if (manifest) {
+		xxh64_t state;
+
+		xxh64_init(&state, 0);
+		xxh64_update(&state, buffer, size);
+		manifest_update(title_name, targetname_ifo, 1, xxh64_digest(&state), size, 0);
+		manifest_update(title_name, targetname_bup, 1, xxh64_digest(&state), size, 0);
+	}
+
+	result = 0;
+
+copy_ifo_cleanup:
+	if (result != 0 && (streamout_ifo != -1 || streamout_bup != -1)) {
+		output_flush(targetname_ifo);
+	}
+	if (buffer) {
+		free(buffer);
+	}
+	if (ifo_file) {
+		DVDCloseFile(ifo_file);
+	}
+	if (streamout_ifo != -1) {
+		target_close(streamout_ifo);
+	}
+	if (streamout_bup != -1) {
+		target_close(streamout_bup);
+	}
+	free(targetname_ifo);
+	free(targetname_bup);
 	return result;
 }
 
-
-static int DVDCmpTitleVobX(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, int vob, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
-	char filename[13] = "VIDEO_TS.VOB";
-	char *targetname;
-	size_t targetname_length;
+static int DVDCmpIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, int title_set, char* targetdir, char* title_name, read_error_strategy_t errorstrat) {
+	char *targetname_ifo = NULL;
+	char *targetname_bup = NULL;
+	size_t string_length;
 	struct stat fileinfo;
 	dvd_file_t* dvd_file = NULL;
 	int fd = -1;
-	int size;
-	int offset = 0;
-	int tsize;
-
-	(void)errorstrat;
-
-	if(title_set > 0) {
-		sprintf(filename, "VTS_%02i_%1i.VOB", title_set, vob);
-	}
+	int blocks;
+	char ifo_label[16];
+	gap_plan_t mismatches = {0};
 
 	if (title_set_info->number_of_title_sets + 1 < title_set) {
 		return 1;
 	}
 
-	if (title_set_info->title_set[title_set].number_of_vob_files < vob ) {
-		return 1;
+	if (title_set_info->title_set[title_set].size_ifo == 0) {
+		return 0;
 	}
 
-	if (title_set_info->title_set[title_set].size_vob[0] == 0 ) {
+	if (title_set_info->title_set[title_set].size_ifo % DVD_VIDEO_LB_LEN != 0) {
+		fprintf(stderr, _("The IFO of title set %d does not have a valid DVD size\n"), title_set);
 		return 1;
-	} else if (title_set_info->title_set[title_set].size_vob[vob - 1] == 0 ) {
+	}
+
+	blocks = title_set_info->title_set[title_set].size_ifo / DVD_VIDEO_LB_LEN;
+
+	string_length = strlen(targetdir) + strlen(title_name) + 24;
+	targetname_ifo = malloc(string_length);
+	targetname_bup = malloc(string_length);
+	if (targetname_ifo == NULL || targetname_bup == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), string_length);
+		free(targetname_ifo);
+		free(targetname_bup);
 		return 1;
-	} else {
-		size = title_set_info->title_set[title_set].size_vob[vob - 1]/DVD_VIDEO_LB_LEN;
-		if (title_set_info->title_set[title_set].size_vob[vob - 1]%DVD_VIDEO_LB_LEN != 0) {
-			return 1;
-		}
 	}
 
-	for (int i = 0; i < vob - 1; i++) {
-		tsize = title_set_info->title_set[title_set].size_vob[i];
-		if (tsize % DVD_VIDEO_LB_LEN != 0) {
-			return 1;
-		}
-		offset += tsize / DVD_VIDEO_LB_LEN;
+	if (title_set == 0) {
+		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.IFO", targetdir, title_name);
+		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.BUP", targetdir, title_name);
+		snprintf(ifo_label, sizeof(ifo_label), "VIDEO_TS.IFO");
+	} else {
+		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.IFO", targetdir, title_name, title_set);
+		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.BUP", targetdir, title_name, title_set);
+		snprintf(ifo_label, sizeof(ifo_label), "VTS_%02d_0.IFO", title_set);
 	}
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS)) == 0) {
-		return 1;
+	/* --repair copies missing files in full */
+	if (repair && (target_stat(targetname_ifo, &fileinfo) != 0
+			|| target_stat(targetname_bup, &fileinfo) != 0)) {
+		free(targetname_ifo);
+		free(targetname_bup);
+		return DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name);
 	}
 
-	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
-	targetname = malloc(targetname_length);
-	if (targetname == NULL) {
-		DVDCloseFile(dvd_file);
-		return 1;
+	if (target_stat(targetname_ifo, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
+		fprintf(stderr, _("Cannot compare %s; file is missing or invalid.\n"), targetname_ifo);
+		goto cmp_ifo_cleanup;
 	}
-	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
 
-	if (stat(targetname, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
-		if (gap_map) {
-			size_t base = gap_map_total_blocks;
-			gap_map_collect_missing(base, (size_t)size);
-			gap_map_total_blocks += size;
-		}
-		free(targetname);
-		DVDCloseFile(dvd_file);
-		return 1;
+	if (target_stat(targetname_bup, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
+		fprintf(stderr, _("Cannot compare %s; file is missing or invalid.\n"), targetname_bup);
+		goto cmp_ifo_cleanup;
 	}
 
-	off_t expected_bytes = (off_t)size * DVD_VIDEO_LB_LEN;
-	if (fileinfo.st_size != expected_bytes) {
-		if (gap_map) {
-			size_t base = gap_map_total_blocks;
-			gap_map_collect_missing(base, (size_t)size);
-			gap_map_total_blocks += size;
-		}
-		free(targetname);
-		DVDCloseFile(dvd_file);
-		return 1;
+	dvd_file = open_job_file(dvd, title_set, DVD_READ_INFO_FILE);
+	if (dvd_file == NULL) {
+		fprintf(stderr, _("Failed opening info file for title set %d\n"), title_set);
+		goto cmp_ifo_cleanup;
 	}
 
-	fd = open(targetname, O_RDONLY);
+	fd = target_open(targetname_ifo, repair ? O_RDWR : O_RDONLY, 0);
 	if (fd == -1) {
+		fprintf(stderr, _("Error opening %s\n"), targetname_ifo);
 		perror(PACKAGE);
-		free(targetname);
-		DVDCloseFile(dvd_file);
-		return 1;
-	}
-
-	if (progress) {
-		snprintf(progressText, MAXNAME, _("Title, part %i"), vob);
+		goto cmp_ifo_cleanup;
 	}
 
 	if (gap_map) {
-		size_t base = gap_map_total_blocks;
+		size_t base = job->gap_map_total_blocks;
 		gap_plan_t plan = {0};
 		size_t blank_blocks = 0;
 		size_t full_blocks = 0;
 		off_t existing_bytes = 0;
-		if (scan_existing_file_for_gaps(fd, (size_t)size, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
-			gap_map_collect_from_plan(base, (size_t)size, &plan, full_blocks);
+		if (scan_existing_file_for_gaps(fd, (size_t)blocks, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
+			gap_map_collect_from_plan(base, (size_t)blocks, &plan, full_blocks);
 		} else {
-			gap_map_collect_missing(base, (size_t)size);
+			gap_map_collect_missing(base, (size_t)blocks);
 		}
 		gap_plan_free(&plan);
-		gap_map_total_blocks += size;
-		if (lseek(fd, (off_t)offset * DVD_VIDEO_LB_LEN, SEEK_SET) == (off_t)-1) {
+		job->gap_map_total_blocks += blocks;
+		if (lseek(fd, image_fd_base(fd), SEEK_SET) == (off_t)-1) {
 			perror(PACKAGE);
-			close(fd);
-			free(targetname);
-			DVDCloseFile(dvd_file);
-			return 1;
+			goto cmp_ifo_cleanup;
 		}
 	}
 
-	int cmp = DVDCmpBlocks(dvd_file, fd, offset, size, targetname, filename, errorstrat);
-
-	close(fd);
-	free(targetname);
-	DVDCloseFile(dvd_file);
-	return cmp;
-}
-
-
-static int DVDCopyMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
-
-	/* Temp filename,dirname */
-	// filename is either "VIDEO_TS.VOB" or "VTS_XX_0.VOB" and terminating "\0"
-	char filename[13] = "VIDEO_TS.VOB";
-	char *targetname;
-	size_t targetname_length;
-	struct stat fileinfo;
-
-	/* File Handler */
-	int streamout;
-
-	int size;
-
-	/* return value */
-	int result;
-
-	/* DVD handler */
-	dvd_file_t* dvd_file = NULL;
-
-	/* create filename VIDEO_TS.VOB or VTS_XX_0.VOB */
-	if(title_set > 0) {
-		sprintf(filename, "VTS_%02i_0.VOB", title_set);
-	}
-
-	if (title_set_info->number_of_title_sets + 1 < title_set) {
-		return(1);
+	if (DVDCmpBlocks(dvd_file, fd, 0, blocks, targetname_ifo, ifo_label, errorstrat,
+				repair ? &mismatches : NULL) != 0
+			|| (mismatches.count > 0 && DVDRepairBlocks(dvd_file, fd, 0, &mismatches,
+				targetname_ifo, ifo_label, errorstrat) != 0)) {
+		goto cmp_ifo_cleanup;
 	}
+	gap_plan_free(&mismatches);
 
-	if (title_set_info->title_set[title_set].size_menu == 0 ) {
-		return(0);
-	} else {
-		size = title_set_info->title_set[title_set].size_menu/DVD_VIDEO_LB_LEN;
-		if (title_set_info->title_set[title_set].size_menu%DVD_VIDEO_LB_LEN != 0) {
-			fprintf(stderr, _("Warning: The Menu VOB of title set %d (%s) does not have a valid DVD size.\n"), title_set, filename);
-		}
-	}
+	target_close(fd);
+	DVDCloseFile(dvd_file);
+	dvd_file = NULL;
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_MENU_VOBS))== 0) {
-		fprintf(stderr, _("Failed opening %s\n"), filename);
-		return(1);
+	dvd_file = open_job_file(dvd, title_set, DVD_READ_INFO_FILE);
+	if (dvd_file == NULL) {
+		fprintf(stderr, _("Failed reopening info file for title set %d\n"), title_set);
+		goto cmp_ifo_cleanup;
 	}
 
-	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/<filename>" and terminating "\0"
-	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
-	targetname = malloc(targetname_length);
-	if (targetname == NULL) {
-		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
-		return 1;
+	fd = target_open(targetname_bup, repair ? O_RDWR : O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, _("Error opening %s\n"), targetname_bup);
+		perror(PACKAGE);
+		goto cmp_ifo_cleanup;
 	}
-	/* Create VIDEO_TS.VOB or VTS_XX_0.VOB */
-	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
 
-	if (stat(targetname, &fileinfo) == 0) {
-		if (! S_ISREG(fileinfo.st_mode)) {
-			/* TRANSLATORS: The sentence starts with "The menu file %s is not valid[...]" */
-			fprintf(stderr,_("The %s %s is not valid, it may be a directory.\n"), _("menu file"), targetname);
-			DVDCloseFile(dvd_file);
-			free(targetname);
-			return(1);
-		}
-		if (fill_gaps) {
-			fprintf(stderr, _("The %s %s exists; checking for gaps.\n"), _("menu file"), targetname);
-			streamout = open(targetname, O_RDWR, 0666);
+	if (gap_map) {
+		size_t base = job->gap_map_total_blocks;
+		gap_plan_t plan = {0};
+		size_t blank_blocks = 0;
+		size_t full_blocks = 0;
+		off_t existing_bytes = 0;
+		if (scan_existing_file_for_gaps(fd, (size_t)blocks, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
+			gap_map_collect_from_plan(base, (size_t)blocks, &plan, full_blocks);
 		} else {
-			/* TRANSLATORS: The sentence starts with "The menu file %s exists[...]" */
-			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("menu file"), targetname);
-			streamout = open(targetname, O_WRONLY | O_TRUNC, 0666);
-		}
-		if (streamout == -1) {
-			fprintf(stderr, _("Error opening %s\n"), targetname);
-			perror(PACKAGE);
-			DVDCloseFile(dvd_file);
-			free(targetname);
-			return(1);
+			gap_map_collect_missing(base, (size_t)blocks);
 		}
-	} else {
-		int create_flags = fill_gaps ? (O_RDWR | O_CREAT) : (O_WRONLY | O_CREAT);
-		if ((streamout = open(targetname, create_flags, 0666)) == -1) {
-			fprintf(stderr, _("Error creating %s\n"), targetname);
+		gap_plan_free(&plan);
+		job->gap_map_total_blocks += blocks;
+		if (lseek(fd, image_fd_base(fd), SEEK_SET) == (off_t)-1) {
 			perror(PACKAGE);
-			DVDCloseFile(dvd_file);
-			free(targetname);
-			return(1);
+			goto cmp_ifo_cleanup;
 		}
 	}
 
-	if(progress) {
-		strncpy(progressText, _("menu"), MAXNAME);
+	if (DVDCmpBlocks(dvd_file, fd, 0, blocks, targetname_bup, ifo_label, errorstrat,
+				repair ? &mismatches : NULL) != 0
+			|| (mismatches.count > 0 && DVDRepairBlocks(dvd_file, fd, 0, &mismatches,
+				targetname_bup, ifo_label, errorstrat) != 0)) {
+		goto cmp_ifo_cleanup;
 	}
+	gap_plan_free(&mismatches);
 
-	result = DVDCopyBlocks(dvd_file, streamout, 0, size, targetname, filename, errorstrat);
-
+	target_close(fd);
 	DVDCloseFile(dvd_file);
-	close(streamout);
-	free(targetname);
-	return result;
-
-}
-
-
-static int DVDCmpMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
-	char filename[13] = "VIDEO_TS.VOB";
-	char *targetname;
-	size_t targetname_length;
-	struct stat fileinfo;
-	dvd_file_t* dvd_file = NULL;
-	int fd = -1;
-	int size;
-
-	(void)errorstrat;
+	free(targetname_ifo);
+	free(targetname_bup);
+	return 0;
 
-	if(title_set > 0) {
-		sprintf(filename, "VTS_%02i_0.VOB", title_set);
+cmp_ifo_cleanup:
+	gap_plan_free(&mismatches);
+	if (fd != -1) {
+		target_close(fd);
 	}
-
-	if (title_set_info->number_of_title_sets + 1 < title_set) {
-		return 1;
+	if (dvd_file) {
+		DVDCloseFile(dvd_file);
 	}
-
-	if (title_set_info->title_set[title_set].size_menu == 0) {
-		return 0;
+	if (targetname_ifo) {
+		free(targetname_ifo);
 	}
-
-	if (title_set_info->title_set[title_set].size_menu % DVD_VIDEO_LB_LEN != 0) {
-		fprintf(stderr, _("Warning: The Menu VOB of title set %d (%s) does not have a valid DVD size.\n"), title_set, filename);
-		return 1;
+	if (targetname_bup) {
+		free(targetname_bup);
 	}
+	return 1;
+}
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_MENU_VOBS)) == 0) {
-		fprintf(stderr, _("Failed opening %s\n"), filename);
-		return 1;
-	}
 
-	size = title_set_info->title_set[title_set].size_menu / DVD_VIDEO_LB_LEN;
-	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
-	targetname = malloc(targetname_length);
-	if (targetname == NULL) {
-		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
-		DVDCloseFile(dvd_file);
-		return 1;
-	}
-	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
+static int DVDMirrorTitleX(dvd_reader_t* dvd, title_set_info_t* title_set_info,
+		int title_set, char* targetdir, char* title_name,
+		read_error_strategy_t errorstrat) {
 
-	if (stat(targetname, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
-		fprintf(stderr, _("Cannot compare %s; file is missing or invalid.\n"), targetname);
-		if (gap_map) {
-			size_t base = gap_map_total_blocks;
-			gap_map_collect_missing(base, (size_t)size);
-			gap_map_total_blocks += size;
-		}
-		free(targetname);
-		DVDCloseFile(dvd_file);
-		return 1;
-	}
+	/* Loop through the vobs */
+	int i;
+	int n;
 
-	off_t expected_bytes = (off_t)size * DVD_VIDEO_LB_LEN;
-	if (fileinfo.st_size != expected_bytes) {
-		fprintf(stderr, _("Size mismatch for %s: expected %lld bytes, found %lld bytes.\n"),
-			targetname, (long long)expected_bytes, (long long)fileinfo.st_size);
-		if (gap_map) {
-			size_t base = gap_map_total_blocks;
-			gap_map_collect_missing(base, (size_t)size);
-			gap_map_total_blocks += size;
+	if (compare_only) {
+		if ( DVDCmpIfoBup(dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
+			return 1;
 		}
-		free(targetname);
-		DVDCloseFile(dvd_file);
+	} else if ( DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
 		return 1;
 	}
 
-	fd = open(targetname, O_RDONLY);
-	if (fd == -1) {
-		fprintf(stderr, _("Error opening %s\n"), targetname);
-		perror(PACKAGE);
-		free(targetname);
-		DVDCloseFile(dvd_file);
+	if (compare_only) {
+		if ( DVDCmpMenu(dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
+			return 1;
+		}
+	} else if ( DVDCopyMenu(dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
 		return 1;
 	}
 
-	if (progress) {
-		strncpy(progressText, _("menu"), MAXNAME);
-	}
-
-	if (gap_map) {
-		size_t base = gap_map_total_blocks;
-		gap_plan_t plan = {0};
-		size_t blank_blocks = 0;
-		size_t full_blocks = 0;
-		off_t existing_bytes = 0;
-		if (scan_existing_file_for_gaps(fd, (size_t)size, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
-			gap_map_collect_from_plan(base, (size_t)size, &plan, full_blocks);
-		} else {
-			gap_map_collect_missing(base, (size_t)size);
-		}
-		gap_plan_free(&plan);
-		gap_map_total_blocks += size;
-		if (lseek(fd, 0, SEEK_SET) == (off_t)-1) {
-			perror(PACKAGE);
-			close(fd);
-			free(targetname);
-			DVDCloseFile(dvd_file);
+	n = title_set_info->title_set[title_set].number_of_vob_files;
+	for (i = 0; i < n; i++) {
+#ifdef DEBUG
+		fprintf(stderr,"In the VOB copy loop for %d\n", i);
+#endif
+		if(progress) {
+			snprintf(job->progress_text, MAXNAME, _("Title, part %i/%i"), i+1, n);
+		}
+		if (compare_only) {
+			if ( DVDCmpTitleVobX(dvd, title_set_info, title_set, i + 1, targetdir, title_name, errorstrat) != 0 ) {
+				return 1;
+			}
+		} else if ( DVDCopyTitleVobX(dvd, title_set_info, title_set, i + 1, targetdir, title_name, errorstrat) != 0 ) {
 			return 1;
 		}
 	}
 
-	int cmp = DVDCmpBlocks(dvd_file, fd, 0, size, targetname, filename, errorstrat);
 
-	close(fd);
-	free(targetname);
-	DVDCloseFile(dvd_file);
-	return cmp;
+	return(0);
 }
 
+int DVDGetTitleName(const char *device, char *title)
+{
+	/* Variables for filehandel and title string interaction */
 
-static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, int title_set, char* targetdir, char* title_name) {
-	char *targetname_ifo = NULL;
-	char *targetname_bup = NULL;
-	size_t string_length;
-	struct stat fileinfo;
-	unsigned char* buffer = NULL;
-	dvd_file_t* ifo_file = NULL;
-	int streamout_ifo = -1;
-	int streamout_bup = -1;
-	int result = 1;
-	size_t size = 0;
+	char tempBuf[DVD_SEC_SIZ];
+	int filehandle, i;
+	int length = 32;
+	int word_length = 0;
 
-	if (title_set_info->number_of_title_sets + 1 < title_set) {
-		return 1;
-	}
+	/* Open DVD device */
 
-	if (title_set_info->title_set[title_set].size_ifo == 0) {
-		return 0;
+	if ( !(filehandle = open(device, O_RDONLY)) ) {
+		fprintf(stderr, _("Cannot open specified device %s - check your DVD device\n"), device);
+		return(1);
 	}
 
-	if (title_set_info->title_set[title_set].size_ifo % DVD_VIDEO_LB_LEN != 0) {
-		fprintf(stderr, _("The IFO of title set %d does not have a valid DVD size\n"), title_set);
-		return 1;
+	/* Seek to title of first track, which is at (track_no * 32768) + 40 */
+
+	if(lseek(filehandle, 32768, SEEK_SET) != 32768) {
+		close(filehandle);
+		fprintf(stderr, _("Cannot seek DVD device %s - check your DVD device\n"), device);
+		return(1);
 	}
 
-	/* Reserve space for "<targetdir>/<title_name>/VIDEO_TS/VTS_XX_0.IFO" */
-	string_length = strlen(targetdir) + strlen(title_name) + 24;
-	targetname_ifo = malloc(string_length);
-	targetname_bup = malloc(string_length);
-	if (targetname_ifo == NULL || targetname_bup == NULL) {
-		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), string_length);
-		goto copy_ifo_cleanup;
+	/* Read the DVD-Video title */
+	if(DVD_SEC_SIZ != read(filehandle, tempBuf, DVD_SEC_SIZ)) {
+		close(filehandle);
+		fprintf(stderr, _("Cannot read title from DVD device %s\n"), device);
+		return(1);
 	}
+	snprintf(title, length + 1, "%s", tempBuf + 40);
 
-	if (title_set == 0) {
-		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.IFO", targetdir, title_name);
-		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.BUP", targetdir, title_name);
-	} else {
-		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.IFO", targetdir, title_name, title_set);
-		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.BUP", targetdir, title_name, title_set);
+	/* Remove trailing white space */
+	while(title[length-1] == ' ') {
+		title[length-1] = '\0';
+		length--;
 	}
 
-	if (stat(targetname_ifo, &fileinfo) == 0) {
-		if (fill_gaps) {
-			fprintf(stderr, _("The %s %s exists; refreshing it for --gaps.\n"), _("IFO file"), targetname_ifo);
+	/* convert title to lower case and replace underscores with spaces */
+	for(i = 0; i < length; i++) {
+		word_length++;
+		if(word_length == 1) {
+			title[i] = toupper(title[i]);
 		} else {
-			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("IFO file"), targetname_ifo);
+			title[i] = tolower(title[i]);
 		}
-		if (!S_ISREG(fileinfo.st_mode)) {
-			fprintf(stderr, _("The %s %s is not valid, it may be a directory.\n"), _("IFO file"), targetname_ifo);
-			goto copy_ifo_cleanup;
+		if(title[i] == '_') {
+			title[i] = ' ';
+		}
+		if(title[i] == ' ') {
+			word_length = 0;
 		}
 	}
 
-	if (stat(targetname_bup, &fileinfo) == 0) {
-		if (fill_gaps) {
-			fprintf(stderr, _("The %s %s exists; refreshing it for --gaps.\n"), _("BUP file"), targetname_bup);
-		} else {
-			fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), _("BUP file"), targetname_bup);
-		}
-		if (!S_ISREG(fileinfo.st_mode)) {
-			fprintf(stderr, _("The %s %s is not valid, it may be a directory.\n"), _("BUP file"), targetname_bup);
-			goto copy_ifo_cleanup;
+	return(0);
+}
+
+
+
+static void bsort_min_to_max(int sector[], int title[], int size){
+
+	int temp_title, temp_sector, i, j;
+
+	for ( i=0; i < size ; i++ ) {
+		for ( j=0; j < size ; j++ ) {
+			if (sector[i] < sector[j]) {
+				temp_sector = sector[i];
+				temp_title = title[i];
+				sector[i] = sector[j];
+				title[i] = title[j];
+				sector[j] = temp_sector;
+				title[j] = temp_title;
+			}
 		}
 	}
+}
 
-	streamout_ifo = open(targetname_ifo, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (streamout_ifo == -1) {
-		fprintf(stderr, _("Error creating %s\n"), targetname_ifo);
-		perror(PACKAGE);
-		goto copy_ifo_cleanup;
-	}
+static void bsort_max_to_min(int sector[], int title[], int size){
 
-	streamout_bup = open(targetname_bup, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (streamout_bup == -1) {
-		fprintf(stderr, _("Error creating %s\n"), targetname_bup);
-		perror(PACKAGE);
-		goto copy_ifo_cleanup;
-	}
+	int temp_title, temp_sector, i, j;
 
-	ifo_file = DVDOpenFile(dvd, title_set, DVD_READ_INFO_FILE);
-	if (ifo_file == NULL) {
-		fprintf(stderr, _("Failed opening IFO for title set %d\n"), title_set);
-		goto copy_ifo_cleanup;
+	for ( i=0; i < size ; i++ ) {
+		for ( j=0; j < size ; j++ ) {
+			if (sector[i] > sector[j]) {
+				temp_sector = sector[i];
+				temp_title = title[i];
+				sector[i] = sector[j];
+				title[i] = title[j];
+				sector[j] = temp_sector;
+				title[j] = temp_title;
+			}
+		}
 	}
+}
 
-	size = (size_t)DVDFileSize(ifo_file) * DVD_VIDEO_LB_LEN;
-	buffer = malloc(size);
-	if (buffer == NULL) {
-		perror(PACKAGE);
-		goto copy_ifo_cleanup;
-	}
 
-	DVDFileSeek(ifo_file, 0);
-	if (DVDReadBytes(ifo_file, buffer, size) != (ssize_t)size) {
-		fprintf(stderr, _("Error reading IFO for title set %d\n"), title_set);
-		goto copy_ifo_cleanup;
-	}
+static void align_end_sector(int cell_start_sector[],int cell_end_sector[], int size) {
 
-	if (write(streamout_ifo, buffer, size) != (ssize_t)size) {
-		fprintf(stderr, _("Error writing %s\n"), targetname_ifo);
-		goto copy_ifo_cleanup;
-	}
+	int i;
 
-	if (write(streamout_bup, buffer, size) != (ssize_t)size) {
-		fprintf(stderr, _("Error writing %s\n"), targetname_bup);
-		goto copy_ifo_cleanup;
+	for (i = 0; i < size - 1 ; i++) {
+		if ( cell_end_sector[i] >= cell_start_sector[i + 1] ) {
+			cell_end_sector[i] = cell_start_sector[i + 1] - 1;
+		}
 	}
+}
 
-	result = 0;
 
-copy_ifo_cleanup:
-	if (buffer) {
-		free(buffer);
-	}
-	if (ifo_file) {
-		DVDCloseFile(ifo_file);
-	}
-	if (streamout_ifo != -1) {
-		close(streamout_ifo);
-	}
-	if (streamout_bup != -1) {
-		close(streamout_bup);
-	}
-	free(targetname_ifo);
-	free(targetname_bup);
-	return result;
+static void DVDFreeTitleSetInfo(title_set_info_t * title_set_info) {
+	free(title_set_info->title_set);
+	free(title_set_info);
 }
 
-static int DVDCmpIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, int title_set, char* targetdir, char* title_name, read_error_strategy_t errorstrat) {
-	char *targetname_ifo = NULL;
-	char *targetname_bup = NULL;
-	size_t string_length;
-	struct stat fileinfo;
-	dvd_file_t* dvd_file = NULL;
-	int fd = -1;
-	int blocks;
-	char ifo_label[16];
 
-	if (title_set_info->number_of_title_sets + 1 < title_set) {
-		return 1;
+static void DVDFreeTitlesInfo(titles_info_t * titles_info) {
+	free(titles_info->titles);
+	free(titles_info);
+}
+
+
+static title_set_info_t* DVDGetFileSet(dvd_reader_t* dvd) {
+
+	/* title interation */
+	int title_sets, counter, i;
+
+	/* DVD Video files */
+	dvd_stat_t statbuf;
+
+	/* DVD IFO handler */
+	ifo_handle_t* vmg_ifo = NULL;
+
+	/* The Title Set Info struct */
+	title_set_info_t* title_set_info;
+
+	/* Open main info file */
+	dvd = job_reader(dvd);
+	vmg_ifo = dvd != NULL ? ifoOpen(dvd, 0) : NULL;
+	if(vmg_ifo == NULL) {
+		fprintf( stderr, _("Cannot open Video Manager (VMG) info.\n"));
+		return NULL;
 	}
 
-	if (title_set_info->title_set[title_set].size_ifo == 0) {
-		return 0;
+	title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+
+	/* Close the VMG IFO file we got all the info we need */
+	ifoClose(vmg_ifo);
+
+	title_set_info = (title_set_info_t*)malloc(sizeof(title_set_info_t));
+	if(title_set_info == NULL) {
+		perror(PACKAGE);
+		return NULL;
 	}
 
-	if (title_set_info->title_set[title_set].size_ifo % DVD_VIDEO_LB_LEN != 0) {
-		fprintf(stderr, _("The IFO of title set %d does not have a valid DVD size\n"), title_set);
-		return 1;
+	title_set_info->title_set = (title_set_t*)malloc((title_sets + 1) * sizeof(title_set_t));
+	if(title_set_info->title_set == NULL) {
+		perror(PACKAGE);
+		free(title_set_info);
+		return NULL;
 	}
 
-	blocks = title_set_info->title_set[title_set].size_ifo / DVD_VIDEO_LB_LEN;
+	title_set_info->number_of_title_sets = title_sets;
 
-	string_length = strlen(targetdir) + strlen(title_name) + 24;
-	targetname_ifo = malloc(string_length);
-	targetname_bup = malloc(string_length);
-	if (targetname_ifo == NULL || targetname_bup == NULL) {
-		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), string_length);
-		free(targetname_ifo);
-		free(targetname_bup);
-		return 1;
-	}
 
-	if (title_set == 0) {
-		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.IFO", targetdir, title_name);
-		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VIDEO_TS.BUP", targetdir, title_name);
-		snprintf(ifo_label, sizeof(ifo_label), "VIDEO_TS.IFO");
+	/* Find VIDEO_TS.IFO is present - must be present since we did a ifo open 0 */
+
+	if (DVDFileStat(dvd, 0, DVD_READ_INFO_FILE, &statbuf) != -1) {
+		title_set_info->title_set[0].size_ifo = statbuf.size;
 	} else {
-		snprintf(targetname_ifo, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.IFO", targetdir, title_name, title_set);
-		snprintf(targetname_bup, string_length, "%s/%s/VIDEO_TS/VTS_%02i_0.BUP", targetdir, title_name, title_set);
-		snprintf(ifo_label, sizeof(ifo_label), "VTS_%02d_0.IFO", title_set);
+		DVDFreeTitleSetInfo(title_set_info);
+		return NULL;
 	}
 
-	if (stat(targetname_ifo, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
-		fprintf(stderr, _("Cannot compare %s; file is missing or invalid.\n"), targetname_ifo);
-		goto cmp_ifo_cleanup;
-	}
+	/* Find VIDEO_TS.VOB if present*/
 
-	if (stat(targetname_bup, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
-		fprintf(stderr, _("Cannot compare %s; file is missing or invalid.\n"), targetname_bup);
-		goto cmp_ifo_cleanup;
+	if(DVDFileStat(dvd, 0, DVD_READ_MENU_VOBS, &statbuf) != -1) {
+		title_set_info->title_set[0].size_menu = statbuf.size;
+	} else {
+		title_set_info->title_set[0].size_menu = 0 ;
 	}
 
-	dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_INFO_FILE);
-	if (dvd_file == NULL) {
-		fprintf(stderr, _("Failed opening info file for title set %d\n"), title_set);
-		goto cmp_ifo_cleanup;
-	}
+	/* Take care of the titles which we don't have in VMG */
 
-	fd = open(targetname_ifo, O_RDONLY);
-	if (fd == -1) {
-		fprintf(stderr, _("Error opening %s\n"), targetname_ifo);
-		perror(PACKAGE);
-		goto cmp_ifo_cleanup;
+	title_set_info->title_set[0].number_of_vob_files = 0;
+	title_set_info->title_set[0].size_vob[0] = 0;
+
+	if ( verbose > 0 ){
+		fprintf(stderr,_("\n\n\nFile sizes for Title set 0 VIDEO_TS.XXX\n"));
+		fprintf(stderr,_("IFO = %jd, MENU_VOB = %jd\n"),(intmax_t)title_set_info->title_set[0].size_ifo, (intmax_t)title_set_info->title_set[0].size_menu);
 	}
 
-	if (gap_map) {
-		size_t base = gap_map_total_blocks;
-		gap_plan_t plan = {0};
-		size_t blank_blocks = 0;
-		size_t full_blocks = 0;
-		off_t existing_bytes = 0;
-		if (scan_existing_file_for_gaps(fd, (size_t)blocks, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
-			gap_map_collect_from_plan(base, (size_t)blocks, &plan, full_blocks);
+	for(counter = 0; counter < title_sets; counter++) {
+
+		if(verbose > 1) {
+			fprintf(stderr,_("At top of loop\n"));
+		}
+
+
+		if(DVDFileStat(dvd, counter + 1, DVD_READ_INFO_FILE, &statbuf) != -1) {
+			title_set_info->title_set[counter+1].size_ifo = statbuf.size;
 		} else {
-			gap_map_collect_missing(base, (size_t)blocks);
+			DVDFreeTitleSetInfo(title_set_info);
+			return NULL;
 		}
-		gap_plan_free(&plan);
-		gap_map_total_blocks += blocks;
-		if (lseek(fd, 0, SEEK_SET) == (off_t)-1) {
-			perror(PACKAGE);
-			goto cmp_ifo_cleanup;
+
+		if(verbose > 1) {
+			fprintf(stderr,_("After opening files\n"));
 		}
-	}
 
-	if (DVDCmpBlocks(dvd_file, fd, 0, blocks, targetname_ifo, ifo_label, errorstrat) != 0) {
-		goto cmp_ifo_cleanup;
-	}
+		/* Find VTS_XX_0.VOB if present */
 
-	close(fd);
-	DVDCloseFile(dvd_file);
-	dvd_file = NULL;
+		if(DVDFileStat(dvd, counter + 1, DVD_READ_MENU_VOBS, &statbuf) != -1) {
+			title_set_info->title_set[counter + 1].size_menu = statbuf.size;
+		} else {
+			title_set_info->title_set[counter + 1].size_menu = 0 ;
+		}
 
-	dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_INFO_FILE);
-	if (dvd_file == NULL) {
-		fprintf(stderr, _("Failed reopening info file for title set %d\n"), title_set);
-		goto cmp_ifo_cleanup;
-	}
+		if(verbose > 1) {
+			fprintf(stderr,_("After Menu VOB check\n"));
+		}
 
-	fd = open(targetname_bup, O_RDONLY);
-	if (fd == -1) {
-		fprintf(stderr, _("Error opening %s\n"), targetname_bup);
-		perror(PACKAGE);
-		goto cmp_ifo_cleanup;
-	}
+		/* Find all VTS_XX_[1 to 9].VOB files if they are present */
 
-	if (gap_map) {
-		size_t base = gap_map_total_blocks;
-		gap_plan_t plan = {0};
-		size_t blank_blocks = 0;
-		size_t full_blocks = 0;
-		off_t existing_bytes = 0;
-		if (scan_existing_file_for_gaps(fd, (size_t)blocks, &plan, &blank_blocks, &full_blocks, &existing_bytes) == 0) {
-			gap_map_collect_from_plan(base, (size_t)blocks, &plan, full_blocks);
-		} else {
-			gap_map_collect_missing(base, (size_t)blocks);
+		i = 0;
+		if(DVDFileStat(dvd, counter + 1, DVD_READ_TITLE_VOBS, &statbuf) != -1) {
+			for(i = 0; i < statbuf.nr_parts; ++i) {
+				title_set_info->title_set[counter + 1].size_vob[i] = statbuf.parts_size[i];
+			}
 		}
-		gap_plan_free(&plan);
-		gap_map_total_blocks += blocks;
-		if (lseek(fd, 0, SEEK_SET) == (off_t)-1) {
-			perror(PACKAGE);
-			goto cmp_ifo_cleanup;
+		title_set_info->title_set[counter + 1].number_of_vob_files = i;
+
+		if(verbose > 1) {
+			fprintf(stderr,_("After Menu Title VOB check\n"));
 		}
-	}
 
-	if (DVDCmpBlocks(dvd_file, fd, 0, blocks, targetname_bup, ifo_label, errorstrat) != 0) {
-		goto cmp_ifo_cleanup;
+		if(verbose > 0) {
+			fprintf(stderr,_("\n\n\nFile sizes for Title set %d i.e. VTS_%02d_X.XXX\n"), counter + 1, counter + 1);
+			fprintf(stderr,_("IFO: %jd, MENU: %jd\n"), (intmax_t)title_set_info->title_set[counter +1].size_ifo, (intmax_t)title_set_info->title_set[counter +1].size_menu);
+			for (i = 0; i < title_set_info->title_set[counter + 1].number_of_vob_files ; i++) {
+				fprintf(stderr, _("VOB %d is %jd\n"), i + 1, (intmax_t)title_set_info->title_set[counter + 1].size_vob[i]);
+			}
+		}
+
+		if(verbose > 1) {
+			fprintf(stderr,_("Bottom of loop\n"));
+		}
 	}
 
-	close(fd);
-	DVDCloseFile(dvd_file);
-	free(targetname_ifo);
-	free(targetname_bup);
-	return 0;
+	/* Return the info */
+	return title_set_info;
+}
 
-cmp_ifo_cleanup:
-	if (fd != -1) {
-		close(fd);
-	}
-	if (dvd_file) {
-		DVDCloseFile(dvd_file);
-	}
-	if (targetname_ifo) {
-		free(targetname_ifo);
-	}
-	if (targetname_bup) {
-		free(targetname_bup);
+
+static int mirror_extent_compare(const void* a, const void* b) {
+	const mirror_extent_t* first = (const mirror_extent_t*)a;
+	const mirror_extent_t* second = (const mirror_extent_t*)b;
+
+	if (first->lba != second->lba) {
+		return first->lba < second->lba ? -1 : 1;
 	}
-	return 1;
+	return first->index - second->index;
 }
 
 
-static int DVDMirrorTitleX(dvd_reader_t* dvd, title_set_info_t* title_set_info,
-		int title_set, char* targetdir, char* title_name,
-		read_error_strategy_t errorstrat) {
+/**
+ * Appends a file of size bytes to the list of a --physical-order mirror and
+ * looks up its first sector. *resolved is cleared once a lookup fails; later
+ * files are not looked up any more then.
+ */
+static void mirror_extent_add(dvd_reader_t* dvd, mirror_extent_t extents[], int* count,
+		int title_set, dvd_read_domain_t domain, int vob, int offset, off_t size, int* resolved) {
+	mirror_extent_t* extent = &extents[*count];
+	dvd_reader_t* reader = job_reader(dvd);
+	char path[64];
+	uint32_t filesize;
+
+	extent->index = *count;
+	extent->title_set = title_set;
+	extent->domain = domain;
+	extent->vob = vob;
+	extent->offset = offset;
+	extent->blocks = (int)(size / DVD_VIDEO_LB_LEN);
+
+	disc_file_path(path, sizeof(path), title_set, domain, vob);
+	extent->lba = *resolved && reader != NULL ? UDFFindFile(reader, path, &filesize) : 0;
+	if (extent->lba == 0) {
+		*resolved = 0;
+	}
+	(*count)++;
+}
 
-	/* Loop through the vobs */
-	int i;
-	int n;
 
-	if (compare_only) {
-		if ( DVDCmpIfoBup(dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
-			return 1;
-		}
-	} else if ( DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
-		return 1;
-	}
+/**
+ * Copies the menu or title VOB file of extent, filename, for
+ * DVDMirrorPhysical(): the blocks of extent are read from dvd_file chunk by
+ * chunk and each chunk is written to its place in the new file of the
+ * VIDEO_TS directory. buffer and buffer_zero hold BUFFER_SIZE blocks.
+ */
+static int DVDCopyExtent(dvd_file_t* dvd_file, const mirror_extent_t* extent, const char* filename,
+		char* targetdir, char* title_name, unsigned char* buffer, const unsigned char* buffer_zero,
+		read_error_strategy_t errorstrat) {
+	const char* kind = extent->domain == DVD_READ_MENU_VOBS ? _("menu file") : _("title file");
+	char* targetname;
+	size_t targetname_length;
+	struct stat fileinfo;
+	int streamout;
+	copy_chunk_t chunk;
+	write_behind_t wb = {0};
+	off_t position = 0;
+	off_t written_from;
+	int block = 0;
+	int slot = -1;
+	int result = 0;
 
-	if (compare_only) {
-		if ( DVDCmpMenu(dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
-			return 1;
-		}
-	} else if ( DVDCopyMenu(dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
+	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS/<filename>" and terminating "\0"
+	targetname_length = strlen(targetdir) + strlen(title_name) + strlen(filename) + 12;
+	targetname = malloc(targetname_length);
+	if (targetname == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
 		return 1;
 	}
+	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/%s", targetdir, title_name, filename);
 
-	n = title_set_info->title_set[title_set].number_of_vob_files;
-	for (i = 0; i < n; i++) {
-#ifdef DEBUG
-		fprintf(stderr,"In the VOB copy loop for %d\n", i);
-#endif
-		if(progress) {
-			snprintf(progressText, MAXNAME, _("Title, part %i/%i"), i+1, n);
-		}
-		if (compare_only) {
-			if ( DVDCmpTitleVobX(dvd, title_set_info, title_set, i + 1, targetdir, title_name, errorstrat) != 0 ) {
-				return 1;
-			}
-		} else if ( DVDCopyTitleVobX(dvd, title_set_info, title_set, i + 1, targetdir, title_name, errorstrat) != 0 ) {
-			return 1;
+	if (target_stat(targetname, &fileinfo) == 0) {
+		if (! S_ISREG(fileinfo.st_mode)) {
+			fprintf(stderr,_("The %s %s is not valid, it may be a directory.\n"), kind, targetname);
+			free(targetname);
+			return(1);
 		}
+		fprintf(stderr, _("The %s %s exists; truncating before copy.\n"), kind, targetname);
+	}
+	if ((streamout = open_output(targetname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		fprintf(stderr, _("Error creating %s\n"), targetname);
+		perror(PACKAGE);
+		free(targetname);
+		return(1);
+	}
+	if (preallocate_file(streamout, targetname, (off_t)extent->blocks * DVD_VIDEO_LB_LEN) != 0) {
+		target_close(streamout);
+		free(targetname);
+		return(1);
 	}
 
+	open_sector_map(targetname, (size_t)extent->blocks, 1);
+	open_checksums(streamout, targetname, (size_t)extent->blocks, 1, 0);
+	manifest_begin(targetname);
 
-	return(0);
-}
+	chunk.data = buffer;
+	while (block < extent->blocks) {
+		chunk.to_read = extent->blocks - block < BUFFER_SIZE ? extent->blocks - block : BUFFER_SIZE;
 
-int DVDGetTitleName(const char *device, char *title)
-{
-	/* Variables for filehandel and title string interaction */
+		/* Read straight into a registered buffer of the output queue */
+		if (async_output) {
+			chunk.data = output_async_buffer(&slot);
+		}
 
-	char tempBuf[DVD_SEC_SIZ];
-	int filehandle, i;
-	int length = 32;
-	int word_length = 0;
+		chunk.offset = extent->offset + block;
+		copy_chunk_read(dvd_file, &chunk, errorstrat);
 
-	/* Open DVD device */
+		written_from = position;
+		if (copy_chunk_write(streamout, &position, &chunk, slot, filename, buffer_zero) != 0) {
+			output_flush(filename);
+			result = 1;
+			break;
+		}
+		write_behind_note(streamout, &wb, written_from, (size_t)(position - written_from));
 
-	if ( !(filehandle = open(device, O_RDONLY)) ) {
-		fprintf(stderr, _("Cannot open specified device %s - check your DVD device\n"), device);
-		return(1);
+		/* pretend we read what we padded */
+		block += copy_chunk_blocks(&chunk);
+
+		if (progress) {
+			copy_report_progress(extent->blocks, extent->blocks - block);
+		}
 	}
 
-	/* Seek to title of first track, which is at (track_no * 32768) + 40 */
+	if (result == 0 && output_flush(filename) != 0) {
+		result = 1;
+	}
+	write_behind_finish(streamout, &wb);
 
-	if(lseek(filehandle, 32768, SEEK_SET) != 32768) {
-		close(filehandle);
-		fprintf(stderr, _("Cannot seek DVD device %s - check your DVD device\n"), device);
-		return(1);
+	if (result == 0 && progress) {
+		fprintf(stdout, "\n");
 	}
 
-	/* Read the DVD-Video title */
-	if(DVD_SEC_SIZ != read(filehandle, tempBuf, DVD_SEC_SIZ)) {
-		close(filehandle);
-		fprintf(stderr, _("Cannot read title from DVD device %s\n"), device);
-		return(1);
+	manifest_end(title_name, targetname, result);
+	close_checksums(streamout, targetname, (size_t)extent->blocks);
+	close_sector_map();
+	target_close(streamout);
+	free(targetname);
+	return result;
+}
+
+
+/**
+ * Mirrors the whole DVD (--physical-order) in one sweep across the disc
+ * instead of seeking back and forth between title sets. The first sector of
+ * every IFO and VOB file is looked up in the UDF file system and the files
+ * are copied sorted by it; the VOB files that follow each other in a domain
+ * are read through one open file. If the files cannot be located, for
+ * example for a VIDEO_TS directory, title set order is used.
+ */
+static int DVDMirrorPhysical(dvd_reader_t* dvd, title_set_info_t* title_set_info,
+		char* targetdir, char* title_name, read_error_strategy_t errorstrat) {
+	mirror_extent_t* extents;
+	const mirror_extent_t* open_extent = NULL;
+	dvd_file_t* dvd_file = NULL;
+	unsigned char* buffer;
+	unsigned char* buffer_zero;
+	char path[64];
+	int count = 0;
+	int capacity = 0;
+	int resolved = 1;
+	int result = 0;
+	int i, vob, offset;
+
+	for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+		capacity += 2 + title_set_info->title_set[i].number_of_vob_files;
 	}
-	snprintf(title, length + 1, "%s", tempBuf + 40);
 
-	/* Remove trailing white space */
-	while(title[length-1] == ' ') {
-		title[length-1] = '\0';
-		length--;
+	extents = (mirror_extent_t*)malloc((size_t)capacity * sizeof(mirror_extent_t));
+	if (extents == NULL) {
+		perror(PACKAGE);
+		return 1;
 	}
 
-	/* convert title to lower case and replace underscores with spaces */
-	for(i = 0; i < length; i++) {
-		word_length++;
-		if(word_length == 1) {
-			title[i] = toupper(title[i]);
-		} else {
-			title[i] = tolower(title[i]);
+	for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+		const title_set_t* set = &title_set_info->title_set[i];
+
+		if (set->size_ifo != 0) {
+			mirror_extent_add(dvd, extents, &count, i, DVD_READ_INFO_FILE, 0, 0, set->size_ifo, &resolved);
 		}
-		if(title[i] == '_') {
-			title[i] = ' ';
+		if (set->size_menu != 0) {
+			mirror_extent_add(dvd, extents, &count, i, DVD_READ_MENU_VOBS, 0, 0, set->size_menu, &resolved);
+		}
+		/* the title VOB parts are one file to open_dvd_file() */
+		offset = 0;
+		for (vob = 1; vob <= set->number_of_vob_files; vob++) {
+			if (set->size_vob[vob - 1] % DVD_VIDEO_LB_LEN != 0) {
+				fprintf(stderr, _("The Title VOB number %d of title set %d does not have a valid DVD size\n"), vob, i);
+				free(extents);
+				return 1;
+			}
+			if (set->size_vob[vob - 1] != 0) {
+				mirror_extent_add(dvd, extents, &count, i, DVD_READ_TITLE_VOBS, vob, offset,
+						set->size_vob[vob - 1], &resolved);
+			}
+			offset += (int)(set->size_vob[vob - 1] / DVD_VIDEO_LB_LEN);
 		}
-		if(title[i] == ' ') {
-			word_length = 0;
+	}
+
+	if (!resolved) {
+		fprintf(stderr, _("Cannot locate the files on the disc; mirroring in title set order.\n"));
+		free(extents);
+		for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+			if (DVDMirrorTitleX(dvd, title_set_info, i, targetdir, title_name, errorstrat) != 0) {
+				fprintf(stderr, _("Mirror of Title set %d failed\n"), i);
+				return 1;
+			}
 		}
+		return 0;
 	}
 
-	return(0);
-}
+	qsort(extents, (size_t)count, sizeof(mirror_extent_t), mirror_extent_compare);
 
+	/* Read and padding buffers, page aligned for --direct-io */
+	buffer = alloc_blocks(BUFFER_SIZE);
+	buffer_zero = alloc_blocks(BUFFER_SIZE);
+	if (buffer == NULL || buffer_zero == NULL) {
+		fprintf(stderr, _("Out of memory\n"));
+		free(buffer);
+		free(buffer_zero);
+		free(extents);
+		return 1;
+	}
+	memset(buffer_zero, 0, (size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
 
+	for (i = 0; i < count && result == 0; i++) {
+		const mirror_extent_t* extent = &extents[i];
+		const char* filename;
 
-static void bsort_min_to_max(int sector[], int title[], int size){
+		disc_file_path(path, sizeof(path), extent->title_set, extent->domain, extent->vob);
+		filename = path + strlen("/VIDEO_TS/");
+		if (verbose > 0) {
+			fprintf(stderr, _("%s at sector %u\n"), filename, extent->lba);
+		}
 
-	int temp_title, temp_sector, i, j;
+		if (extent->domain == DVD_READ_INFO_FILE) {
+			result = DVDCopyIfoBup(dvd, title_set_info, extent->title_set, targetdir, title_name);
+		} else {
+			if (dvd_file != NULL && (open_extent->title_set != extent->title_set
+					|| open_extent->domain != extent->domain)) {
+				close_dvd_file(dvd_file);
+				dvd_file = NULL;
+			}
+			if (dvd_file == NULL && (dvd_file = open_dvd_file(dvd, extent->title_set, extent->domain)) == NULL) {
+				fprintf(stderr, _("Failed opening %s\n"), filename);
+				result = 1;
+			}
+			open_extent = extent;
 
-	for ( i=0; i < size ; i++ ) {
-		for ( j=0; j < size ; j++ ) {
-			if (sector[i] < sector[j]) {
-				temp_sector = sector[i];
-				temp_title = title[i];
-				sector[i] = sector[j];
-				title[i] = title[j];
-				sector[j] = temp_sector;
-				title[j] = temp_title;
+			if (progress && extent->domain == DVD_READ_MENU_VOBS) {
+				strncpy(job->progress_text, _("menu"), MAXNAME);
+			} else if (progress) {
+				snprintf(job->progress_text, MAXNAME, _("Title, part %i/%i"), extent->vob,
+						title_set_info->title_set[extent->title_set].number_of_vob_files);
+			}
+			if (result == 0) {
+				result = DVDCopyExtent(dvd_file, extent, filename, targetdir, title_name, buffer,
+						buffer_zero, errorstrat);
 			}
 		}
+
+		if (result != 0) {
+			fprintf(stderr, _("Mirror of Title set %d failed\n"), extent->title_set);
+		}
+	}
+
+	if (dvd_file != NULL) {
+		close_dvd_file(dvd_file);
 	}
+	free(buffer_zero);
+	free(buffer);
+	free(extents);
+	return result;
 }
 
-static void bsort_max_to_min(int sector[], int title[], int size){
 
-	int temp_title, temp_sector, i, j;
+/**
+ * Lists the files of the VIDEO_TS directory in DVD-Video order: IFO, menu
+ * VOB, title VOBs and BUP of each title set. Returns a malloc()ed array of
+ * *count entries or NULL.
+ */
+static disc_file_t* DVDListFiles(const title_set_info_t* title_set_info, int* count) {
+	disc_file_t* files;
+	int capacity = 0;
+	int i, vob;
 
-	for ( i=0; i < size ; i++ ) {
-		for ( j=0; j < size ; j++ ) {
-			if (sector[i] > sector[j]) {
-				temp_sector = sector[i];
-				temp_title = title[i];
-				sector[i] = sector[j];
-				title[i] = title[j];
-				sector[j] = temp_sector;
-				title[j] = temp_title;
-			}
-		}
+	for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+		capacity += 3 + title_set_info->title_set[i].number_of_vob_files;
 	}
-}
 
+	files = (disc_file_t*)malloc((size_t)capacity * sizeof(disc_file_t));
+	if (files == NULL) {
+		perror(PACKAGE);
+		return NULL;
+	}
 
-static void align_end_sector(int cell_start_sector[],int cell_end_sector[], int size) {
+	*count = 0;
+	for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+		const title_set_t* set = &title_set_info->title_set[i];
+		char base[24];
 
-	int i;
+		if (set->size_ifo == 0) {
+			continue;
+		}
+		if (i == 0) {
+			strcpy(base, "VIDEO_TS");
+		} else {
+			snprintf(base, sizeof(base), "VTS_%02i_0", i);
+		}
 
-	for (i = 0; i < size - 1 ; i++) {
-		if ( cell_end_sector[i] >= cell_start_sector[i + 1] ) {
-			cell_end_sector[i] = cell_start_sector[i + 1] - 1;
+		snprintf(files[*count].name, sizeof(files[*count].name), "%s.IFO", base);
+		files[(*count)++].size = set->size_ifo;
+		if (set->size_menu != 0) {
+			snprintf(files[*count].name, sizeof(files[*count].name), "%s.VOB", base);
+			files[(*count)++].size = set->size_menu;
 		}
+		for (vob = 1; vob <= set->number_of_vob_files; vob++) {
+			snprintf(files[*count].name, sizeof(files[*count].name), "VTS_%02i_%i.VOB", i, vob);
+			files[(*count)++].size = set->size_vob[vob - 1];
+		}
+		snprintf(files[*count].name, sizeof(files[*count].name), "%s.BUP", base);
+		files[(*count)++].size = set->size_ifo;
 	}
-}
 
-
-static void DVDFreeTitleSetInfo(title_set_info_t * title_set_info) {
-	free(title_set_info->title_set);
-	free(title_set_info);
+	return files;
 }
 
 
-static void DVDFreeTitlesInfo(titles_info_t * titles_info) {
-	free(titles_info->titles);
-	free(titles_info);
-}
+/**
+ * Adds the file name of the VIDEO_TS directory to image, with the sector it
+ * starts at on the disc if the UDF file system tells.
+ */
+static int image_add_disc_file(dvd_reader_t* dvd, image_t* image, const char* name, off_t size) {
+	char path[64];
+	uint32_t filesize;
+	uint32_t lba;
 
+	snprintf(path, sizeof(path), "/VIDEO_TS/%s", name);
+	dvd = job_reader(dvd);
+	lba = dvd != NULL ? UDFFindFile(dvd, path, &filesize) : 0;
 
-static title_set_info_t* DVDGetFileSet(dvd_reader_t* dvd) {
+	if (image_add_file(image, name, size, lba) != 0) {
+		fprintf(stderr, _("Cannot add %s to the image\n"), name);
+		perror(PACKAGE);
+		return 1;
+	}
 
-	/* title interation */
-	int title_sets, counter, i;
+	return 0;
+}
 
-	/* DVD Video files */
-	dvd_stat_t statbuf;
 
-	/* DVD IFO handler */
-	ifo_handle_t* vmg_ifo = NULL;
+/**
+ * Describes the files of title_set_info as an image, creates it (or opens it
+ * for --cmp and --gaps) and makes it the target of the copy and compare
+ * functions until DVDCloseImage().
+ */
+static int DVDOpenImage(dvd_reader_t* dvd, title_set_info_t* title_set_info, char* title_name) {
+	image_t* image;
+	disc_file_t* files = NULL;
+	int count;
+	struct stat st;
+	off_t size;
+	int flags;
+	int i;
 
-	/* The Title Set Info struct */
-	title_set_info_t* title_set_info;
+	image = image_new(title_name);
+	if (image == NULL) {
+		perror(PACKAGE);
+		return 1;
+	}
 
-	/* Open main info file */
-	vmg_ifo = ifoOpen(dvd, 0);
-	if(vmg_ifo == NULL) {
-		fprintf( stderr, _("Cannot open Video Manager (VMG) info.\n"));
-		return NULL;
+	files = DVDListFiles(title_set_info, &count);
+	if (files == NULL) {
+		goto open_image_failed;
+	}
+	for (i = 0; i < count; i++) {
+		if (image_add_disc_file(dvd, image, files[i].name, files[i].size) != 0) {
+			goto open_image_failed;
+		}
 	}
 
-	title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+	size = image_layout(image);
+	if (size < 0) {
+		perror(PACKAGE);
+		goto open_image_failed;
+	}
+	if (verbose > 0 && !image_keeps_layout(image)) {
+		fprintf(stderr, _("Cannot keep the disc layout in %s; the files are stored back to back.\n"), image_file);
+	}
 
-	/* Close the VMG IFO file we got all the info we need */
-	ifoClose(vmg_ifo);
+	if (compare_only) {
+		flags = O_RDONLY;
+	} else if (fill_gaps || (resume && stat(image_file, &st) == 0)) {
+		flags = O_RDWR | O_CREAT;
+	} else {
+		if (no_overwrite && stat(image_file, &st) == 0) {
+			fprintf(stderr, _("The image %s exists; rerun without --no-overwrite.\n"), image_file);
+			goto open_image_failed;
+		}
+		flags = O_RDWR | O_CREAT | O_TRUNC;
+	}
 
-	title_set_info = (title_set_info_t*)malloc(sizeof(title_set_info_t));
-	if(title_set_info == NULL) {
+	if (image_open(image, image_file, flags) != 0) {
+		fprintf(stderr, _("Error opening %s\n"), image_file);
 		perror(PACKAGE);
-		return NULL;
+		goto open_image_failed;
 	}
 
-	title_set_info->title_set = (title_set_t*)malloc((title_sets + 1) * sizeof(title_set_t));
-	if(title_set_info->title_set == NULL) {
-		perror(PACKAGE);
-		free(title_set_info);
-		return NULL;
+	if (!compare_only && !fill_gaps && preallocate) {
+		int fd = open(image_file, O_WRONLY);
+		if (fd == -1 || preallocate_file(fd, image_file, size) != 0) {
+			if (fd != -1) {
+				close(fd);
+			}
+			goto open_image_failed;
+		}
+		close(fd);
 	}
 
-	title_set_info->number_of_title_sets = title_sets;
+	free(files);
+	output_image = image;
+	output_image_created = (flags & O_TRUNC) != 0;
+	return 0;
 
+open_image_failed:
+	free(files);
+	image_free(image);
+	return 1;
+}
 
-	/* Find VIDEO_TS.IFO is present - must be present since we did a ifo open 0 */
 
-	if (DVDFileStat(dvd, 0, DVD_READ_INFO_FILE, &statbuf) != -1) {
-		title_set_info->title_set[0].size_ifo = statbuf.size;
-	} else {
-		DVDFreeTitleSetInfo(title_set_info);
-		return NULL;
-	}
+/**
+ * Starts the --tar archive of the files of title_set_info, which are stored
+ * below "<title_name>/VIDEO_TS" in the order they are copied.
+ */
+static int DVDOpenTar(title_set_info_t* title_set_info, char* title_name) {
+	disc_file_t* files;
+	char* directory;
+	int count;
+	int i;
 
-	/* Find VIDEO_TS.VOB if present*/
+	directory = malloc(strlen(title_name) + 10);
+	if (directory == NULL) {
+		perror(PACKAGE);
+		return 1;
+	}
+	sprintf(directory, "%s/VIDEO_TS", title_name);
+	output_tar = tar_new(tar_fd, directory);
+	free(directory);
+	if (output_tar == NULL) {
+		perror(PACKAGE);
+		return 1;
+	}
 
-	if(DVDFileStat(dvd, 0, DVD_READ_MENU_VOBS, &statbuf) != -1) {
-		title_set_info->title_set[0].size_menu = statbuf.size;
-	} else {
-		title_set_info->title_set[0].size_menu = 0 ;
+	files = DVDListFiles(title_set_info, &count);
+	if (files == NULL) {
+		tar_free(output_tar);
+		output_tar = NULL;
+		return 1;
 	}
+	for (i = 0; i < count; i++) {
+		if (tar_add_file(output_tar, files[i].name, files[i].size) != 0) {
+			fprintf(stderr, _("Cannot add %s to the tar archive\n"), files[i].name);
+			perror(PACKAGE);
+			free(files);
+			tar_free(output_tar);
+			output_tar = NULL;
+			return 1;
+		}
+	}
+	free(files);
 
-	/* Take care of the titles which we don't have in VMG */
+	return 0;
+}
 
-	title_set_info->title_set[0].number_of_vob_files = 0;
-	title_set_info->title_set[0].size_vob[0] = 0;
 
-	if ( verbose > 0 ){
-		fprintf(stderr,_("\n\n\nFile sizes for Title set 0 VIDEO_TS.XXX\n"));
-		fprintf(stderr,_("IFO = %jd, MENU_VOB = %jd\n"),(intmax_t)title_set_info->title_set[0].size_ifo, (intmax_t)title_set_info->title_set[0].size_menu);
+/**
+ * Ends the --tar archive. After a failed copy the end of archive marker is
+ * left out, so that the consumer sees a truncated archive.
+ */
+static int DVDCloseTar(int complete) {
+	int result = 0;
+
+	if (output_tar == NULL) {
+		return 0;
 	}
 
-	for(counter = 0; counter < title_sets; counter++) {
+	if (complete && tar_finish(output_tar) != 0) {
+		fprintf(stderr, _("Error writing the tar archive\n"));
+		perror(PACKAGE);
+		result = 1;
+	}
+	tar_free(output_tar);
+	output_tar = NULL;
 
-		if(verbose > 1) {
-			fprintf(stderr,_("At top of loop\n"));
-		}
+	return result;
+}
 
 
-		if(DVDFileStat(dvd, counter + 1, DVD_READ_INFO_FILE, &statbuf) != -1) {
-			title_set_info->title_set[counter+1].size_ifo = statbuf.size;
-		} else {
-			DVDFreeTitleSetInfo(title_set_info);
-			return NULL;
-		}
+static int DVDCloseImage(void) {
+	int result = 0;
 
-		if(verbose > 1) {
-			fprintf(stderr,_("After opening files\n"));
-		}
+	if (output_image == NULL) {
+		return 0;
+	}
 
-		/* Find VTS_XX_0.VOB if present */
+	if (image_close(output_image) != 0) {
+		fprintf(stderr, _("Error writing %s\n"), image_file);
+		perror(PACKAGE);
+		result = 1;
+	}
+	image_free(output_image);
+	output_image = NULL;
 
-		if(DVDFileStat(dvd, counter + 1, DVD_READ_MENU_VOBS, &statbuf) != -1) {
-			title_set_info->title_set[counter + 1].size_menu = statbuf.size;
-		} else {
-			title_set_info->title_set[counter + 1].size_menu = 0 ;
-		}
+	return result;
+}
 
-		if(verbose > 1) {
-			fprintf(stderr,_("After Menu VOB check\n"));
-		}
 
-		/* Find all VTS_XX_[1 to 9].VOB files if they are present */
+int DVDMirror(dvd_reader_t * _dvd, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
 
-		i = 0;
-		if(DVDFileStat(dvd, counter + 1, DVD_READ_TITLE_VOBS, &statbuf) != -1) {
-			for(i = 0; i < statbuf.nr_parts; ++i) {
-				title_set_info->title_set[counter + 1].size_vob[i] = statbuf.parts_size[i];
-			}
-		}
-		title_set_info->title_set[counter + 1].number_of_vob_files = i;
+	int i;
+	int result = 0;
+	off_t needed;
+	title_set_info_t * title_set_info=NULL;
 
-		if(verbose > 1) {
-			fprintf(stderr,_("After Menu Title VOB check\n"));
-		}
+	title_set_info = DVDGetFileSet(_dvd);
+	if (!title_set_info) {
+		DVDClose(_dvd);
+		return(1);
+	}
 
-		if(verbose > 0) {
-			fprintf(stderr,_("\n\n\nFile sizes for Title set %d i.e. VTS_%02d_X.XXX\n"), counter + 1, counter + 1);
-			fprintf(stderr,_("IFO: %jd, MENU: %jd\n"), (intmax_t)title_set_info->title_set[counter +1].size_ifo, (intmax_t)title_set_info->title_set[counter +1].size_menu);
-			for (i = 0; i < title_set_info->title_set[counter + 1].number_of_vob_files ; i++) {
-				fprintf(stderr, _("VOB %d is %jd\n"), i + 1, (intmax_t)title_set_info->title_set[counter + 1].size_vob[i]);
-			}
-		}
+	needed = 0;
+	for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+		needed += title_set_bytes(title_set_info, i);
+	}
+	if (check_free_space(targetdir, title_name, ALL_TITLE_SETS, needed) != 0) {
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
 
-		if(verbose > 1) {
-			fprintf(stderr,_("Bottom of loop\n"));
+	if (image_file != NULL && DVDOpenImage(_dvd, title_set_info, title_name) != 0) {
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+	if (tar_output && DVDOpenTar(title_set_info, title_name) != 0) {
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
+	if (physical_order) {
+		result = DVDMirrorPhysical(_dvd, title_set_info, targetdir, title_name, errorstrat);
+	} else {
+		for ( i=0; i <= title_set_info->number_of_title_sets; i++) {
+			if ( DVDMirrorTitleX(_dvd, title_set_info, i, targetdir, title_name, errorstrat) != 0 ) {
+				fprintf(stderr,_("Mirror of Title set %d failed\n"), i);
+				result = 1;
+				break;
+			}
 		}
 	}
 
-	/* Return the info */
-	return title_set_info;
+	if (DVDCloseImage() != 0 || DVDCloseTar(result == 0) != 0) {
+		result = 1;
+	}
+	DVDFreeTitleSetInfo(title_set_info);
+	return result;
 }
 
 
-int DVDMirror(dvd_reader_t * _dvd, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
+static void* drive_job_thread(void* arg) {
+	job = (job_t*)arg;
+
+	job->result = DVDMirror(job->dvd, job->targetdir, job->title_name, job->errorstrat);
+	job->seconds = monotonic_seconds() - drives_started;
+	return NULL;
+}
+
 
+/**
+ * Mirrors the discs in count drives at once into targetdir/title_names[i],
+ * one thread per drive, with their writes going to the output through one
+ * writer thread.
+ * Returns 0 if every mirror succeeded.
+ */
+int DVDMirrorDrives(dvd_reader_t** dvds, char** devices, char** title_names, int count,
+		char* targetdir, read_error_strategy_t errorstrat) {
+	pthread_t* threads;
+	int started;
+	int result = 0;
 	int i;
-	title_set_info_t * title_set_info=NULL;
 
-	title_set_info = DVDGetFileSet(_dvd);
-	if (!title_set_info) {
-		DVDClose(_dvd);
-		return(1);
+	drive_jobs = calloc((size_t)count, sizeof(job_t));
+	threads = calloc((size_t)count, sizeof(pthread_t));
+	if (drive_jobs == NULL || threads == NULL) {
+		fprintf(stderr, _("Out of memory starting %d drives\n"), count);
+		free(drive_jobs);
+		free(threads);
+		drive_jobs = NULL;
+		return 1;
 	}
 
-	for ( i=0; i <= title_set_info->number_of_title_sets; i++) {
-		if ( DVDMirrorTitleX(_dvd, title_set_info, i, targetdir, title_name, errorstrat) != 0 ) {
-			fprintf(stderr,_("Mirror of Title set %d failed\n"), i);
-			DVDFreeTitleSetInfo(title_set_info);
-			return(1);
+	for (i = 0; i < count; ++i) {
+		drive_jobs[i].dvd = dvds[i];
+		drive_jobs[i].device = devices[i];
+		drive_jobs[i].title_name = title_names[i];
+		drive_jobs[i].targetdir = targetdir;
+		drive_jobs[i].errorstrat = errorstrat;
+		drive_jobs[i].result = 1;
+		strcpy(drive_jobs[i].progress_text, "n/a");
+	}
+	drive_job_count = count;
+	drives_bytes_written = 0;
+	drives_started = monotonic_seconds();
+	if (writer_start() != 0) {
+		fprintf(stderr, _("Failed to start the writer thread\n"));
+		drive_job_count = 0;
+		free(drive_jobs);
+		drive_jobs = NULL;
+		free(threads);
+		return 1;
+	}
+
+	for (started = 0; started < count; ++started) {
+		if (pthread_create(&threads[started], NULL, drive_job_thread, &drive_jobs[started]) != 0) {
+			fprintf(stderr, _("Failed to start the thread for %s\n"), devices[started]);
+			break;
 		}
 	}
-	return(0);
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	writer_finish();
+
+	if (progress) {
+		fprintf(stdout, "\n");
+	}
+	for (i = 0; i < count; ++i) {
+		job = &drive_jobs[i];
+		if (job->result != 0) {
+			fprintf(stderr, _("Mirror of the DVD in %s failed\n"), job->device);
+			result = 1;
+		} else if (job->seconds > 0.0) {
+			printf(_("%s: %s mirrored at %.1f MiB/s, %.0f%% of the time waiting for the output\n"),
+					job->device, job->title_name,
+					(double)job->bytes_written / 1048576.0 / job->seconds,
+					job->write_wait * 100.0 / job->seconds);
+		}
+		if (gap_map) {
+			printf(_("Gap map of %s:\n"), job->device);
+			gap_map_render();
+			gap_map_free();
+		}
+		if (errorstrat == STRATEGY_BISECT) {
+			bisect_report();
+		}
+		read_stall_report();
+		/* the drives themselves are closed by the caller */
+		close_dvd_reader(NULL);
+	}
+
+	job = &default_job;
+	drive_job_count = 0;
+	free(drive_jobs);
+	drive_jobs = NULL;
+	free(threads);
+	return result;
 }
 
 
@@ -3170,8 +7434,24 @@ int DVDMirrorTitleSet(dvd_reader_t * _dvd, char * targetdir,char * title_name, i
 		return(1);
 	}
 
+	if (check_free_space(targetdir, title_name, title_set, title_set_bytes(title_set_info, title_set)) != 0) {
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
+	if (tar_output && DVDOpenTar(title_set_info, title_name) != 0) {
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
 	if ( DVDMirrorTitleX(_dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
 		fprintf(stderr,_("Mirror of Title set %d failed\n"), title_set);
+		DVDCloseTar(0);
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
+	if (DVDCloseTar(1) != 0) {
 		DVDFreeTitleSetInfo(title_set_info);
 		return(1);
 	}
@@ -3199,8 +7479,28 @@ int DVDMirrorMainFeature(dvd_reader_t * _dvd, char * targetdir,char * title_name
 		return(1);
 	}
 
+	if (check_free_space(targetdir, title_name, titles_info->main_title_set,
+			title_set_bytes(title_set_info, titles_info->main_title_set)) != 0) {
+		DVDFreeTitlesInfo(titles_info);
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
+	if (tar_output && DVDOpenTar(title_set_info, title_name) != 0) {
+		DVDFreeTitlesInfo(titles_info);
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
 	if ( DVDMirrorTitleX(_dvd, title_set_info, titles_info->main_title_set, targetdir, title_name, errorstrat) != 0 ) {
 		fprintf(stderr,_("Mirror of main feature file which is title set %d failed\n"), titles_info->main_title_set);
+		DVDCloseTar(0);
+		DVDFreeTitleSetInfo(title_set_info);
+		return(1);
+	}
+
+	if (DVDCloseTar(1) != 0) {
+		DVDFreeTitlesInfo(titles_info);
 		DVDFreeTitleSetInfo(title_set_info);
 		return(1);
 	}
@@ -3252,7 +7552,7 @@ int DVDMirrorChapters(dvd_reader_t * _dvd, char * targetdir,char * title_name, i
 		}
 	}
 
-	vts_ifo_info = ifoOpen(_dvd, titles_info->titles[titles - 1].title_set);
+	vts_ifo_info = open_job_ifo(_dvd, titles_info->titles[titles - 1].title_set);
 	if(!vts_ifo_info) {
 		fprintf(stderr, _("Could not open title_set %d IFO file\n"), titles_info->titles[titles - 1].title_set);
 		DVDFreeTitlesInfo(titles_info);
@@ -3595,3 +7895,569 @@ int DVDDisplayInfo(dvd_reader_t* dvd, char* device) {
 
 	return(0);
 }
+
+
+/* One file listed in a manifest, for --scrub */
+typedef struct {
+	char* path;
+	uint64_t digest;
+	uint64_t size;
+} scrub_file_t;
+
+/* Files of a --scrub and the state its threads share */
+typedef struct {
+	scrub_file_t* files;
+	size_t count;
+	size_t capacity;
+
+	pthread_mutex_t lock; /* next, the counters and the report */
+	size_t next;
+	size_t mismatched;
+	size_t missing;
+	size_t errors;
+	uint64_t bytes;
+
+	pthread_mutex_t rate_lock;
+	double rate; /* bytes per second, 0 for no limit */
+	double rate_next; /* when the next read may start */
+} scrub_t;
+
+
+static int scrub_add_file(scrub_t* scrub, const char* title_dir, const char* name,
+		uint64_t digest, uint64_t size) {
+	scrub_file_t* file;
+	size_t length;
+
+	if (scrub->count == scrub->capacity) {
+		size_t capacity = scrub->capacity ? scrub->capacity * 2 : 64;
+		scrub_file_t* grown = realloc(scrub->files, capacity * sizeof(*grown));
+		if (grown == NULL) {
+			return -1;
+		}
+		scrub->files = grown;
+		scrub->capacity = capacity;
+	}
+
+	file = &scrub->files[scrub->count];
+	length = strlen(title_dir) + strlen(name) + 2;
+	file->path = malloc(length);
+	if (file->path == NULL) {
+		return -1;
+	}
+	snprintf(file->path, length, "%s/%s", title_dir, name);
+	file->digest = digest;
+	file->size = size;
+	scrub->count++;
+	return 0;
+}
+
+
+/**
+ * Adds the files listed in the MANIFEST of title_dir. A line that cannot be
+ * parsed is reported and counted as an error.
+ */
+static int scrub_read_manifest(scrub_t* scrub, const char* title_dir, const char* manifest_path) {
+	char line[PATH_MAX + 64];
+	unsigned int line_number = 0;
+	FILE* file;
+
+	file = fopen(manifest_path, "r");
+	if (file == NULL) {
+		fprintf(stderr, _("Failed opening manifest %s\n"), manifest_path);
+		perror(PACKAGE);
+		scrub->errors++;
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		uint64_t digest;
+		uint64_t size;
+		size_t padded;
+		int name_start = 0;
+		char* newline;
+
+		line_number++;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		newline = strchr(line, '\n');
+		if (newline != NULL) {
+			*newline = '\0';
+		}
+		if (sscanf(line, "%16" SCNx64 " %" SCNu64 " %zu %n", &digest, &size, &padded, &name_start) < 3
+				|| name_start == 0 || line[name_start] == '\0' || strstr(line + name_start, "..") != NULL) {
+			printf("MALFORMED - - %s:%u\n", manifest_path, line_number);
+			scrub->errors++;
+			continue;
+		}
+		if (scrub_add_file(scrub, title_dir, line + name_start, digest, size) != 0) {
+			fclose(file);
+			return -1;
+		}
+	}
+
+	fclose(file);
+	return 0;
+}
+
+
+/**
+ * Collects the files of every title directory at or below dir, which are the
+ * directories with a MANIFEST. VIDEO_TS directories, hidden entries and
+ * symbolic links are not descended into.
+ */
+static int scrub_walk(scrub_t* scrub, const char* dir) {
+	struct dirent* entry;
+	struct stat st;
+	char* path;
+	size_t length;
+	DIR* handle;
+	int result = 0;
+
+	length = strlen(dir) + NAME_MAX + 2;
+	path = malloc(length);
+	if (path == NULL) {
+		return -1;
+	}
+
+	snprintf(path, length, "%s/MANIFEST", dir);
+	if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (scrub_read_manifest(scrub, dir, path) != 0) {
+			free(path);
+			return -1;
+		}
+	}
+
+	handle = opendir(dir);
+	if (handle == NULL) {
+		fprintf(stderr, _("Failed opening directory %s\n"), dir);
+		perror(PACKAGE);
+		scrub->errors++;
+		free(path);
+		return 0;
+	}
+
+	while (result == 0 && (entry = readdir(handle)) != NULL) {
+		if (entry->d_name[0] == '.' || strcmp(entry->d_name, "VIDEO_TS") == 0) {
+			continue;
+		}
+		snprintf(path, length, "%s/%s", dir, entry->d_name);
+		if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+			result = scrub_walk(scrub, path);
+		}
+	}
+
+	closedir(handle);
+	free(path);
+	return result;
+}
+
+
+/**
+ * Waits until length more bytes may be read without the --scrub-rate being
+ * exceeded by all threads together.
+ */
+static void scrub_rate_wait(scrub_t* scrub, size_t length) {
+	double now;
+	double start;
+
+	if (scrub->rate <= 0.0) {
+		return;
+	}
+
+	pthread_mutex_lock(&scrub->rate_lock);
+	now = monotonic_seconds();
+	start = scrub->rate_next > now ? scrub->rate_next : now;
+	scrub->rate_next = start + (double)length / scrub->rate;
+	pthread_mutex_unlock(&scrub->rate_lock);
+
+	if (start > now) {
+		struct timespec delay;
+		delay.tv_sec = (time_t)(start - now);
+		delay.tv_nsec = (long)((start - now - (double)delay.tv_sec) * 1e9);
+		while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+		}
+	}
+}
+
+
+/**
+ * Hashes one file and prints its line of the report: the status, the expected
+ * and the actual digest or size and the path.
+ */
+static void scrub_file(scrub_t* scrub, const scrub_file_t* file, unsigned char* buffer) {
+	struct stat st;
+	xxh64_t state;
+	uint64_t digest;
+	ssize_t got = 0;
+	off_t done = 0;
+	int fd;
+
+	fd = open(file->path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) != 0) {
+		int saved_errno = errno;
+		pthread_mutex_lock(&scrub->lock);
+		if (saved_errno == ENOENT) {
+			printf("MISSING %016" PRIx64 " - %s\n", file->digest, file->path);
+			scrub->missing++;
+		} else {
+			printf("ERROR %016" PRIx64 " - %s\n", file->digest, file->path);
+			fprintf(stderr, "%s: %s\n", file->path, strerror(saved_errno));
+			scrub->errors++;
+		}
+		pthread_mutex_unlock(&scrub->lock);
+		if (fd != -1) {
+			close(fd);
+		}
+		return;
+	}
+
+	if ((uint64_t)st.st_size != file->size) {
+		pthread_mutex_lock(&scrub->lock);
+		printf("SIZE %" PRIu64 " %lld %s\n", file->size, (long long)st.st_size, file->path);
+		scrub->mismatched++;
+		pthread_mutex_unlock(&scrub->lock);
+		close(fd);
+		return;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	xxh64_init(&state, 0);
+	while (done < st.st_size) {
+		size_t want = (size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN;
+
+		if ((off_t)want > st.st_size - done) {
+			want = (size_t)(st.st_size - done);
+		}
+		scrub_rate_wait(scrub, want);
+		got = read(fd, buffer, want);
+		if (got <= 0) {
+			break;
+		}
+		xxh64_update(&state, buffer, (size_t)got);
+#ifdef HAVE_POSIX_FADVISE
+		/* an archive scrub should not push the working set out of the cache */
+		posix_fadvise(fd, done, got, POSIX_FADV_DONTNEED);
+#endif
+		done += got;
+	}
+	digest = xxh64_digest(&state);
+
+	pthread_mutex_lock(&scrub->lock);
+	if (got < 0) {
+		printf("ERROR %016" PRIx64 " - %s\n", file->digest, file->path);
+		fprintf(stderr, "%s: %s\n", file->path, strerror(errno));
+		scrub->errors++;
+	} else if (digest != file->digest) {
+		printf("MISMATCH %016" PRIx64 " %016" PRIx64 " %s\n", file->digest, digest, file->path);
+		scrub->mismatched++;
+	} else {
+		printf("OK %016" PRIx64 " %016" PRIx64 " %s\n", file->digest, digest, file->path);
+	}
+	scrub->bytes += (uint64_t)done;
+	pthread_mutex_unlock(&scrub->lock);
+	close(fd);
+}
+
+
+static void* scrub_thread(void* arg) {
+	scrub_t* scrub = (scrub_t*)arg;
+	unsigned char* buffer;
+
+	buffer = malloc((size_t)BUFFER_SIZE * DVD_VIDEO_LB_LEN);
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	for (;;) {
+		size_t index;
+
+		pthread_mutex_lock(&scrub->lock);
+		index = scrub->next;
+		if (index < scrub->count) {
+			scrub->next++;
+		}
+		pthread_mutex_unlock(&scrub->lock);
+		if (index >= scrub->count) {
+			break;
+		}
+
+		scrub_file(scrub, &scrub->files[index], buffer);
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+
+/**
+ * Verifies the title directories at or below root against their MANIFEST
+ * with threads threads, 0 for one per CPU, reading at most rate MiB per
+ * second, 0 for no limit. Every file gets a line on standard output. Returns
+ * 0 if all files match.
+ */
+int DVDScrub(const char* root, int threads, int rate) {
+	scrub_t scrub;
+	pthread_t* workers;
+	double started;
+	int started_threads;
+	int result;
+	size_t i;
+
+	memset(&scrub, 0, sizeof(scrub));
+	pthread_mutex_init(&scrub.lock, NULL);
+	pthread_mutex_init(&scrub.rate_lock, NULL);
+	scrub.rate = (double)rate * 1024.0 * 1024.0;
+
+	if (scrub_walk(&scrub, root) != 0) {
+		fprintf(stderr, _("Out of memory reading the manifests below %s\n"), root);
+		result = 1;
+		goto scrub_cleanup;
+	}
+	if (scrub.count == 0 && scrub.errors == 0) {
+		fprintf(stderr, _("There is no MANIFEST at or below %s\n"), root);
+		result = 1;
+		goto scrub_cleanup;
+	}
+
+	if (threads <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (int)cpus : 1;
+	}
+	if ((size_t)threads > scrub.count) {
+		threads = scrub.count > 0 ? (int)scrub.count : 1;
+	}
+	workers = calloc((size_t)threads, sizeof(pthread_t));
+	if (workers == NULL) {
+		fprintf(stderr, _("Out of memory starting %d threads\n"), threads);
+		result = 1;
+		goto scrub_cleanup;
+	}
+
+	started = monotonic_seconds();
+	scrub.rate_next = started;
+	for (started_threads = 0; started_threads < threads; ++started_threads) {
+		if (pthread_create(&workers[started_threads], NULL, scrub_thread, &scrub) != 0) {
+			break;
+		}
+	}
+	if (started_threads == 0) {
+		/* do the work on this thread instead */
+		scrub_thread(&scrub);
+	}
+	for (i = 0; i < (size_t)started_threads; ++i) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+
+	fprintf(stderr, _("Scrubbed %zu files, %.1f MiB in %.1f s: %zu mismatched, %zu missing, %zu errors\n"),
+			scrub.count, (double)scrub.bytes / 1048576.0, monotonic_seconds() - started,
+			scrub.mismatched, scrub.missing, scrub.errors);
+	result = scrub.mismatched + scrub.missing + scrub.errors == 0 ? 0 : 1;
+
+scrub_cleanup:
+	for (i = 0; i < scrub.count; ++i) {
+		free(scrub.files[i].path);
+	}
+	free(scrub.files);
+	pthread_mutex_destroy(&scrub.rate_lock);
+	pthread_mutex_destroy(&scrub.lock);
+	return result;
+}
+
+
+/**
+ * Copies the file sectors of a --replay-trace disc the way DVDCopyBlocks()
+ * does with errorstrat and adds the sectors left unread to unread. Returns
+ * the number of sectors read, or -1 if out of memory.
+ */
+static long replay_copy(dvd_file_t* file, size_t blocks, read_error_strategy_t errorstrat,
+		unsigned char* buffer, gap_plan_t* unread) {
+	copy_chunk_t chunk;
+	size_t offset = 0;
+	long read = 0;
+	int result = 0;
+
+	memset(&chunk, 0, sizeof(chunk));
+	chunk.data = buffer;
+	job->bisect_seconds = 0.0;
+	job->bisect_unreadable_blocks = 0;
+	job->bisect_recovered_blocks = 0;
+
+	while (offset < blocks && result == 0) {
+		int good;
+		int i;
+
+		chunk.offset = (int)offset;
+		chunk.to_read = blocks - offset < BUFFER_SIZE ? (int)(blocks - offset) : BUFFER_SIZE;
+		copy_chunk_read(file, &chunk, errorstrat);
+		if (chunk.blanks < 0) {
+			break;
+		}
+
+		good = chunk.act_read > 0 ? chunk.act_read : 0;
+		if (chunk.recovered >= 0) {
+			read += good + chunk.recovered;
+			for (i = good; i < chunk.to_read && result == 0; ++i) {
+				if (chunk.padded[i / 8] & (1 << (i % 8))) {
+					result = gap_plan_add(unread, offset + (size_t)i, 1);
+				}
+			}
+		} else {
+			read += good;
+			if (chunk.blanks > 0) {
+				result = gap_plan_add(unread, offset + (size_t)good, (size_t)chunk.blanks);
+			}
+		}
+		offset += (size_t)copy_chunk_blocks(&chunk);
+	}
+
+	if (result == 0 && offset < blocks) {
+		result = gap_plan_add(unread, offset, blocks - offset);
+	}
+	return result == 0 ? read : -1;
+}
+
+
+int DVDReplayTrace(const char* path) {
+	static const struct {
+		read_error_strategy_t strategy;
+		const char* name;
+	} copies[] = {
+		{ STRATEGY_ABORT, "a" },
+		{ STRATEGY_SKIP_BLOCK, "b" },
+		{ STRATEGY_SKIP_MULTIBLOCK, "m" },
+		{ STRATEGY_BISECT, "i" }
+	};
+	static const struct {
+		gap_strategy_t strategy;
+		const char* name;
+	} fills[] = {
+		{ GAP_STRATEGY_FORWARD, "forward" },
+		{ GAP_STRATEGY_REVERSE, "reverse" },
+		{ GAP_STRATEGY_OUTSIDE_IN, "outside-in" },
+		{ GAP_STRATEGY_RANDOM, "random" },
+		{ GAP_STRATEGY_RESCUE, "rescue" }
+	};
+	open_file_t entry;
+	disc_model_t* model;
+	gap_plan_t left = {NULL, 0, 0};
+	unsigned char* buffer;
+	size_t blocks;
+	size_t unreadable;
+	size_t unknown;
+	char label[64];
+	int devnull;
+	int saved_stderr;
+	int line;
+	int result = 0;
+	size_t i;
+
+	/* the simulated writes go to /dev/null directly */
+	async_output = 0;
+
+	model = disc_model_load(path, &line);
+	if (model == NULL) {
+		if (line > 0) {
+			fprintf(stderr, _("Cannot parse line %d of the read trace %s\n"), line, path);
+		} else {
+			fprintf(stderr, _("Cannot read the read trace %s\n"), path);
+			perror(PACKAGE);
+		}
+		return 1;
+	}
+	blocks = disc_model_blocks(model);
+	unreadable = disc_model_unreadable(model, &unknown);
+
+	/* the simulated disc is one file, read like any other */
+	memset(&entry, 0, sizeof(entry));
+	entry.file = (dvd_file_t*)&entry;
+	entry.no_file = 1;
+	entry.source = block_source_replay(model);
+	buffer = alloc_blocks(BUFFER_SIZE);
+	devnull = open("/dev/null", O_WRONLY);
+	if (entry.source == NULL || buffer == NULL || devnull == -1) {
+		fprintf(stderr, _("Cannot set up the replay of %s\n"), path);
+		perror(PACKAGE);
+		result = 1;
+		goto replay_cleanup;
+	}
+	block_source = BLOCK_SOURCE_REPLAY;
+	pthread_mutex_lock(&open_files_lock);
+	entry.next = open_files;
+	open_files = &entry;
+	pthread_mutex_unlock(&open_files_lock);
+
+	printf(_("Replaying %zu reads of sectors %" PRIu32 " to %zu: %zu unreadable, %zu of them only known to be in a failed read\n"),
+			disc_model_reads(model), disc_model_first(model),
+			(size_t)disc_model_first(model) + blocks - 1, unreadable, unknown);
+	printf(_("%-40s %12s %12s %10s\n"), _("Strategy"), _("Read"), _("Not read"), _("Seconds"));
+
+	/* the simulated runs report their read errors as usual */
+	fflush(stderr);
+	saved_stderr = dup(STDERR_FILENO);
+	dup2(devnull, STDERR_FILENO);
+	replay_model = model;
+
+	for (i = 0; i < sizeof(copies) / sizeof(copies[0]) && result == 0; ++i) {
+		gap_plan_t unread = {NULL, 0, 0};
+		long read;
+
+		disc_model_reset(model);
+		read = replay_copy(entry.file, blocks, copies[i].strategy, buffer, &unread);
+		if (read < 0) {
+			result = 1;
+		} else {
+			snprintf(label, sizeof(label), "-r %s", copies[i].name);
+			printf("%-40s %12ld %12zu %10.1f\n", label, read, blocks - (size_t)read,
+					disc_model_seconds(model));
+			fflush(stdout);
+		}
+		/* gap strategies start from what -r m left */
+		if (copies[i].strategy == STRATEGY_SKIP_MULTIBLOCK) {
+			gap_plan_free(&left);
+			left = unread;
+		} else {
+			gap_plan_free(&unread);
+		}
+	}
+
+	for (i = 0; i < sizeof(fills) / sizeof(fills[0]) && result == 0; ++i) {
+		size_t filled = 0;
+
+		disc_model_reset(model);
+		gap_strategy = fills[i].strategy;
+		if (gap_fill_from_plan(devnull, entry.file, 0, &left, path, STRATEGY_SKIP_MULTIBLOCK,
+					&filled) != 0) {
+			result = 1;
+			break;
+		}
+		snprintf(label, sizeof(label), "-r m, --gaps --gap-strategy=%s", fills[i].name);
+		printf("%-40s %12zu %12zu %10.1f\n", label, filled, gap_plan_blocks(&left) - filled,
+				disc_model_seconds(model));
+		fflush(stdout);
+	}
+
+	replay_model = NULL;
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stderr);
+	if (result != 0) {
+		fprintf(stderr, _("Out of memory replaying %s\n"), path);
+	}
+
+	pthread_mutex_lock(&open_files_lock);
+	open_files = entry.next;
+	pthread_mutex_unlock(&open_files_lock);
+
+replay_cleanup:
+	if (devnull != -1) {
+		close(devnull);
+	}
+	gap_plan_free(&left);
+	free(buffer);
+	block_source_close(entry.source);
+	disc_model_free(model);
+	return result;
+}
@@ -30,23 +30,56 @@ extern int aspect;
 extern int progress;
 extern int fill_gaps;
 extern int no_overwrite;
+extern int pipeline;
+extern int async_output;
+extern int direct_io;
+extern int sparse_output;
+extern int preallocate;
+extern int write_behind;
+extern int physical_order;
+extern char* image_file;
+extern int tar_output;
+extern int bisect_max_depth;
+extern int bisect_time_limit;
+extern int resume;
+extern int journal_interval;
+extern int manifest;
+extern int crc_index;
+extern int repair;
+extern int read_timeout;
+extern const char* dvd_device;
+
+typedef enum {
+	BLOCK_SOURCE_DVDREAD,
+	BLOCK_SOURCE_RAW,
+	BLOCK_SOURCE_MOCK,
+	BLOCK_SOURCE_REPLAY
+} block_source_kind_t;
+
+extern block_source_kind_t block_source;
+extern char* fault_spec;
+extern char* record_trace;
 
 typedef enum {
 	STRATEGY_ABORT,
 	STRATEGY_SKIP_BLOCK,
-	STRATEGY_SKIP_MULTIBLOCK
+	STRATEGY_SKIP_MULTIBLOCK,
+	STRATEGY_BISECT
 } read_error_strategy_t;
 
 typedef enum {
 	GAP_STRATEGY_FORWARD,
 	GAP_STRATEGY_REVERSE,
 	GAP_STRATEGY_OUTSIDE_IN,
-	GAP_STRATEGY_RANDOM
+	GAP_STRATEGY_RANDOM,
+	GAP_STRATEGY_RESCUE
 } gap_strategy_t;
 
 extern gap_strategy_t gap_strategy;
 extern unsigned int gap_random_seed;
 extern int gap_random_seed_set;
+extern int rescue_retries;
+extern int rescue_time;
 extern int compare_only;
 extern int gap_map;
 
@@ -54,12 +87,26 @@ void gap_map_reset(void);
 void gap_map_render(void);
 void gap_map_free(void);
 
+void async_output_setup(void);
+void async_output_finish(void);
+
+int tar_output_setup(void);
+
+void bisect_report(void);
+void read_stall_report(void);
+void close_dvd_reader(dvd_reader_t*);
+int block_source_setup(void);
+int block_source_finish(void);
+
 int DVDDisplayInfo(dvd_reader_t*, char*);
 int DVDGetTitleName(const char*, char*);
 int DVDMirror(dvd_reader_t*, char*, char*, read_error_strategy_t);
+int DVDMirrorDrives(dvd_reader_t**, char**, char**, int, char*, read_error_strategy_t);
 int DVDMirrorChapters(dvd_reader_t*, char*, char*, int, int, int);
 int DVDMirrorMainFeature(dvd_reader_t*, char*, char*, read_error_strategy_t);
 int DVDMirrorTitles(dvd_reader_t*, char*, char*, int);
 int DVDMirrorTitleSet(dvd_reader_t*, char*, char*, int, read_error_strategy_t);
+int DVDScrub(const char*, int, int);
+int DVDReplayTrace(const char*);
 
 #endif /* DVDBACKUP_H_ */
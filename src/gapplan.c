@@ -0,0 +1,247 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "gapplan.h"
+
+/* C standard libraries */
+#include <stdlib.h>
+#include <string.h>
+
+
+void gap_plan_free(gap_plan_t* plan) {
+	free(plan->ranges);
+	plan->ranges = NULL;
+	plan->count = 0;
+	plan->capacity = 0;
+}
+
+
+/* Index of the first range that ends after block, count if there is none */
+static size_t gap_plan_search(const gap_plan_t* plan, size_t block) {
+	size_t low = 0;
+	size_t high = plan->count;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		const gap_range_t* range = &plan->ranges[middle];
+
+		if (range->start_block + range->block_count <= block) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+
+static int gap_plan_reserve(gap_plan_t* plan, size_t count) {
+	gap_range_t* new_ranges;
+	size_t new_capacity;
+
+	if (count <= plan->capacity) {
+		return 0;
+	}
+
+	new_capacity = plan->capacity == 0 ? 8 : plan->capacity * 2;
+	if (new_capacity < count) {
+		new_capacity = count;
+	}
+	new_ranges = realloc(plan->ranges, new_capacity * sizeof(*new_ranges));
+	if (new_ranges == NULL) {
+		return -1;
+	}
+	plan->ranges = new_ranges;
+	plan->capacity = new_capacity;
+	return 0;
+}
+
+
+int gap_plan_add(gap_plan_t* plan, size_t start, size_t count) {
+	size_t end;
+	size_t first;
+	size_t last;
+
+	if (count == 0) {
+		return 0;
+	}
+	end = start + count;
+
+	/* ranges arrive in order from the scans, so try the end first */
+	if (plan->count > 0) {
+		gap_range_t* tail = &plan->ranges[plan->count - 1];
+		size_t tail_end = tail->start_block + tail->block_count;
+
+		if (start >= tail->start_block && start <= tail_end) {
+			if (end > tail_end) {
+				tail->block_count = end - tail->start_block;
+			}
+			return 0;
+		}
+	}
+
+	/* the ranges from first to last overlap or touch the new one */
+	first = gap_plan_search(plan, start > 0 ? start - 1 : 0);
+	last = first;
+	while (last < plan->count && plan->ranges[last].start_block <= end) {
+		last++;
+	}
+
+	if (first == last) {
+		if (gap_plan_reserve(plan, plan->count + 1) != 0) {
+			return -1;
+		}
+		memmove(plan->ranges + first + 1, plan->ranges + first,
+				(plan->count - first) * sizeof(*plan->ranges));
+		plan->ranges[first].start_block = start;
+		plan->ranges[first].block_count = count;
+		plan->count++;
+		return 0;
+	}
+
+	if (plan->ranges[first].start_block < start) {
+		start = plan->ranges[first].start_block;
+	}
+	if (plan->ranges[last - 1].start_block + plan->ranges[last - 1].block_count > end) {
+		end = plan->ranges[last - 1].start_block + plan->ranges[last - 1].block_count;
+	}
+	plan->ranges[first].start_block = start;
+	plan->ranges[first].block_count = end - start;
+	memmove(plan->ranges + first + 1, plan->ranges + last,
+			(plan->count - last) * sizeof(*plan->ranges));
+	plan->count -= last - first - 1;
+	return 0;
+}
+
+
+int gap_plan_subtract(gap_plan_t* plan, size_t start, size_t count) {
+	size_t end = start + count;
+	size_t first;
+	size_t last;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	first = gap_plan_search(plan, start);
+	if (first == plan->count || plan->ranges[first].start_block >= end) {
+		return 0;
+	}
+
+	/* a range reaching past both ends is split in two */
+	if (plan->ranges[first].start_block < start
+			&& plan->ranges[first].start_block + plan->ranges[first].block_count > end) {
+		size_t range_end = plan->ranges[first].start_block + plan->ranges[first].block_count;
+
+		if (gap_plan_reserve(plan, plan->count + 1) != 0) {
+			return -1;
+		}
+		memmove(plan->ranges + first + 2, plan->ranges + first + 1,
+				(plan->count - first - 1) * sizeof(*plan->ranges));
+		plan->ranges[first].block_count = start - plan->ranges[first].start_block;
+		plan->ranges[first + 1].start_block = end;
+		plan->ranges[first + 1].block_count = range_end - end;
+		plan->count++;
+		return 0;
+	}
+
+	if (plan->ranges[first].start_block < start) {
+		plan->ranges[first].block_count = start - plan->ranges[first].start_block;
+		first++;
+	}
+
+	/* ranges from first to last lie inside, last may stick out at the end */
+	last = first;
+	while (last < plan->count
+			&& plan->ranges[last].start_block + plan->ranges[last].block_count <= end) {
+		last++;
+	}
+	if (last < plan->count && plan->ranges[last].start_block < end) {
+		size_t range_end = plan->ranges[last].start_block + plan->ranges[last].block_count;
+
+		plan->ranges[last].start_block = end;
+		plan->ranges[last].block_count = range_end - end;
+	}
+
+	memmove(plan->ranges + first, plan->ranges + last,
+			(plan->count - last) * sizeof(*plan->ranges));
+	plan->count -= last - first;
+	return 0;
+}
+
+
+int gap_plan_merge(gap_plan_t* plan, const gap_plan_t* other) {
+	size_t i;
+
+	if (gap_plan_reserve(plan, plan->count + other->count) != 0) {
+		return -1;
+	}
+	for (i = 0; i < other->count; ++i) {
+		if (gap_plan_add(plan, other->ranges[i].start_block, other->ranges[i].block_count) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+int gap_plan_contains(const gap_plan_t* plan, size_t block) {
+	size_t index = gap_plan_search(plan, block);
+
+	return index < plan->count && plan->ranges[index].start_block <= block;
+}
+
+
+size_t gap_plan_next_good(const gap_plan_t* plan, size_t block) {
+	size_t index = gap_plan_search(plan, block);
+
+	/* ranges never touch, so the block after one is good */
+	if (index < plan->count && plan->ranges[index].start_block <= block) {
+		return plan->ranges[index].start_block + plan->ranges[index].block_count;
+	}
+
+	return block;
+}
+
+
+size_t gap_plan_prev_good(const gap_plan_t* plan, size_t block) {
+	size_t index = gap_plan_search(plan, block);
+
+	if (index < plan->count && plan->ranges[index].start_block <= block) {
+		return plan->ranges[index].start_block - 1;
+	}
+
+	return block;
+}
+
+
+size_t gap_plan_blocks(const gap_plan_t* plan) {
+	size_t blocks = 0;
+	size_t i;
+
+	for (i = 0; i < plan->count; ++i) {
+		blocks += plan->ranges[i].block_count;
+	}
+
+	return blocks;
+}
@@ -0,0 +1,74 @@
+#ifndef GAPPLAN_H_
+#define GAPPLAN_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+/*
+ * Plan of the blocks of a file a gap fill has to read: sorted ranges that
+ * neither overlap nor touch, so a block is in the plan if and only if a
+ * binary search finds a range holding it. Iterate over ranges[0..count).
+ */
+typedef struct {
+	size_t start_block;
+	size_t block_count;
+} gap_range_t;
+
+typedef struct {
+	gap_range_t* ranges;
+	size_t count;
+	size_t capacity;
+} gap_plan_t;
+
+void gap_plan_free(gap_plan_t* plan);
+
+/**
+ * Adds count blocks from start, merging them with the ranges they overlap or
+ * touch. Adding in ascending order is the fast case. Returns -1 if out of
+ * memory.
+ */
+int gap_plan_add(gap_plan_t* plan, size_t start, size_t count);
+
+/**
+ * Removes count blocks from start, splitting a range they fall into. Returns
+ * -1 if out of memory.
+ */
+int gap_plan_subtract(gap_plan_t* plan, size_t start, size_t count);
+
+/* Adds every range of other to plan. Returns -1 if out of memory. */
+int gap_plan_merge(gap_plan_t* plan, const gap_plan_t* other);
+
+int gap_plan_contains(const gap_plan_t* plan, size_t block);
+
+/* Returns the first block at or after block that is not in the plan. */
+size_t gap_plan_next_good(const gap_plan_t* plan, size_t block);
+
+/**
+ * Returns the last block at or before block that is not in the plan, or
+ * (size_t)-1 if there is none.
+ */
+size_t gap_plan_prev_good(const gap_plan_t* plan, size_t block);
+
+/* Number of blocks in the plan */
+size_t gap_plan_blocks(const gap_plan_t* plan);
+
+#endif /* GAPPLAN_H_ */
@@ -0,0 +1,308 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "hash.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <pthread.h>
+
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Buffers between the copy and the hashing thread */
+#define HASHER_SLOTS 4
+
+
+static uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+
+static uint64_t read64(const unsigned char* p) {
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24
+		| (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+
+static uint32_t read32(const unsigned char* p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t value) {
+	acc ^= xxh64_round(0, value);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+/* Consumes one 32 byte stripe */
+static void xxh64_stripe(xxh64_t* state, const unsigned char* p) {
+	state->v[0] = xxh64_round(state->v[0], read64(p));
+	state->v[1] = xxh64_round(state->v[1], read64(p + 8));
+	state->v[2] = xxh64_round(state->v[2], read64(p + 16));
+	state->v[3] = xxh64_round(state->v[3], read64(p + 24));
+}
+
+
+void xxh64_init(xxh64_t* state, uint64_t seed) {
+	memset(state, 0, sizeof(*state));
+	state->seed = seed;
+	state->v[0] = seed + PRIME64_1 + PRIME64_2;
+	state->v[1] = seed + PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - PRIME64_1;
+}
+
+
+void xxh64_update(xxh64_t* state, const void* data, size_t length) {
+	const unsigned char* p = data;
+
+	state->total += length;
+
+	if (state->pending_length + length < sizeof(state->pending)) {
+		memcpy(state->pending + state->pending_length, p, length);
+		state->pending_length += length;
+		return;
+	}
+
+	if (state->pending_length > 0) {
+		size_t fill = sizeof(state->pending) - state->pending_length;
+		memcpy(state->pending + state->pending_length, p, fill);
+		xxh64_stripe(state, state->pending);
+		p += fill;
+		length -= fill;
+		state->pending_length = 0;
+	}
+
+	while (length >= 32) {
+		xxh64_stripe(state, p);
+		p += 32;
+		length -= 32;
+	}
+
+	memcpy(state->pending, p, length);
+	state->pending_length = length;
+}
+
+
+uint64_t xxh64_digest(const xxh64_t* state) {
+	const unsigned char* p = state->pending;
+	const unsigned char* end = p + state->pending_length;
+	uint64_t h;
+
+	if (state->total >= 32) {
+		h = rotl64(state->v[0], 1) + rotl64(state->v[1], 7)
+			+ rotl64(state->v[2], 12) + rotl64(state->v[3], 18);
+		h = xxh64_merge_round(h, state->v[0]);
+		h = xxh64_merge_round(h, state->v[1]);
+		h = xxh64_merge_round(h, state->v[2]);
+		h = xxh64_merge_round(h, state->v[3]);
+	} else {
+		h = state->seed + PRIME64_5;
+	}
+	h += state->total;
+
+	while (p + 8 <= end) {
+		h ^= xxh64_round(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (uint64_t)*p * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+typedef struct {
+	unsigned char* data;
+	size_t length;
+	int zeros; /* length zero bytes instead of data */
+} hasher_slot_t;
+
+struct hasher_s {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	hasher_slot_t slots[HASHER_SLOTS];
+	size_t chunk_size;
+	unsigned char* zero;
+	int head;
+	int count;
+	int done; /* no more data will be fed */
+	xxh64_t state;
+};
+
+
+static void* hasher_thread(void* arg) {
+	hasher_t* hasher = (hasher_t*)arg;
+
+	for (;;) {
+		hasher_slot_t* slot;
+
+		pthread_mutex_lock(&hasher->lock);
+		while (hasher->count == 0 && !hasher->done) {
+			pthread_cond_wait(&hasher->cond, &hasher->lock);
+		}
+		if (hasher->count == 0) {
+			pthread_mutex_unlock(&hasher->lock);
+			break;
+		}
+		slot = &hasher->slots[hasher->head];
+		pthread_mutex_unlock(&hasher->lock);
+
+		xxh64_update(&hasher->state, slot->zeros ? hasher->zero : slot->data, slot->length);
+
+		pthread_mutex_lock(&hasher->lock);
+		hasher->head = (hasher->head + 1) % HASHER_SLOTS;
+		hasher->count--;
+		pthread_cond_broadcast(&hasher->cond);
+		pthread_mutex_unlock(&hasher->lock);
+	}
+
+	return NULL;
+}
+
+
+static void hasher_free(hasher_t* hasher) {
+	int i;
+
+	for (i = 0; i < HASHER_SLOTS; ++i) {
+		free(hasher->slots[i].data);
+	}
+	free(hasher->zero);
+	free(hasher);
+}
+
+
+hasher_t* hasher_start(size_t chunk_size) {
+	hasher_t* hasher;
+	int i;
+
+	hasher = calloc(1, sizeof(*hasher));
+	if (hasher == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	hasher->chunk_size = chunk_size;
+	hasher->zero = calloc(1, chunk_size);
+	for (i = 0; i < HASHER_SLOTS; ++i) {
+		hasher->slots[i].data = malloc(chunk_size);
+		if (hasher->slots[i].data == NULL) {
+			break;
+		}
+	}
+	if (hasher->zero == NULL || i < HASHER_SLOTS) {
+		hasher_free(hasher);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	xxh64_init(&hasher->state, 0);
+	pthread_mutex_init(&hasher->lock, NULL);
+	pthread_cond_init(&hasher->cond, NULL);
+	if (pthread_create(&hasher->thread, NULL, hasher_thread, hasher) != 0) {
+		pthread_cond_destroy(&hasher->cond);
+		pthread_mutex_destroy(&hasher->lock);
+		hasher_free(hasher);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return hasher;
+}
+
+
+void hasher_feed(hasher_t* hasher, const unsigned char* data, size_t length) {
+	while (length > 0) {
+		size_t part = length < hasher->chunk_size ? length : hasher->chunk_size;
+		hasher_slot_t* slot;
+
+		pthread_mutex_lock(&hasher->lock);
+		while (hasher->count == HASHER_SLOTS) {
+			pthread_cond_wait(&hasher->cond, &hasher->lock);
+		}
+		slot = &hasher->slots[(hasher->head + hasher->count) % HASHER_SLOTS];
+		pthread_mutex_unlock(&hasher->lock);
+
+		/* the hasher does not touch free slots */
+		slot->zeros = data == NULL;
+		slot->length = part;
+		if (data != NULL) {
+			memcpy(slot->data, data, part);
+			data += part;
+		}
+		length -= part;
+
+		pthread_mutex_lock(&hasher->lock);
+		hasher->count++;
+		pthread_cond_broadcast(&hasher->cond);
+		pthread_mutex_unlock(&hasher->lock);
+	}
+}
+
+
+uint64_t hasher_finish(hasher_t* hasher, uint64_t* length) {
+	uint64_t digest;
+
+	pthread_mutex_lock(&hasher->lock);
+	hasher->done = 1;
+	pthread_cond_broadcast(&hasher->cond);
+	pthread_mutex_unlock(&hasher->lock);
+	pthread_join(hasher->thread, NULL);
+
+	digest = xxh64_digest(&hasher->state);
+	*length = hasher->state.total;
+	pthread_cond_destroy(&hasher->cond);
+	pthread_mutex_destroy(&hasher->lock);
+	hasher_free(hasher);
+	return digest;
+}
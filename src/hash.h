@@ -0,0 +1,61 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Streaming XXH64, as computed by xxhsum -H1 */
+typedef struct {
+	uint64_t v[4];
+	uint64_t total;
+	unsigned char pending[32];
+	size_t pending_length;
+	uint64_t seed;
+} xxh64_t;
+
+void xxh64_init(xxh64_t* state, uint64_t seed);
+
+void xxh64_update(xxh64_t* state, const void* data, size_t length);
+
+uint64_t xxh64_digest(const xxh64_t* state);
+
+/*
+ * Hashes the data of one file on a thread of its own. hasher_feed() copies the
+ * data into a small ring of buffers, so the caller may reuse its buffer right
+ * away and only waits when the hasher falls behind.
+ */
+typedef struct hasher_s hasher_t;
+
+/* Starts a hasher whose buffers take chunk_size bytes each. */
+hasher_t* hasher_start(size_t chunk_size);
+
+/* Adds length bytes of data, or of zeros if data is NULL. */
+void hasher_feed(hasher_t* hasher, const unsigned char* data, size_t length);
+
+/**
+ * Waits for the hasher to hash everything fed to it, stops it and returns the
+ * XXH64 of the data. The number of bytes hashed is stored in length.
+ */
+uint64_t hasher_finish(hasher_t* hasher, uint64_t* length);
+
+#endif /* HASH_H_ */
@@ -0,0 +1,1124 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "image.h"
+
+/* C standard libraries */
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <unistd.h>
+
+
+#define SECTOR_SIZE 2048
+
+/* Fixed sectors of the volume structures */
+#define ISO_PVD_SECTOR 16
+#define ISO_TERMINATOR_SECTOR 17
+#define UDF_BEA_SECTOR 18
+#define UDF_NSR_SECTOR 19
+#define UDF_TEA_SECTOR 20
+#define ISO_PATH_TABLE_L_SECTOR 21
+#define ISO_PATH_TABLE_M_SECTOR 22
+#define ISO_ROOT_SECTOR 23
+#define ISO_AUDIO_TS_SECTOR 24
+#define ISO_VIDEO_TS_SECTOR 25
+#define UDF_MAIN_VDS_SECTOR 64
+#define UDF_RESERVE_VDS_SECTOR 80
+#define UDF_VDS_LENGTH 16
+#define UDF_LVID_SECTOR 96
+#define UDF_ANCHOR_SECTOR 256
+#define UDF_PARTITION_START 257
+
+/* Logical blocks at the start of the partition */
+#define UDF_FSD_BLOCK 0
+#define UDF_ROOT_FE_BLOCK 2
+#define UDF_ROOT_DIR_BLOCK 3
+#define UDF_AUDIO_TS_FE_BLOCK 4
+#define UDF_AUDIO_TS_DIR_BLOCK 5
+#define UDF_VIDEO_TS_FE_BLOCK 6
+#define UDF_FIRST_FREE_BLOCK 7
+
+/* Largest extent a short allocation descriptor can describe */
+#define UDF_MAX_EXTENT 0x3FFFF800
+
+/* UDF unique IDs 1 to 15 are reserved */
+#define UDF_AUDIO_TS_ID 16
+#define UDF_VIDEO_TS_ID 17
+#define UDF_FIRST_FILE_ID 18
+
+/* Size of the file identifier descriptors; names are "VTS_01_0.IFO" or shorter */
+#define UDF_FID_PARENT 40
+#define UDF_FID_DIR 48
+#define UDF_FID_FILE 52
+
+/* ISO 9660 directory records of "VTS_01_0.IFO;1" and of "." / ".." */
+#define ISO_RECORD_FILE 48
+#define ISO_RECORD_DOT 34
+
+/* The ISO 9660 VIDEO_TS directory has to end before the UDF volume descriptors */
+#define IMAGE_MAX_FILES ((UDF_MAIN_VDS_SECTOR - ISO_VIDEO_TS_SECTOR) * (SECTOR_SIZE / ISO_RECORD_FILE) - 2)
+
+#define IMAGE_MAX_VIEWS 16
+
+typedef struct {
+	char name[13];
+	off_t size;
+	uint32_t source_lba;
+	uint32_t sector;
+	uint32_t fe_sector;
+} image_file_t;
+
+struct image_s {
+	char volume_id[33];
+	time_t created;
+	image_file_t* files;
+	size_t count;
+	size_t capacity;
+	size_t* order; /* files sorted by name, as directories list them */
+	uint32_t video_ts_dir_sector;
+	uint32_t video_ts_dir_bytes;
+	uint32_t iso_video_ts_sectors;
+	uint32_t total_sectors;
+	int keeps_layout;
+	char* path;
+	int fd;
+};
+
+/* Files opened with image_file_open() */
+typedef struct {
+	int fd;
+	off_t base;
+	off_t length;
+} image_view_t;
+
+static image_view_t views[IMAGE_MAX_VIEWS];
+static int views_used = 0;
+
+
+static uint32_t sectors_of(off_t size) {
+	return (uint32_t)((size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+}
+
+
+static void set_le16(unsigned char* p, uint16_t value) {
+	p[0] = (unsigned char)value;
+	p[1] = (unsigned char)(value >> 8);
+}
+
+
+static void set_be16(unsigned char* p, uint16_t value) {
+	p[0] = (unsigned char)(value >> 8);
+	p[1] = (unsigned char)value;
+}
+
+
+static void set_le32(unsigned char* p, uint32_t value) {
+	set_le16(p, (uint16_t)value);
+	set_le16(p + 2, (uint16_t)(value >> 16));
+}
+
+
+static void set_be32(unsigned char* p, uint32_t value) {
+	set_be16(p, (uint16_t)(value >> 16));
+	set_be16(p + 2, (uint16_t)value);
+}
+
+
+static void set_le64(unsigned char* p, uint64_t value) {
+	set_le32(p, (uint32_t)value);
+	set_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+
+/* ISO 9660 both-byte orders */
+static void set_both16(unsigned char* p, uint16_t value) {
+	set_le16(p, value);
+	set_be16(p + 2, value);
+}
+
+
+static void set_both32(unsigned char* p, uint32_t value) {
+	set_le32(p, value);
+	set_be32(p + 4, value);
+}
+
+
+/* Fills a field with a string padded with spaces */
+static void set_padded(unsigned char* p, size_t length, const char* text) {
+	size_t n = strlen(text);
+
+	memset(p, ' ', length);
+	memcpy(p, text, n < length ? n : length);
+}
+
+
+static int write_sector(int fd, uint32_t sector, const unsigned char* data) {
+	ssize_t written = pwrite(fd, data, SECTOR_SIZE, (off_t)sector * SECTOR_SIZE);
+
+	if (written != SECTOR_SIZE) {
+		if (written >= 0) {
+			errno = EIO;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * ISO 9660
+ */
+
+static void iso_date7(unsigned char* p, time_t t) {
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	p[0] = (unsigned char)tm.tm_year;
+	p[1] = (unsigned char)(tm.tm_mon + 1);
+	p[2] = (unsigned char)tm.tm_mday;
+	p[3] = (unsigned char)tm.tm_hour;
+	p[4] = (unsigned char)tm.tm_min;
+	p[5] = (unsigned char)tm.tm_sec;
+	p[6] = 0;
+}
+
+
+static void iso_date17(unsigned char* p, time_t t) {
+	struct tm tm;
+	char text[17];
+
+	if (t == 0) {
+		memset(p, '0', 16);
+	} else {
+		gmtime_r(&t, &tm);
+		strftime(text, sizeof(text), "%Y%m%d%H%M%S00", &tm);
+		memcpy(p, text, 16);
+	}
+	p[16] = 0;
+}
+
+
+/* Writes a directory record at p and returns its length */
+static size_t iso_record(unsigned char* p, uint32_t extent, uint32_t size, int directory,
+		const char* id, size_t id_length, time_t t) {
+	size_t length = 33 + id_length + (id_length % 2 == 0 ? 1 : 0);
+
+	memset(p, 0, length);
+	p[0] = (unsigned char)length;
+	set_both32(p + 2, extent);
+	set_both32(p + 10, size);
+	iso_date7(p + 18, t);
+	p[25] = directory ? 0x02 : 0x00;
+	set_both16(p + 28, 1);
+	p[32] = (unsigned char)id_length;
+	memcpy(p + 33, id, id_length);
+
+	return length;
+}
+
+
+static size_t iso_path_entry(unsigned char* p, uint32_t extent, uint16_t parent,
+		const char* id, size_t id_length, int big_endian) {
+	p[0] = (unsigned char)id_length;
+	p[1] = 0;
+	if (big_endian) {
+		set_be32(p + 2, extent);
+		set_be16(p + 6, parent);
+	} else {
+		set_le32(p + 2, extent);
+		set_le16(p + 6, parent);
+	}
+	memcpy(p + 8, id, id_length);
+	if (id_length % 2 != 0) {
+		p[8 + id_length] = 0;
+	}
+
+	return 8 + id_length + id_length % 2;
+}
+
+
+static int iso_write_path_tables(const image_t* image, int fd, uint32_t* size) {
+	unsigned char sector[SECTOR_SIZE];
+	int big_endian;
+
+	for (big_endian = 0; big_endian <= 1; big_endian++) {
+		size_t used = 0;
+
+		memset(sector, 0, sizeof(sector));
+		used += iso_path_entry(sector + used, ISO_ROOT_SECTOR, 1, "\0", 1, big_endian);
+		used += iso_path_entry(sector + used, ISO_AUDIO_TS_SECTOR, 1, "AUDIO_TS", 8, big_endian);
+		used += iso_path_entry(sector + used, ISO_VIDEO_TS_SECTOR, 1, "VIDEO_TS", 8, big_endian);
+		*size = (uint32_t)used;
+
+		if (write_sector(fd, big_endian ? ISO_PATH_TABLE_M_SECTOR : ISO_PATH_TABLE_L_SECTOR, sector) != 0) {
+			return -1;
+		}
+	}
+
+	(void)image;
+	return 0;
+}
+
+
+static int iso_write_directories(const image_t* image, int fd) {
+	unsigned char sector[SECTOR_SIZE];
+	uint32_t video_ts_sector = ISO_VIDEO_TS_SECTOR;
+	size_t used;
+	size_t i;
+
+	memset(sector, 0, sizeof(sector));
+	used = iso_record(sector, ISO_ROOT_SECTOR, SECTOR_SIZE, 1, "\0", 1, image->created);
+	used += iso_record(sector + used, ISO_ROOT_SECTOR, SECTOR_SIZE, 1, "\1", 1, image->created);
+	used += iso_record(sector + used, ISO_AUDIO_TS_SECTOR, SECTOR_SIZE, 1, "AUDIO_TS", 8, image->created);
+	iso_record(sector + used, ISO_VIDEO_TS_SECTOR, image->iso_video_ts_sectors * SECTOR_SIZE, 1,
+			"VIDEO_TS", 8, image->created);
+	if (write_sector(fd, ISO_ROOT_SECTOR, sector) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	used = iso_record(sector, ISO_AUDIO_TS_SECTOR, SECTOR_SIZE, 1, "\0", 1, image->created);
+	iso_record(sector + used, ISO_ROOT_SECTOR, SECTOR_SIZE, 1, "\1", 1, image->created);
+	if (write_sector(fd, ISO_AUDIO_TS_SECTOR, sector) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	used = iso_record(sector, ISO_VIDEO_TS_SECTOR, image->iso_video_ts_sectors * SECTOR_SIZE, 1,
+			"\0", 1, image->created);
+	used += iso_record(sector + used, ISO_ROOT_SECTOR, SECTOR_SIZE, 1, "\1", 1, image->created);
+	for (i = 0; i < image->count; i++) {
+		const image_file_t* file = &image->files[image->order[i]];
+		char id[16];
+
+		/* records must not cross a sector boundary */
+		if (used + ISO_RECORD_FILE > SECTOR_SIZE) {
+			if (write_sector(fd, video_ts_sector++, sector) != 0) {
+				return -1;
+			}
+			memset(sector, 0, sizeof(sector));
+			used = 0;
+		}
+		snprintf(id, sizeof(id), "%s;1", file->name);
+		used += iso_record(sector + used, file->sector, (uint32_t)file->size, 0,
+				id, strlen(id), image->created);
+	}
+
+	return write_sector(fd, video_ts_sector, sector);
+}
+
+
+static int iso_write_descriptors(const image_t* image, int fd) {
+	unsigned char sector[SECTOR_SIZE];
+	uint32_t path_table_size;
+
+	if (iso_write_path_tables(image, fd, &path_table_size) != 0 ||
+			iso_write_directories(image, fd) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	sector[0] = 1;
+	memcpy(sector + 1, "CD001", 5);
+	sector[6] = 1;
+	set_padded(sector + 8, 32, "");
+	set_padded(sector + 40, 32, image->volume_id);
+	set_both32(sector + 80, image->total_sectors);
+	set_both16(sector + 120, 1);
+	set_both16(sector + 124, 1);
+	set_both16(sector + 128, SECTOR_SIZE);
+	set_both32(sector + 132, path_table_size);
+	set_le32(sector + 140, ISO_PATH_TABLE_L_SECTOR);
+	set_be32(sector + 148, ISO_PATH_TABLE_M_SECTOR);
+	iso_record(sector + 156, ISO_ROOT_SECTOR, SECTOR_SIZE, 1, "\0", 1, image->created);
+	set_padded(sector + 190, 128, "");
+	set_padded(sector + 318, 128, "");
+	set_padded(sector + 446, 128, "");
+	set_padded(sector + 574, 128, PACKAGE_STRING);
+	set_padded(sector + 702, 37, "");
+	set_padded(sector + 739, 37, "");
+	set_padded(sector + 776, 37, "");
+	iso_date17(sector + 813, image->created);
+	iso_date17(sector + 830, image->created);
+	iso_date17(sector + 847, 0);
+	iso_date17(sector + 864, 0);
+	sector[881] = 1;
+	if (write_sector(fd, ISO_PVD_SECTOR, sector) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	sector[0] = 255;
+	memcpy(sector + 1, "CD001", 5);
+	sector[6] = 1;
+	return write_sector(fd, ISO_TERMINATOR_SECTOR, sector);
+}
+
+
+/*
+ * UDF 1.02 (ECMA-167 with the OSTA restrictions)
+ */
+
+static uint16_t udf_crc(const unsigned char* data, size_t length) {
+	uint16_t crc = 0;
+	size_t i;
+	int bit;
+
+	for (i = 0; i < length; i++) {
+		crc ^= (uint16_t)(data[i] << 8);
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+
+/* Fills in the descriptor tag of the length bytes long descriptor at p */
+static void udf_tag(unsigned char* p, uint16_t identifier, uint32_t location, size_t length) {
+	unsigned char checksum = 0;
+	int i;
+
+	set_le16(p, identifier);
+	set_le16(p + 2, 2);
+	p[5] = 0;
+	set_le16(p + 6, 1);
+	set_le16(p + 8, udf_crc(p + 16, length - 16));
+	set_le16(p + 10, (uint16_t)(length - 16));
+	set_le32(p + 12, location);
+
+	for (i = 0; i < 16; i++) {
+		if (i != 4) {
+			checksum = (unsigned char)(checksum + p[i]);
+		}
+	}
+	p[4] = checksum;
+}
+
+
+static void udf_regid(unsigned char* p, const char* identifier, int udf_suffix) {
+	memset(p, 0, 32);
+	memcpy(p + 1, identifier, strlen(identifier));
+	if (udf_suffix) {
+		/* UDF revision 1.02 */
+		set_le16(p + 24, 0x0102);
+	}
+}
+
+
+static void udf_charspec(unsigned char* p) {
+	memset(p, 0, 64);
+	memcpy(p + 1, "OSTA Compressed Unicode", 23);
+}
+
+
+/* 8 bit OSTA compressed unicode string in a field of length bytes */
+static void udf_dstring(unsigned char* p, size_t length, const char* text) {
+	size_t n = strlen(text);
+
+	memset(p, 0, length);
+	if (n == 0) {
+		return;
+	}
+	if (n > length - 2) {
+		n = length - 2;
+	}
+	p[0] = 8;
+	memcpy(p + 1, text, n);
+	p[length - 1] = (unsigned char)(n + 1);
+}
+
+
+static void udf_timestamp(unsigned char* p, time_t t) {
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	/* local time with a UTC offset of 0 */
+	set_le16(p, 0x1000);
+	set_le16(p + 2, (uint16_t)(tm.tm_year + 1900));
+	p[4] = (unsigned char)(tm.tm_mon + 1);
+	p[5] = (unsigned char)tm.tm_mday;
+	p[6] = (unsigned char)tm.tm_hour;
+	p[7] = (unsigned char)tm.tm_min;
+	p[8] = (unsigned char)tm.tm_sec;
+	p[9] = 0;
+	p[10] = 0;
+	p[11] = 0;
+}
+
+
+static void udf_long_ad(unsigned char* p, uint32_t length, uint32_t block, uint32_t unique_id) {
+	memset(p, 0, 16);
+	set_le32(p, length);
+	set_le32(p + 4, block);
+	set_le32(p + 12, unique_id);
+}
+
+
+static uint32_t udf_partition_length(const image_t* image) {
+	/* everything up to the closing anchor */
+	return image->total_sectors - 1 - UDF_PARTITION_START;
+}
+
+
+static int udf_write_anchor(const image_t* image, int fd, uint32_t location) {
+	unsigned char sector[SECTOR_SIZE];
+
+	memset(sector, 0, sizeof(sector));
+	set_le32(sector + 16, UDF_VDS_LENGTH * SECTOR_SIZE);
+	set_le32(sector + 20, UDF_MAIN_VDS_SECTOR);
+	set_le32(sector + 24, UDF_VDS_LENGTH * SECTOR_SIZE);
+	set_le32(sector + 28, UDF_RESERVE_VDS_SECTOR);
+	udf_tag(sector, 2, location, 512);
+
+	(void)image;
+	return write_sector(fd, location, sector);
+}
+
+
+static int udf_write_volume_descriptors(const image_t* image, int fd, uint32_t start) {
+	unsigned char sector[SECTOR_SIZE];
+	char volume_set[128];
+	uint32_t hash = 0;
+	const char* c;
+
+	for (c = image->volume_id; *c; c++) {
+		hash = hash * 31 + (unsigned char)*c;
+	}
+	/* the first 16 characters have to be unique */
+	snprintf(volume_set, sizeof(volume_set), "%08X%08X%s",
+			(unsigned int)image->created, (unsigned int)hash, image->volume_id);
+
+	/* Primary Volume Descriptor */
+	memset(sector, 0, sizeof(sector));
+	set_le32(sector + 16, 1);
+	udf_dstring(sector + 24, 32, image->volume_id);
+	set_le16(sector + 56, 1);
+	set_le16(sector + 58, 1);
+	set_le16(sector + 60, 2);
+	set_le16(sector + 62, 2);
+	set_le32(sector + 64, 1);
+	set_le32(sector + 68, 1);
+	udf_dstring(sector + 72, 128, volume_set);
+	udf_charspec(sector + 200);
+	udf_charspec(sector + 264);
+	udf_timestamp(sector + 376, image->created);
+	udf_regid(sector + 388, "*" PACKAGE, 0);
+	udf_tag(sector, 1, start, 512);
+	if (write_sector(fd, start, sector) != 0) {
+		return -1;
+	}
+
+	/* Implementation Use Volume Descriptor */
+	memset(sector, 0, sizeof(sector));
+	set_le32(sector + 16, 2);
+	udf_regid(sector + 20, "*UDF LV Info", 1);
+	udf_charspec(sector + 52);
+	udf_dstring(sector + 116, 128, image->volume_id);
+	udf_regid(sector + 352, "*" PACKAGE, 0);
+	udf_tag(sector, 4, start + 1, 512);
+	if (write_sector(fd, start + 1, sector) != 0) {
+		return -1;
+	}
+
+	/* Partition Descriptor */
+	memset(sector, 0, sizeof(sector));
+	set_le32(sector + 16, 3);
+	set_le16(sector + 20, 1);
+	set_le16(sector + 22, 0);
+	udf_regid(sector + 24, "+NSR02", 0);
+	set_le32(sector + 184, 1);
+	set_le32(sector + 188, UDF_PARTITION_START);
+	set_le32(sector + 192, udf_partition_length(image));
+	udf_regid(sector + 196, "*" PACKAGE, 0);
+	udf_tag(sector, 5, start + 2, 512);
+	if (write_sector(fd, start + 2, sector) != 0) {
+		return -1;
+	}
+
+	/* Logical Volume Descriptor with one type 1 partition map */
+	memset(sector, 0, sizeof(sector));
+	set_le32(sector + 16, 4);
+	udf_charspec(sector + 20);
+	udf_dstring(sector + 84, 128, image->volume_id);
+	set_le32(sector + 212, SECTOR_SIZE);
+	udf_regid(sector + 216, "*OSTA UDF Compliant", 1);
+	udf_long_ad(sector + 248, SECTOR_SIZE, UDF_FSD_BLOCK, 0);
+	set_le32(sector + 264, 6);
+	set_le32(sector + 268, 1);
+	udf_regid(sector + 272, "*" PACKAGE, 0);
+	set_le32(sector + 432, 2 * SECTOR_SIZE);
+	set_le32(sector + 436, UDF_LVID_SECTOR);
+	sector[440] = 1;
+	sector[441] = 6;
+	set_le16(sector + 442, 1);
+	set_le16(sector + 444, 0);
+	udf_tag(sector, 6, start + 3, 446);
+	if (write_sector(fd, start + 3, sector) != 0) {
+		return -1;
+	}
+
+	/* Unallocated Space Descriptor; a read-only image has none */
+	memset(sector, 0, sizeof(sector));
+	set_le32(sector + 16, 5);
+	udf_tag(sector, 7, start + 4, 24);
+	if (write_sector(fd, start + 4, sector) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	udf_tag(sector, 8, start + 5, 512);
+	return write_sector(fd, start + 5, sector);
+}
+
+
+static int udf_write_integrity(const image_t* image, int fd) {
+	unsigned char sector[SECTOR_SIZE];
+
+	memset(sector, 0, sizeof(sector));
+	udf_timestamp(sector + 16, image->created);
+	/* close integrity descriptor */
+	set_le32(sector + 28, 1);
+	set_le64(sector + 40, UDF_FIRST_FILE_ID + image->count);
+	set_le32(sector + 72, 1);
+	set_le32(sector + 76, 46);
+	set_le32(sector + 80, 0);
+	set_le32(sector + 84, udf_partition_length(image));
+	udf_regid(sector + 88, "*" PACKAGE, 0);
+	set_le32(sector + 120, (uint32_t)image->count);
+	set_le32(sector + 124, 3);
+	set_le16(sector + 128, 0x0102);
+	set_le16(sector + 130, 0x0102);
+	set_le16(sector + 132, 0x0102);
+	udf_tag(sector, 9, UDF_LVID_SECTOR, 134);
+	if (write_sector(fd, UDF_LVID_SECTOR, sector) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	udf_tag(sector, 8, UDF_LVID_SECTOR + 1, 512);
+	return write_sector(fd, UDF_LVID_SECTOR + 1, sector);
+}
+
+
+static int udf_write_file_set(const image_t* image, int fd) {
+	unsigned char sector[SECTOR_SIZE];
+
+	memset(sector, 0, sizeof(sector));
+	udf_timestamp(sector + 16, image->created);
+	set_le16(sector + 28, 3);
+	set_le16(sector + 30, 3);
+	set_le32(sector + 32, 1);
+	set_le32(sector + 36, 1);
+	udf_charspec(sector + 48);
+	udf_dstring(sector + 112, 128, image->volume_id);
+	udf_charspec(sector + 240);
+	udf_dstring(sector + 304, 32, image->volume_id);
+	udf_long_ad(sector + 400, SECTOR_SIZE, UDF_ROOT_FE_BLOCK, 0);
+	udf_regid(sector + 416, "*OSTA UDF Compliant", 1);
+	udf_tag(sector, 256, UDF_FSD_BLOCK, 512);
+	if (write_sector(fd, UDF_PARTITION_START + UDF_FSD_BLOCK, sector) != 0) {
+		return -1;
+	}
+
+	memset(sector, 0, sizeof(sector));
+	udf_tag(sector, 8, UDF_FSD_BLOCK + 1, 512);
+	return write_sector(fd, UDF_PARTITION_START + UDF_FSD_BLOCK + 1, sector);
+}
+
+
+/**
+ * Writes the File Entry of a file or directory whose size bytes start at
+ * the partition block data_block.
+ */
+static int udf_write_file_entry(const image_t* image, int fd, uint32_t block, int directory,
+		uint64_t size, uint32_t data_block, uint64_t unique_id, uint16_t links) {
+	unsigned char sector[SECTOR_SIZE];
+	uint64_t left = size;
+	size_t descriptors = 0;
+
+	memset(sector, 0, sizeof(sector));
+	/* ICB tag: strategy 4, one entry, short allocation descriptors */
+	set_le16(sector + 20, 4);
+	set_le16(sector + 24, 1);
+	sector[27] = directory ? 4 : 5;
+	set_le16(sector + 34, 0);
+	set_le32(sector + 36, 0xFFFFFFFF);
+	set_le32(sector + 40, 0xFFFFFFFF);
+	set_le32(sector + 44, directory ? 0x14A5 : 0x1084);
+	set_le16(sector + 48, links);
+	set_le64(sector + 56, size);
+	set_le64(sector + 64, (size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	udf_timestamp(sector + 72, image->created);
+	udf_timestamp(sector + 84, image->created);
+	udf_timestamp(sector + 96, image->created);
+	set_le32(sector + 108, 1);
+	udf_regid(sector + 128, "*" PACKAGE, 0);
+	set_le64(sector + 160, unique_id);
+
+	/* files of 1 GiB need a second extent */
+	do {
+		uint32_t extent = left > UDF_MAX_EXTENT ? UDF_MAX_EXTENT : (uint32_t)left;
+
+		set_le32(sector + 176 + descriptors * 8, extent);
+		set_le32(sector + 180 + descriptors * 8, data_block);
+		data_block += extent / SECTOR_SIZE;
+		left -= extent;
+		descriptors++;
+	} while (left > 0);
+
+	set_le32(sector + 172, (uint32_t)(descriptors * 8));
+	udf_tag(sector, 261, block, 176 + descriptors * 8);
+	return write_sector(fd, UDF_PARTITION_START + block, sector);
+}
+
+
+/* Appends a File Identifier Descriptor at offset of the directory starting at block */
+static size_t udf_fid(unsigned char* dir, size_t offset, uint32_t block, unsigned char characteristics,
+		const char* name, uint32_t icb_block, uint32_t unique_id) {
+	unsigned char* p = dir + offset;
+	size_t name_length = name ? strlen(name) + 1 : 0;
+	size_t length = (38 + name_length + 3) & ~(size_t)3;
+
+	memset(p, 0, length);
+	set_le16(p + 16, 1);
+	p[18] = characteristics;
+	p[19] = (unsigned char)name_length;
+	udf_long_ad(p + 20, SECTOR_SIZE, icb_block, unique_id);
+	set_le16(p + 36, 0);
+	if (name) {
+		p[38] = 8;
+		memcpy(p + 39, name, name_length - 1);
+	}
+	udf_tag(p, 257, block + (uint32_t)(offset / SECTOR_SIZE), length);
+
+	return length;
+}
+
+
+static int udf_write_directories(const image_t* image, int fd) {
+	unsigned char sector[SECTOR_SIZE];
+	unsigned char* dir;
+	uint32_t dir_sectors = sectors_of(image->video_ts_dir_bytes);
+	uint32_t video_ts_block = image->video_ts_dir_sector - UDF_PARTITION_START;
+	size_t used;
+	size_t i;
+
+	/* root */
+	memset(sector, 0, sizeof(sector));
+	used = udf_fid(sector, 0, UDF_ROOT_DIR_BLOCK, 0x0A, NULL, UDF_ROOT_FE_BLOCK, 0);
+	used += udf_fid(sector, used, UDF_ROOT_DIR_BLOCK, 0x02, "AUDIO_TS", UDF_AUDIO_TS_FE_BLOCK, UDF_AUDIO_TS_ID);
+	used += udf_fid(sector, used, UDF_ROOT_DIR_BLOCK, 0x02, "VIDEO_TS", UDF_VIDEO_TS_FE_BLOCK, UDF_VIDEO_TS_ID);
+	if (write_sector(fd, UDF_PARTITION_START + UDF_ROOT_DIR_BLOCK, sector) != 0 ||
+			udf_write_file_entry(image, fd, UDF_ROOT_FE_BLOCK, 1, used, UDF_ROOT_DIR_BLOCK, 0, 3) != 0) {
+		return -1;
+	}
+
+	/* AUDIO_TS */
+	memset(sector, 0, sizeof(sector));
+	used = udf_fid(sector, 0, UDF_AUDIO_TS_DIR_BLOCK, 0x0A, NULL, UDF_ROOT_FE_BLOCK, 0);
+	if (write_sector(fd, UDF_PARTITION_START + UDF_AUDIO_TS_DIR_BLOCK, sector) != 0 ||
+			udf_write_file_entry(image, fd, UDF_AUDIO_TS_FE_BLOCK, 1, used, UDF_AUDIO_TS_DIR_BLOCK,
+				UDF_AUDIO_TS_ID, 1) != 0) {
+		return -1;
+	}
+
+	/* VIDEO_TS, whose identifiers may span several sectors */
+	dir = calloc(dir_sectors, SECTOR_SIZE);
+	if (dir == NULL) {
+		return -1;
+	}
+	used = udf_fid(dir, 0, video_ts_block, 0x0A, NULL, UDF_ROOT_FE_BLOCK, 0);
+	for (i = 0; i < image->count; i++) {
+		size_t index = image->order[i];
+		const image_file_t* file = &image->files[index];
+
+		used += udf_fid(dir, used, video_ts_block, 0x00, file->name,
+				file->fe_sector - UDF_PARTITION_START, (uint32_t)(UDF_FIRST_FILE_ID + index));
+	}
+	for (i = 0; i < dir_sectors; i++) {
+		if (write_sector(fd, image->video_ts_dir_sector + (uint32_t)i, dir + i * SECTOR_SIZE) != 0) {
+			free(dir);
+			return -1;
+		}
+	}
+	free(dir);
+
+	if (udf_write_file_entry(image, fd, UDF_VIDEO_TS_FE_BLOCK, 1, used, video_ts_block,
+			UDF_VIDEO_TS_ID, 1) != 0) {
+		return -1;
+	}
+
+	for (i = 0; i < image->count; i++) {
+		const image_file_t* file = &image->files[i];
+
+		if (udf_write_file_entry(image, fd, file->fe_sector - UDF_PARTITION_START, 0,
+				(uint64_t)file->size, file->sector - UDF_PARTITION_START,
+				UDF_FIRST_FILE_ID + i, 1) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int image_write_structures(const image_t* image, int fd) {
+	unsigned char sector[SECTOR_SIZE];
+
+	/* Volume Recognition Sequence after the ISO 9660 descriptors */
+	memset(sector, 0, sizeof(sector));
+	sector[6] = 1;
+	memcpy(sector + 1, "BEA01", 5);
+	if (write_sector(fd, UDF_BEA_SECTOR, sector) != 0) {
+		return -1;
+	}
+	memcpy(sector + 1, "NSR02", 5);
+	if (write_sector(fd, UDF_NSR_SECTOR, sector) != 0) {
+		return -1;
+	}
+	memcpy(sector + 1, "TEA01", 5);
+	if (write_sector(fd, UDF_TEA_SECTOR, sector) != 0) {
+		return -1;
+	}
+
+	if (iso_write_descriptors(image, fd) != 0 ||
+			udf_write_volume_descriptors(image, fd, UDF_MAIN_VDS_SECTOR) != 0 ||
+			udf_write_volume_descriptors(image, fd, UDF_RESERVE_VDS_SECTOR) != 0 ||
+			udf_write_integrity(image, fd) != 0 ||
+			udf_write_anchor(image, fd, UDF_ANCHOR_SECTOR) != 0 ||
+			udf_write_anchor(image, fd, image->total_sectors - 1) != 0 ||
+			udf_write_file_set(image, fd) != 0 ||
+			udf_write_directories(image, fd) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Image description
+ */
+
+image_t* image_new(const char* volume_id) {
+	image_t* image = calloc(1, sizeof(image_t));
+	size_t i;
+
+	if (image == NULL) {
+		return NULL;
+	}
+
+	/* ISO 9660 d-characters */
+	for (i = 0; volume_id[i] != '\0' && i < sizeof(image->volume_id) - 1; i++) {
+		unsigned char c = (unsigned char)toupper((unsigned char)volume_id[i]);
+		image->volume_id[i] = (isalnum(c) && c < 0x80) ? (char)c : '_';
+	}
+	image->created = time(NULL);
+	image->fd = -1;
+
+	return image;
+}
+
+
+int image_add_file(image_t* image, const char* name, off_t size, uint32_t lba) {
+	image_file_t* file;
+
+	if (strlen(name) >= sizeof(file->name) || size < 0 || size > 0xFFFFFFFFLL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (image->count >= IMAGE_MAX_FILES) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	if (image->count == image->capacity) {
+		size_t capacity = image->capacity == 0 ? 32 : image->capacity * 2;
+		image_file_t* files = realloc(image->files, capacity * sizeof(image_file_t));
+		if (files == NULL) {
+			return -1;
+		}
+		image->files = files;
+		image->capacity = capacity;
+	}
+
+	file = &image->files[image->count++];
+	memset(file, 0, sizeof(*file));
+	strcpy(file->name, name);
+	file->size = size;
+	file->source_lba = lba;
+
+	return 0;
+}
+
+
+static const image_t* sort_image;
+
+static int image_compare_names(const void* a, const void* b) {
+	return strcmp(sort_image->files[*(const size_t*)a].name, sort_image->files[*(const size_t*)b].name);
+}
+
+
+off_t image_layout(image_t* image) {
+	uint32_t next = UDF_PARTITION_START + UDF_FIRST_FREE_BLOCK;
+	uint32_t end = next;
+	uint32_t records_per_sector = (SECTOR_SIZE - 2 * ISO_RECORD_DOT) / ISO_RECORD_FILE;
+	size_t i;
+
+	free(image->order);
+	image->order = malloc((image->count + 1) * sizeof(size_t));
+	if (image->order == NULL) {
+		return -1;
+	}
+	for (i = 0; i < image->count; i++) {
+		image->order[i] = i;
+	}
+	sort_image = image;
+	qsort(image->order, image->count, sizeof(size_t), image_compare_names);
+
+	/* keep the source layout if it is complete, ordered and leaves room for the structures */
+	image->keeps_layout = image->count > 0;
+	for (i = 0; i < image->count && image->keeps_layout; i++) {
+		if (image->files[i].source_lba < next) {
+			image->keeps_layout = 0;
+		}
+		next = image->files[i].source_lba + sectors_of(image->files[i].size);
+	}
+
+	next = UDF_PARTITION_START + UDF_FIRST_FREE_BLOCK;
+	for (i = 0; i < image->count; i++) {
+		image_file_t* file = &image->files[i];
+
+		file->sector = image->keeps_layout ? file->source_lba : next;
+		next = file->sector + sectors_of(file->size);
+		if (next > end) {
+			end = next;
+		}
+	}
+
+	image->video_ts_dir_sector = end;
+	image->video_ts_dir_bytes = UDF_FID_PARENT + (uint32_t)image->count * UDF_FID_FILE;
+	end += sectors_of(image->video_ts_dir_bytes);
+	for (i = 0; i < image->count; i++) {
+		image->files[i].fe_sector = end++;
+	}
+
+	/* "." and ".." share the first sector with the first files */
+	image->iso_video_ts_sectors = 1;
+	if (image->count > records_per_sector) {
+		image->iso_video_ts_sectors += (uint32_t)((image->count - records_per_sector
+				+ SECTOR_SIZE / ISO_RECORD_FILE - 1) / (SECTOR_SIZE / ISO_RECORD_FILE));
+	}
+
+	/* closing anchor */
+	image->total_sectors = end + 1;
+
+	return (off_t)image->total_sectors * SECTOR_SIZE;
+}
+
+
+uint32_t image_first_file_sector(void) {
+	return UDF_PARTITION_START + UDF_FIRST_FREE_BLOCK;
+}
+
+
+int image_keeps_layout(const image_t* image) {
+	return image->keeps_layout;
+}
+
+
+int image_open(image_t* image, const char* path, int flags) {
+	int saved_errno;
+
+	image->path = strdup(path);
+	if (image->path == NULL) {
+		return -1;
+	}
+
+	image->fd = open(path, flags, 0666);
+	if (image->fd == -1) {
+		goto open_failed;
+	}
+
+	if ((flags & O_ACCMODE) == O_RDONLY) {
+		return 0;
+	}
+
+	if (ftruncate(image->fd, (off_t)image->total_sectors * SECTOR_SIZE) != 0 ||
+			image_write_structures(image, image->fd) != 0) {
+		goto open_failed;
+	}
+
+	return 0;
+
+open_failed:
+	saved_errno = errno;
+	if (image->fd != -1) {
+		close(image->fd);
+		image->fd = -1;
+	}
+	free(image->path);
+	image->path = NULL;
+	errno = saved_errno;
+	return -1;
+}
+
+
+int image_close(image_t* image) {
+	int result = 0;
+
+	if (image->fd != -1) {
+		result = close(image->fd);
+		image->fd = -1;
+	}
+	free(image->path);
+	image->path = NULL;
+
+	return result;
+}
+
+
+static const image_file_t* image_find(const image_t* image, const char* name) {
+	size_t i;
+
+	for (i = 0; i < image->count; i++) {
+		if (strcmp(image->files[i].name, name) == 0) {
+			return &image->files[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+int image_file_stat(const image_t* image, const char* name, struct stat* st) {
+	const image_file_t* file = image_find(image, name);
+
+	if (file == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	memset(st, 0, sizeof(*st));
+	st->st_mode = S_IFREG | 0444;
+	st->st_nlink = 1;
+	st->st_size = file->size;
+	st->st_blksize = SECTOR_SIZE;
+	st->st_blocks = file->size / 512;
+
+	return 0;
+}
+
+
+int image_file_open(image_t* image, const char* name, int flags) {
+	const image_file_t* file = image_find(image, name);
+	int fd;
+
+	if (file == NULL || image->path == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (views_used == IMAGE_MAX_VIEWS) {
+		errno = EMFILE;
+		return -1;
+	}
+
+	fd = open(image->path, flags & ~(O_CREAT | O_TRUNC | O_APPEND | O_EXCL));
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (lseek(fd, (off_t)file->sector * SECTOR_SIZE, SEEK_SET) == (off_t)-1) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+
+	views[views_used].fd = fd;
+	views[views_used].base = (off_t)file->sector * SECTOR_SIZE;
+	views[views_used].length = file->size;
+	views_used++;
+
+	return fd;
+}
+
+
+int image_file_close(int fd) {
+	int i;
+
+	for (i = 0; i < views_used; i++) {
+		if (views[i].fd == fd) {
+			views[i] = views[--views_used];
+			break;
+		}
+	}
+
+	return close(fd);
+}
+
+
+off_t image_fd_base(int fd) {
+	int i;
+
+	for (i = 0; i < views_used; i++) {
+		if (views[i].fd == fd) {
+			return views[i].base;
+		}
+	}
+
+	return 0;
+}
+
+
+off_t image_fd_length(int fd) {
+	int i;
+
+	for (i = 0; i < views_used; i++) {
+		if (views[i].fd == fd) {
+			return views[i].length;
+		}
+	}
+
+	return -1;
+}
+
+
+void image_free(image_t* image) {
+	if (image == NULL) {
+		return;
+	}
+
+	image_close(image);
+	free(image->order);
+	free(image->files);
+	free(image);
+}
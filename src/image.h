@@ -0,0 +1,91 @@
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * DVD-Video image with a UDF 1.02 / ISO 9660 bridge file system, holding
+ * VIDEO_TS with the files added by image_add_file() and an empty AUDIO_TS.
+ * The files are read and written in place through image_file_open(), which
+ * returns a file descriptor positioned at the start of the file inside the
+ * image; image_fd_base() gives that start for absolute offsets.
+ */
+typedef struct image_s image_t;
+
+/* Creates an empty image description; volume_id is the disc title. */
+image_t* image_new(const char* volume_id);
+
+/**
+ * Adds a VIDEO_TS file of size bytes. Files must be added in DVD-Video order
+ * (VIDEO_TS.IFO first). lba is the sector the file starts at on the source
+ * disc or 0 if unknown.
+ */
+int image_add_file(image_t* image, const char* name, off_t size, uint32_t lba);
+
+/**
+ * Places the files and the file system structures. The source layout is kept
+ * if every file has an lba that leaves room for the structures, so that the
+ * sector addresses in the IFO files stay valid; otherwise the files are
+ * placed back to back. Returns the image size in bytes, or -1.
+ */
+off_t image_layout(image_t* image);
+
+/* First sector a file can start at for image_layout() to keep the source layout. */
+uint32_t image_first_file_sector(void);
+
+/* 1 if the source disc layout could be kept by image_layout(). */
+int image_keeps_layout(const image_t* image);
+
+/**
+ * Opens the image at path with flags (O_RDONLY, or O_RDWR with O_CREAT and
+ * O_TRUNC as needed), sets its size and, unless opened read-only, writes the
+ * file system structures. Returns 0 or -1 with errno set.
+ */
+int image_open(image_t* image, const char* path, int flags);
+
+/* Closes the image file; the description can be opened again. */
+int image_close(image_t* image);
+
+/* stat() of a VIDEO_TS file inside the image; -1 with ENOENT if there is none. */
+int image_file_stat(const image_t* image, const char* name, struct stat* st);
+
+/**
+ * Opens a VIDEO_TS file inside the image. O_CREAT, O_TRUNC and O_APPEND are
+ * ignored since all files already exist at their final size. The returned
+ * descriptor must be closed with image_file_close().
+ */
+int image_file_open(image_t* image, const char* name, int flags);
+
+int image_file_close(int fd);
+
+/* Byte offset of the file opened as fd inside its image, 0 for other descriptors. */
+off_t image_fd_base(int fd);
+
+/* Size of the file opened as fd inside its image, -1 for other descriptors. */
+off_t image_fd_length(int fd);
+
+void image_free(image_t* image);
+
+#endif /* IMAGE_H_ */
@@ -0,0 +1,147 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "journal.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/* Longest line: the file name, the key and three numbers */
+#define JOURNAL_LINE 80
+
+struct journal_s {
+	int fd;
+};
+
+
+uint32_t journal_key(uint32_t key, const void* data, size_t length) {
+	const unsigned char* bytes = data;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < length; ++i) {
+		key ^= bytes[i];
+		key *= 16777619u;
+	}
+
+	return key;
+}
+
+
+journal_t* journal_open(const char* path) {
+	journal_t* journal;
+
+	journal = malloc(sizeof(*journal));
+	if (journal == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	journal->fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0666);
+	if (journal->fd == -1) {
+		int saved_errno = errno;
+		free(journal);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	return journal;
+}
+
+
+int journal_append(journal_t* journal, uint32_t key, const journal_entry_t* entry) {
+	char line[JOURNAL_LINE];
+	int length;
+
+	length = snprintf(line, sizeof(line), "%.15s %08x %d %d %d\n",
+			entry->file, (unsigned int)key, entry->cell, entry->sector, entry->blocks);
+	if (length < 0 || (size_t)length >= sizeof(line)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* a single write, so that entries are never interleaved */
+	if (write(journal->fd, line, (size_t)length) != length) {
+		return -1;
+	}
+#ifdef HAVE_FDATASYNC
+	return fdatasync(journal->fd);
+#else
+	return fsync(journal->fd);
+#endif
+}
+
+
+int journal_lookup(journal_t* journal, uint32_t key, journal_entry_t* entry) {
+	char line[JOURNAL_LINE];
+	journal_entry_t candidate;
+	unsigned int candidate_key;
+	int found = 0;
+	FILE* file;
+	int fd;
+
+	fd = dup(journal->fd);
+	if (fd == -1) {
+		return -1;
+	}
+	file = fdopen(fd, "r");
+	if (file == NULL) {
+		close(fd);
+		return -1;
+	}
+	rewind(file);
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		/* a torn last line has no newline */
+		if (strchr(line, '\n') == NULL) {
+			continue;
+		}
+		if (sscanf(line, "%15s %x %d %d %d", candidate.file, &candidate_key,
+				&candidate.cell, &candidate.sector, &candidate.blocks) != 5) {
+			continue;
+		}
+		if (candidate_key == key) {
+			*entry = candidate;
+			found = 1;
+		}
+	}
+
+	if (ferror(file)) {
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	return found;
+}
+
+
+void journal_close(journal_t* journal) {
+	close(journal->fd);
+	free(journal);
+}
@@ -0,0 +1,63 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Append-only resume journal. Every entry records how far a copy, identified
+ * by a key over what is being copied, got: the output file, the cell and disc
+ * sector to continue at and the number of blocks of the file that are
+ * complete. Each entry is one line that is synced to disk when it is added,
+ * so a crash can at most lose a partly written last line, which is ignored.
+ */
+typedef struct journal_s journal_t;
+
+typedef struct {
+	char file[16];
+	int cell;
+	int sector;
+	int blocks;
+} journal_entry_t;
+
+/* Key of length bytes of data, chained onto the key of earlier data. */
+uint32_t journal_key(uint32_t key, const void* data, size_t length);
+
+/* Key to start journal_key() chains with */
+#define JOURNAL_KEY_INIT 2166136261u
+
+/* Opens or creates the journal at path. */
+journal_t* journal_open(const char* path);
+
+/* Appends entry for key and syncs it to disk. Returns 0 or -1 with errno set. */
+int journal_append(journal_t* journal, uint32_t key, const journal_entry_t* entry);
+
+/**
+ * Finds the last entry for key. Returns 1 if there is one, 0 if not or -1
+ * with errno set.
+ */
+int journal_lookup(journal_t* journal, uint32_t key, journal_entry_t* entry);
+
+void journal_close(journal_t* journal);
+
+#endif /* JOURNAL_H_ */
@@ -90,25 +90,77 @@ Print a friendly, customizable greeting.\n"), stdout); */
   -T, --titleset=X   backup title set X\n\
   -t, --title=X      backup title X\n\
   -s, --start=X      backup from chapter X\n\
-  -e, --end=X        backup to chapter X\n\n"));
+  -e, --end=X        backup to chapter X\n\
+      --scrub=DIR    verify the title directories at or below DIR against\n\
+                     their MANIFEST; no DVD is needed\n\
+      --replay-trace=FILE\n\
+                     simulate every error and gap strategy on the disc the\n\
+                     read trace FILE was recorded from; no DVD is needed\n\n"));
 
 	printf(_("\
   -i, --input=DEVICE       where DEVICE is your DVD device\n\
-                           if not given /dev/dvd is used\n\
+                           if not given /dev/dvd is used; repeat with -M to\n\
+                           rip several drives at once\n\
   -o, --output=DIRECTORY   where directory is your backup target\n\
-                           if not given the current directory is used\n"));
+                           if not given the current directory is used;\n\
+                           - writes a tar archive to standard output\n"));
 	printf(_("\
   -v, --verbose            print more information about progress\n\
   -n, --name=NAME          set the title (useful if autodetection fails)\n\
   -a, --aspect=0           to get aspect ratio 4:3 instead of 16:9 if both are\n\
                            present\n\
-  -r, --error={a,b,m}      select read error handling: a=abort, b=skip block,\n\
-                          m=skip multiple blocks (default)\n\
+  -r, --error={a,b,m,i}    select read error handling: a=abort, b=skip block,\n\
+                          m=skip multiple blocks (default), i=isolate bad\n\
+                          blocks by bisecting failed reads\n\
+      --bisect-depth=N     halve a failed read at most N times (default 9)\n\
+      --bisect-time=SECS   stop bisecting after SECS seconds, 0 for no limit\n\
+                          (default 300)\n\
+      --read-timeout=SECS  give up a read of the DVD that takes longer than\n\
+                          SECS seconds and reopen the drive, 0 to wait for\n\
+                          every read (default 0)\n\
+      --block-source=SOURCE\n\
+                          read VOB sectors with libdvdread (dvdread, the\n\
+                          default), straight from the device without CSS\n\
+                          decryption (raw), or with libdvdread and the\n\
+                          faults listed in FILE injected (mock:FILE)\n\
+      --record-trace=FILE  log every read of the DVD to FILE for\n\
+                          --replay-trace\n\
   -p, --progress           print progress information while copying VOBs\n\
+      --pipeline           read the DVD in a separate thread while writing\n\
+      --async-io           queue output writes with io_uring if available\n\
+      --direct-io          write VOBs with O_DIRECT, bypassing the page cache\n\
+      --sparse             leave unreadable blocks as holes instead of zeros\n\
+      --preallocate        reserve disk space for each VOB before copying it\n\
+      --write-behind[=MiB] flush VOB data to disk every MiB (default 64) and\n\
+                          drop it from the page cache\n\
+      --physical-order     with -M, copy the files in one sweep in the order\n\
+                          they are stored on the disc\n\
+      --iso=FILE           with -M, write a UDF/ISO 9660 image to FILE instead\n\
+                          of a VIDEO_TS directory\n\
+      --tar                with -M, -F or -T, write a tar archive to standard\n\
+                          output instead of a VIDEO_TS directory (-o -)\n\
+      --journal[=MiB]      note in a journal every MiB (default 64) how far\n\
+                          the title VOBs were copied, for --resume\n\
+      --resume             continue an interrupted copy where the journal\n\
+                          says it stopped instead of starting over\n\
+      --manifest           write the XXH64 hash, size and padded blocks of\n\
+                          every copied file to MANIFEST\n\
+      --crc-index          keep a CRC32C of every 32 KiB of each VOB next to\n\
+                          the sector states; with --cmp, check the files\n\
+                          against it instead of rereading the disc\n\
+      --scrub-threads=N    hash N files at once with --scrub (default: one\n\
+                          per CPU)\n\
+      --scrub-rate=MiB     read at most MiB per second with --scrub, 0 for no\n\
+                          limit (default 0)\n\
       --gaps               verify existing output and fill missing blocks\n\
+      --repair             with -M, compare the backup with the DVD and copy\n\
+                          every differing or missing block again\n\
       --gap-strategy=MODE  reorder gap fill attempts: forward, reverse,\n\
-                          outside-in, or random\n\
+                          outside-in, random, or rescue\n\
       --gap-random-seed=N  seed for the random gap strategy (default 0)\n\
+      --rescue-retries=N   retry passes of the rescue gap strategy (default 1)\n\
+      --rescue-time=SECS   give up each rescue phase after SECS seconds, 0 for\n\
+                          no limit (default 0)\n\
       --no-overwrite       abort if the target title directory already exists\n\n"));
 
 	printf(_("\
@@ -132,6 +184,218 @@ void init_i18n() {
 }
 
 
+/**
+ * Appends value to the list of a repeatable option.
+ */
+static int append_option(char*** list, int* count, char* value) {
+	char** grown = realloc(*list, (size_t)(*count + 1) * sizeof(char*));
+
+	if (grown == NULL) {
+		fprintf(stderr, _("Failed to allocate memory for the options.\n"));
+		return -1;
+	}
+	grown[(*count)++] = value;
+	*list = grown;
+	return 0;
+}
+
+
+/**
+ * Gets the title name from the disc in device unless one is provided.
+ * Returns 0, or the exit code after printing why there is none.
+ */
+static int get_title_name(const char* device, const char* provided_title_name, char* title_name) {
+	if(provided_title_name == NULL) {
+		if (DVDGetTitleName(device,title_name) != 0) {
+			fprintf(stderr,_("You must provide a title name when you read your DVD-Video structure direct from the HD\n"));
+			return 1;
+		}
+		if (strstr(title_name, "DVD_VIDEO") != NULL) {
+			fprintf(stderr,_("The DVD-Video title on the disk is DVD_VIDEO, which is too generic; please provide a title with the -n switch\n"));
+			return 2;
+		}
+
+	} else {
+		if (strlen(provided_title_name) > 32) {
+			fprintf(stderr,_("The title name specified is longer than 32 characters; truncating the title name\n"));
+			strncpy(title_name,provided_title_name, 32);
+			title_name[32]='\0';
+		} else {
+			strcpy(title_name,provided_title_name);
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Creates targetdir/title_name/VIDEO_TS for a mirror, or with --cmp checks
+ * that it exists. Returns 0, or the exit code after printing why it failed.
+ */
+static int create_title_directories(char* targetdir, char* title_name) {
+	char *targetname;
+	size_t targetname_length;
+	struct stat fileinfo;
+
+	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS" and terminating "\0"
+	targetname_length = strlen(targetdir) + strlen(title_name) + 11;
+	targetname = malloc(targetname_length);
+	if (targetname == NULL) {
+		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
+		return 1;
+	}
+	snprintf(targetname, targetname_length, "%s", targetdir);
+
+	/* with --iso or --tar the files go into the image or archive instead */
+	if (image_file == NULL && !tar_output) {
+		if (stat(targetname, &fileinfo) == 0) {
+			if (! S_ISDIR(fileinfo.st_mode)) {
+				fprintf(stderr,_("The target directory is not valid; it may be an ordinary file.\n"));
+			}
+		} else {
+			if (compare_only) {
+				fprintf(stderr, _("The target directory %s is missing.\n"), targetname);
+				free(targetname);
+				return -1;
+			}
+			if (mkdir(targetname, 0777) != 0) {
+				fprintf(stderr,_("Failed creating target directory %s\n"), targetname);
+				perror("");
+				free(targetname);
+				return -1;
+			}
+		}
+
+
+		snprintf(targetname, targetname_length, "%s/%s", targetdir, title_name);
+
+		if (stat(targetname, &fileinfo) == 0) {
+			if (! S_ISDIR(fileinfo.st_mode)) {
+				fprintf(stderr,_("The title directory is not valid; it may be an ordinary file.\n"));
+			} else if (no_overwrite) {
+				fprintf(stderr, _("The title directory %s exists; rerun without --no-overwrite.\n"), targetname);
+				free(targetname);
+				return -1;
+			}
+		} else {
+			if (compare_only) {
+				fprintf(stderr, _("The title directory %s is missing.\n"), targetname);
+				free(targetname);
+				return -1;
+			}
+			if (mkdir(targetname, 0777) != 0) {
+				fprintf(stderr,_("Failed creating title directory\n"));
+				perror("");
+				free(targetname);
+				return -1;
+			}
+		}
+
+		snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS", targetdir, title_name);
+
+		if (stat(targetname, &fileinfo) == 0) {
+			if (! S_ISDIR(fileinfo.st_mode)) {
+				fprintf(stderr,_("The VIDEO_TS directory is not valid; it may be an ordinary file.\n"));
+			} else if (no_overwrite) {
+				fprintf(stderr, _("The VIDEO_TS directory %s exists; rerun without --no-overwrite.\n"), targetname);
+				free(targetname);
+				return -1;
+			}
+		} else {
+			if (compare_only) {
+				fprintf(stderr, _("The VIDEO_TS directory %s is missing.\n"), targetname);
+				free(targetname);
+				return -1;
+			}
+			if (mkdir(targetname, 0777) != 0) {
+				fprintf(stderr,_("Failed creating VIDEO_TS directory\n"));
+				perror("");
+				free(targetname);
+				return -1;
+			}
+		}
+	}
+
+	free(targetname);
+	return 0;
+}
+
+
+/**
+ * Mirrors the discs in several drives at once (-M with more than one -i).
+ * provided_title_names has one name per drive or is NULL. Returns the exit
+ * code.
+ */
+static int mirror_drives(char** devices, int count, char** provided_title_names,
+		char* targetdir, read_error_strategy_t errorstrat) {
+	dvd_reader_t** dvds;
+	char (*title_names)[33];
+	char** names;
+	int return_code = 0;
+	int opened;
+	int i, j;
+
+	dvds = calloc((size_t)count, sizeof(dvd_reader_t*));
+	title_names = calloc((size_t)count, sizeof(*title_names));
+	names = calloc((size_t)count, sizeof(char*));
+	if (dvds == NULL || title_names == NULL || names == NULL) {
+		fprintf(stderr, _("Failed to allocate memory for %d drives.\n"), count);
+		free(dvds);
+		free(title_names);
+		free(names);
+		return 1;
+	}
+
+	for (opened = 0; opened < count; ++opened) {
+		dvds[opened] = DVDOpen(devices[opened]);
+		if (!dvds[opened]) {
+			fprintf(stderr,_("Cannot open specified device %s - check your DVD device\n"), devices[opened]);
+			return_code = -1;
+			goto cleanup;
+		}
+
+		return_code = get_title_name(devices[opened],
+				provided_title_names ? provided_title_names[opened] : NULL, title_names[opened]);
+		if (return_code != 0) {
+			++opened;
+			goto cleanup;
+		}
+		names[opened] = title_names[opened];
+
+		for (j = 0; j < opened; ++j) {
+			if (strcmp(title_names[j], title_names[opened]) == 0) {
+				fprintf(stderr, _("The discs in %s and %s are both titled %s; please provide a title for each with the -n switch\n"),
+						devices[j], devices[opened], title_names[opened]);
+				return_code = 2;
+				++opened;
+				goto cleanup;
+			}
+		}
+
+		return_code = create_title_directories(targetdir, title_names[opened]);
+		if (return_code != 0) {
+			++opened;
+			goto cleanup;
+		}
+	}
+
+	if (DVDMirrorDrives(dvds, devices, names, count, targetdir, errorstrat) != 0) {
+		fprintf(stderr, _("Mirror of DVD failed\n"));
+		return_code = -1;
+	}
+
+cleanup:
+	for (i = 0; i < opened; ++i) {
+		close_dvd_reader(dvds[i]);
+	}
+	free(dvds);
+	free(title_names);
+	free(names);
+	return return_code;
+}
+
+
 int main(int argc, char* argv[]) {
 
 	/* Args */
@@ -150,6 +414,10 @@ int main(int argc, char* argv[]) {
 	int do_titles = 0;
 	int do_feature = 0;
 	int do_info = 0;
+	char* scrub_dir = NULL;
+	char* replay_trace = NULL;
+	int scrub_threads = 0;
+	int scrub_rate = 0;
 
 	/* Because of copy protection you normally want to skip
 	 * the defect sectors. To speed things up we skip multiblocks.
@@ -160,6 +428,8 @@ int main(int argc, char* argv[]) {
 
 	/* DVD Video device */
 	char* dvd = "/dev/dvd";
+	char** devices = NULL;
+	int device_count = 0;
 
 	/* Temp switch helpers */
 	char* aspect_temp = NULL;
@@ -173,15 +443,12 @@ int main(int argc, char* argv[]) {
 	/* Title of the DVD */
 	char title_name[33] = "";
 	char* provided_title_name = NULL;
+	char** provided_title_names = NULL;
+	int provided_title_count = 0;
 
 	/* Targer dir */
 	char* targetdir = ".";
 
-	/* Temp filename,dirname */
-	char *targetname;
-	size_t targetname_length;
-	struct stat fileinfo;
-
 	/* The DVD main structure */
 	dvd_reader_t* _dvd = NULL;
 
@@ -210,7 +477,32 @@ int main(int argc, char* argv[]) {
 		{"no-overwrite", no_argument, NULL, 'O'},
 		{"gap-strategy", required_argument, NULL, 0},
 		{"gap-random-seed", required_argument, NULL, 0},
+		{"rescue-retries", required_argument, NULL, 0},
+		{"rescue-time", required_argument, NULL, 0},
 		{"gap-map", no_argument, NULL, 0},
+		{"repair", no_argument, NULL, 0},
+		{"pipeline", no_argument, NULL, 0},
+		{"async-io", no_argument, NULL, 0},
+		{"direct-io", no_argument, NULL, 0},
+		{"sparse", no_argument, NULL, 0},
+		{"preallocate", no_argument, NULL, 0},
+		{"write-behind", optional_argument, NULL, 0},
+		{"physical-order", no_argument, NULL, 0},
+		{"iso", required_argument, NULL, 0},
+		{"tar", no_argument, NULL, 0},
+		{"bisect-depth", required_argument, NULL, 0},
+		{"bisect-time", required_argument, NULL, 0},
+		{"read-timeout", required_argument, NULL, 0},
+		{"block-source", required_argument, NULL, 0},
+		{"record-trace", required_argument, NULL, 0},
+		{"replay-trace", required_argument, NULL, 0},
+		{"resume", no_argument, NULL, 0},
+		{"journal", optional_argument, NULL, 0},
+		{"manifest", no_argument, NULL, 0},
+		{"crc-index", no_argument, NULL, 0},
+		{"scrub", required_argument, NULL, 0},
+		{"scrub-threads", required_argument, NULL, 0},
+		{"scrub-rate", required_argument, NULL, 0},
 		{NULL, 0, NULL, 0}
 	};
 	const char* shortopts = "hVIMFT:t:s:e:i:o:vn:a:r:pCGO";
@@ -233,8 +525,10 @@ int main(int argc, char* argv[]) {
 					gap_strategy = GAP_STRATEGY_OUTSIDE_IN;
 				} else if (strcasecmp(optarg, "random") == 0) {
 					gap_strategy = GAP_STRATEGY_RANDOM;
+				} else if (strcasecmp(optarg, "rescue") == 0) {
+					gap_strategy = GAP_STRATEGY_RESCUE;
 				} else {
-					fprintf(stderr, _("Unknown gap strategy '%s'. Use forward, reverse, outside-in, or random.\n"), optarg);
+					fprintf(stderr, _("Unknown gap strategy '%s'. Use forward, reverse, outside-in, random, or rescue.\n"), optarg);
 					lose = true;
 				}
 			} else if (strcmp(longopts[option_index].name, "gap-random-seed") == 0) {
@@ -247,6 +541,18 @@ int main(int argc, char* argv[]) {
 					gap_random_seed = (unsigned int)seed;
 					gap_random_seed_set = 1;
 				}
+			} else if (strcmp(longopts[option_index].name, "rescue-retries") == 0
+					|| strcmp(longopts[option_index].name, "rescue-time") == 0) {
+				char* endptr = NULL;
+				long value = strtol(optarg, &endptr, 10);
+				if (optarg[0] == '\0' || *endptr != '\0' || value < 0 || value > INT_MAX) {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else if (strcmp(longopts[option_index].name, "rescue-retries") == 0) {
+					rescue_retries = (int)value;
+				} else {
+					rescue_time = (int)value;
+				}
 			} else if (strcmp(longopts[option_index].name, "gap-map") == 0) {
 				if (fill_gaps) {
 					fprintf(stderr, _("--gap-map cannot be combined with --gaps.\n"));
@@ -254,6 +560,116 @@ int main(int argc, char* argv[]) {
 				}
 				gap_map = 1;
 				compare_only = 1;
+			} else if (strcmp(longopts[option_index].name, "repair") == 0) {
+				repair = 1;
+				compare_only = 1;
+			} else if (strcmp(longopts[option_index].name, "pipeline") == 0) {
+				pipeline = 1;
+			} else if (strcmp(longopts[option_index].name, "async-io") == 0) {
+				async_output = 1;
+			} else if (strcmp(longopts[option_index].name, "direct-io") == 0) {
+				direct_io = 1;
+			} else if (strcmp(longopts[option_index].name, "sparse") == 0) {
+				sparse_output = 1;
+			} else if (strcmp(longopts[option_index].name, "preallocate") == 0) {
+				preallocate = 1;
+			} else if (strcmp(longopts[option_index].name, "physical-order") == 0) {
+				physical_order = 1;
+			} else if (strcmp(longopts[option_index].name, "iso") == 0) {
+				if (optarg[0] == '\0') {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else {
+					image_file = optarg;
+				}
+			} else if (strcmp(longopts[option_index].name, "tar") == 0) {
+				tar_output = 1;
+			} else if (strcmp(longopts[option_index].name, "write-behind") == 0) {
+				char* endptr = NULL;
+				long value = optarg ? strtol(optarg, &endptr, 10) : 64;
+				if (optarg && (optarg[0] == '\0' || *endptr != '\0' || value < 1 || value > 65536)) {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else {
+					write_behind = (int)value;
+				}
+			} else if (strcmp(longopts[option_index].name, "bisect-depth") == 0
+					|| strcmp(longopts[option_index].name, "bisect-time") == 0) {
+				char* endptr = NULL;
+				long value = strtol(optarg, &endptr, 10);
+				if (optarg[0] == '\0' || *endptr != '\0' || value < 0 || value > INT_MAX) {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else if (strcmp(longopts[option_index].name, "bisect-depth") == 0) {
+					bisect_max_depth = (int)value;
+				} else {
+					bisect_time_limit = (int)value;
+				}
+			} else if (strcmp(longopts[option_index].name, "read-timeout") == 0) {
+				char* endptr = NULL;
+				long value = strtol(optarg, &endptr, 10);
+				if (optarg[0] == '\0' || *endptr != '\0' || value < 0 || value > INT_MAX) {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else {
+					read_timeout = (int)value;
+				}
+			} else if (strcmp(longopts[option_index].name, "block-source") == 0) {
+				if (strcasecmp(optarg, "dvdread") == 0) {
+					block_source = BLOCK_SOURCE_DVDREAD;
+				} else if (strcasecmp(optarg, "raw") == 0) {
+					block_source = BLOCK_SOURCE_RAW;
+				} else if (strncasecmp(optarg, "mock:", 5) == 0 && optarg[5] != '\0') {
+					block_source = BLOCK_SOURCE_MOCK;
+					fault_spec = optarg + 5;
+				} else {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				}
+			} else if (strcmp(longopts[option_index].name, "resume") == 0) {
+				resume = 1;
+			} else if (strcmp(longopts[option_index].name, "manifest") == 0) {
+				manifest = 1;
+			} else if (strcmp(longopts[option_index].name, "crc-index") == 0) {
+				crc_index = 1;
+			} else if (strcmp(longopts[option_index].name, "record-trace") == 0
+					|| strcmp(longopts[option_index].name, "replay-trace") == 0) {
+				if (optarg[0] == '\0') {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else if (strcmp(longopts[option_index].name, "record-trace") == 0) {
+					record_trace = optarg;
+				} else {
+					replay_trace = optarg;
+				}
+			} else if (strcmp(longopts[option_index].name, "scrub") == 0) {
+				if (optarg[0] == '\0') {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else {
+					scrub_dir = optarg;
+				}
+			} else if (strcmp(longopts[option_index].name, "scrub-threads") == 0
+					|| strcmp(longopts[option_index].name, "scrub-rate") == 0) {
+				char* endptr = NULL;
+				long value = strtol(optarg, &endptr, 10);
+				if (optarg[0] == '\0' || *endptr != '\0' || value < 0 || value > 65536) {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else if (strcmp(longopts[option_index].name, "scrub-threads") == 0) {
+					scrub_threads = (int)value;
+				} else {
+					scrub_rate = (int)value;
+				}
+			} else if (strcmp(longopts[option_index].name, "journal") == 0) {
+				char* endptr = NULL;
+				long value = optarg ? strtol(optarg, &endptr, 10) : 64;
+				if (optarg && (optarg[0] == '\0' || *endptr != '\0' || value < 1 || value > 65536)) {
+					fprintf(stderr, _("Invalid value '%s' for --%s.\n"), optarg, longopts[option_index].name);
+					lose = true;
+				} else {
+					journal_interval = (int)value;
+				}
 			}
 			break;
 		case 'h':
@@ -288,6 +704,9 @@ int main(int argc, char* argv[]) {
 			break;
 
 		case 'i':
+			if (append_option(&devices, &device_count, optarg) != 0) {
+				lose = true;
+			}
 			dvd = optarg;
 			break;
 		case 'o':
@@ -297,6 +716,9 @@ int main(int argc, char* argv[]) {
 			verbose = 10;
 			break;
 		case 'n':
+			if (append_option(&provided_title_names, &provided_title_count, optarg) != 0) {
+				lose = true;
+			}
 			provided_title_name = optarg;
 			break;
 		case 'a':
@@ -329,6 +751,55 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	if (strcmp(targetdir, "-") == 0) {
+		tar_output = 1;
+	}
+	if (tar_output && (image_file != NULL || fill_gaps || compare_only || async_output
+			|| direct_io || sparse_output || preallocate || write_behind)) {
+		fprintf(stderr, _("--tar cannot be combined with --iso, --gaps, --cmp, --gap-map, --async-io, --direct-io, --sparse, --preallocate or --write-behind.\n"));
+		lose = true;
+	}
+
+	if (device_count > 1 && (image_file != NULL || tar_output || async_output)) {
+		fprintf(stderr, _("Several drives cannot be combined with --iso, --tar or --async-io.\n"));
+		lose = true;
+	}
+	if (device_count > 1 && provided_title_count > 0 && provided_title_count != device_count) {
+		fprintf(stderr, _("Give one -n for every -i when ripping several drives.\n"));
+		lose = true;
+	}
+
+	if (sparse_output && preallocate) {
+		fprintf(stderr, _("--sparse cannot be combined with --preallocate.\n"));
+		lose = true;
+	}
+
+	if (resume && (fill_gaps || compare_only || tar_output || no_overwrite)) {
+		fprintf(stderr, _("--resume cannot be combined with --gaps, --cmp, --tar or --no-overwrite.\n"));
+		lose = true;
+	}
+	if (physical_order && (fill_gaps || compare_only || resume || journal_interval > 0 || pipeline
+			|| image_file != NULL || tar_output)) {
+		fprintf(stderr, _("--physical-order cannot be combined with --gaps, --cmp, --gap-map, --repair, --resume, --journal, --pipeline, --iso or --tar.\n"));
+		lose = true;
+	}
+	/* a resumed copy goes on noting its progress */
+	if (resume && journal_interval == 0) {
+		journal_interval = 64;
+	}
+	if (manifest && (fill_gaps || compare_only || tar_output || resume)) {
+		fprintf(stderr, _("--manifest cannot be combined with --gaps, --cmp, --tar or --resume.\n"));
+		lose = true;
+	}
+	if (repair && (fill_gaps || gap_map)) {
+		fprintf(stderr, _("--repair cannot be combined with --gaps or --gap-map.\n"));
+		lose = true;
+	}
+	if (crc_index && tar_output) {
+		fprintf(stderr, _("--crc-index cannot be combined with --tar.\n"));
+		lose = true;
+	}
+
 	if(lose || optind < argc) {
 		/* Print error message and exit. */
 		if (optind < argc) {
@@ -345,6 +816,8 @@ int main(int argc, char* argv[]) {
 			errorstrat=STRATEGY_SKIP_BLOCK;
 		} else if(errorstrat_temp[0]=='m') {
 			errorstrat=STRATEGY_SKIP_MULTIBLOCK;
+		} else if(errorstrat_temp[0]=='i') {
+			errorstrat=STRATEGY_BISECT;
 		} else {
 			print_help();
 			exit(1);
@@ -417,22 +890,59 @@ int main(int argc, char* argv[]) {
 		do_title_set = 1;
 	}
 
-	if (do_info + do_titles + do_chapter + do_feature + do_title_set + do_mirror > 1 ) {
+	if (do_info + do_titles + do_chapter + do_feature + do_title_set + do_mirror + (scrub_dir != NULL) + (replay_trace != NULL) > 1 ) {
 		print_help();
 		exit(1);
-	} else if ( do_info + do_titles + do_chapter + do_feature + do_title_set + do_mirror == 0) {
+	} else if ( do_info + do_titles + do_chapter + do_feature + do_title_set + do_mirror + (scrub_dir != NULL) + (replay_trace != NULL) == 0) {
 		print_help();
 		exit(1);
 	}
 
+	/* a scrub only reads the backups */
+	if (scrub_dir != NULL) {
+		exit(DVDScrub(scrub_dir, scrub_threads, scrub_rate) == 0 ? 0 : -1);
+	}
+	/* and a replay only the trace */
+	if (replay_trace != NULL) {
+		exit(DVDReplayTrace(replay_trace) == 0 ? 0 : -1);
+	}
+
 	if (compare_only) {
 		if (!do_mirror || do_info || do_titles || do_chapter || do_feature || do_title_set) {
-			fprintf(stderr, _("Compare-only modes (--cmp/--gap-map) currently require -M and no other copy modes.\n"));
+			fprintf(stderr, _("Compare-only modes (--cmp/--gap-map/--repair) currently require -M and no other copy modes.\n"));
 			print_help();
 			exit(1);
 		}
 		fill_gaps = 0;
 	}
+	if (image_file != NULL && !do_mirror) {
+		fprintf(stderr, _("--iso currently requires -M.\n"));
+		print_help();
+		exit(1);
+	}
+	if (physical_order && !do_mirror) {
+		fprintf(stderr, _("--physical-order requires -M.\n"));
+		print_help();
+		exit(1);
+	}
+	if (tar_output && !(do_mirror || do_feature || do_title_set)) {
+		fprintf(stderr, _("--tar requires -M, -F or -T.\n"));
+		print_help();
+		exit(1);
+	}
+	if (device_count > 1 && !do_mirror) {
+		fprintf(stderr, _("Several drives currently require -M.\n"));
+		print_help();
+		exit(1);
+	}
+	if (device_count > 1 && record_trace != NULL) {
+		fprintf(stderr, _("--record-trace cannot be used with several drives.\n"));
+		print_help();
+		exit(1);
+	}
+	if (tar_output_setup() != 0 || block_source_setup() != 0) {
+		exit(1);
+	}
 	if (gap_map) {
 		gap_map_reset();
 	}
@@ -440,7 +950,12 @@ int main(int argc, char* argv[]) {
 	fprintf(stderr,"After args\n");
 #endif
 
+	if (device_count > 1) {
+		exit(mirror_drives(devices, device_count, provided_title_names, targetdir, errorstrat));
+	}
+
 
+	dvd_device = dvd;
 	_dvd = DVDOpen(dvd);
 	if (!_dvd) {
 		fprintf(stderr,_("Cannot open specified device %s - check your DVD device\n"), dvd);
@@ -454,107 +969,16 @@ int main(int argc, char* argv[]) {
 	}
 
 
-	if(provided_title_name == NULL) {
-		if (DVDGetTitleName(dvd,title_name) != 0) {
-			fprintf(stderr,_("You must provide a title name when you read your DVD-Video structure direct from the HD\n"));
-			DVDClose(_dvd);
-			exit(1);
-		}
-		if (strstr(title_name, "DVD_VIDEO") != NULL) {
-			fprintf(stderr,_("The DVD-Video title on the disk is DVD_VIDEO, which is too generic; please provide a title with the -n switch\n"));
-			DVDClose(_dvd);
-			exit(2);
-		}
-
-	} else {
-		if (strlen(provided_title_name) > 32) {
-			fprintf(stderr,_("The title name specified is longer than 32 characters; truncating the title name\n"));
-			strncpy(title_name,provided_title_name, 32);
-			title_name[32]='\0';
-		} else {
-			strcpy(title_name,provided_title_name);
-		}
-	}
-
-	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS" and terminating "\0"
-	targetname_length = strlen(targetdir) + strlen(title_name) + 11;
-	targetname = malloc(targetname_length);
-	if (targetname == NULL) {
-		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
+	return_code = get_title_name(dvd, provided_title_name, title_name);
+	if (return_code != 0) {
 		DVDClose(_dvd);
-		return 1;
+		exit(return_code);
 	}
-	snprintf(targetname, targetname_length, "%s", targetdir);
 
-	if (stat(targetname, &fileinfo) == 0) {
-		if (! S_ISDIR(fileinfo.st_mode)) {
-			fprintf(stderr,_("The target directory is not valid; it may be an ordinary file.\n"));
-		}
-	} else {
-		if (compare_only) {
-			fprintf(stderr, _("The target directory %s is missing.\n"), targetname);
-			DVDClose(_dvd);
-			exit(-1);
-		}
-		if (mkdir(targetname, 0777) != 0) {
-			fprintf(stderr,_("Failed creating target directory %s\n"), targetname);
-			perror("");
-			DVDClose(_dvd);
-			exit(-1);
-		}
-	}
-
-
-	snprintf(targetname, targetname_length, "%s/%s", targetdir, title_name);
-
-	if (stat(targetname, &fileinfo) == 0) {
-		if (! S_ISDIR(fileinfo.st_mode)) {
-			fprintf(stderr,_("The title directory is not valid; it may be an ordinary file.\n"));
-		} else if (no_overwrite) {
-			fprintf(stderr, _("The title directory %s exists; rerun without --no-overwrite.\n"), targetname);
-			free(targetname);
-			DVDClose(_dvd);
-			exit(-1);
-		}
-	} else {
-		if (compare_only) {
-			fprintf(stderr, _("The title directory %s is missing.\n"), targetname);
-			free(targetname);
-			DVDClose(_dvd);
-			exit(-1);
-		}
-		if (mkdir(targetname, 0777) != 0) {
-			fprintf(stderr,_("Failed creating title directory\n"));
-			perror("");
-			DVDClose(_dvd);
-			exit(-1);
-		}
-	}
-
-	snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS", targetdir, title_name);
-
-	if (stat(targetname, &fileinfo) == 0) {
-		if (! S_ISDIR(fileinfo.st_mode)) {
-			fprintf(stderr,_("The VIDEO_TS directory is not valid; it may be an ordinary file.\n"));
-		} else if (no_overwrite) {
-			fprintf(stderr, _("The VIDEO_TS directory %s exists; rerun without --no-overwrite.\n"), targetname);
-			free(targetname);
-			DVDClose(_dvd);
-			exit(-1);
-		}
-	} else {
-		if (compare_only) {
-			fprintf(stderr, _("The VIDEO_TS directory %s is missing.\n"), targetname);
-			free(targetname);
-			DVDClose(_dvd);
-			exit(-1);
-		}
-		if (mkdir(targetname, 0777) != 0) {
-			fprintf(stderr,_("Failed creating VIDEO_TS directory\n"));
-			perror("");
-			DVDClose(_dvd);
-			exit(-1);
-		}
+	return_code = create_title_directories(targetdir, title_name);
+	if (return_code != 0) {
+		DVDClose(_dvd);
+		exit(return_code);
 	}
 
 
@@ -562,6 +986,10 @@ int main(int argc, char* argv[]) {
 	fprintf(stderr,"After dirs\n");
 #endif
 
+	if (!compare_only || repair) {
+		async_output_setup();
+	}
+
 
 	if(do_mirror) {
 		if ( DVDMirror(_dvd, targetdir, title_name, errorstrat) != 0 ) {
@@ -624,7 +1052,16 @@ int main(int argc, char* argv[]) {
 		gap_map_free();
 	}
 
-	free(targetname);
-	DVDClose(_dvd);
+	async_output_finish();
+
+	if (errorstrat == STRATEGY_BISECT) {
+		bisect_report();
+	}
+	read_stall_report();
+	if (block_source_finish() != 0) {
+		return_code = -1;
+	}
+
+	close_dvd_reader(_dvd);
 	exit(return_code);
 }
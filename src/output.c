@@ -0,0 +1,377 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "output.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+
+typedef struct {
+	int busy; /* handed out to the caller or in flight */
+	int fd;
+	off_t offset;
+	size_t length;
+	unsigned char* data;
+} output_slot_t;
+
+static struct io_uring ring;
+static int ring_ready = 0;
+static unsigned char* slot_memory = NULL;
+static size_t slot_size = 0;
+static output_slot_t slots[OUTPUT_QUEUE_DEPTH];
+static unsigned int in_flight = 0;
+static int pending_errno = 0;
+
+static unsigned long long stat_writes = 0;
+static unsigned long long stat_depth_sum = 0;
+static unsigned int stat_peak_depth = 0;
+
+
+int output_async_init(size_t buffer_size) {
+	struct iovec iov[OUTPUT_QUEUE_DEPTH];
+	long page_size = sysconf(_SC_PAGESIZE);
+	int ret;
+	int i;
+
+	if (ring_ready) {
+		return 0;
+	}
+
+	if (page_size <= 0) {
+		page_size = 4096;
+	}
+
+	ret = posix_memalign((void**)&slot_memory, (size_t)page_size, buffer_size * OUTPUT_QUEUE_DEPTH);
+	if (ret != 0) {
+		slot_memory = NULL;
+		errno = ret;
+		return -1;
+	}
+
+	ret = io_uring_queue_init(OUTPUT_QUEUE_DEPTH * 2, &ring, 0);
+	if (ret < 0) {
+		free(slot_memory);
+		slot_memory = NULL;
+		errno = -ret;
+		return -1;
+	}
+
+	for (i = 0; i < OUTPUT_QUEUE_DEPTH; ++i) {
+		slots[i].busy = 0;
+		slots[i].data = slot_memory + (size_t)i * buffer_size;
+		iov[i].iov_base = slots[i].data;
+		iov[i].iov_len = buffer_size;
+	}
+
+	ret = io_uring_register_buffers(&ring, iov, OUTPUT_QUEUE_DEPTH);
+	if (ret < 0) {
+		io_uring_queue_exit(&ring);
+		free(slot_memory);
+		slot_memory = NULL;
+		errno = -ret;
+		return -1;
+	}
+
+	slot_size = buffer_size;
+	in_flight = 0;
+	pending_errno = 0;
+	ring_ready = 1;
+	return 0;
+}
+
+
+/**
+ * Finishes a write the kernel only did partially. This practically never
+ * happens for regular files, so it is simply completed synchronously.
+ */
+static void output_complete_short(output_slot_t* slot, size_t done) {
+	while (done < slot->length) {
+		ssize_t written = pwrite(slot->fd, slot->data + done, slot->length - done,
+				slot->offset + (off_t)done);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (pending_errno == 0) {
+				pending_errno = errno;
+			}
+			return;
+		}
+		if (written == 0) {
+			if (pending_errno == 0) {
+				pending_errno = EIO;
+			}
+			return;
+		}
+		done += (size_t)written;
+	}
+}
+
+
+/**
+ * Clears O_DIRECT on fd if it is set, so a write the file system rejected for
+ * its alignment can be repeated through the page cache. Returns 1 if it did.
+ */
+static int output_drop_direct(int fd) {
+#ifdef O_DIRECT
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags != -1 && (flags & O_DIRECT)) {
+		return fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+	}
+#else
+	(void)fd;
+#endif
+
+	return 0;
+}
+
+
+/* Reaps all available completions; waits for at least one if wait is set. */
+static void output_reap(int wait) {
+	struct io_uring_cqe* cqes[OUTPUT_QUEUE_DEPTH * 2];
+	unsigned int count;
+	unsigned int i;
+
+	if (in_flight == 0) {
+		return;
+	}
+
+	if (wait) {
+		struct io_uring_cqe* cqe;
+		int ret;
+
+		do {
+			ret = io_uring_wait_cqe(&ring, &cqe);
+		} while (ret == -EINTR);
+		if (ret < 0) {
+			if (pending_errno == 0) {
+				pending_errno = -ret;
+			}
+			return;
+		}
+	}
+
+	count = io_uring_peek_batch_cqe(&ring, cqes, OUTPUT_QUEUE_DEPTH * 2);
+	for (i = 0; i < count; ++i) {
+		output_slot_t* slot = (output_slot_t*)io_uring_cqe_get_data(cqes[i]);
+		int res = cqes[i]->res;
+
+		if (res == -EINVAL && output_drop_direct(slot->fd)) {
+			output_complete_short(slot, 0);
+		} else if (res < 0) {
+			if (pending_errno == 0) {
+				pending_errno = -res;
+			}
+		} else if ((size_t)res < slot->length) {
+			output_complete_short(slot, (size_t)res);
+		}
+
+		slot->busy = 0;
+		in_flight--;
+	}
+	io_uring_cq_advance(&ring, count);
+}
+
+
+unsigned char* output_async_buffer(int* slot) {
+	int i;
+
+	for (;;) {
+		for (i = 0; i < OUTPUT_QUEUE_DEPTH; ++i) {
+			if (!slots[i].busy) {
+				slots[i].busy = 1;
+				*slot = i;
+				return slots[i].data;
+			}
+		}
+		output_reap(1);
+	}
+}
+
+
+void output_async_release(int slot) {
+	slots[slot].busy = 0;
+}
+
+
+int output_async_write(int fd, int slot, size_t length, off_t offset) {
+	struct io_uring_sqe* sqe;
+	output_slot_t* entry = &slots[slot];
+	int ret;
+
+	entry->fd = fd;
+	entry->offset = offset;
+	entry->length = length;
+
+	sqe = io_uring_get_sqe(&ring);
+	if (sqe == NULL) {
+		/* the ring has twice as many entries as buffers, but be safe */
+		io_uring_submit(&ring);
+		sqe = io_uring_get_sqe(&ring);
+		if (sqe == NULL) {
+			entry->busy = 0;
+			errno = EBUSY;
+			return -1;
+		}
+	}
+
+	io_uring_prep_write_fixed(sqe, fd, entry->data, (unsigned)length, (uint64_t)offset, slot);
+	io_uring_sqe_set_data(sqe, entry);
+
+	ret = io_uring_submit(&ring);
+	if (ret < 0) {
+		entry->busy = 0;
+		errno = -ret;
+		return -1;
+	}
+
+	in_flight++;
+	stat_writes++;
+	stat_depth_sum += in_flight;
+	if (in_flight > stat_peak_depth) {
+		stat_peak_depth = in_flight;
+	}
+
+	/* pick up whatever already completed without blocking */
+	output_reap(0);
+	return 0;
+}
+
+
+int output_async_write_copy(int fd, const unsigned char* data, size_t length, off_t offset) {
+	while (length > 0) {
+		size_t part = length < slot_size ? length : slot_size;
+		int slot;
+		unsigned char* buffer = output_async_buffer(&slot);
+
+		memcpy(buffer, data, part);
+		if (output_async_write(fd, slot, part, offset) != 0) {
+			return -1;
+		}
+		data += part;
+		offset += (off_t)part;
+		length -= part;
+	}
+
+	return 0;
+}
+
+
+int output_async_drain(void) {
+	int error;
+
+	while (in_flight > 0) {
+		output_reap(1);
+	}
+
+	error = pending_errno;
+	pending_errno = 0;
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void output_async_stats(unsigned long long* writes, unsigned int* peak_depth, double* average_depth) {
+	*writes = stat_writes;
+	*peak_depth = stat_peak_depth;
+	*average_depth = stat_writes > 0 ? (double)stat_depth_sum / (double)stat_writes : 0.0;
+}
+
+
+void output_async_shutdown(void) {
+	if (!ring_ready) {
+		return;
+	}
+
+	output_async_drain();
+	io_uring_unregister_buffers(&ring);
+	io_uring_queue_exit(&ring);
+	free(slot_memory);
+	slot_memory = NULL;
+	ring_ready = 0;
+}
+
+#else /* !HAVE_LIBURING */
+
+int output_async_init(size_t buffer_size) {
+	(void)buffer_size;
+	errno = ENOSYS;
+	return -1;
+}
+
+unsigned char* output_async_buffer(int* slot) {
+	*slot = -1;
+	return NULL;
+}
+
+void output_async_release(int slot) {
+	(void)slot;
+}
+
+int output_async_write(int fd, int slot, size_t length, off_t offset) {
+	(void)fd;
+	(void)slot;
+	(void)length;
+	(void)offset;
+	errno = ENOSYS;
+	return -1;
+}
+
+int output_async_write_copy(int fd, const unsigned char* data, size_t length, off_t offset) {
+	(void)fd;
+	(void)data;
+	(void)length;
+	(void)offset;
+	errno = ENOSYS;
+	return -1;
+}
+
+int output_async_drain(void) {
+	return 0;
+}
+
+void output_async_stats(unsigned long long* writes, unsigned int* peak_depth, double* average_depth) {
+	*writes = 0;
+	*peak_depth = 0;
+	*average_depth = 0.0;
+}
+
+void output_async_shutdown(void) {
+}
+
+#endif /* HAVE_LIBURING */
@@ -0,0 +1,64 @@
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Number of registered buffers, and thus the maximum number of writes in
+ * flight, of the asynchronous output queue.
+ */
+#define OUTPUT_QUEUE_DEPTH 8
+
+/*
+ * Asynchronous output queue backed by io_uring. Writes are submitted from
+ * registered buffers and their completions are reaped in batches whenever a
+ * buffer is needed or the queue is drained. All functions must be called from
+ * the same thread. Without liburing output_async_init() always fails and the
+ * callers keep using synchronous writes.
+ */
+
+/* Sets up the ring with buffers of buffer_size bytes; 0 on success, else -1 and errno. */
+int output_async_init(size_t buffer_size);
+
+/* Returns a free registered buffer and its slot, waiting for completions if necessary. */
+unsigned char* output_async_buffer(int* slot);
+
+/* Returns a buffer obtained with output_async_buffer() without writing it. */
+void output_async_release(int slot);
+
+/* Queues length bytes of the buffer in slot for writing to fd at offset. */
+int output_async_write(int fd, int slot, size_t length, off_t offset);
+
+/* Copies data into registered buffers and queues it for writing to fd at offset. */
+int output_async_write_copy(int fd, const unsigned char* data, size_t length, off_t offset);
+
+/* Waits for all queued writes; -1 with errno set if any of them failed since the last drain. */
+int output_async_drain(void);
+
+/* Write count, peak and average number of writes in flight at submission time. */
+void output_async_stats(unsigned long long* writes, unsigned int* peak_depth, double* average_depth);
+
+void output_async_shutdown(void);
+
+#endif /* OUTPUT_H_ */
@@ -0,0 +1,259 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "sectormap.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+ * File layout: the magic, the block count as 32 bit little endian, a flags
+ * byte and three reserved bytes, followed by the states with four blocks per
+ * byte, the first block in the low bits. A sidecar with SECTOR_MAP_COMPLETE
+ * set is only the header and has every block SECTOR_GOOD.
+ */
+#define SECTOR_MAP_MAGIC "DVDBSMAP"
+#define SECTOR_MAP_HEADER 16
+#define SECTOR_MAP_FLAGS 12
+#define SECTOR_MAP_COMPLETE 0x01
+
+/* A byte of four SECTOR_GOOD blocks */
+#define SECTOR_MAP_ALL_GOOD 0x55
+
+struct sector_map_s {
+	int fd;
+	unsigned char* mapping;
+	size_t length;
+	unsigned char* states;
+	size_t blocks;
+};
+
+
+static sector_map_t* sector_map_map(int fd, size_t blocks) {
+	sector_map_t* map;
+	void* mapping;
+	size_t length = SECTOR_MAP_HEADER + (blocks + 3) / 4;
+
+	map = malloc(sizeof(*map));
+	if (map == NULL) {
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		int saved_errno = errno;
+		free(map);
+		close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	map->fd = fd;
+	map->mapping = mapping;
+	map->length = length;
+	map->states = map->mapping + SECTOR_MAP_HEADER;
+	map->blocks = blocks;
+	return map;
+}
+
+
+sector_map_t* sector_map_create(const char* path, size_t blocks) {
+	sector_map_t* map;
+	int fd;
+
+	if (blocks > UINT32_MAX) {
+		errno = EFBIG;
+		return NULL;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		return NULL;
+	}
+	/* the states read back as zero, which is SECTOR_NEVER_READ */
+	if (ftruncate(fd, (off_t)(SECTOR_MAP_HEADER + (blocks + 3) / 4)) != 0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	map = sector_map_map(fd, blocks);
+	if (map == NULL) {
+		return NULL;
+	}
+
+	memcpy(map->mapping, SECTOR_MAP_MAGIC, 8);
+	map->mapping[8] = (unsigned char)(blocks & 0xff);
+	map->mapping[9] = (unsigned char)((blocks >> 8) & 0xff);
+	map->mapping[10] = (unsigned char)((blocks >> 16) & 0xff);
+	map->mapping[11] = (unsigned char)((blocks >> 24) & 0xff);
+	return map;
+}
+
+
+sector_map_t* sector_map_open(const char* path, size_t blocks) {
+	unsigned char header[SECTOR_MAP_HEADER];
+	struct stat st;
+	size_t stored;
+	off_t length = (off_t)(SECTOR_MAP_HEADER + (blocks + 3) / 4);
+	sector_map_t* map;
+	int complete;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0 || pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	stored = (size_t)header[8] | (size_t)header[9] << 8
+		| (size_t)header[10] << 16 | (size_t)header[11] << 24;
+	complete = (header[SECTOR_MAP_FLAGS] & SECTOR_MAP_COMPLETE) != 0;
+	if (memcmp(header, SECTOR_MAP_MAGIC, 8) != 0 || stored != blocks
+			|| st.st_size != (complete ? SECTOR_MAP_HEADER : length)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* a complete sidecar gets its states back, all good */
+	if (complete && ftruncate(fd, length) != 0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	map = sector_map_map(fd, blocks);
+	if (map != NULL && complete) {
+		memset(map->states, SECTOR_MAP_ALL_GOOD, (blocks + 3) / 4);
+		map->mapping[SECTOR_MAP_FLAGS] &= (unsigned char)~SECTOR_MAP_COMPLETE;
+	}
+	return map;
+}
+
+
+void sector_map_set(sector_map_t* map, size_t start, size_t count, sector_state_t state) {
+	size_t end;
+
+	if (start >= map->blocks) {
+		return;
+	}
+	end = count > map->blocks - start ? map->blocks : start + count;
+
+	while (start < end && start % 4 != 0) {
+		unsigned int shift = (unsigned int)(start % 4) * 2;
+		map->states[start / 4] = (unsigned char)((map->states[start / 4] & ~(3u << shift)) | (unsigned int)state << shift);
+		start++;
+	}
+
+	if (end - start >= 4) {
+		memset(map->states + start / 4, (int)state * SECTOR_MAP_ALL_GOOD, (end - start) / 4);
+		start += (end - start) / 4 * 4;
+	}
+
+	while (start < end) {
+		unsigned int shift = (unsigned int)(start % 4) * 2;
+		map->states[start / 4] = (unsigned char)((map->states[start / 4] & ~(3u << shift)) | (unsigned int)state << shift);
+		start++;
+	}
+}
+
+
+sector_state_t sector_map_get(const sector_map_t* map, size_t block) {
+	return (sector_state_t)((map->states[block / 4] >> (block % 4 * 2)) & 3);
+}
+
+
+/* 1 if one of the four blocks in byte is SECTOR_GOOD */
+static int byte_has_good(unsigned char byte) {
+	unsigned int diff = byte ^ SECTOR_MAP_ALL_GOOD;
+
+	/* a good block has both bits of its pair cleared in diff */
+	return ((diff | diff >> 1) & SECTOR_MAP_ALL_GOOD) != SECTOR_MAP_ALL_GOOD;
+}
+
+
+size_t sector_map_find(const sector_map_t* map, size_t from, int good) {
+	size_t block = from;
+
+	while (block < map->blocks) {
+		/* skip whole bytes that cannot hold a match */
+		if (block % 4 == 0) {
+			unsigned char byte = map->states[block / 4];
+			if (good ? !byte_has_good(byte) : byte == SECTOR_MAP_ALL_GOOD) {
+				block += 4;
+				continue;
+			}
+		}
+
+		if ((sector_map_get(map, block) == SECTOR_GOOD) == (good != 0)) {
+			return block;
+		}
+		block++;
+	}
+
+	return map->blocks;
+}
+
+
+int sector_map_all_good(const sector_map_t* map) {
+	return sector_map_find(map, 0, 0) == map->blocks;
+}
+
+
+int sector_map_close(sector_map_t* map) {
+	unsigned char flags = SECTOR_MAP_COMPLETE;
+	int complete = sector_map_all_good(map);
+	int result = 0;
+
+	if (munmap(map->mapping, map->length) != 0) {
+		result = -1;
+	}
+	/* a file without gaps keeps just the header to say so */
+	if (complete && (ftruncate(map->fd, SECTOR_MAP_HEADER) != 0
+			|| pwrite(map->fd, &flags, 1, SECTOR_MAP_FLAGS) != 1)) {
+		result = -1;
+	}
+	if (close(map->fd) != 0) {
+		result = -1;
+	}
+	free(map);
+	return result;
+}
@@ -0,0 +1,68 @@
+#ifndef SECTORMAP_H_
+#define SECTORMAP_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+/*
+ * Sector state sidecar of an output file: a memory mapped file with two bits
+ * per DVD logical block recording whether the block was copied, padded after
+ * a read error or found to differ from the disc. A new sidecar has every block
+ * SECTOR_NEVER_READ. Once every block is SECTOR_GOOD the sidecar is closed as
+ * a header that only says so, which sector_map_open() expands again.
+ */
+typedef struct sector_map_s sector_map_t;
+
+typedef enum {
+	SECTOR_NEVER_READ = 0,
+	SECTOR_GOOD = 1,
+	SECTOR_PADDED = 2,
+	SECTOR_MISMATCHED = 3
+} sector_state_t;
+
+/* Creates or truncates the sidecar at path for a file of blocks blocks. */
+sector_map_t* sector_map_create(const char* path, size_t blocks);
+
+/**
+ * Opens the existing sidecar at path. Returns NULL with errno set to ENOENT if
+ * there is none, or to EINVAL if it is damaged or not for a file of blocks
+ * blocks.
+ */
+sector_map_t* sector_map_open(const char* path, size_t blocks);
+
+void sector_map_set(sector_map_t* map, size_t start, size_t count, sector_state_t state);
+
+sector_state_t sector_map_get(const sector_map_t* map, size_t block);
+
+/**
+ * Returns the first block at or after from that is SECTOR_GOOD if good is 1,
+ * or that is not if good is 0; the number of blocks if there is none.
+ */
+size_t sector_map_find(const sector_map_t* map, size_t from, int good);
+
+/* Whether every block is SECTOR_GOOD */
+int sector_map_all_good(const sector_map_t* map);
+
+/* Closes map, leaving only the header on disk if every block is SECTOR_GOOD. */
+int sector_map_close(sector_map_t* map);
+
+#endif /* SECTORMAP_H_ */
@@ -0,0 +1,256 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "tar.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* C POSIX library */
+#include <unistd.h>
+
+
+#define TAR_RECORD 512
+
+/* ustar stores the size in 11 octal digits */
+#define TAR_MAX_SIZE 077777777777LL
+
+typedef struct {
+	char name[13];
+	off_t size;
+} tar_file_t;
+
+struct tar_s {
+	int fd;
+	char* directory;
+	time_t mtime;
+	tar_file_t* files;
+	size_t count;
+	size_t capacity;
+	int directories_written;
+	const tar_file_t* open_file;
+};
+
+
+static int write_all(int fd, const unsigned char* data, size_t length) {
+	while (length > 0) {
+		ssize_t written = write(fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += written;
+		length -= (size_t)written;
+	}
+
+	return 0;
+}
+
+
+static void set_octal(unsigned char* p, size_t length, unsigned long long value) {
+	/* length - 1 digits and a NUL */
+	snprintf((char*)p, length, "%0*llo", (int)(length - 1), value);
+}
+
+
+/* Writes the header of a file (type '0') or directory (type '5') */
+static int tar_write_header(tar_t* tar, const char* name, char type, off_t size) {
+	unsigned char header[TAR_RECORD];
+	unsigned int checksum = 0;
+	size_t i;
+
+	if (strlen(name) >= 100) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, name, strlen(name));
+	set_octal(header + 100, 8, type == '5' ? 0755 : 0644);
+	set_octal(header + 108, 8, 0);
+	set_octal(header + 116, 8, 0);
+	set_octal(header + 124, 12, (unsigned long long)size);
+	set_octal(header + 136, 12, (unsigned long long)tar->mtime);
+	header[156] = (unsigned char)type;
+	memcpy(header + 257, "ustar", 6);
+	memcpy(header + 263, "00", 2);
+
+	/* the checksum is computed with its own field set to spaces */
+	memset(header + 148, ' ', 8);
+	for (i = 0; i < sizeof(header); i++) {
+		checksum += header[i];
+	}
+	snprintf((char*)header + 148, 7, "%06o", checksum);
+	header[154] = '\0';
+	header[155] = ' ';
+
+	return write_all(tar->fd, header, sizeof(header));
+}
+
+
+static int tar_write_directories(tar_t* tar) {
+	char name[100];
+	size_t length = strlen(tar->directory);
+	size_t i;
+
+	/* every component of the directory, so that extracting creates them */
+	for (i = 1; i <= length; i++) {
+		if (i < length && tar->directory[i] != '/') {
+			continue;
+		}
+		if (i + 1 >= sizeof(name)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memcpy(name, tar->directory, i);
+		name[i] = '/';
+		name[i + 1] = '\0';
+		if (tar_write_header(tar, name, '5', 0) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+tar_t* tar_new(int fd, const char* directory) {
+	tar_t* tar = calloc(1, sizeof(tar_t));
+
+	if (tar == NULL) {
+		return NULL;
+	}
+
+	tar->directory = strdup(directory);
+	if (tar->directory == NULL) {
+		free(tar);
+		return NULL;
+	}
+	tar->fd = fd;
+	tar->mtime = time(NULL);
+
+	return tar;
+}
+
+
+int tar_add_file(tar_t* tar, const char* name, off_t size) {
+	tar_file_t* file;
+
+	if (strlen(name) >= sizeof(file->name) || size < 0 || size > TAR_MAX_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (tar->count == tar->capacity) {
+		size_t capacity = tar->capacity == 0 ? 32 : tar->capacity * 2;
+		tar_file_t* files = realloc(tar->files, capacity * sizeof(tar_file_t));
+		if (files == NULL) {
+			return -1;
+		}
+		tar->files = files;
+		tar->capacity = capacity;
+	}
+
+	file = &tar->files[tar->count++];
+	strcpy(file->name, name);
+	file->size = size;
+
+	return 0;
+}
+
+
+int tar_file_open(tar_t* tar, const char* name) {
+	char path[100];
+	size_t i;
+
+	if (tar->open_file != NULL) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	for (i = 0; i < tar->count; i++) {
+		if (strcmp(tar->files[i].name, name) == 0) {
+			break;
+		}
+	}
+	if (i == tar->count) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (!tar->directories_written) {
+		if (tar_write_directories(tar) != 0) {
+			return -1;
+		}
+		tar->directories_written = 1;
+	}
+
+	if ((size_t)snprintf(path, sizeof(path), "%s/%s", tar->directory, name) >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (tar_write_header(tar, path, '0', tar->files[i].size) != 0) {
+		return -1;
+	}
+
+	tar->open_file = &tar->files[i];
+	return tar->fd;
+}
+
+
+int tar_file_close(tar_t* tar, int fd) {
+	static const unsigned char zeros[TAR_RECORD];
+	size_t padding;
+
+	if (tar->open_file == NULL || fd != tar->fd) {
+		errno = EBADF;
+		return -1;
+	}
+
+	padding = (size_t)((TAR_RECORD - tar->open_file->size % TAR_RECORD) % TAR_RECORD);
+	tar->open_file = NULL;
+
+	return write_all(tar->fd, zeros, padding);
+}
+
+
+int tar_finish(tar_t* tar) {
+	static const unsigned char zeros[2 * TAR_RECORD];
+
+	return write_all(tar->fd, zeros, sizeof(zeros));
+}
+
+
+void tar_free(tar_t* tar) {
+	if (tar == NULL) {
+		return;
+	}
+
+	free(tar->files);
+	free(tar->directory);
+	free(tar);
+}
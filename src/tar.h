@@ -0,0 +1,57 @@
+#ifndef TAR_H_
+#define TAR_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/types.h>
+
+/*
+ * POSIX ustar archive written sequentially to a pipe. The size of every file
+ * has to be given with tar_add_file() before it is written, since the header
+ * precedes the data and the stream cannot seek back.
+ */
+typedef struct tar_s tar_t;
+
+/**
+ * Creates an archive written to fd whose files are stored below directory
+ * (e.g. "TITLE/VIDEO_TS").
+ */
+tar_t* tar_new(int fd, const char* directory);
+
+/* Announces the file name of size bytes; it is written when opened. */
+int tar_add_file(tar_t* tar, const char* name, off_t size);
+
+/**
+ * Writes the header of name (and of its directories before the first file)
+ * and returns the descriptor its size bytes of data have to be written to.
+ * Only one file can be open at a time.
+ */
+int tar_file_open(tar_t* tar, const char* name);
+
+/* Pads the data of the open file to the end of its record. */
+int tar_file_close(tar_t* tar, int fd);
+
+/* Writes the end of archive marker; fd is left open. */
+int tar_finish(tar_t* tar);
+
+void tar_free(tar_t* tar);
+
+#endif /* TAR_H_ */
@@ -0,0 +1,333 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "trace.h"
+
+/* C standard libraries */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX library */
+#include <pthread.h>
+
+/* Sectors of a single layer DVD, for the seek time model */
+#define DISC_SECTORS 2295104.0
+/* Seconds to seek to a nearby sector, and more in proportion up to across the disc */
+#define SEEK_SHORT 0.02
+#define SEEK_FULL_STROKE 0.1
+
+typedef enum {
+	MODEL_UNKNOWN = 0, /* never asked for, assumed readable */
+	MODEL_FAILED, /* in a failed read that gave no details */
+	MODEL_BAD,
+	MODEL_GOOD
+} model_state_t;
+
+typedef struct {
+	uint32_t lba;
+	int count;
+	int returned;
+	unsigned long microseconds;
+} trace_read_t;
+
+struct read_trace_s {
+	FILE* file;
+	pthread_mutex_t lock;
+};
+
+struct disc_model_s {
+	uint32_t first;
+	size_t blocks;
+	size_t reads;
+	unsigned char* state;
+	double sector_seconds; /* per sector read */
+	double failure_seconds; /* per failed read */
+	double clock;
+	uint32_t head; /* where the last read ended */
+};
+
+
+read_trace_t* read_trace_create(const char* path) {
+	read_trace_t* trace = calloc(1, sizeof(*trace));
+
+	if (trace == NULL) {
+		return NULL;
+	}
+	trace->file = fopen(path, "w");
+	if (trace->file == NULL) {
+		free(trace);
+		return NULL;
+	}
+	pthread_mutex_init(&trace->lock, NULL);
+	fprintf(trace->file, "# dvdbackup read trace: LBA COUNT RETURNED MICROSECONDS\n");
+	return trace;
+}
+
+
+void read_trace_add(read_trace_t* trace, uint32_t lba, int count, int returned,
+		double seconds) {
+	pthread_mutex_lock(&trace->lock);
+	fprintf(trace->file, "%" PRIu32 " %d %d %lu\n", lba, count, returned,
+			(unsigned long)(seconds * 1e6 + 0.5));
+	pthread_mutex_unlock(&trace->lock);
+}
+
+
+int read_trace_close(read_trace_t* trace) {
+	int result = 0;
+
+	if (trace == NULL) {
+		return 0;
+	}
+	if (ferror(trace->file)) {
+		result = -1;
+	}
+	if (fclose(trace->file) != 0) {
+		result = -1;
+	}
+	pthread_mutex_destroy(&trace->lock);
+	free(trace);
+	return result;
+}
+
+
+static trace_read_t* trace_load(const char* path, size_t* count, int* error_line) {
+	trace_read_t* reads = NULL;
+	size_t capacity = 0;
+	char line[128];
+	FILE* file;
+	int number = 0;
+
+	*count = 0;
+	*error_line = 0;
+	file = fopen(path, "r");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		trace_read_t read;
+
+		++number;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		if (sscanf(line, "%" SCNu32 " %d %d %lu", &read.lba, &read.count, &read.returned,
+					&read.microseconds) != 4 || read.count <= 0 || read.returned > read.count
+				|| (uint64_t)read.lba + (uint64_t)read.count > UINT32_MAX) {
+			*error_line = number;
+			break;
+		}
+		if (*count == capacity) {
+			size_t new_capacity = capacity == 0 ? 1024 : capacity * 2;
+			trace_read_t* grown = realloc(reads, new_capacity * sizeof(*grown));
+
+			if (grown == NULL) {
+				break;
+			}
+			reads = grown;
+			capacity = new_capacity;
+		}
+		reads[(*count)++] = read;
+	}
+
+	if (ferror(file) || !feof(file)) {
+		fclose(file);
+		free(reads);
+		return NULL;
+	}
+	fclose(file);
+	if (*count == 0) {
+		*error_line = number > 0 ? number : 1;
+		free(reads);
+		return NULL;
+	}
+	return reads;
+}
+
+
+static void model_mark(disc_model_t* model, uint32_t lba, size_t count, model_state_t state) {
+	memset(model->state + (lba - model->first), state, count);
+}
+
+
+disc_model_t* disc_model_load(const char* path, int* error_line) {
+	disc_model_t* model;
+	trace_read_t* reads;
+	size_t count;
+	size_t i;
+	uint32_t last = 0;
+	double good_seconds = 0.0;
+	double good_sectors = 0.0;
+	double failed_seconds = 0.0;
+	size_t failures = 0;
+
+	reads = trace_load(path, &count, error_line);
+	if (reads == NULL) {
+		return NULL;
+	}
+
+	model = calloc(1, sizeof(*model));
+	if (model == NULL) {
+		free(reads);
+		return NULL;
+	}
+	model->first = reads[0].lba;
+	for (i = 0; i < count; ++i) {
+		if (reads[i].lba < model->first) {
+			model->first = reads[i].lba;
+		}
+		if (reads[i].lba + (uint32_t)reads[i].count > last) {
+			last = reads[i].lba + (uint32_t)reads[i].count;
+		}
+	}
+	model->blocks = last - model->first;
+	model->reads = count;
+	model->state = calloc(model->blocks, 1);
+	if (model->state == NULL) {
+		free(model);
+		free(reads);
+		return NULL;
+	}
+
+	/* failed reads first, so that what any read returned wins */
+	for (i = 0; i < count; ++i) {
+		const trace_read_t* read = &reads[i];
+		size_t returned = read->returned > 0 ? (size_t)read->returned : 0;
+
+		if (returned < (size_t)read->count) {
+			failed_seconds += (double)read->microseconds / 1e6;
+			failures++;
+			model_mark(model, read->lba, (size_t)read->count, MODEL_FAILED);
+		} else {
+			good_seconds += (double)read->microseconds / 1e6;
+			good_sectors += (double)read->count;
+		}
+	}
+	for (i = 0; i < count; ++i) {
+		const trace_read_t* read = &reads[i];
+		size_t returned = read->returned > 0 ? (size_t)read->returned : 0;
+
+		/* a read that stops early or of one sector tells which sector fails */
+		if (returned < (size_t)read->count && (returned > 0 || read->count == 1)) {
+			model_mark(model, read->lba + (uint32_t)returned, 1, MODEL_BAD);
+		}
+	}
+	for (i = 0; i < count; ++i) {
+		if (reads[i].returned > 0) {
+			model_mark(model, reads[i].lba, (size_t)reads[i].returned, MODEL_GOOD);
+		}
+	}
+	free(reads);
+
+	model->sector_seconds = good_sectors > 0 ? good_seconds / good_sectors : 0.0005;
+	model->failure_seconds = failures > 0 ? failed_seconds / (double)failures : 1.0;
+	disc_model_reset(model);
+	return model;
+}
+
+
+void disc_model_free(disc_model_t* model) {
+	if (model == NULL) {
+		return;
+	}
+	free(model->state);
+	free(model);
+}
+
+
+uint32_t disc_model_first(const disc_model_t* model) {
+	return model->first;
+}
+
+
+size_t disc_model_blocks(const disc_model_t* model) {
+	return model->blocks;
+}
+
+
+size_t disc_model_reads(const disc_model_t* model) {
+	return model->reads;
+}
+
+
+size_t disc_model_unreadable(const disc_model_t* model, size_t* unknown) {
+	size_t unreadable = 0;
+	size_t i;
+
+	*unknown = 0;
+	for (i = 0; i < model->blocks; ++i) {
+		if (model->state[i] == MODEL_FAILED) {
+			(*unknown)++;
+			unreadable++;
+		} else if (model->state[i] == MODEL_BAD) {
+			unreadable++;
+		}
+	}
+	return unreadable;
+}
+
+
+static int model_readable(const disc_model_t* model, uint32_t lba) {
+	if (lba < model->first || lba - model->first >= model->blocks) {
+		return 1;
+	}
+	return model->state[lba - model->first] == MODEL_UNKNOWN
+		|| model->state[lba - model->first] == MODEL_GOOD;
+}
+
+
+int disc_model_read(disc_model_t* model, uint32_t lba, int count) {
+	int readable = 0;
+
+	if (lba != model->head) {
+		double distance = lba > model->head ? lba - model->head : model->head - lba;
+
+		model->clock += SEEK_SHORT + SEEK_FULL_STROKE * distance / DISC_SECTORS;
+	}
+
+	while (readable < count && model_readable(model, lba + (uint32_t)readable)) {
+		readable++;
+	}
+	model->clock += (double)readable * model->sector_seconds;
+	if (readable == count) {
+		model->head = lba + (uint32_t)count;
+		return count;
+	}
+
+	model->clock += model->failure_seconds;
+	model->head = lba + (uint32_t)readable + 1;
+	return readable > 0 ? readable : -1;
+}
+
+
+double disc_model_seconds(const disc_model_t* model) {
+	return model->clock;
+}
+
+
+void disc_model_reset(disc_model_t* model) {
+	model->clock = 0.0;
+	model->head = model->first;
+}
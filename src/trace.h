@@ -0,0 +1,86 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Traces of the reads of a rip, one line per read request:
+ *
+ *   LBA COUNT RETURNED MICROSECONDS
+ *
+ * with the first disc sector and number of sectors asked for, what the read
+ * returned (-1 for a failure) and how long it took. A disc model built from a
+ * trace answers reads the way the disc did, with a simulated clock, so error
+ * and gap strategies can be compared without the disc.
+ */
+typedef struct read_trace_s read_trace_t;
+typedef struct disc_model_s disc_model_t;
+
+/* Returns NULL with errno set if path cannot be created */
+read_trace_t* read_trace_create(const char* path);
+
+/* Adds a read; safe to call from several threads */
+void read_trace_add(read_trace_t* trace, uint32_t lba, int count, int returned,
+		double seconds);
+
+/* Returns -1 with errno set if the trace could not be written */
+int read_trace_close(read_trace_t* trace);
+
+/**
+ * Builds the model of the disc a trace was recorded from. Sectors a read
+ * returned are readable, sectors a read failed on are not, and so are the
+ * other sectors of failed reads that no read returned; sectors the trace
+ * never asked for are assumed readable. Returns NULL with *error_line the
+ * line that could not be parsed, or 0 and errno set.
+ */
+disc_model_t* disc_model_load(const char* path, int* error_line);
+
+void disc_model_free(disc_model_t* model);
+
+/* The first sector and the number of sectors the trace covers */
+uint32_t disc_model_first(const disc_model_t* model);
+size_t disc_model_blocks(const disc_model_t* model);
+
+size_t disc_model_reads(const disc_model_t* model);
+
+/**
+ * Sectors the model cannot read; unknown are those of them only known to be
+ * somewhere in a failed read.
+ */
+size_t disc_model_unreadable(const disc_model_t* model, size_t* unknown);
+
+/**
+ * Reads like DVDReadBlocks() from sector lba and advances the simulated clock
+ * by the time the disc took per sector or per failed read, plus the time to
+ * seek there from the end of the last read.
+ */
+int disc_model_read(disc_model_t* model, uint32_t lba, int count);
+
+/* Simulated seconds since the last disc_model_reset() */
+double disc_model_seconds(const disc_model_t* model);
+
+/* Sets the clock back to 0 and the head to the first sector */
+void disc_model_reset(disc_model_t* model);
+
+#endif /* TRACE_H_ */
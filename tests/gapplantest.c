@@ -0,0 +1,158 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Copyright (C) 2002  Olaf Beck <olaf_sc@yahoo.com>
+ * Copyright (C) 2008-2013  Benjamin Drung <benjamin.drung@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * gapplantest applies random adds, subtracts and merges to a gap plan and to
+ * a bitmap of the same blocks, and after every round checks that the plan is
+ * sorted, has no empty, overlapping or touching ranges and answers every
+ * lookup the way the bitmap does. An optional argument picks another seed.
+ */
+
+#include <config.h>
+#include "gapplan.h"
+
+/* C standard libraries */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define BLOCKS 4096
+#define MAX_COUNT 64
+#define ROUNDS 500
+#define OPERATIONS 80
+
+/* the model, with room for ranges that start near the end */
+static unsigned char model[BLOCKS + MAX_COUNT];
+static uint64_t random_state;
+
+
+/* xorshift64, so that a seed fails the same way with every C library */
+static size_t random_below(size_t limit) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (size_t)(random_state % limit);
+}
+
+
+static int fail(int round, const char* what, size_t block) {
+	fprintf(stderr, "round %d: %s at block %zu\n", round, what, block);
+	return 1;
+}
+
+
+static int check(int round, const gap_plan_t* plan) {
+	size_t block, next, prev, blocks = 0;
+	size_t i;
+
+	for (i = 0; i < plan->count; ++i) {
+		const gap_range_t* range = &plan->ranges[i];
+
+		if (range->block_count == 0) {
+			return fail(round, "empty range", range->start_block);
+		}
+		if (i > 0 && plan->ranges[i - 1].start_block + plan->ranges[i - 1].block_count >= range->start_block) {
+			return fail(round, "unsorted, overlapping or touching range", range->start_block);
+		}
+	}
+
+	for (block = 0; block < sizeof(model); ++block) {
+		blocks += model[block];
+		if (gap_plan_contains(plan, block) != model[block]) {
+			return fail(round, "gap_plan_contains() differs", block);
+		}
+		for (next = block; next < sizeof(model) && model[next]; ++next) {
+		}
+		if (gap_plan_next_good(plan, block) != next) {
+			return fail(round, "gap_plan_next_good() differs", block);
+		}
+		for (prev = block; prev != (size_t)-1 && model[prev]; --prev) {
+		}
+		if (gap_plan_prev_good(plan, block) != prev) {
+			return fail(round, "gap_plan_prev_good() differs", block);
+		}
+	}
+	if (gap_plan_blocks(plan) != blocks) {
+		return fail(round, "gap_plan_blocks() differs", blocks);
+	}
+
+	return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+	int round, operation;
+
+	random_state = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+	if (random_state == 0) {
+		random_state = 1;
+	}
+
+	for (round = 0; round < ROUNDS; ++round) {
+		gap_plan_t plan = { NULL, 0, 0 };
+		int result = 0;
+
+		memset(model, 0, sizeof(model));
+
+		for (operation = 0; operation < OPERATIONS && result == 0; ++operation) {
+			gap_plan_t other = { NULL, 0, 0 };
+			size_t start = random_below(BLOCKS);
+			size_t count = random_below(MAX_COUNT);
+			int ranges;
+
+			switch (random_below(4)) {
+			case 0:
+				result = gap_plan_subtract(&plan, start, count);
+				memset(model + start, 0, count);
+				break;
+			case 1:
+				for (ranges = 1 + (int)random_below(4); ranges > 0 && result == 0; --ranges) {
+					result = gap_plan_add(&other, start, count);
+					memset(model + start, 1, count);
+					start = random_below(BLOCKS);
+					count = random_below(MAX_COUNT);
+				}
+				if (result == 0) {
+					result = gap_plan_merge(&plan, &other);
+				}
+				gap_plan_free(&other);
+				break;
+			default:
+				result = gap_plan_add(&plan, start, count);
+				memset(model + start, 1, count);
+				break;
+			}
+		}
+
+		if (result != 0) {
+			fprintf(stderr, "round %d: out of memory\n", round);
+		} else {
+			result = check(round, &plan);
+		}
+		gap_plan_free(&plan);
+		if (result != 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
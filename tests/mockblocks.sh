@@ -0,0 +1,160 @@
+#!/bin/sh
+#
+# Mirrors a small synthetic disc from bench/mkdvdvideo through
+# --block-source=mock with bad, slow and flaky sectors and checks that the
+# copy pads just the bad sectors, that --cmp finds them, and that --gaps
+# fills them in again so that the backup matches a mirror made without
+# faults, and that --cmp --crc-index and --repair treat them the same
+# way. --physical-order makes the same copy reading the disc front to back.
+# A read slower than --read-timeout is given up and padded. Once every
+# sector is good the sector states say so, and --gaps leaves the backup
+# alone even if nothing could be read, also for the chapters copied with -t.
+#
+#   DVDBACKUP   dvdbackup to test (default ../src/dvdbackup)
+#   MKDVDVIDEO  disc generator (default ../bench/mkdvdvideo)
+
+dvdbackup=${DVDBACKUP-../src/dvdbackup}
+mkdvdvideo=${MKDVDVIDEO-../bench/mkdvdvideo}
+dir=mockblocks.tmp
+log=$dir/log
+
+fail() {
+	echo "FAIL: $*" >&2
+	echo "see $log" >&2
+	exit 1
+}
+
+
+# backup NAME ARGUMENT...: mirrors the disc into $dir/NAME
+backup() {
+	name=$1
+	shift
+	echo "== $name $*" >>"$log"
+	"$dvdbackup" -M -i "$dir/disc.iso" -o "$dir" -n "$name" "$@" >>"$log" 2>&1
+}
+
+
+# chapters NAME ARGUMENT...: copies the chapters of title 1 into $dir/NAME
+chapters() {
+	name=$1
+	shift
+	echo "== $name -t 1 $*" >>"$log"
+	"$dvdbackup" -t 1 -i "$dir/disc.iso" -o "$dir" -n "$name" "$@" >>"$log" 2>&1
+}
+
+
+# complete NAME FILE: whether the sector states of FILE in NAME are only the
+# marker that every sector is good
+complete() {
+	[ -f "$dir/$1/.sectors/$2" ] && [ "$(wc -c < "$dir/$1/.sectors/$2")" -eq 16 ]
+}
+
+
+# blocks FILE FIRST COUNT: copies COUNT blocks of FILE from block FIRST to stdout
+blocks() {
+	dd if="$1" bs=2048 skip="$2" count="$3" 2>/dev/null
+}
+
+
+rm -rf "$dir" && mkdir "$dir" || exit 99
+: > "$log"
+
+"$mkdvdvideo" -i "$dir/disc.iso" -S 12M -n 2 -c 4 -m 256k > "$dir/files" || fail "cannot write the disc"
+vts1=$(awk '$1 == "VTS_01_1.VOB" { print $2 }' "$dir/files")
+vts2=$(awk '$1 == "VTS_02_1.VOB" { print $2 }' "$dir/files")
+[ -n "$vts1" ] && [ -n "$vts2" ] || fail "no title VOBs on the disc"
+
+# blocks 100 to 163 of VTS_01_1.VOB cannot be read, the start of
+# VTS_02_1.VOB only sometimes
+cat > "$dir/faults" <<EOF
+bad $((vts1 + 100))-$((vts1 + 163))
+slow $((vts1 + 300))-$((vts1 + 310)) 1
+flaky $vts2-$((vts2 + 50)) 50
+EOF
+grep '^slow' "$dir/faults" > "$dir/slow"
+grep -v '^flaky' "$dir/faults" > "$dir/bad"
+echo "bad 0-$((12 * 512))" > "$dir/unreadable"
+# reading two sectors takes 6 seconds
+echo "slow $((vts1 + 600))-$((vts1 + 601)) 3000" > "$dir/stall"
+
+backup REF || fail "mirror without faults exited with $?"
+
+# copy: -r i bisects the failed reads down to the bad sectors
+backup T --block-source=mock:"$dir/faults" -r i || fail "mirror with faults exited with $?"
+ref=$dir/REF/VIDEO_TS
+out=$dir/T/VIDEO_TS
+[ -n "$(blocks "$out/VTS_01_1.VOB" 100 64 | tr -d '\000')" ] && fail "bad sectors of VTS_01_1.VOB are not zero"
+blocks "$out/VTS_01_1.VOB" 0 100 | cmp -s - "$ref/VTS_01_1.VOB" -n $((100 * 2048)) \
+	|| fail "VTS_01_1.VOB differs before the bad sectors"
+cmp -s -i $((164 * 2048)) "$out/VTS_01_1.VOB" "$ref/VTS_01_1.VOB" \
+	|| fail "VTS_01_1.VOB differs after the bad sectors"
+for file in VIDEO_TS.IFO VIDEO_TS.VOB VTS_01_0.IFO VTS_01_0.VOB VTS_02_0.BUP; do
+	cmp -s "$out/$file" "$ref/$file" || fail "$file differs"
+done
+[ -f "$dir/T/.sectors/VTS_01_1.VOB" ] || fail "no sector states for the padded VTS_01_1.VOB"
+complete T VTS_01_1.VOB && fail "the padded VTS_01_1.VOB is marked complete"
+complete T VTS_01_0.VOB || fail "the complete VTS_01_0.VOB is not marked complete"
+
+# the same copy in one sweep in disc order reads the disc front to back
+backup P --physical-order --block-source=mock:"$dir/bad" -r i --record-trace="$dir/trace" \
+	|| fail "mirror with --physical-order exited with $?"
+cmp -s "$out/VTS_01_1.VOB" "$dir/P/VIDEO_TS/VTS_01_1.VOB" || fail "VTS_01_1.VOB differs with --physical-order"
+for file in "$ref"/*; do
+	[ "${file##*/}" = VTS_01_1.VOB ] || cmp -s "$file" "$dir/P/VIDEO_TS/${file##*/}" \
+		|| fail "${file##*/} differs with --physical-order"
+done
+complete P VTS_01_1.VOB && fail "the padded VTS_01_1.VOB is marked complete with --physical-order"
+awk '/^#/ { next } $1 < last { exit 1 } { last = $1 }' "$dir/trace" \
+	|| fail "--physical-order went back on the disc"
+
+# compare: the padded sectors differ from the disc
+backup T --cmp && fail "--cmp did not find the padded sectors"
+
+# gap fill, through the mock source with only the slow sectors left
+backup T --gaps --block-source=mock:"$dir/slow" || fail "--gaps exited with $?"
+for file in "$ref"/*; do
+	cmp -s "$file" "$out/${file##*/}" || fail "${file##*/} differs after --gaps"
+done
+complete T VTS_01_1.VOB || fail "VTS_01_1.VOB is not marked complete after --gaps"
+backup T --cmp || fail "--cmp after --gaps exited with $?"
+
+# a complete backup needs no reads, not even of its zero sectors
+backup T --gaps --block-source=mock:"$dir/unreadable" || fail "--gaps of a complete backup read the disc"
+for file in "$ref"/*; do
+	cmp -s "$file" "$out/${file##*/}" || fail "${file##*/} differs after --gaps of a complete backup"
+done
+
+# the checksum index cannot vouch for padded sectors, so --cmp --crc-index
+# fails on them and --repair fetches them again
+backup X --block-source=mock:"$dir/faults" -r i --crc-index || fail "mirror with --crc-index exited with $?"
+backup X --cmp --crc-index && fail "--cmp --crc-index did not find the padded sectors"
+backup X --repair --crc-index --block-source=mock:"$dir/slow" || fail "--repair --crc-index exited with $?"
+for file in "$ref"/*; do
+	cmp -s "$file" "$dir/X/VIDEO_TS/${file##*/}" || fail "${file##*/} differs after --repair --crc-index"
+done
+backup X --cmp --crc-index || fail "--cmp --crc-index after --repair exited with $?"
+
+# a read that takes longer than --read-timeout is given up and padded, and
+# the rest of the disc is read on a new reader
+started=$(date +%s)
+backup S --block-source=mock:"$dir/stall" --read-timeout=1 || fail "mirror with a stalled read exited with $?"
+[ $(($(date +%s) - started)) -lt 6 ] || fail "the stalled read was waited for"
+grep -q "^1 reads stalled for more than 1 seconds" "$log" || fail "no summary of the stalled read"
+[ -n "$(blocks "$dir/S/VIDEO_TS/VTS_01_1.VOB" 600 2 | tr -d '\000')" ] && fail "the stalled sectors are not zero"
+for file in VIDEO_TS.IFO VTS_01_0.IFO VTS_01_0.BUP VTS_02_1.VOB VTS_02_0.BUP; do
+	cmp -s "$ref/$file" "$dir/S/VIDEO_TS/$file" || fail "$file differs after the stalled read"
+done
+backup S --gaps || fail "--gaps after the stalled read exited with $?"
+for file in "$ref"/*; do
+	cmp -s "$file" "$dir/S/VIDEO_TS/${file##*/}" || fail "${file##*/} differs after --gaps of the stalled read"
+done
+
+# the same for the chapters of a title
+chapters C || fail "-t 1 exited with $?"
+cp "$dir/C/VIDEO_TS/VTS_01_1.VOB" "$dir/chapters"
+complete C VTS_01_1.VOB || fail "the chapters of -t 1 are not marked complete"
+chapters C --gaps --block-source=mock:"$dir/unreadable" || fail "--gaps of complete chapters read the disc"
+cmp -s "$dir/chapters" "$dir/C/VIDEO_TS/VTS_01_1.VOB" || fail "the chapters differ after --gaps"
+
+rm -rf "$dir"
+exit 0